@@ -0,0 +1,264 @@
+#include "bench.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Number of measurements of every benchmark, of which the median is reported.
+#define BENCH_REPEATS 5
+// Minimum duration of a measurement in seconds.
+#define BENCH_MIN_TIME 0.2
+// Maximum number of iterations of a measurement.
+#define BENCH_MAX_ITERATIONS 1000000000ULL
+
+/**
+ * The result of a benchmark.
+ *
+ * @param iterations Number of iterations of every measurement.
+ * @param ns_per_op The median duration of an operation in nanoseconds.
+ * @param ns_per_op_min The shortest duration of an operation in nanoseconds.
+ * @param bytes_per_op Number of bytes processed by an operation, or 0 if the
+ * benchmark doesn't process bytes.
+ * @param bytes_per_second The throughput at the median duration, or 0 if the
+ * benchmark doesn't process bytes.
+ * @param heap_peak_bytes The peak heap usage of the measurements above the
+ * usage after the setup, or 0 if it isn't tracked.
+ * @param allocs_per_op Number of allocations of an operation, or 0 if they
+ * aren't counted.
+ */
+typedef struct bench_result {
+  uint64_t iterations;
+  double ns_per_op;
+  double ns_per_op_min;
+  double bytes_per_op;
+  double bytes_per_second;
+  size_t heap_peak_bytes;
+  double allocs_per_op;
+} bench_result_t;
+
+// All suites of benchmarks.
+static const bench_case_t* const suites[] = {
+    bench_core_cases,
+    bench_meter_cases,
+    bench_prom_cases,
+    bench_push_cases,
+    bench_trace_cases,
+    bench_update_cases,
+};
+
+/**
+ * Get a monotonic time.
+ *
+ * @return The time in nanoseconds.
+ */
+static uint64_t bench_now_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+/**
+ * Measure the duration of running an operation a number of times.
+ *
+ * @param[in] bench The benchmark.
+ * @param[in] ctx The context of the benchmark.
+ * @param[in] iterations Number of times the operation is run.
+ * @param[out] bytes Receives the number of bytes processed.
+ *
+ * @return The duration in nanoseconds.
+ */
+static uint64_t bench_time(const bench_case_t* bench, void* ctx,
+                           uint64_t iterations, uint64_t* bytes) {
+  uint64_t start = bench_now_ns();
+  *bytes = bench->run(ctx, iterations);
+  return bench_now_ns() - start;
+}
+
+/**
+ * Compare two durations for sorting.
+ *
+ * @param[in] a A pointer to the first duration.
+ * @param[in] b A pointer to the second duration.
+ *
+ * @return A negative number, zero or a positive number if the first duration
+ * is shorter, equal or longer.
+ */
+static int bench_compare(const void* a, const void* b) {
+  double x = *(const double*)a;
+  double y = *(const double*)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * Run a benchmark. The number of iterations grows until a measurement takes
+ * the minimum time, which keeps the overhead of the clock negligible.
+ *
+ * @param[in] bench The benchmark.
+ * @param[in] min_time Minimum duration of a measurement in seconds.
+ * @param[out] result Receives the result.
+ *
+ * @return true if the benchmark was run.
+ */
+static bool bench_run(const bench_case_t* bench, double min_time,
+                      bench_result_t* result) {
+  void* ctx = bench->setup != NULL ? bench->setup() : NULL;
+  if (bench->setup != NULL && ctx == NULL) {
+    return false;
+  }
+
+  // Only the memory used by the operations counts, not the one of the setup.
+  bench_heap_reset();
+  uint64_t min_ns = (uint64_t)(min_time * 1e9);
+  uint64_t iterations = 1;
+  uint64_t bytes;
+  uint64_t elapsed = bench_time(bench, ctx, iterations, &bytes);
+  while (elapsed < min_ns && iterations < BENCH_MAX_ITERATIONS) {
+    // Aim slightly above the minimum, but grow at most tenfold at a time, as
+    // the first iterations are often slower.
+    double scale = elapsed > 0 ? 1.2 * min_ns / elapsed : 10;
+    uint64_t next = (uint64_t)(iterations * (scale < 10 ? scale : 10));
+    iterations = next > iterations ? next : iterations + 1;
+    elapsed = bench_time(bench, ctx, iterations, &bytes);
+  }
+
+  // The operations are deterministic, so every measurement processes the
+  // same number of bytes.
+  double ns_per_op[BENCH_REPEATS];
+  ns_per_op[0] = (double)elapsed / iterations;
+  size_t allocations = bench_heap_allocations();
+  for (size_t i = 1; i < BENCH_REPEATS; ++i) {
+    ns_per_op[i] =
+        (double)bench_time(bench, ctx, iterations, &bytes) / iterations;
+  }
+  allocations = bench_heap_allocations() - allocations;
+  qsort(ns_per_op, BENCH_REPEATS, sizeof(ns_per_op[0]), bench_compare);
+  result->heap_peak_bytes = bench_heap_peak();
+
+  if (bench->teardown != NULL) {
+    bench->teardown(ctx);
+  }
+
+  result->iterations = iterations;
+  result->ns_per_op = ns_per_op[BENCH_REPEATS / 2];
+  result->ns_per_op_min = ns_per_op[0];
+  result->bytes_per_op = (double)bytes / iterations;
+  result->bytes_per_second = result->bytes_per_op * 1e9 / result->ns_per_op;
+  result->allocs_per_op =
+      (double)allocations / ((BENCH_REPEATS - 1) * iterations);
+  return true;
+}
+
+/**
+ * Print the usage of the program.
+ *
+ * @param[in] program The name of the program.
+ */
+static void bench_usage(const char* program) {
+  fprintf(stderr,
+          "Usage: %s [--filter TEXT] [--min-time SECONDS] [--json] [--list]\n"
+          "\n"
+          "Run the benchmarks of the firmware modules whose name contains the\n"
+          "filter. Every benchmark is measured %d times and the median is\n"
+          "reported, either as a table or as JSON for tracking regressions.\n",
+          program, BENCH_REPEATS);
+}
+
+int main(int argc, char* argv[]) {
+  const char* filter = "";
+  double min_time = BENCH_MIN_TIME;
+  bool json = false;
+  bool list = false;
+
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+      filter = argv[++i];
+    } else if (strcmp(argv[i], "--min-time") == 0 && i + 1 < argc) {
+      min_time = atof(argv[++i]);
+    } else if (strcmp(argv[i], "--json") == 0) {
+      json = true;
+    } else if (strcmp(argv[i], "--list") == 0) {
+      list = true;
+    } else {
+      bench_usage(argv[0]);
+      return 2;
+    }
+  }
+  if (min_time <= 0) {
+    bench_usage(argv[0]);
+    return 2;
+  }
+
+  if (json) {
+    printf("{\n  \"compiler\": \"%s\",\n  \"benchmarks\": [", __VERSION__);
+  } else if (!list) {
+    printf("%-32s %12s %12s %12s %12s %12s %12s %12s\n", "benchmark",
+           "iterations", "ns/op", "min ns/op", "B/op", "MB/s", "peak KiB",
+           "allocs/op");
+  }
+
+  int status = 0;
+  bool first = true;
+  for (size_t s = 0; s < sizeof(suites) / sizeof(suites[0]); ++s) {
+    for (const bench_case_t* bench = suites[s]; bench->name != NULL; ++bench) {
+      if (strstr(bench->name, filter) == NULL) {
+        continue;
+      }
+      if (list) {
+        printf("%s\n", bench->name);
+        continue;
+      }
+
+      bench_result_t result;
+      if (!bench_run(bench, min_time, &result)) {
+        fprintf(stderr, "Failed to set up %s\n", bench->name);
+        status = 1;
+        continue;
+      }
+
+      if (json) {
+        printf("%s\n    {\"name\": \"%s\", \"iterations\": %llu, "
+               "\"ns_per_op\": %.3f, \"ns_per_op_min\": %.3f, "
+               "\"bytes_per_op\": %.0f, \"bytes_per_second\": %.0f, "
+               "\"heap_peak_bytes\": %zu, \"allocs_per_op\": %.3f}",
+               first ? "" : ",", bench->name,
+               (unsigned long long)result.iterations, result.ns_per_op,
+               result.ns_per_op_min, result.bytes_per_op,
+               result.bytes_per_second, result.heap_peak_bytes,
+               result.allocs_per_op);
+      } else {
+        char size[16] = "-";
+        char throughput[16] = "-";
+        if (result.bytes_per_second > 0) {
+          snprintf(size, sizeof(size), "%.0f", result.bytes_per_op);
+          snprintf(throughput, sizeof(throughput), "%.1f",
+                   result.bytes_per_second / 1e6);
+        }
+        char heap[16] = "-";
+        if (result.heap_peak_bytes > 0) {
+          snprintf(heap, sizeof(heap), "%.1f",
+                   result.heap_peak_bytes / 1024.0);
+        }
+        // Unlike the peak, no allocations is a result worth showing.
+        char allocs[16] = "-";
+#ifdef BENCH_HEAP
+        snprintf(allocs, sizeof(allocs), "%.1f", result.allocs_per_op);
+#endif
+        printf("%-32s %12llu %12.1f %12.1f %12s %12s %12s %12s\n",
+               bench->name, (unsigned long long)result.iterations,
+               result.ns_per_op, result.ns_per_op_min, size, throughput, heap,
+               allocs);
+      }
+      fflush(stdout);
+      first = false;
+    }
+  }
+
+  if (json) {
+    printf("\n  ]\n}\n");
+  }
+  return status;
+}
@@ -0,0 +1,77 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Run the measured operation of a benchmark a number of times.
+ *
+ * @param[in] ctx The context returned by the setup.
+ * @param[in] iterations Number of times the operation is run.
+ *
+ * @return Number of bytes processed, which is used to calculate the
+ * throughput, or 0 if it doesn't apply.
+ */
+typedef uint64_t (*bench_run_t)(void* ctx, uint64_t iterations);
+
+/**
+ * Describes a benchmark. The setup and teardown are not measured.
+ *
+ * @param name The name of the benchmark, such as "semver/compare".
+ * @param setup Prepares the benchmark and returns its context, or NULL to use
+ * no context.
+ * @param run Runs the measured operation.
+ * @param teardown Releases the context, or NULL if there's nothing to release.
+ */
+typedef struct bench_case {
+  const char* name;
+  void* (*setup)(void);
+  bench_run_t run;
+  void (*teardown)(void* ctx);
+} bench_case_t;
+
+/**
+ * Keep the compiler from optimizing away a computation whose result is
+ * otherwise unused.
+ *
+ * @param[in] value A pointer to the result.
+ */
+static inline void bench_use(const void* value) {
+  __asm__ volatile("" : : "r"(value) : "memory");
+}
+
+/**
+ * Start measuring the peak heap usage from the current usage.
+ */
+void bench_heap_reset(void);
+
+/**
+ * Get the peak heap usage since `bench_heap_reset()`, counting the memory
+ * allocated through malloc() by all threads, including the overhead of the
+ * allocator. Allocations are only tracked on Linux, where the allocator is
+ * wrapped by the linker.
+ *
+ * @return The peak above the usage at the reset in bytes, or 0 if allocations
+ * are not tracked.
+ */
+size_t bench_heap_peak(void);
+
+/**
+ * Get the number of allocations through malloc(), calloc() and realloc() by
+ * all threads so far. Allocations are only counted on Linux, where the
+ * allocator is wrapped by the linker.
+ *
+ * @return The number of allocations, or 0 if they are not counted.
+ */
+size_t bench_heap_allocations(void);
+
+// The benchmarks of the portable modules, each terminated by an empty case.
+extern const bench_case_t bench_core_cases[];
+extern const bench_case_t bench_meter_cases[];
+extern const bench_case_t bench_prom_cases[];
+extern const bench_case_t bench_push_cases[];
+extern const bench_case_t bench_trace_cases[];
+extern const bench_case_t bench_update_cases[];
+
+#endif
@@ -0,0 +1,365 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "esp_app_desc.h"
+#include "esp_err.h"
+#include "health.h"
+#include "json.h"
+#include "meter.h"
+#include "metrics.h"
+#include "outbuf.h"
+#include "prom.h"
+#include "ring.h"
+#include "semver.h"
+
+#ifdef BENCH_CJSON
+#include "cJSON.h"
+#endif
+
+// Number of outlets in the JSON document.
+#define BENCH_OUTLETS 8
+// Capacity of the ring, which matches the ring of an outlet.
+#define BENCH_RING_SIZE 1024
+// Number of samples pushed and popped at once, like a block of the meter.
+#define BENCH_RING_BLOCK 64
+
+// Pairs of versions compared by the update check.
+static const char* const versions[][2] = {
+    {"v1.2.3", "v1.2.3"},
+    {"v1.10.0", "v1.9.12"},
+    {"v2.0.0-rc.1", "v2.0.0"},
+    {"v2.0.0-alpha.10", "v2.0.0-alpha.9"},
+    {"v0.9.1+build.5", "v0.9.1"},
+    {"v12.4.0-beta.2+sha.5114f85", "v12.4.0-beta.11"},
+};
+// Upper bounds of the histogram in microseconds.
+static const uint32_t latency_bounds[] = {
+    100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000,
+};
+// A representative set of metrics, like the device exports.
+static metrics_metric_t metrics[] = {
+    METRICS_COUNTER_INIT("zeus_bench_requests_total", "Number of requests."),
+    METRICS_COUNTER_INIT("zeus_bench_errors_total", "Number of errors."),
+    METRICS_COUNTER_INIT("zeus_bench_bytes_total", "Number of bytes sent."),
+    METRICS_COUNTER_INIT("zeus_bench_frames_total", "Number of frames."),
+    METRICS_GAUGE_INIT("zeus_bench_clients", "Number of clients."),
+    METRICS_GAUGE_INIT("zeus_bench_heap_bytes", "Free heap in bytes."),
+    METRICS_HISTOGRAM_INIT("zeus_bench_latency_seconds", "Request latency.",
+                           latency_bounds, 1e-6),
+    METRICS_HISTOGRAM_INIT("zeus_bench_write_seconds", "Write duration.",
+                           latency_bounds, 1e-6),
+};
+
+/**
+ * Discard the output. This is an `outbuf_sink_t`.
+ *
+ * @param[in] ctx Unused.
+ * @param[in] data The data.
+ * @param[in] length Number of bytes.
+ *
+ * @return ESP_OK.
+ */
+static esp_err_t bench_discard(void* ctx, const char* data, size_t length) {
+  bench_use(data);
+  return ESP_OK;
+}
+
+/**
+ * Compare the versions checked by the update module.
+ *
+ * @param[in] ctx Unused.
+ * @param[in] iterations Number of comparisons of all pairs.
+ *
+ * @return 0.
+ */
+static uint64_t bench_semver_compare(void* ctx, uint64_t iterations) {
+  int sum = 0;
+  for (uint64_t i = 0; i < iterations; ++i) {
+    for (size_t j = 0; j < sizeof(versions) / sizeof(versions[0]); ++j) {
+      sum += semver_compare(versions[j][0], versions[j][1]);
+    }
+  }
+  bench_use(&sum);
+  return 0;
+}
+
+/**
+ * Write a document like the readings of all outlets.
+ *
+ * @param[in] ctx Unused.
+ * @param[in] iterations Number of documents.
+ *
+ * @return Number of bytes written.
+ */
+static uint64_t bench_json_document(void* ctx, uint64_t iterations) {
+  outbuf_t out;
+  outbuf_init(&out, bench_discard, NULL);
+  json_t json;
+
+  for (uint64_t i = 0; i < iterations; ++i) {
+    json_init(&json, &out);
+    json_object_begin(&json);
+    json_key(&json, "data");
+    json_array_begin(&json);
+    for (size_t outlet = 0; outlet < BENCH_OUTLETS; ++outlet) {
+      json_object_begin(&json);
+      json_key(&json, "id");
+      json_int(&json, (int64_t)outlet);
+      json_key(&json, "on");
+      json_bool(&json, outlet % 2 == 0);
+      json_key(&json, "voltage");
+      json_double(&json, 229.87 + outlet);
+      json_key(&json, "current");
+      json_double(&json, 0.125 * outlet);
+      json_key(&json, "power");
+      json_double(&json, 28.73 * outlet);
+      json_key(&json, "energy");
+      json_int(&json, 123456789 + (int64_t)outlet);
+      json_key(&json, "name");
+      json_string(&json, "Outlet \"A\"");
+      json_object_end(&json);
+    }
+    json_array_end(&json);
+    json_object_end(&json);
+  }
+  outbuf_flush(&out);
+  return out.bytes_sent;
+}
+
+/**
+ * Describe a running firmware, like the health document does.
+ *
+ * @return The description or NULL if it can't be allocated.
+ */
+static void* bench_health_setup(void) {
+  esp_app_desc_t* app = calloc(1, sizeof(*app));
+  if (app == NULL) {
+    return NULL;
+  }
+  strcpy(app->version, "v2.3.1");
+  strcpy(app->project_name, "zeus");
+  strcpy(app->time, "03:05:41");
+  strcpy(app->date, "Oct 18 2026");
+  strcpy(app->idf_ver, "v5.1.2");
+  for (size_t i = 0; i < sizeof(app->app_elf_sha256); ++i) {
+    app->app_elf_sha256[i] = (uint8_t)(i * 37);
+  }
+  return app;
+}
+
+/**
+ * Build the health document with the streaming JSON writer.
+ *
+ * @param[in] ctx The description of the running firmware.
+ * @param[in] iterations Number of documents.
+ *
+ * @return Number of bytes written.
+ */
+static uint64_t bench_json_health(void* ctx, uint64_t iterations) {
+  const esp_app_desc_t* app = ctx;
+  health_t health;
+  uint64_t bytes = 0;
+  for (uint64_t i = 0; i < iterations; ++i) {
+    health_init(&health, app);
+    bytes += health.length;
+  }
+  bench_use(&health);
+  return bytes;
+}
+
+#ifdef BENCH_CJSON
+/**
+ * Describe a running firmware and route the allocations of cJSON through the
+ * wrapped allocator, which the linker doesn't redirect within the shared
+ * library. cJSON then resizes the printed document without realloc().
+ *
+ * @return The description or NULL if it can't be allocated.
+ */
+static void* bench_cjson_setup(void) {
+  cJSON_Hooks hooks = {
+      .malloc_fn = malloc,
+      .free_fn = free,
+  };
+  cJSON_InitHooks(&hooks);
+  return bench_health_setup();
+}
+
+/**
+ * Build the health document like the /health endpoint did with cJSON before
+ * the streaming JSON writer, but release the tree and the printed document,
+ * which the endpoint leaked.
+ *
+ * @param[in] ctx The description of the running firmware.
+ * @param[in] iterations Number of documents.
+ *
+ * @return Number of bytes printed.
+ */
+static uint64_t bench_json_health_cjson(void* ctx, uint64_t iterations) {
+  const esp_app_desc_t* app = ctx;
+  uint64_t bytes = 0;
+  for (uint64_t i = 0; i < iterations; ++i) {
+    cJSON* firmware = cJSON_CreateObject();
+    cJSON_AddStringToObject(firmware, "version", app->version);
+    cJSON_AddStringToObject(firmware, "sdk", app->idf_ver);
+
+    char timestamp[sizeof(app->date) + sizeof(app->time) + 2];
+    snprintf(timestamp, sizeof(timestamp), "%s %s", app->date, app->time);
+    cJSON_AddStringToObject(firmware, "timestamp", timestamp);
+
+    char sha256[sizeof(app->app_elf_sha256) * 2 + 1];
+    for (size_t j = 0; j < sizeof(app->app_elf_sha256); ++j) {
+      sprintf(&sha256[j * 2], "%02x", app->app_elf_sha256[j]);
+    }
+    cJSON_AddStringToObject(firmware, "sha256", sha256);
+
+    cJSON* data = cJSON_CreateObject();
+    cJSON_AddItemReferenceToObject(data, "firmware", firmware);
+    cJSON* response = cJSON_CreateObject();
+    cJSON_AddItemReferenceToObject(response, "data", data);
+
+    char* text = cJSON_Print(response);
+    if (text != NULL) {
+      bytes += strlen(text);
+    }
+    bench_use(text);
+    cJSON_free(text);
+    // References are released without the items they refer to.
+    cJSON_Delete(response);
+    cJSON_Delete(data);
+    cJSON_Delete(firmware);
+  }
+  return bytes;
+}
+#endif
+
+/**
+ * Register the metrics and give them values.
+ *
+ * @return A non-NULL pointer or NULL if the metrics can't be registered.
+ */
+static void* bench_metrics_setup(void) {
+  for (size_t i = 0; i < sizeof(metrics) / sizeof(metrics[0]); ++i) {
+    if (metrics_register(&metrics[i]) != ESP_OK) {
+      return NULL;
+    }
+    if (metrics[i].type == METRICS_HISTOGRAM) {
+      for (uint32_t value = 50; value < 200000; value = value * 3 / 2) {
+        metrics_observe(&metrics[i], value);
+      }
+    } else if (metrics[i].type == METRICS_GAUGE) {
+      metrics_set(&metrics[i], 123456);
+    } else {
+      metrics_add(&metrics[i], 987654321);
+    }
+  }
+  return metrics;
+}
+
+/**
+ * Export all registered metrics in the Prometheus text format.
+ *
+ * @param[in] ctx Unused.
+ * @param[in] iterations Number of exports.
+ *
+ * @return Number of bytes written.
+ */
+static uint64_t bench_metrics_export(void* ctx, uint64_t iterations) {
+  outbuf_t out;
+  outbuf_init(&out, bench_discard, NULL);
+  prom_t prom;
+  prom_init(&prom, &out, PROM_TEXT);
+  for (uint64_t i = 0; i < iterations; ++i) {
+    metrics_export(&prom);
+  }
+  outbuf_flush(&out);
+  return out.bytes_sent;
+}
+
+/**
+ * Allocate a ring like the ring of an outlet.
+ *
+ * @return The ring or NULL if it can't be allocated.
+ */
+static void* bench_ring_setup(void) {
+  ring_t* ring = malloc(sizeof(*ring));
+  if (ring == NULL) {
+    return NULL;
+  }
+  if (ring_init(ring, BENCH_RING_SIZE, sizeof(meter_sample_t)) != ESP_OK) {
+    free(ring);
+    return NULL;
+  }
+  return ring;
+}
+
+/**
+ * Release the ring.
+ *
+ * @param[in] ctx The ring.
+ */
+static void bench_ring_teardown(void* ctx) {
+  ring_deinit(ctx);
+  free(ctx);
+}
+
+/**
+ * Push blocks of samples into the ring and pop them again.
+ *
+ * @param[in] ctx The ring.
+ * @param[in] iterations Number of blocks.
+ *
+ * @return Number of bytes passed through the ring.
+ */
+static uint64_t bench_ring_push_pop(void* ctx, uint64_t iterations) {
+  ring_t* ring = ctx;
+  meter_sample_t block[BENCH_RING_BLOCK] = {{0}};
+  uint64_t moved = 0;
+  for (uint64_t i = 0; i < iterations; ++i) {
+    block[0].voltage = (int16_t)i;
+    ring_push(ring, block, BENCH_RING_BLOCK);
+    moved += ring_pop(ring, block, BENCH_RING_BLOCK);
+  }
+  bench_use(block);
+  return moved * sizeof(meter_sample_t);
+}
+
+const bench_case_t bench_core_cases[] = {
+    {
+        .name = "semver/compare",
+        .run = bench_semver_compare,
+    },
+    {
+        .name = "json/document",
+        .run = bench_json_document,
+    },
+    {
+        .name = "json/health",
+        .setup = bench_health_setup,
+        .run = bench_json_health,
+        .teardown = free,
+    },
+#ifdef BENCH_CJSON
+    {
+        .name = "json/health_cjson",
+        .setup = bench_cjson_setup,
+        .run = bench_json_health_cjson,
+        .teardown = free,
+    },
+#endif
+    {
+        .name = "metrics/export",
+        .setup = bench_metrics_setup,
+        .run = bench_metrics_export,
+    },
+    {
+        .name = "ring/push_pop",
+        .setup = bench_ring_setup,
+        .run = bench_ring_push_pop,
+        .teardown = bench_ring_teardown,
+    },
+    {0},
+};
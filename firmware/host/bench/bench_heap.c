@@ -0,0 +1,107 @@
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bench.h"
+
+#ifdef BENCH_HEAP
+
+#include <malloc.h>
+
+// Number of allocations through the wrapped allocator.
+static atomic_size_t heap_allocations = 0;
+// Number of bytes allocated through the wrapped allocator.
+static atomic_size_t heap_used = 0;
+// The highest number of bytes allocated since the last reset.
+static atomic_size_t heap_peak = 0;
+// The number of bytes allocated at the last reset.
+static atomic_size_t heap_base = 0;
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+void __real_free(void* ptr);
+
+/**
+ * Account for an allocation and raise the peak if needed.
+ *
+ * @param[in] ptr The allocated memory or NULL.
+ */
+static void bench_heap_alloc(void* ptr) {
+  if (ptr == NULL) {
+    return;
+  }
+  atomic_fetch_add(&heap_allocations, 1);
+  size_t used = atomic_fetch_add(&heap_used, malloc_usable_size(ptr)) +
+                malloc_usable_size(ptr);
+  size_t peak = atomic_load(&heap_peak);
+  while (used > peak &&
+         !atomic_compare_exchange_weak(&heap_peak, &peak, used)) {
+  }
+}
+
+/**
+ * Account for memory that is about to be released.
+ *
+ * @param[in] ptr The allocated memory or NULL.
+ */
+static void bench_heap_release(void* ptr) {
+  if (ptr != NULL) {
+    atomic_fetch_sub(&heap_used, malloc_usable_size(ptr));
+  }
+}
+
+// The allocator is wrapped by the linker, which redirects the calls of the
+// benchmarks and the modules, but not those within the C library.
+void* __wrap_malloc(size_t size) {
+  void* ptr = __real_malloc(size);
+  bench_heap_alloc(ptr);
+  return ptr;
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+  void* ptr = __real_calloc(count, size);
+  bench_heap_alloc(ptr);
+  return ptr;
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+  bench_heap_release(ptr);
+  void* result = __real_realloc(ptr, size);
+  // The original memory is kept if it can't be resized.
+  bench_heap_alloc(result != NULL || size == 0 ? result : ptr);
+  return result;
+}
+
+void __wrap_free(void* ptr) {
+  bench_heap_release(ptr);
+  __real_free(ptr);
+}
+
+void bench_heap_reset(void) {
+  size_t used = atomic_load(&heap_used);
+  atomic_store(&heap_base, used);
+  atomic_store(&heap_peak, used);
+}
+
+size_t bench_heap_peak(void) {
+  return atomic_load(&heap_peak) - atomic_load(&heap_base);
+}
+
+size_t bench_heap_allocations(void) {
+  return atomic_load(&heap_allocations);
+}
+
+#else
+
+void bench_heap_reset(void) {}
+
+size_t bench_heap_peak(void) {
+  return 0;
+}
+
+size_t bench_heap_allocations(void) {
+  return 0;
+}
+
+#endif
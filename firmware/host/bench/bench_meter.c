@@ -0,0 +1,272 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "dsp.h"
+#include "esp_err.h"
+#include "history.h"
+#include "json.h"
+#include "meter.h"
+#include "outbuf.h"
+#include "sdkconfig.h"
+#include "synth.h"
+
+// Number of outlets that are sampled.
+#define BENCH_OUTLETS 8
+// Number of frames read at once, like the meter does.
+#define BENCH_BLOCK_FRAMES 32
+// Number of samples summed at once, which is about one cycle.
+#define BENCH_DSP_SAMPLES 80
+// Interval between the cycles recorded in the history in milliseconds.
+#define BENCH_CYCLE_MS 20
+
+/**
+ * The state of the sampling pipeline of all outlets.
+ *
+ * @param synth The generator standing in for the analog front end.
+ * @param source The description of the generator.
+ * @param channels The cycle detection of every outlet.
+ * @param frames The frames of the current block.
+ * @param column The samples of an outlet in the current block.
+ */
+typedef struct bench_meter {
+  synth_t synth;
+  meter_source_t source;
+  meter_channel_t channels[BENCH_OUTLETS];
+  meter_sample_t frames[BENCH_BLOCK_FRAMES * BENCH_OUTLETS];
+  meter_sample_t column[BENCH_BLOCK_FRAMES];
+} bench_meter_t;
+
+/**
+ * The samples of one outlet for the DSP benchmarks.
+ *
+ * @param samples About one cycle of samples.
+ * @param cycle The sums of the samples.
+ */
+typedef struct bench_dsp {
+  meter_sample_t samples[BENCH_DSP_SAMPLES];
+  meter_cycle_t cycle;
+} bench_dsp_t;
+
+// The time of the last cycle recorded in the history.
+static int64_t history_ms = 0;
+
+/**
+ * Discard the output. This is an `outbuf_sink_t`.
+ *
+ * @param[in] ctx Unused.
+ * @param[in] data The data.
+ * @param[in] length Number of bytes.
+ *
+ * @return ESP_OK.
+ */
+static esp_err_t bench_discard(void* ctx, const char* data, size_t length) {
+  bench_use(data);
+  return ESP_OK;
+}
+
+/**
+ * Generate samples of the outlet with the largest load.
+ *
+ * @return The samples or NULL if they can't be allocated.
+ */
+static void* bench_dsp_setup(void) {
+  bench_dsp_t* dsp = calloc(1, sizeof(*dsp));
+  if (dsp == NULL) {
+    return NULL;
+  }
+
+  // The synthesized loads increase with the outlet, so use the last one.
+  synth_t synth;
+  meter_sample_t frame[BENCH_OUTLETS];
+  synth_init(&synth, BENCH_OUTLETS, CONFIG_ZEUS_METER_SAMPLE_RATE,
+             CONFIG_ZEUS_METER_MAINS_FREQUENCY, false);
+  for (size_t i = 0; i < BENCH_DSP_SAMPLES; ++i) {
+    synth_read(&synth, frame, 1);
+    dsp->samples[i] = frame[BENCH_OUTLETS - 1];
+  }
+  return dsp;
+}
+
+/**
+ * Sum the samples with the optimized implementation.
+ *
+ * @param[in] ctx The samples.
+ * @param[in] iterations Number of times the samples are summed.
+ *
+ * @return Number of bytes of samples.
+ */
+static uint64_t bench_dsp_sums(void* ctx, uint64_t iterations) {
+  bench_dsp_t* dsp = ctx;
+  for (uint64_t i = 0; i < iterations; ++i) {
+    dsp->cycle = (meter_cycle_t){0};
+    dsp_sums(&dsp->cycle, dsp->samples, BENCH_DSP_SAMPLES);
+  }
+  bench_use(&dsp->cycle);
+  return iterations * sizeof(dsp->samples);
+}
+
+/**
+ * Sum the samples with the plain implementation.
+ *
+ * @param[in] ctx The samples.
+ * @param[in] iterations Number of times the samples are summed.
+ *
+ * @return Number of bytes of samples.
+ */
+static uint64_t bench_dsp_sums_scalar(void* ctx, uint64_t iterations) {
+  bench_dsp_t* dsp = ctx;
+  for (uint64_t i = 0; i < iterations; ++i) {
+    dsp->cycle = (meter_cycle_t){0};
+    dsp_sums_scalar(&dsp->cycle, dsp->samples, BENCH_DSP_SAMPLES);
+  }
+  bench_use(&dsp->cycle);
+  return iterations * sizeof(dsp->samples);
+}
+
+/**
+ * Prepare the generator and the cycle detection of all outlets.
+ *
+ * @return The state or NULL if it can't be allocated.
+ */
+static void* bench_meter_setup(void) {
+  bench_meter_t* meter = calloc(1, sizeof(*meter));
+  if (meter == NULL) {
+    return NULL;
+  }
+  synth_init(&meter->synth, BENCH_OUTLETS, CONFIG_ZEUS_METER_SAMPLE_RATE,
+             CONFIG_ZEUS_METER_MAINS_FREQUENCY, false);
+  synth_source(&meter->synth, &meter->source);
+  for (size_t outlet = 0; outlet < BENCH_OUTLETS; ++outlet) {
+    meter_channel_init(&meter->channels[outlet], CONFIG_ZEUS_METER_SAMPLE_RATE,
+                       CONFIG_ZEUS_METER_MAINS_FREQUENCY);
+  }
+  return meter;
+}
+
+/**
+ * Generate blocks of frames and compute the readings of all outlets, like the
+ * threads of the meter do, but without the rings in between.
+ *
+ * @param[in] ctx The state.
+ * @param[in] iterations Number of blocks.
+ *
+ * @return Number of bytes of samples.
+ */
+static uint64_t bench_meter_feed(void* ctx, uint64_t iterations) {
+  bench_meter_t* meter = ctx;
+  meter_reading_t reading = {0};
+
+  for (uint64_t i = 0; i < iterations; ++i) {
+    synth_read(&meter->synth, meter->frames, BENCH_BLOCK_FRAMES);
+    for (size_t outlet = 0; outlet < BENCH_OUTLETS; ++outlet) {
+      for (size_t frame = 0; frame < BENCH_BLOCK_FRAMES; ++frame) {
+        meter->column[frame] = meter->frames[frame * BENCH_OUTLETS + outlet];
+      }
+
+      const meter_sample_t* cursor = meter->column;
+      size_t count = BENCH_BLOCK_FRAMES;
+      while (count > 0) {
+        size_t consumed;
+        meter_cycle_t cycle;
+        if (meter_channel_feed(&meter->channels[outlet], cursor, count,
+                               &consumed, &cycle)) {
+          meter_cycle_reading(&cycle, &meter->source, &reading);
+        }
+        cursor += consumed;
+        count -= consumed;
+      }
+    }
+  }
+  bench_use(&reading);
+  return iterations * sizeof(meter->frames);
+}
+
+/**
+ * Record cycles in the history of an outlet, which includes the rollups.
+ *
+ * @param[in] ctx Unused.
+ * @param[in] iterations Number of cycles.
+ *
+ * @return 0.
+ */
+static uint64_t bench_history_record(void* ctx, uint64_t iterations) {
+  meter_reading_t reading = {
+      .voltage_rms = 230.0f,
+      .current_rms = 4.35f,
+      .real_power = 980.5f,
+      .apparent_power = 1000.5f,
+      .power_factor = 0.98f,
+      .frequency = 50.0f,
+  };
+  for (uint64_t i = 0; i < iterations; ++i) {
+    history_ms += BENCH_CYCLE_MS;
+    reading.real_power = 980.5f + (float)(i % 100);
+    history_record(0, history_ms, &reading);
+  }
+  return 0;
+}
+
+/**
+ * Fill all resolutions of the history of an outlet.
+ *
+ * @return A non-NULL pointer.
+ */
+static void* bench_history_setup(void) {
+  // Record a day of cycles, which fills even the hourly rollups.
+  bench_history_record(NULL, 24 * 3600 * 1000 / BENCH_CYCLE_MS);
+  return &history_ms;
+}
+
+/**
+ * Query the raw points of an outlet as JSON.
+ *
+ * @param[in] ctx Unused.
+ * @param[in] iterations Number of queries.
+ *
+ * @return Number of bytes written.
+ */
+static uint64_t bench_history_query(void* ctx, uint64_t iterations) {
+  outbuf_t out;
+  outbuf_init(&out, bench_discard, NULL);
+  json_t json;
+  for (uint64_t i = 0; i < iterations; ++i) {
+    json_init(&json, &out);
+    history_query(&json, 0, HISTORY_RAW, 0);
+  }
+  outbuf_flush(&out);
+  return out.bytes_sent;
+}
+
+const bench_case_t bench_meter_cases[] = {
+    {
+        .name = "dsp/sums",
+        .setup = bench_dsp_setup,
+        .run = bench_dsp_sums,
+        .teardown = free,
+    },
+    {
+        .name = "dsp/sums_scalar",
+        .setup = bench_dsp_setup,
+        .run = bench_dsp_sums_scalar,
+        .teardown = free,
+    },
+    {
+        .name = "meter/channel_feed",
+        .setup = bench_meter_setup,
+        .run = bench_meter_feed,
+        .teardown = free,
+    },
+    {
+        .name = "history/record",
+        .run = bench_history_record,
+    },
+    {
+        .name = "history/query",
+        .setup = bench_history_setup,
+        .run = bench_history_query,
+    },
+    {0},
+};
@@ -0,0 +1,331 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "esp_err.h"
+#include "gzip.h"
+#include "outbuf.h"
+#include "prom.h"
+
+// Largest number of outlets of a scrape.
+#define BENCH_MAX_OUTLETS 32
+// Number of per-outlet families, as in the HTTP server.
+#define BENCH_OUTLET_FAMILIES 7
+
+/**
+ * A scrape of a device with a number of outlets.
+ *
+ * @param format The exposition format.
+ * @param compress Whether the scrape is compressed, as the HTTP server does
+ * for clients accepting gzip.
+ * @param outlet_count Number of outlets.
+ * @param numbers The values of the outlet labels.
+ * @param labels The outlet labels.
+ * @param values The readings per family and outlet.
+ * @param samples The samples of a family.
+ * @param gzip Compresses the scrape.
+ */
+typedef struct bench_prom {
+  prom_format_t format;
+  bool compress;
+  size_t outlet_count;
+  char numbers[BENCH_MAX_OUTLETS][4];
+  prom_label_t labels[BENCH_MAX_OUTLETS];
+  double values[BENCH_OUTLET_FAMILIES][BENCH_MAX_OUTLETS];
+  prom_sample_t samples[BENCH_MAX_OUTLETS];
+  gzip_t gzip;
+} bench_prom_t;
+
+// Names of the per-outlet families, the last being a counter.
+static const char* const outlet_names[BENCH_OUTLET_FAMILIES] = {
+    "zeus_outlet_voltage_volts",
+    "zeus_outlet_current_amperes",
+    "zeus_outlet_power_watts",
+    "zeus_outlet_apparent_power_voltamperes",
+    "zeus_outlet_power_factor",
+    "zeus_outlet_frequency_hertz",
+    "zeus_outlet_energy_joules_total",
+};
+// Typical readings per family, which vary slightly between outlets.
+static const double outlet_levels[BENCH_OUTLET_FAMILIES] = {
+    230.4, 0.42, 93.1, 96.6, 0.96, 50.01, 3600000,
+};
+// Upper bounds of the latency histogram in microseconds.
+static const uint32_t latency_bounds[] = {
+    100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000,
+};
+// A snapshot of the buckets of the latency histogram.
+static const uint64_t latency_buckets[] = {
+    12, 340, 1210, 560, 98, 21, 4, 1, 0, 0, 0,
+};
+
+/**
+ * Discard the output. This is an `outbuf_sink_t`.
+ *
+ * @param[in] ctx Unused.
+ * @param[in] data The data.
+ * @param[in] length Number of bytes.
+ *
+ * @return ESP_OK.
+ */
+static esp_err_t bench_prom_discard(void* ctx, const char* data,
+                                    size_t length) {
+  bench_use(data);
+  return ESP_OK;
+}
+
+/**
+ * Compress the output. This is an `outbuf_sink_t`.
+ *
+ * @param[in] ctx The compressor.
+ * @param[in] data The data.
+ * @param[in] length Number of bytes.
+ *
+ * @return The result of the compressor.
+ */
+static esp_err_t bench_prom_compress(void* ctx, const char* data,
+                                     size_t length) {
+  return gzip_feed(ctx, data, length);
+}
+
+/**
+ * Prepare the readings of a scrape.
+ *
+ * @param[in] format The exposition format.
+ * @param[in] compress Whether the scrape is compressed.
+ * @param[in] outlet_count Number of outlets.
+ *
+ * @return The scrape or NULL if it can't be allocated.
+ */
+static bench_prom_t* bench_prom_create(prom_format_t format, bool compress,
+                                       size_t outlet_count) {
+  bench_prom_t* prom = calloc(1, sizeof(bench_prom_t));
+  if (prom == NULL) {
+    return NULL;
+  }
+
+  prom->format = format;
+  prom->compress = compress;
+  prom->outlet_count = outlet_count;
+  uint32_t seed = 1;
+  for (size_t outlet = 0; outlet < outlet_count; ++outlet) {
+    snprintf(prom->numbers[outlet], sizeof(prom->numbers[outlet]), "%u",
+             (unsigned)outlet);
+    prom->labels[outlet] =
+        (prom_label_t){.name = "outlet", .value = prom->numbers[outlet]};
+    for (size_t i = 0; i < BENCH_OUTLET_FAMILIES; ++i) {
+      seed = seed * 1664525 + 1013904223;
+      double jitter = (double)(seed >> 16) / 65536 - 0.5;
+      // The readings are single-precision floats on the device.
+      prom->values[i][outlet] =
+          (float)(outlet_levels[i] * (1 + jitter / 100));
+    }
+  }
+  return prom;
+}
+
+/**
+ * Scrape the device in an exposition format, as the HTTP server does: a few
+ * device families, a histogram and the families of all outlets.
+ *
+ * @param[in] ctx The scrape.
+ * @param[in] iterations Number of scrapes.
+ *
+ * @return Number of bytes written, after compression if the scrape is
+ * compressed.
+ */
+static uint64_t bench_prom_scrape(void* ctx, uint64_t iterations) {
+  bench_prom_t* scrape = ctx;
+  outbuf_t out;
+  prom_t prom;
+  uint64_t bytes = 0;
+
+  const prom_label_t build_labels[] = {
+      {.name = "version", .value = "v1.4.0"},
+      {.name = "sdk", .value = "v5.2.1"},
+  };
+  const prom_histogram_t histogram = {
+      .bounds = latency_bounds,
+      .scale = 1e-6,
+      .buckets = latency_buckets,
+      .bound_count = sizeof(latency_bounds) / sizeof(latency_bounds[0]),
+      .sum = 1873412,
+  };
+
+  for (uint64_t i = 0; i < iterations; ++i) {
+    if (scrape->compress) {
+      gzip_init(&scrape->gzip, bench_prom_discard, NULL);
+      outbuf_init(&out, bench_prom_compress, &scrape->gzip);
+    } else {
+      outbuf_init(&out, bench_prom_discard, NULL);
+    }
+    prom_init(&prom, &out, scrape->format);
+
+    prom_sample_t sample = {
+        .labels = build_labels,
+        .label_count = sizeof(build_labels) / sizeof(build_labels[0]),
+        .value = 1,
+    };
+    prom_family(&prom, "zeus_build_info", PROM_GAUGE,
+                "Version of the running firmware.", &sample, 1);
+    sample = (prom_sample_t){.value = 86400.125};
+    prom_family(&prom, "zeus_uptime_seconds", PROM_GAUGE,
+                "Time since the device was started.", &sample, 1);
+    sample.value = 154312;
+    prom_family(&prom, "zeus_heap_free_bytes", PROM_GAUGE,
+                "Free heap memory.", &sample, 1);
+    prom_histogram(&prom, "zeus_http_request_duration_seconds",
+                   "Time to handle a request.", &histogram);
+
+    for (size_t family = 0; family < BENCH_OUTLET_FAMILIES; ++family) {
+      for (size_t outlet = 0; outlet < scrape->outlet_count; ++outlet) {
+        scrape->samples[outlet] = (prom_sample_t){
+            .labels = &scrape->labels[outlet],
+            .label_count = 1,
+            .value = scrape->values[family][outlet],
+        };
+      }
+      prom_family(&prom, outlet_names[family],
+                  family + 1 < BENCH_OUTLET_FAMILIES ? PROM_GAUGE
+                                                     : PROM_COUNTER,
+                  "A reading of the outlet.", scrape->samples,
+                  scrape->outlet_count);
+    }
+
+    outbuf_flush(&out);
+    if (scrape->compress) {
+      gzip_finish(&scrape->gzip);
+      bytes += scrape->gzip.output_length;
+    } else {
+      bytes += out.bytes_sent;
+    }
+  }
+  return bytes;
+}
+
+/**
+ * Scrape 8 outlets in the text format.
+ *
+ * @return The scrape or NULL if it can't be allocated.
+ */
+static void* bench_prom_text_8_setup(void) {
+  return bench_prom_create(PROM_TEXT, false, 8);
+}
+
+/**
+ * Scrape 16 outlets in the text format.
+ *
+ * @return The scrape or NULL if it can't be allocated.
+ */
+static void* bench_prom_text_16_setup(void) {
+  return bench_prom_create(PROM_TEXT, false, 16);
+}
+
+/**
+ * Scrape 32 outlets in the text format.
+ *
+ * @return The scrape or NULL if it can't be allocated.
+ */
+static void* bench_prom_text_32_setup(void) {
+  return bench_prom_create(PROM_TEXT, false, 32);
+}
+
+/**
+ * Scrape 8 outlets in the protobuf format.
+ *
+ * @return The scrape or NULL if it can't be allocated.
+ */
+static void* bench_prom_protobuf_8_setup(void) {
+  return bench_prom_create(PROM_PROTOBUF, false, 8);
+}
+
+/**
+ * Scrape 16 outlets in the protobuf format.
+ *
+ * @return The scrape or NULL if it can't be allocated.
+ */
+static void* bench_prom_protobuf_16_setup(void) {
+  return bench_prom_create(PROM_PROTOBUF, false, 16);
+}
+
+/**
+ * Scrape 32 outlets in the protobuf format.
+ *
+ * @return The scrape or NULL if it can't be allocated.
+ */
+static void* bench_prom_protobuf_32_setup(void) {
+  return bench_prom_create(PROM_PROTOBUF, false, 32);
+}
+
+/**
+ * Scrape 16 outlets in the text format and compress it.
+ *
+ * @return The scrape or NULL if it can't be allocated.
+ */
+static void* bench_prom_text_16_gzip_setup(void) {
+  return bench_prom_create(PROM_TEXT, true, 16);
+}
+
+/**
+ * Scrape 16 outlets in the protobuf format and compress it.
+ *
+ * @return The scrape or NULL if it can't be allocated.
+ */
+static void* bench_prom_protobuf_16_gzip_setup(void) {
+  return bench_prom_create(PROM_PROTOBUF, true, 16);
+}
+
+const bench_case_t bench_prom_cases[] = {
+    {
+        .name = "prom/text/8",
+        .setup = bench_prom_text_8_setup,
+        .run = bench_prom_scrape,
+        .teardown = free,
+    },
+    {
+        .name = "prom/text/16",
+        .setup = bench_prom_text_16_setup,
+        .run = bench_prom_scrape,
+        .teardown = free,
+    },
+    {
+        .name = "prom/text/32",
+        .setup = bench_prom_text_32_setup,
+        .run = bench_prom_scrape,
+        .teardown = free,
+    },
+    {
+        .name = "prom/protobuf/8",
+        .setup = bench_prom_protobuf_8_setup,
+        .run = bench_prom_scrape,
+        .teardown = free,
+    },
+    {
+        .name = "prom/protobuf/16",
+        .setup = bench_prom_protobuf_16_setup,
+        .run = bench_prom_scrape,
+        .teardown = free,
+    },
+    {
+        .name = "prom/protobuf/32",
+        .setup = bench_prom_protobuf_32_setup,
+        .run = bench_prom_scrape,
+        .teardown = free,
+    },
+    {
+        .name = "prom/text/16/gzip",
+        .setup = bench_prom_text_16_gzip_setup,
+        .run = bench_prom_scrape,
+        .teardown = free,
+    },
+    {
+        .name = "prom/protobuf/16/gzip",
+        .setup = bench_prom_protobuf_16_gzip_setup,
+        .run = bench_prom_scrape,
+        .teardown = free,
+    },
+    {0},
+};
@@ -0,0 +1,338 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "batch.h"
+#include "bench.h"
+#include "esp_err.h"
+#include "esp_http_client.h"
+#include "sdkconfig.h"
+
+#ifdef BENCH_ZLIB
+#include <zlib.h>
+#endif
+
+// The URL of the endpoint emulated by the receiver.
+#define BENCH_PUSH_URL "http://zeus.bench/api/v1/write"
+// Size of the buffers of the encoder, as in the push module.
+#define BENCH_BODY_SIZE (16 * 1024)
+// Number of series of registered metrics sampled at every interval.
+#define BENCH_METRIC_SERIES 40
+// Number of outlets sampled at every interval.
+#define BENCH_OUTLETS 8
+// Number of series per outlet, as in the push module.
+#define BENCH_OUTLET_FIELDS 7
+// Number of series sampled at every interval.
+#define BENCH_SERIES (BENCH_METRIC_SERIES + BENCH_OUTLETS * BENCH_OUTLET_FIELDS)
+// Time between two samples of a series in milliseconds.
+#define BENCH_INTERVAL_MS 10000
+
+/**
+ * The state of pushing batches to the receiver.
+ *
+ * @param samples The samples of a batch in the order they were queued.
+ * @param batch A copy of the samples, which the encoder sorts.
+ * @param count Number of samples in a batch.
+ * @param body Buffer receiving the compressed body.
+ * @param scratch Buffer receiving the uncompressed protobuf.
+ * @param decoded Buffer receiving the decompressed body in the receiver.
+ * @param encoder Encodes the batches.
+ * @param client The HTTP client posting the batches.
+ * @param received_length Number of bytes the receiver decompressed from the
+ * last body.
+ */
+typedef struct bench_push {
+  batch_sample_t samples[CONFIG_ZEUS_PUSH_BATCH_SIZE];
+  batch_sample_t batch[CONFIG_ZEUS_PUSH_BATCH_SIZE];
+  size_t count;
+  char body[BENCH_BODY_SIZE];
+  char scratch[BENCH_BODY_SIZE];
+  char decoded[4 * BENCH_BODY_SIZE];
+  batch_t encoder;
+  esp_http_client_handle_t client;
+  size_t received_length;
+} bench_push_t;
+
+// Names of the per-outlet series.
+static const char* const outlet_names[BENCH_OUTLET_FIELDS] = {
+    "zeus_outlet_voltage_volts",
+    "zeus_outlet_current_amperes",
+    "zeus_outlet_power_watts",
+    "zeus_outlet_apparent_power_voltamperes",
+    "zeus_outlet_power_factor",
+    "zeus_outlet_frequency_hertz",
+    "zeus_outlet_energy_joules_total",
+};
+
+/**
+ * Resolve a series into a name and an outlet, like the push module does.
+ * This is a `batch_describe_t`.
+ *
+ * @param[in] ctx Unused.
+ * @param[in] series The series.
+ * @param[out] description Receives the name and the outlet.
+ */
+static void bench_push_describe(void* ctx, uint16_t series,
+                                batch_series_t* description) {
+  if (series < BENCH_METRIC_SERIES) {
+    snprintf(description->name, sizeof(description->name),
+             "zeus_bench_series_%02u_total", (unsigned)series);
+    description->outlet = -1;
+    return;
+  }
+  series -= BENCH_METRIC_SERIES;
+  snprintf(description->name, sizeof(description->name), "%s",
+           outlet_names[series % BENCH_OUTLET_FIELDS]);
+  description->outlet = series / BENCH_OUTLET_FIELDS;
+}
+
+/**
+ * Decompress a body in the raw Snappy format.
+ *
+ * @param[in] data The compressed body.
+ * @param[in] length Number of bytes of the compressed body.
+ * @param[out] output Buffer receiving the decompressed body.
+ * @param[in] size Size of the buffer.
+ *
+ * @return Number of bytes decompressed or 0 if the body is malformed.
+ */
+static size_t bench_unsnappy(const uint8_t* data, size_t length,
+                             uint8_t* output, size_t size) {
+  size_t in = 0;
+  size_t expected = 0;
+  for (int shift = 0; in < length; shift += 7) {
+    expected |= (size_t)(data[in] & 0x7f) << shift;
+    if (data[in++] < 0x80) {
+      break;
+    }
+  }
+  if (expected > size) {
+    return 0;
+  }
+
+  size_t out = 0;
+  while (in < length) {
+    uint8_t tag = data[in++];
+    size_t count = (tag >> 2) + 1;
+    if ((tag & 3) == 0) {
+      // A literal, whose longer lengths follow the tag.
+      if (count > 60) {
+        size_t bytes = count - 60;
+        count = 0;
+        for (size_t i = 0; i < bytes && in < length; ++i) {
+          count |= (size_t)data[in++] << (8 * i);
+        }
+        count += 1;
+      }
+      if (count > length - in || count > expected - out) {
+        return 0;
+      }
+      memcpy(&output[out], &data[in], count);
+      in += count;
+      out += count;
+      continue;
+    }
+
+    size_t offset = 0;
+    if ((tag & 3) == 1) {
+      count = ((tag >> 2) & 7) + 4;
+      if (in >= length) {
+        return 0;
+      }
+      offset = (size_t)(tag >> 5) << 8 | data[in++];
+    } else {
+      size_t bytes = (tag & 3) == 2 ? 2 : 4;
+      if (bytes > length - in) {
+        return 0;
+      }
+      for (size_t i = 0; i < bytes; ++i) {
+        offset |= (size_t)data[in++] << (8 * i);
+      }
+    }
+    if (offset == 0 || offset > out || count > expected - out) {
+      return 0;
+    }
+    for (size_t i = 0; i < count; ++i, ++out) {
+      output[out] = output[out - offset];
+    }
+  }
+  return out == expected ? out : 0;
+}
+
+/**
+ * Decompress a posted body, as the endpoint would. This is an
+ * `esp_http_client_host_receiver_t`.
+ *
+ * @param[in] ctx The state of the push.
+ * @param[in] content_encoding The encoding of the body.
+ * @param[in] body The body.
+ * @param[in] length Number of bytes in the body.
+ *
+ * @return 204 if the body was decompressed or 400 if it is malformed.
+ */
+static int bench_push_receive(void* ctx, const char* content_encoding,
+                              const char* body, size_t length) {
+  bench_push_t* push = ctx;
+  push->received_length = 0;
+  if (strcmp(content_encoding, "snappy") == 0) {
+    push->received_length =
+        bench_unsnappy((const uint8_t*)body, length, (uint8_t*)push->decoded,
+                       sizeof(push->decoded));
+  }
+#ifdef BENCH_ZLIB
+  if (strcmp(content_encoding, "gzip") == 0) {
+    z_stream stream = {
+        .next_in = (Bytef*)body,
+        .avail_in = (uInt)length,
+        .next_out = (Bytef*)push->decoded,
+        .avail_out = sizeof(push->decoded),
+    };
+    if (inflateInit2(&stream, 16 + MAX_WBITS) == Z_OK) {
+      if (inflate(&stream, Z_FINISH) == Z_STREAM_END) {
+        push->received_length = stream.total_out;
+      }
+      inflateEnd(&stream);
+    }
+  }
+#endif
+  return push->received_length > 0 ? 204 : 400;
+}
+
+/**
+ * Prepare a batch of samples taken at intervals, as the push module queues
+ * them: a few counters that grow and readings that vary around their level.
+ *
+ * @param[in] format The format of the bodies.
+ *
+ * @return The state of the push or NULL if it can't be allocated.
+ */
+static bench_push_t* bench_push_create(batch_format_t format) {
+  bench_push_t* push = calloc(1, sizeof(bench_push_t));
+  if (push == NULL) {
+    return NULL;
+  }
+
+  uint32_t seed = 1;
+  int64_t time_ms = 1700000000000LL;
+  push->count = CONFIG_ZEUS_PUSH_BATCH_SIZE;
+  for (size_t i = 0; i < push->count; ++i) {
+    uint16_t series = (uint16_t)(i % BENCH_SERIES);
+    if (i > 0 && series == 0) {
+      time_ms += BENCH_INTERVAL_MS;
+    }
+    seed = seed * 1664525 + 1013904223;
+    double jitter = (double)(seed >> 16) / 65536;
+    double value = 0;
+    if (series < BENCH_METRIC_SERIES) {
+      value = (double)(series * 1000 + (time_ms / BENCH_INTERVAL_MS) % 1000);
+    } else {
+      value = 230 + 4 * jitter;
+    }
+    push->samples[i] = (batch_sample_t){
+        .time_ms = time_ms,
+        .value = value,
+        .series = series,
+    };
+  }
+
+  batch_init(&push->encoder, format, "a4cf12f0c0de", bench_push_describe,
+             NULL, push->body, sizeof(push->body), push->scratch,
+             sizeof(push->scratch));
+
+  esp_http_client_config_t config = {
+      .url = BENCH_PUSH_URL,
+      .method = HTTP_METHOD_POST,
+  };
+  push->client = esp_http_client_init(&config);
+  if (push->client == NULL ||
+      esp_http_client_host_receive(BENCH_PUSH_URL, bench_push_receive,
+                                   push) != ESP_OK) {
+    esp_http_client_cleanup(push->client);
+    free(push);
+    return NULL;
+  }
+  esp_http_client_set_header(push->client, "Content-Encoding",
+                             batch_content_encoding(&push->encoder));
+  return push;
+}
+
+/**
+ * Push batches as remote-write requests.
+ *
+ * @return The state of the push or NULL if it can't be allocated.
+ */
+static void* bench_push_remote_write_setup(void) {
+  return bench_push_create(BATCH_REMOTE_WRITE);
+}
+
+#ifdef BENCH_ZLIB
+/**
+ * Push batches as line protocol.
+ *
+ * @return The state of the push or NULL if it can't be allocated.
+ */
+static void* bench_push_line_setup(void) {
+  return bench_push_create(BATCH_LINE);
+}
+#endif
+
+/**
+ * Release the state of the push.
+ *
+ * @param[in] ctx The state of the push.
+ */
+static void bench_push_teardown(void* ctx) {
+  bench_push_t* push = ctx;
+  esp_http_client_cleanup(push->client);
+  free(push);
+}
+
+/**
+ * Encode, compress and post a batch, which the receiver decompresses.
+ *
+ * @param[in] ctx The state of the push.
+ * @param[in] iterations Number of batches.
+ *
+ * @return Number of bytes of the uncompressed bodies.
+ */
+static uint64_t bench_push(void* ctx, uint64_t iterations) {
+  bench_push_t* push = ctx;
+  uint64_t bytes = 0;
+  for (uint64_t i = 0; i < iterations; ++i) {
+    memcpy(push->batch, push->samples, push->count * sizeof(batch_sample_t));
+    size_t length = 0;
+    if (batch_encode(&push->encoder, push->batch, push->count, &length) !=
+        ESP_OK) {
+      abort();
+    }
+    esp_http_client_set_post_field(push->client, push->body, (int)length);
+    if (esp_http_client_perform(push->client) != ESP_OK ||
+        esp_http_client_get_status_code(push->client) != 204 ||
+        push->received_length != push->encoder.encoded_length) {
+      abort();
+    }
+    bytes += push->encoder.encoded_length;
+  }
+  return bytes;
+}
+
+const bench_case_t bench_push_cases[] = {
+    {
+        .name = "push/remote_write",
+        .setup = bench_push_remote_write_setup,
+        .run = bench_push,
+        .teardown = bench_push_teardown,
+    },
+#ifdef BENCH_ZLIB
+    {
+        .name = "push/line",
+        .setup = bench_push_line_setup,
+        .run = bench_push,
+        .teardown = bench_push_teardown,
+    },
+#endif
+    {0},
+};
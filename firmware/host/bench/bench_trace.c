@@ -0,0 +1,120 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bench.h"
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "json.h"
+#include "outbuf.h"
+#include "sdkconfig.h"
+#include "trace.h"
+
+// Name of the recorded slices.
+static const char slice_name[] = "bench.slice";
+
+/**
+ * Discard the output. This is an `outbuf_sink_t`.
+ *
+ * @param[in] ctx Unused.
+ * @param[in] data The data.
+ * @param[in] length Number of bytes.
+ *
+ * @return ESP_OK.
+ */
+static esp_err_t bench_trace_discard(void* ctx, const char* data,
+                                     size_t length) {
+  bench_use(data);
+  return ESP_OK;
+}
+
+/**
+ * Allocate the rings with the default capacity of the device, unless a
+ * previous benchmark did.
+ *
+ * @return The name of the recorded slices or NULL if the rings can't be
+ * allocated.
+ */
+static void* bench_trace_setup(void) {
+  esp_err_t err = trace_init(CONFIG_ZEUS_TRACE_EVENTS);
+  if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) {
+    return NULL;
+  }
+  return (void*)slice_name;
+}
+
+/**
+ * Fill the rings of all cores, as after tracing for a while.
+ *
+ * @return The name of the recorded slices or NULL if the rings can't be
+ * allocated.
+ */
+static void* bench_trace_full_setup(void) {
+  void* name = bench_trace_setup();
+  if (name == NULL) {
+    return NULL;
+  }
+  // The events are recorded on the core running the setup, so this overfills
+  // one ring to be sure that all are filled.
+  for (size_t i = 0; i < portNUM_PROCESSORS * CONFIG_ZEUS_TRACE_EVENTS; ++i) {
+    trace_record(i % 2 == 0 ? name : NULL,
+                 i % 2 == 0 ? TRACE_PHASE_BEGIN : TRACE_PHASE_END);
+  }
+  return name;
+}
+
+/**
+ * Record events that alternately begin and end a slice, which is the cost of
+ * an instrumentation point when tracing is enabled.
+ *
+ * @param[in] ctx The name of the slices.
+ * @param[in] iterations Number of events.
+ *
+ * @return 0.
+ */
+static uint64_t bench_trace_record(void* ctx, uint64_t iterations) {
+  for (uint64_t i = 0; i < iterations; ++i) {
+    if (i % 2 == 0) {
+      trace_record(ctx, TRACE_PHASE_BEGIN);
+    } else {
+      trace_record(NULL, TRACE_PHASE_END);
+    }
+  }
+  return 0;
+}
+
+/**
+ * Export the full rings as the trace endpoint does.
+ *
+ * @param[in] ctx Unused.
+ * @param[in] iterations Number of exports.
+ *
+ * @return Number of bytes of the documents.
+ */
+static uint64_t bench_trace_export(void* ctx, uint64_t iterations) {
+  uint64_t bytes = 0;
+
+  for (uint64_t i = 0; i < iterations; ++i) {
+    outbuf_t out;
+    json_t json;
+    outbuf_init(&out, bench_trace_discard, NULL);
+    json_init(&json, &out);
+    trace_export(&json);
+    outbuf_flush(&out);
+    bytes += out.bytes_sent;
+  }
+  return bytes;
+}
+
+const bench_case_t bench_trace_cases[] = {
+    {
+        .name = "trace/record",
+        .setup = bench_trace_setup,
+        .run = bench_trace_record,
+    },
+    {
+        .name = "trace/export",
+        .setup = bench_trace_full_setup,
+        .run = bench_trace_export,
+    },
+    {0},
+};
@@ -0,0 +1,542 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "delta.h"
+#include "download.h"
+#include "esp_err.h"
+#include "esp_http_client.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "inflate.h"
+#include "sdkconfig.h"
+
+#ifdef BENCH_ZLIB
+#include <zlib.h>
+#endif
+
+// Size of the firmware image.
+#define BENCH_IMAGE_SIZE (1024 * 1024)
+// Size of the base image of the patch.
+#define BENCH_BASE_SIZE (256 * 1024)
+// Every block of the base image is copied, followed by an inserted literal.
+#define BENCH_PATCH_BLOCK 4096
+// Number of literal bytes inserted for every block.
+#define BENCH_PATCH_LITERAL 16
+// Size of the chunks in which the patch is fed, like the buffers of the
+// download.
+#define BENCH_CHUNK_SIZE 1024
+// The URL of the firmware image served by the shim of the HTTP client.
+#define BENCH_IMAGE_URL "http://zeus.bench/zeus-esp32.bin"
+// The URL of the compressed firmware image.
+#define BENCH_COMPRESSED_URL "http://zeus.bench/zeus-esp32.zlib"
+// The rate of the emulated link in bytes per second, a management network
+// that is slower than the flash.
+#define BENCH_LINK_RATE (2 * 1000 * 1000)
+// Duration of erasing a flash sector and of writing a KiB in microseconds,
+// which makes the flash about as fast as the link. The overlap of receiving
+// and writing gains most then.
+#define BENCH_FLASH_ERASE_US 1500
+#define BENCH_FLASH_WRITE_US 128
+// Size of the blocks written to the slow flash. Each write stalls the download
+// for longer than the TCP window of the link covers, like on a device.
+#define BENCH_FLASH_BLOCK_SIZE (16 * 1024)
+// Percentage of the image made of recurring instructions, which compresses
+// it to about 62 %, like the firmware.
+#define BENCH_CODE_REUSE 50
+
+/**
+ * A patch together with its base and target image.
+ *
+ * @param base The base image.
+ * @param target Receives the reconstructed image.
+ * @param target_length Number of bytes reconstructed.
+ * @param patch The patch.
+ * @param patch_length Number of bytes in the patch.
+ * @param delta The decoder.
+ */
+typedef struct bench_delta {
+  uint8_t base[BENCH_BASE_SIZE];
+  uint8_t target[BENCH_BASE_SIZE];
+  size_t target_length;
+  uint8_t patch[BENCH_BASE_SIZE / 32];
+  size_t patch_length;
+  delta_t delta;
+} bench_delta_t;
+
+/**
+ * A firmware image that is downloaded with the download module.
+ *
+ * @param image The firmware image that is served.
+ * @param stream The compressed image that is served, or NULL if the image is
+ * downloaded raw.
+ * @param url The URL of the downloaded file.
+ * @param block_size Size of the blocks written to the flash.
+ * @param slot_count Number of buffers between the download and the flash
+ * thread, where 1 makes receiving and writing alternate.
+ */
+typedef struct bench_download {
+  uint8_t* image;
+  uint8_t* stream;
+  const char* url;
+  size_t block_size;
+  size_t slot_count;
+} bench_download_t;
+
+// The digest of the base image, which the shims don't calculate.
+static const uint8_t base_sha256[DELTA_SHA256_LEN] = {0};
+
+/**
+ * Fill a buffer with deterministic data that doesn't compress.
+ *
+ * @param[out] data The buffer.
+ * @param[in] length Number of bytes.
+ * @param[in] seed The seed of the generator.
+ */
+static void bench_fill(uint8_t* data, size_t length, uint32_t seed) {
+  for (size_t i = 0; i < length; ++i) {
+    seed = seed * 1664525 + 1013904223;
+    data[i] = (uint8_t)(seed >> 24);
+  }
+}
+
+/**
+ * Fill a buffer with deterministic data that compresses like machine code,
+ * in which some instructions recur often and most are rare.
+ *
+ * @param[out] data The buffer.
+ * @param[in] length Number of bytes.
+ * @param[in] seed The seed of the generator.
+ */
+static void bench_fill_code(uint8_t* data, size_t length, uint32_t seed) {
+  uint8_t words[256][3];
+  bench_fill(&words[0][0], sizeof(words), seed);
+
+  for (size_t i = 0; i < length;) {
+    seed = seed * 1664525 + 1013904223;
+    if ((seed >> 24) % 100 >= BENCH_CODE_REUSE) {
+      data[i++] = (uint8_t)(seed >> 8);
+      continue;
+    }
+    // Combining two random bytes makes the lower indices more likely.
+    const uint8_t* word = words[(seed >> 8) & (seed >> 16) & 0xff];
+    for (size_t j = 0; j < sizeof(words[0]) && i < length; ++j) {
+      data[i++] = word[j];
+    }
+  }
+}
+
+/**
+ * Append an unsigned LEB128 varint to a patch.
+ *
+ * @param[in] patch The patch.
+ * @param[in] value The value.
+ */
+static void bench_varint(bench_delta_t* patch, uint32_t value) {
+  do {
+    uint8_t byte = value & 0x7f;
+    value >>= 7;
+    patch->patch[patch->patch_length++] = byte | (value != 0 ? 0x80 : 0);
+  } while (value != 0);
+}
+
+/**
+ * Store a 32-bit integer in little-endian byte order.
+ *
+ * @param[out] data The destination.
+ * @param[in] value The value.
+ */
+static void bench_u32(uint8_t* data, uint32_t value) {
+  for (size_t i = 0; i < 4; ++i) {
+    data[i] = (uint8_t)(value >> (8 * i));
+  }
+}
+
+/**
+ * Create a patch that keeps most of every block of the base image, but
+ * replaces its end with literal data, like a typical release does.
+ *
+ * @return The patch or NULL if it can't be allocated.
+ */
+static void* bench_delta_setup(void) {
+  bench_delta_t* patch = calloc(1, sizeof(*patch));
+  if (patch == NULL) {
+    return NULL;
+  }
+  bench_fill(patch->base, BENCH_BASE_SIZE, 1);
+
+  uint8_t* header = patch->patch;
+  memcpy(header, DELTA_MAGIC, 4);
+  header[4] = DELTA_FORMAT;
+  bench_u32(&header[8], BENCH_BASE_SIZE);
+  bench_u32(&header[12], BENCH_BASE_SIZE);
+  memcpy(&header[16], base_sha256, DELTA_SHA256_LEN);
+  memcpy(&header[48], "v1.0.0", 6);
+  patch->patch_length = DELTA_HEADER_SIZE;
+
+  for (uint32_t offset = 0; offset < BENCH_BASE_SIZE;
+       offset += BENCH_PATCH_BLOCK) {
+    patch->patch[patch->patch_length++] = DELTA_OP_COPY;
+    bench_varint(patch, offset);
+    bench_varint(patch, BENCH_PATCH_BLOCK - BENCH_PATCH_LITERAL);
+    patch->patch[patch->patch_length++] = DELTA_OP_INSERT;
+    bench_varint(patch, BENCH_PATCH_LITERAL);
+    bench_fill(&patch->patch[patch->patch_length], BENCH_PATCH_LITERAL,
+               offset);
+    patch->patch_length += BENCH_PATCH_LITERAL;
+  }
+  return patch;
+}
+
+/**
+ * Read a range of the base image. This is a `delta_read_t`.
+ *
+ * @param[in] ctx The patch.
+ * @param[in] offset Offset within the base image.
+ * @param[out] data Buffer receiving the data.
+ * @param[in] length Number of bytes to be read.
+ *
+ * @return ESP_OK.
+ */
+static esp_err_t bench_delta_read(void* ctx, size_t offset, void* data,
+                                  size_t length) {
+  bench_delta_t* patch = ctx;
+  memcpy(data, &patch->base[offset], length);
+  return ESP_OK;
+}
+
+/**
+ * Append to the target image. This is a `delta_write_t`.
+ *
+ * @param[in] ctx The patch.
+ * @param[in] data The data to be written.
+ * @param[in] length Number of bytes to be written.
+ *
+ * @return ESP_OK.
+ */
+static esp_err_t bench_delta_write(void* ctx, const void* data,
+                                   size_t length) {
+  bench_delta_t* patch = ctx;
+  memcpy(&patch->target[patch->target_length], data, length);
+  patch->target_length += length;
+  return ESP_OK;
+}
+
+/**
+ * Apply the patch in chunks, like a download does.
+ *
+ * @param[in] ctx The patch.
+ * @param[in] iterations Number of times the patch is applied.
+ *
+ * @return Number of bytes reconstructed.
+ */
+static uint64_t bench_delta_apply(void* ctx, uint64_t iterations) {
+  bench_delta_t* patch = ctx;
+  uint64_t bytes = 0;
+
+  for (uint64_t i = 0; i < iterations; ++i) {
+    delta_init(&patch->delta, base_sha256, bench_delta_read, patch,
+               bench_delta_write, patch);
+    patch->target_length = 0;
+
+    esp_err_t err = ESP_OK;
+    for (size_t offset = 0; offset < patch->patch_length && err == ESP_OK;
+         offset += BENCH_CHUNK_SIZE) {
+      size_t length = patch->patch_length - offset;
+      err = delta_feed(&patch->delta, &patch->patch[offset],
+                       length < BENCH_CHUNK_SIZE ? length : BENCH_CHUNK_SIZE);
+    }
+    if (err != ESP_OK || delta_finish(&patch->delta) != ESP_OK) {
+      abort();
+    }
+    bytes += patch->target_length;
+  }
+  return bytes;
+}
+
+/**
+ * Stop serving the firmware image and release it.
+ *
+ * @param[in] ctx The state of the download.
+ */
+static void bench_download_teardown(void* ctx) {
+  bench_download_t* download = ctx;
+  esp_http_client_host_serve(download->url, 404, NULL, 0);
+  esp_http_client_host_set_rate(0);
+  esp_partition_host_set_latency(0, 0);
+  free(download->stream);
+  free(download->image);
+  free(download);
+}
+
+/**
+ * Serve a firmware image through the shim of the HTTP client.
+ *
+ * @param[in] compressed Indicates that the image is served compressed like
+ * `tools/compress.py` does, which requires zlib on the host.
+ * @param[in] rate The rate of the link in bytes per second, or 0 if
+ * unlimited.
+ * @param[in] slow_flash Indicates that the flash is about as slow as the
+ * link rather than instant, which is written in larger blocks.
+ * @param[in] slot_count Number of buffers between the download and the flash
+ * thread.
+ *
+ * @return The state of the download or NULL if it can't be allocated.
+ */
+static bench_download_t* bench_download_create(bool compressed, uint32_t rate,
+                                               bool slow_flash,
+                                               size_t slot_count) {
+  bench_download_t* download = calloc(1, sizeof(*download));
+  if (download == NULL) {
+    return NULL;
+  }
+  download->url = compressed ? BENCH_COMPRESSED_URL : BENCH_IMAGE_URL;
+  download->block_size =
+      slow_flash ? BENCH_FLASH_BLOCK_SIZE : CONFIG_ZEUS_UPDATE_BLOCK_SIZE;
+  download->slot_count = slot_count;
+  download->image = malloc(BENCH_IMAGE_SIZE);
+  if (download->image == NULL) {
+    bench_download_teardown(download);
+    return NULL;
+  }
+  bench_fill_code(download->image, BENCH_IMAGE_SIZE, 2);
+
+  const uint8_t* body = download->image;
+  size_t length = BENCH_IMAGE_SIZE;
+#ifdef BENCH_ZLIB
+  if (compressed) {
+    uLong bound = compressBound(BENCH_IMAGE_SIZE);
+    download->stream = malloc(bound);
+    z_stream stream = {
+        .next_in = download->image,
+        .avail_in = BENCH_IMAGE_SIZE,
+        .next_out = download->stream,
+        .avail_out = (uInt)bound,
+    };
+    if (download->stream == NULL ||
+        deflateInit2(&stream, 9, Z_DEFLATED, INFLATE_WINDOW_BITS, 9,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+      bench_download_teardown(download);
+      return NULL;
+    }
+    int status = deflate(&stream, Z_FINISH);
+    deflateEnd(&stream);
+    if (status != Z_STREAM_END) {
+      bench_download_teardown(download);
+      return NULL;
+    }
+    body = download->stream;
+    length = stream.total_out;
+  }
+#else
+  if (compressed) {
+    bench_download_teardown(download);
+    return NULL;
+  }
+#endif
+
+  if (esp_http_client_host_serve(download->url, 200, body, length) !=
+      ESP_OK) {
+    bench_download_teardown(download);
+    return NULL;
+  }
+  esp_http_client_host_set_rate(rate);
+  if (slow_flash) {
+    esp_partition_host_set_latency(BENCH_FLASH_ERASE_US, BENCH_FLASH_WRITE_US);
+  }
+
+  // The shim allocates the emulated flash when it is first accessed, which
+  // doesn't count as heap usage of the download.
+  uint8_t byte;
+  esp_partition_read(esp_ota_get_next_update_partition(NULL), 0, &byte, 1);
+  return download;
+}
+
+/**
+ * Serve the raw image without limiting the rate, which measures the overhead
+ * of the download.
+ *
+ * @return The state of the download or NULL if it can't be allocated.
+ */
+static void* bench_download_setup(void) {
+  return bench_download_create(false, 0, false, DOWNLOAD_SLOT_COUNT);
+}
+
+/**
+ * Serve the raw image over the emulated link.
+ *
+ * @return The state of the download or NULL if it can't be allocated.
+ */
+static void* bench_download_link_setup(void) {
+  return bench_download_create(false, BENCH_LINK_RATE, false,
+                               DOWNLOAD_SLOT_COUNT);
+}
+
+/**
+ * Serve the raw image over the emulated link to a slow flash, with receiving
+ * and writing overlapped like in the update module.
+ *
+ * @return The state of the download or NULL if it can't be allocated.
+ */
+static void* bench_download_flash_setup(void) {
+  return bench_download_create(false, BENCH_LINK_RATE, true,
+                               DOWNLOAD_SLOT_COUNT);
+}
+
+/**
+ * Serve the raw image over the emulated link to a slow flash, with receiving
+ * and writing alternating, which is the baseline of the overlap.
+ *
+ * @return The state of the download or NULL if it can't be allocated.
+ */
+static void* bench_download_serial_setup(void) {
+  return bench_download_create(false, BENCH_LINK_RATE, true, 1);
+}
+
+#ifdef BENCH_ZLIB
+/**
+ * Serve the compressed image without limiting the rate, which measures the
+ * overhead of the decompression.
+ *
+ * @return The state of the download or NULL if it can't be allocated.
+ */
+static void* bench_download_zlib_setup(void) {
+  return bench_download_create(true, 0, false, DOWNLOAD_SLOT_COUNT);
+}
+
+/**
+ * Serve the compressed image over the emulated link.
+ *
+ * @return The state of the download or NULL if it can't be allocated.
+ */
+static void* bench_download_zlib_link_setup(void) {
+  return bench_download_create(true, BENCH_LINK_RATE, false,
+                               DOWNLOAD_SLOT_COUNT);
+}
+#endif
+
+/**
+ * Accept every image. This is a `download_check_t`.
+ *
+ * @param[in] ctx Unused.
+ * @param[in] header The beginning of the image.
+ * @param[out] needed Receives true.
+ *
+ * @return ESP_OK.
+ */
+static esp_err_t bench_download_check(void* ctx, const char* header,
+                                      bool* needed) {
+  *needed = true;
+  return ESP_OK;
+}
+
+/**
+ * Download the image and write it to the update partition with the download
+ * module, like the update module does for an image without a manifest.
+ *
+ * @param[in] download The image.
+ *
+ * @return ESP_OK if the image was written.
+ */
+static esp_err_t bench_download_once(const bench_download_t* download) {
+  download_config_t config = {
+      .format = download->stream != NULL ? DOWNLOAD_FORMAT_COMPRESSED
+                                         : DOWNLOAD_FORMAT_IMAGE,
+      .block_size = download->block_size,
+      .slot_count = download->slot_count,
+      .check = bench_download_check,
+  };
+  // The state is allocated for every download like in the update module.
+  download_t* state = malloc(sizeof(*state));
+  if (state == NULL) {
+    return ESP_ERR_NO_MEM;
+  }
+  esp_err_t err = download_prepare(state, &config);
+  if (err != ESP_OK) {
+    free(state);
+    return err;
+  }
+
+  esp_http_client_config_t client_config = {
+      .url = download->url,
+      .buffer_size = DOWNLOAD_SLOT_SIZE,
+  };
+  esp_http_client_handle_t client = esp_http_client_init(&client_config);
+  err = client != NULL ? download_run(state, client) : ESP_ERR_NO_MEM;
+  if (client != NULL) {
+    esp_http_client_cleanup(client);
+  }
+  err = download_finish(state, err);
+  free(state);
+  return err;
+}
+
+/**
+ * Download and write the image, which is decompressed if it is served
+ * compressed.
+ *
+ * @param[in] ctx The state of the download.
+ * @param[in] iterations Number of downloads.
+ *
+ * @return Number of bytes written.
+ */
+static uint64_t bench_download(void* ctx, uint64_t iterations) {
+  bench_download_t* download = ctx;
+  for (uint64_t i = 0; i < iterations; ++i) {
+    if (bench_download_once(download) != ESP_OK) {
+      abort();
+    }
+  }
+  return iterations * BENCH_IMAGE_SIZE;
+}
+
+const bench_case_t bench_update_cases[] = {
+    {
+        .name = "delta/apply",
+        .setup = bench_delta_setup,
+        .run = bench_delta_apply,
+        .teardown = free,
+    },
+    {
+        .name = "update/download",
+        .setup = bench_download_setup,
+        .run = bench_download,
+        .teardown = bench_download_teardown,
+    },
+    {
+        .name = "update/download_link",
+        .setup = bench_download_link_setup,
+        .run = bench_download,
+        .teardown = bench_download_teardown,
+    },
+    {
+        .name = "update/download_flash",
+        .setup = bench_download_flash_setup,
+        .run = bench_download,
+        .teardown = bench_download_teardown,
+    },
+    {
+        .name = "update/download_serial",
+        .setup = bench_download_serial_setup,
+        .run = bench_download,
+        .teardown = bench_download_teardown,
+    },
+#ifdef BENCH_ZLIB
+    {
+        .name = "update/download_zlib",
+        .setup = bench_download_zlib_setup,
+        .run = bench_download,
+        .teardown = bench_download_teardown,
+    },
+    {
+        .name = "update/download_zlib_link",
+        .setup = bench_download_zlib_link_setup,
+        .run = bench_download,
+        .teardown = bench_download_teardown,
+    },
+#endif
+    {0},
+};
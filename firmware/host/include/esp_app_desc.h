@@ -0,0 +1,24 @@
+#ifndef ESP_APP_DESC_H
+#define ESP_APP_DESC_H
+
+// Host shim of the ESP-IDF app description, with the layout of the device.
+
+#include <stdint.h>
+
+// Identifies the app description within an app image.
+#define ESP_APP_DESC_MAGIC_WORD 0xABCD5432
+
+typedef struct {
+  uint32_t magic_word;
+  uint32_t secure_version;
+  uint32_t reserv1[2];
+  char version[32];
+  char project_name[32];
+  char time[16];
+  char date[16];
+  char idf_ver[32];
+  uint8_t app_elf_sha256[32];
+  uint32_t reserv2[20];
+} esp_app_desc_t;
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef ESP_CPU_H
+#define ESP_CPU_H
+
+// Host shim of the ESP-IDF CPU API. The processors of the host are mapped onto
+// the cores of the ESP32.
+
+#include <stdint.h>
+
+typedef uint32_t esp_cpu_cycle_count_t;
+
+/**
+ * Get the core that runs the calling thread.
+ *
+ * @return The core, which is less than `portNUM_PROCESSORS`.
+ */
+int esp_cpu_get_core_id(void);
+
+/**
+ * Get the cycle count of the calling core, which wraps around like on the
+ * ESP32. On x86 hosts, this is the time stamp counter, which counts at a
+ * constant rate close to the nominal clock. Elsewhere, nanoseconds are
+ * counted.
+ *
+ * @return The cycle count.
+ */
+esp_cpu_cycle_count_t esp_cpu_get_cycle_count(void);
+
+#endif
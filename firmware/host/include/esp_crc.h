@@ -0,0 +1,19 @@
+#ifndef ESP_CRC_H
+#define ESP_CRC_H
+
+// Host shim of the ESP-IDF CRC functions, which are in the ROM of the ESP32.
+
+#include <stdint.h>
+
+/**
+ * Continue a little-endian CRC-32 with the polynomial 0xEDB88320.
+ *
+ * @param[in] crc The CRC of the preceding data or 0.
+ * @param[in] buf The data.
+ * @param[in] len Number of bytes in the data.
+ *
+ * @return The CRC of the preceding data and the given data.
+ */
+uint32_t esp_crc32_le(uint32_t crc, const uint8_t* buf, uint32_t len);
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef ESP_ERR_H
+#define ESP_ERR_H
+
+// Host shim of the ESP-IDF error codes. The values match ESP-IDF.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef int esp_err_t;
+
+#define ESP_OK 0
+#define ESP_FAIL -1
+
+#define ESP_ERR_NO_MEM 0x101
+#define ESP_ERR_INVALID_ARG 0x102
+#define ESP_ERR_INVALID_STATE 0x103
+#define ESP_ERR_INVALID_SIZE 0x104
+#define ESP_ERR_NOT_FOUND 0x105
+#define ESP_ERR_NOT_SUPPORTED 0x106
+#define ESP_ERR_TIMEOUT 0x107
+#define ESP_ERR_INVALID_RESPONSE 0x108
+#define ESP_ERR_INVALID_CRC 0x109
+#define ESP_ERR_INVALID_VERSION 0x10A
+#define ESP_ERR_NOT_FINISHED 0x10C
+
+#define ESP_ERR_NVS_BASE 0x1100
+#define ESP_ERR_NVS_NOT_FOUND (ESP_ERR_NVS_BASE + 0x02)
+#define ESP_ERR_OTA_BASE 0x1500
+#define ESP_ERR_HTTP_BASE 0x7000
+#define ESP_ERR_HTTP_CONNECT (ESP_ERR_HTTP_BASE + 3)
+#define ESP_ERR_HTTP_CONNECTION_CLOSED (ESP_ERR_HTTP_BASE + 8)
+
+/**
+ * Get the name of an error code.
+ *
+ * @param[in] code An error code.
+ *
+ * @return The name of the error code.
+ */
+const char* esp_err_to_name(esp_err_t code);
+
+// Abort if an expression doesn't evaluate to ESP_OK.
+#define ESP_ERROR_CHECK(x)                                              \
+  do {                                                                  \
+    esp_err_t err_rc_ = (x);                                            \
+    if (err_rc_ != ESP_OK) {                                            \
+      fprintf(stderr, "%s:%d: %s failed: %s\n", __FILE__, __LINE__, #x, \
+              esp_err_to_name(err_rc_));                                \
+      abort();                                                          \
+    }                                                                   \
+  } while (0)
+
+#endif
@@ -0,0 +1,143 @@
+#ifndef ESP_HTTP_CLIENT_H
+#define ESP_HTTP_CLIENT_H
+
+// Host shim of the ESP-IDF HTTP client. Responses are served from memory, so
+// that download paths can be measured without a network. A response is
+// registered with `esp_http_client_host_serve()` before the client is used.
+// The bodies of POST requests are handed to a receiver registered with
+// `esp_http_client_host_receive()` instead. Range requests for the rest of a
+// body, such as "bytes=1024-", are answered with 206 Partial Content.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+typedef struct esp_http_client* esp_http_client_handle_t;
+
+typedef enum {
+  HTTP_EVENT_ERROR = 0,
+  HTTP_EVENT_ON_CONNECTED,
+  HTTP_EVENT_HEADERS_SENT,
+  HTTP_EVENT_ON_HEADER,
+  HTTP_EVENT_ON_DATA,
+  HTTP_EVENT_ON_FINISH,
+  HTTP_EVENT_DISCONNECTED,
+} esp_http_client_event_id_t;
+
+typedef struct esp_http_client_event {
+  esp_http_client_event_id_t event_id;
+  esp_http_client_handle_t client;
+  void* data;
+  int data_len;
+  void* user_data;
+  char* header_key;
+  char* header_value;
+} esp_http_client_event_t;
+
+typedef esp_err_t (*http_event_handle_cb)(esp_http_client_event_t* evt);
+
+typedef enum {
+  HTTP_METHOD_GET = 0,
+  HTTP_METHOD_POST,
+} esp_http_client_method_t;
+
+typedef struct {
+  const char* url;
+  int timeout_ms;
+  const char* user_agent;
+  esp_http_client_method_t method;
+  http_event_handle_cb event_handler;
+  int buffer_size;
+  int buffer_size_tx;
+  void* user_data;
+  bool keep_alive_enable;
+  esp_err_t (*crt_bundle_attach)(void* conf);
+} esp_http_client_config_t;
+
+/**
+ * Serve a response from memory to all requests of a URL. The body must
+ * outlive all clients requesting it.
+ *
+ * @param[in] url The URL.
+ * @param[in] status The HTTP status code of the response.
+ * @param[in] body The body of the response.
+ * @param[in] length Number of bytes in the body.
+ *
+ * @return ESP_OK or ESP_ERR_NO_MEM if too many responses are served.
+ */
+esp_err_t esp_http_client_host_serve(const char* url, int status,
+                                     const void* body, size_t length);
+
+/**
+ * Receive the body of a POST request.
+ *
+ * @param[in] ctx The context passed to `esp_http_client_host_receive()`.
+ * @param[in] content_encoding The value of the Content-Encoding header or an
+ * empty string.
+ * @param[in] body The body of the request.
+ * @param[in] length Number of bytes in the body.
+ *
+ * @return The HTTP status code of the response, which has no body.
+ */
+typedef int (*esp_http_client_host_receiver_t)(void* ctx,
+                                               const char* content_encoding,
+                                               const char* body,
+                                               size_t length);
+
+/**
+ * Hand the bodies of all POST requests to a URL to a receiver, which stands
+ * in for an endpoint collecting data from the device.
+ *
+ * @param[in] url The URL.
+ * @param[in] receiver Receives the bodies.
+ * @param[in] ctx The context passed to the receiver.
+ *
+ * @return ESP_OK or ESP_ERR_NO_MEM if too many URLs are served.
+ */
+esp_err_t esp_http_client_host_receive(const char* url,
+                                       esp_http_client_host_receiver_t receiver,
+                                       void* ctx);
+
+/**
+ * Limit the rate at which the bodies of responses are received, emulating a
+ * network link, so that downloads are as long as on a device.
+ *
+ * @param[in] bytes_per_second The rate or 0 for no limit.
+ */
+void esp_http_client_host_set_rate(uint32_t bytes_per_second);
+
+/**
+ * Cut the connection after a number of bytes of every body that is received
+ * from now on, like a flaky link does. The read following the cut returns 0
+ * and sets `errno` to ECONNRESET, as on the device.
+ *
+ * @param[in] bytes Number of bytes received before the cut or 0 to never cut.
+ */
+void esp_http_client_host_set_cut(size_t bytes);
+
+esp_http_client_handle_t esp_http_client_init(
+    const esp_http_client_config_t* config);
+esp_err_t esp_http_client_cleanup(esp_http_client_handle_t client);
+esp_err_t esp_http_client_set_header(esp_http_client_handle_t client,
+                                     const char* key, const char* value);
+esp_err_t esp_http_client_get_url(esp_http_client_handle_t client, char* url,
+                                  int len);
+esp_err_t esp_http_client_set_redirection(esp_http_client_handle_t client);
+esp_err_t esp_http_client_set_method(esp_http_client_handle_t client,
+                                     esp_http_client_method_t method);
+esp_err_t esp_http_client_set_post_field(esp_http_client_handle_t client,
+                                         const char* data, int len);
+esp_err_t esp_http_client_perform(esp_http_client_handle_t client);
+esp_err_t esp_http_client_open(esp_http_client_handle_t client, int write_len);
+int64_t esp_http_client_fetch_headers(esp_http_client_handle_t client);
+int esp_http_client_read(esp_http_client_handle_t client, char* buffer,
+                         int len);
+int esp_http_client_get_status_code(esp_http_client_handle_t client);
+int64_t esp_http_client_get_content_length(esp_http_client_handle_t client);
+bool esp_http_client_is_complete_data_received(
+    esp_http_client_handle_t client);
+esp_err_t esp_http_client_close(esp_http_client_handle_t client);
+
+#endif
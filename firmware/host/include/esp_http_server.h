@@ -0,0 +1,73 @@
+#ifndef ESP_HTTP_SERVER_H
+#define ESP_HTTP_SERVER_H
+
+// Host shim of the ESP-IDF HTTP server. Only the functions used by the
+// portable modules are declared. Queries are parsed like on the device, but
+// the host has no server, so all socket operations fail.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#define ESP_ERR_HTTPD_BASE 0xb000
+#define ESP_ERR_HTTPD_RESULT_TRUNC (ESP_ERR_HTTPD_BASE + 3)
+
+#define HTTPD_SOCK_ERR_FAIL -1
+#define HTTPD_SOCK_ERR_INVALID -2
+#define HTTPD_SOCK_ERR_TIMEOUT -3
+
+typedef void* httpd_handle_t;
+
+typedef enum {
+  HTTP_DELETE = 0,
+  HTTP_GET = 1,
+  HTTP_HEAD = 2,
+  HTTP_POST = 3,
+  HTTP_PUT = 4,
+} httpd_method_t;
+
+typedef struct httpd_req {
+  httpd_handle_t handle;
+  int method;
+  const char uri[513];
+  size_t content_len;
+  void* aux;
+  void* user_ctx;
+  void* sess_ctx;
+} httpd_req_t;
+
+typedef enum {
+  HTTPD_WS_TYPE_CONTINUE = 0x0,
+  HTTPD_WS_TYPE_TEXT = 0x1,
+  HTTPD_WS_TYPE_BINARY = 0x2,
+  HTTPD_WS_TYPE_CLOSE = 0x8,
+  HTTPD_WS_TYPE_PING = 0x9,
+  HTTPD_WS_TYPE_PONG = 0xA,
+} httpd_ws_type_t;
+
+typedef struct httpd_ws_frame {
+  bool final;
+  bool fragmented;
+  httpd_ws_type_t type;
+  uint8_t* payload;
+  size_t len;
+} httpd_ws_frame_t;
+
+typedef void (*httpd_work_fn_t)(void* arg);
+
+esp_err_t httpd_query_key_value(const char* qry, const char* key, char* val,
+                                size_t val_size);
+esp_err_t httpd_req_get_url_query_str(httpd_req_t* r, char* buf,
+                                      size_t buf_len);
+int httpd_req_to_sockfd(httpd_req_t* r);
+esp_err_t httpd_ws_recv_frame(httpd_req_t* req, httpd_ws_frame_t* pkt,
+                              size_t max_len);
+int httpd_socket_send(httpd_handle_t hd, int sockfd, const char* buf,
+                      size_t buf_len, int flags);
+esp_err_t httpd_queue_work(httpd_handle_t handle, httpd_work_fn_t work,
+                           void* arg);
+esp_err_t httpd_sess_trigger_close(httpd_handle_t handle, int sockfd);
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef ESP_IMAGE_FORMAT_H
+#define ESP_IMAGE_FORMAT_H
+
+// Host shim of the ESP-IDF app image format, which parses the images in the
+// emulated partitions.
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+// The first byte of every app image.
+#define ESP_IMAGE_HEADER_MAGIC 0xE9
+// Maximum number of segments of an app image.
+#define ESP_IMAGE_MAX_SEGMENTS 16
+// Size of the SHA-256 digest appended to an app image.
+#define ESP_IMAGE_HASH_LEN 32
+
+#define ESP_ERR_IMAGE_BASE 0x2000
+#define ESP_ERR_IMAGE_INVALID (ESP_ERR_IMAGE_BASE + 2)
+
+typedef struct {
+  uint32_t offset;
+  uint32_t size;
+} esp_partition_pos_t;
+
+typedef struct __attribute__((packed)) {
+  uint8_t magic;
+  uint8_t segment_count;
+  uint8_t spi_mode;
+  uint8_t spi_speed : 4;
+  uint8_t spi_size : 4;
+  uint32_t entry_addr;
+  uint8_t wp_pin;
+  uint8_t spi_pin_drv[3];
+  uint16_t chip_id;
+  uint8_t min_chip_rev;
+  uint16_t min_chip_rev_full;
+  uint16_t max_chip_rev_full;
+  uint8_t reserved[4];
+  uint8_t hash_appended;
+} esp_image_header_t;
+
+typedef struct {
+  uint32_t load_addr;
+  uint32_t data_len;
+} esp_image_segment_header_t;
+
+typedef struct {
+  uint32_t start_addr;
+  esp_image_header_t image;
+  uint32_t image_len;
+} esp_image_metadata_t;
+
+/**
+ * Get the metadata of the app image in a partition. The length covers the
+ * segments, the padded checksum and the appended digest, if any.
+ *
+ * @param[in] part The flash address and the size of the partition.
+ * @param[out] metadata Receives the metadata.
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_ARG if no partition is at the address or
+ * ESP_ERR_IMAGE_INVALID if the partition holds no valid image.
+ */
+esp_err_t esp_image_get_metadata(const esp_partition_pos_t* part,
+                                 esp_image_metadata_t* metadata);
+
+#endif
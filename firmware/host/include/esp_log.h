@@ -0,0 +1,46 @@
+#ifndef ESP_LOG_H
+#define ESP_LOG_H
+
+// Host shim of the ESP-IDF logging, which writes to the standard error.
+
+#include <stdio.h>
+
+typedef enum {
+  ESP_LOG_NONE,
+  ESP_LOG_ERROR,
+  ESP_LOG_WARN,
+  ESP_LOG_INFO,
+  ESP_LOG_DEBUG,
+  ESP_LOG_VERBOSE,
+} esp_log_level_t;
+
+// The most verbose level that is written, which applies to all tags.
+extern esp_log_level_t esp_log_host_level;
+
+/**
+ * Set the level of all tags, as the host doesn't distinguish tags.
+ *
+ * @param[in] tag Ignored.
+ * @param[in] level The most verbose level that is written.
+ */
+void esp_log_level_set(const char* tag, esp_log_level_t level);
+
+#define ESP_LOG_LEVEL(level, letter, tag, format, ...)                \
+  do {                                                                \
+    if (esp_log_host_level >= (level)) {                              \
+      fprintf(stderr, letter " (%s) " format "\n", tag, ##__VA_ARGS__); \
+    }                                                                 \
+  } while (0)
+
+#define ESP_LOGE(tag, format, ...) \
+  ESP_LOG_LEVEL(ESP_LOG_ERROR, "E", tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) \
+  ESP_LOG_LEVEL(ESP_LOG_WARN, "W", tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) \
+  ESP_LOG_LEVEL(ESP_LOG_INFO, "I", tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) \
+  ESP_LOG_LEVEL(ESP_LOG_DEBUG, "D", tag, format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...) \
+  ESP_LOG_LEVEL(ESP_LOG_VERBOSE, "V", tag, format, ##__VA_ARGS__)
+
+#endif
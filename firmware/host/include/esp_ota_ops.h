@@ -0,0 +1,46 @@
+#ifndef ESP_OTA_OPS_H
+#define ESP_OTA_OPS_H
+
+// Host shim of the ESP-IDF OTA API, which writes to the emulated partitions.
+// Like on the device, sectors are erased as the image is written.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_app_desc.h"
+#include "esp_err.h"
+#include "esp_partition.h"
+
+#define OTA_SIZE_UNKNOWN 0xffffffff
+#define OTA_WITH_SEQUENTIAL_WRITES 0xfffffffe
+#define ESP_ERR_OTA_VALIDATE_FAILED (ESP_ERR_OTA_BASE + 0x03)
+
+typedef uint32_t esp_ota_handle_t;
+
+const esp_partition_t* esp_ota_get_running_partition(void);
+const esp_partition_t* esp_ota_get_boot_partition(void);
+const esp_partition_t* esp_ota_get_next_update_partition(
+    const esp_partition_t* start_from);
+esp_err_t esp_ota_begin(const esp_partition_t* partition, size_t image_size,
+                        esp_ota_handle_t* out_handle);
+esp_err_t esp_ota_resume(const esp_partition_t* partition, size_t erase_size,
+                         size_t image_offset, esp_ota_handle_t* out_handle);
+esp_err_t esp_ota_write(esp_ota_handle_t handle, const void* data,
+                        size_t size);
+esp_err_t esp_ota_end(esp_ota_handle_t handle);
+esp_err_t esp_ota_abort(esp_ota_handle_t handle);
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t* partition);
+
+/**
+ * Get the app description of the image in a partition, which follows the
+ * image header and the header of the first segment, like on the device.
+ *
+ * @param[in] partition The partition.
+ * @param[out] app_desc Receives the app description.
+ *
+ * @return ESP_OK or ESP_ERR_NOT_FOUND if the partition holds no app image.
+ */
+esp_err_t esp_ota_get_partition_description(const esp_partition_t* partition,
+                                            esp_app_desc_t* app_desc);
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef ESP_PARTITION_H
+#define ESP_PARTITION_H
+
+// Host shim of the ESP-IDF partition API. The partition table holds two app
+// partitions for updates, whose flash is emulated in memory.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+// Size of the emulated app partitions.
+#define ESP_PARTITION_HOST_APP_SIZE (1536 * 1024)
+
+typedef enum {
+  ESP_PARTITION_TYPE_APP = 0x00,
+  ESP_PARTITION_TYPE_DATA = 0x01,
+  ESP_PARTITION_TYPE_ANY = 0xff,
+} esp_partition_type_t;
+
+typedef enum {
+  ESP_PARTITION_SUBTYPE_APP_OTA_0 = 0x10,
+  ESP_PARTITION_SUBTYPE_APP_OTA_1 = 0x11,
+  ESP_PARTITION_SUBTYPE_ANY = 0xff,
+} esp_partition_subtype_t;
+
+typedef struct {
+  esp_partition_type_t type;
+  esp_partition_subtype_t subtype;
+  uint32_t address;
+  uint32_t size;
+  char label[17];
+} esp_partition_t;
+
+const esp_partition_t* esp_partition_find_first(esp_partition_type_t type,
+                                                esp_partition_subtype_t subtype,
+                                                const char* label);
+esp_err_t esp_partition_read(const esp_partition_t* partition,
+                             size_t src_offset, void* dst, size_t size);
+esp_err_t esp_partition_write(const esp_partition_t* partition,
+                              size_t dst_offset, const void* src, size_t size);
+esp_err_t esp_partition_erase_range(const esp_partition_t* partition,
+                                    size_t offset, size_t size);
+
+/**
+ * Emulate the latency of the flash, so that writing an image takes about as
+ * long as on a device. Reads are not delayed.
+ *
+ * @param[in] erase_us Duration of erasing a sector in microseconds.
+ * @param[in] write_us Duration of writing a KiB in microseconds.
+ */
+void esp_partition_host_set_latency(uint32_t erase_us, uint32_t write_us);
+
+#endif
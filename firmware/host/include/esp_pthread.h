@@ -0,0 +1,23 @@
+#ifndef ESP_PTHREAD_H
+#define ESP_PTHREAD_H
+
+// Host shim of the ESP-IDF thread configuration. The host ignores priorities
+// and cores, as threads are scheduled by the operating system.
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "esp_err.h"
+
+typedef struct {
+  size_t stack_size;
+  size_t prio;
+  bool inherit_cfg;
+  const char* thread_name;
+  int pin_to_core;
+} esp_pthread_cfg_t;
+
+esp_pthread_cfg_t esp_pthread_get_default_config(void);
+esp_err_t esp_pthread_set_cfg(const esp_pthread_cfg_t* cfg);
+
+#endif
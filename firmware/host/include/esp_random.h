@@ -0,0 +1,15 @@
+#ifndef ESP_RANDOM_H
+#define ESP_RANDOM_H
+
+// Host shim of the ESP-IDF random number generator.
+
+#include <stdint.h>
+
+/**
+ * Get a random number from the entropy source of the operating system.
+ *
+ * @return The random number.
+ */
+uint32_t esp_random(void);
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef ESP_SYSTEM_H
+#define ESP_SYSTEM_H
+
+// Host shim of the ESP-IDF system API.
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+typedef void (*shutdown_handler_t)(void);
+
+esp_err_t esp_register_shutdown_handler(shutdown_handler_t handler);
+esp_err_t esp_unregister_shutdown_handler(shutdown_handler_t handler);
+
+/**
+ * Run the shutdown handlers and exit the process.
+ */
+void esp_restart(void);
+
+uint32_t esp_get_free_heap_size(void);
+uint32_t esp_get_minimum_free_heap_size(void);
+
+#endif
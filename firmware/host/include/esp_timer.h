@@ -0,0 +1,15 @@
+#ifndef ESP_TIMER_H
+#define ESP_TIMER_H
+
+// Host shim of the ESP-IDF high resolution timer.
+
+#include <stdint.h>
+
+/**
+ * Get the time since the process was started.
+ *
+ * @return The time in microseconds.
+ */
+int64_t esp_timer_get_time(void);
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef FREERTOS_H
+#define FREERTOS_H
+
+// Host shim of the FreeRTOS configuration, which matches the ESP32.
+
+// Number of cores.
+#define portNUM_PROCESSORS 2
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef TASK_H
+#define TASK_H
+
+// Host shim of the FreeRTOS task API, where every thread is a task.
+
+#include "freertos/FreeRTOS.h"
+
+typedef void* TaskHandle_t;
+
+/**
+ * Get the handle of the calling task.
+ *
+ * @return The handle, which identifies the thread.
+ */
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+
+#endif
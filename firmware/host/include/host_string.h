@@ -0,0 +1,28 @@
+#ifndef HOST_STRING_H
+#define HOST_STRING_H
+
+// Declares the BSD string functions that newlib provides on the device, but
+// glibc only since version 2.38. It is included ahead of the modules using
+// them.
+
+#include <stddef.h>
+#include <string.h>
+
+#if defined(__GLIBC__) && !__GLIBC_PREREQ(2, 38)
+#define HOST_STRLCPY
+
+/**
+ * Copy a string, truncating it to fit into the destination.
+ *
+ * @param[out] dst The destination, which is always null-terminated unless its
+ * size is zero.
+ * @param[in] src The string.
+ * @param[in] size Size of the destination.
+ *
+ * @return Length of the string, which is at least the size if it was
+ * truncated.
+ */
+size_t strlcpy(char* dst, const char* src, size_t size);
+#endif
+
+#endif
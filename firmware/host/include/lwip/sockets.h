@@ -0,0 +1,14 @@
+#ifndef LWIP_SOCKETS_H
+#define LWIP_SOCKETS_H
+
+// Host shim of the lwIP sockets, whose API is that of the POSIX sockets.
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#endif
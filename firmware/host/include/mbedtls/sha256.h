@@ -0,0 +1,70 @@
+#ifndef MBEDTLS_SHA256_H
+#define MBEDTLS_SHA256_H
+
+// Host shim of the SHA-256 API of mbedTLS, which the ESP32 accelerates. Only
+// SHA-256 itself is supported, not SHA-224.
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * The state of a SHA-256 computation.
+ *
+ * @param state The intermediate hash value.
+ * @param length Number of bytes hashed so far.
+ * @param buffer The bytes of the current block that were not hashed yet.
+ */
+typedef struct mbedtls_sha256_context {
+  uint32_t state[8];
+  uint64_t length;
+  uint8_t buffer[64];
+} mbedtls_sha256_context;
+
+/**
+ * Initialize a context.
+ *
+ * @param[out] ctx The context.
+ */
+void mbedtls_sha256_init(mbedtls_sha256_context* ctx);
+
+/**
+ * Release a context.
+ *
+ * @param[in] ctx The context.
+ */
+void mbedtls_sha256_free(mbedtls_sha256_context* ctx);
+
+/**
+ * Start a computation.
+ *
+ * @param[in] ctx The context.
+ * @param[in] is224 Must be 0, as SHA-224 is not supported.
+ *
+ * @return 0 or -1 if SHA-224 is requested.
+ */
+int mbedtls_sha256_starts(mbedtls_sha256_context* ctx, int is224);
+
+/**
+ * Hash the next bytes.
+ *
+ * @param[in] ctx The context.
+ * @param[in] input The bytes.
+ * @param[in] ilen Number of bytes.
+ *
+ * @return 0.
+ */
+int mbedtls_sha256_update(mbedtls_sha256_context* ctx,
+                          const unsigned char* input, size_t ilen);
+
+/**
+ * Finish the computation.
+ *
+ * @param[in] ctx The context.
+ * @param[out] output Receives the digest of 32 bytes.
+ *
+ * @return 0.
+ */
+int mbedtls_sha256_finish(mbedtls_sha256_context* ctx,
+                          unsigned char output[32]);
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef NVS_H
+#define NVS_H
+
+// Host shim of the ESP-IDF non-volatile storage, which is kept in memory.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+typedef uint32_t nvs_handle_t;
+
+typedef enum {
+  NVS_READONLY,
+  NVS_READWRITE,
+} nvs_open_mode_t;
+
+esp_err_t nvs_open(const char* name, nvs_open_mode_t open_mode,
+                   nvs_handle_t* out_handle);
+void nvs_close(nvs_handle_t handle);
+esp_err_t nvs_commit(nvs_handle_t handle);
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char* key, void* out_value,
+                       size_t* length);
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char* key, const void* value,
+                       size_t length);
+esp_err_t nvs_get_str(nvs_handle_t handle, const char* key, char* out_value,
+                      size_t* length);
+esp_err_t nvs_set_str(nvs_handle_t handle, const char* key, const char* value);
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char* key,
+                      uint32_t* out_value);
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char* key, uint32_t value);
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char* key);
+
+/**
+ * Make writes fail from a point on, as when the device loses power. Writes are
+ * the calls of the setters and of `nvs_commit()`. If the first failing write
+ * is a setter, it leaves a torn value behind, whose second half reads as
+ * erased flash. All later writes fail without effect.
+ *
+ * @param[in] writes Number of writes that still succeed, or -1 so that all
+ * writes succeed again.
+ */
+void nvs_host_fail_after(int writes);
+
+#endif
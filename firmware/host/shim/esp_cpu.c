@@ -0,0 +1,34 @@
+#define _GNU_SOURCE
+
+#include "esp_cpu.h"
+
+#include <sched.h>
+#include <stdint.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "freertos/FreeRTOS.h"
+
+int esp_cpu_get_core_id(void) {
+#ifdef __linux__
+  int cpu = sched_getcpu();
+  if (cpu >= 0) {
+    return cpu % portNUM_PROCESSORS;
+  }
+#endif
+  return 0;
+}
+
+esp_cpu_cycle_count_t esp_cpu_get_cycle_count(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  return (esp_cpu_cycle_count_t)__rdtsc();
+#else
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (esp_cpu_cycle_count_t)((uint64_t)now.tv_sec * 1000000000ULL +
+                                 (uint64_t)now.tv_nsec);
+#endif
+}
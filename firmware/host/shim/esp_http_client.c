@@ -0,0 +1,377 @@
+#include "esp_http_client.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+// Maximum number of responses that can be served.
+#define HOST_RESPONSES 16
+// Maximum length of a URL.
+#define HOST_URL_SIZE 512
+// Maximum length of the Content-Encoding header of a request.
+#define HOST_ENCODING_SIZE 32
+// Number of bytes the link buffers while the client doesn't read, like the
+// default TCP window of lwIP.
+#define HOST_WINDOW_SIZE 5760
+
+/**
+ * A response served from memory.
+ *
+ * @param url The URL requested by the clients.
+ * @param status The HTTP status code.
+ * @param body The body.
+ * @param length Number of bytes in the body.
+ * @param receiver Receives the bodies of POST requests or NULL.
+ * @param receiver_ctx The context passed to the receiver.
+ */
+typedef struct host_response {
+  char url[HOST_URL_SIZE];
+  int status;
+  const char* body;
+  size_t length;
+  esp_http_client_host_receiver_t receiver;
+  void* receiver_ctx;
+} host_response_t;
+
+/**
+ * A client reading a response.
+ *
+ * @param config The configuration of the client.
+ * @param url The requested URL.
+ * @param response The response that is read or NULL before the request.
+ * @param range_start The first byte of the body requested by a Range header,
+ * or 0 to request the whole body.
+ * @param start Offset within the body at which the response starts.
+ * @param cut Offset within the body at which the connection is cut, or
+ * SIZE_MAX if it isn't.
+ * @param offset Offset within the body of the next byte to be read.
+ * @param arrived_ns The time at which the bytes read so far have arrived.
+ * @param method The method of the request.
+ * @param post_data The body of a POST request.
+ * @param post_length Number of bytes in the body of a POST request.
+ * @param content_encoding The Content-Encoding header of the request.
+ * @param status The status code of the response.
+ */
+struct esp_http_client {
+  esp_http_client_config_t config;
+  char url[HOST_URL_SIZE];
+  const host_response_t* response;
+  size_t range_start;
+  size_t start;
+  size_t cut;
+  size_t offset;
+  uint64_t arrived_ns;
+  esp_http_client_method_t method;
+  const char* post_data;
+  size_t post_length;
+  char content_encoding[HOST_ENCODING_SIZE];
+  int status;
+};
+
+// The responses that are served.
+static host_response_t responses[HOST_RESPONSES];
+// Number of responses that are served.
+static size_t response_count = 0;
+// Guards the responses.
+static pthread_mutex_t responses_mutex = PTHREAD_MUTEX_INITIALIZER;
+// The rate at which bodies are received in bytes per second, 0 if unlimited.
+static uint32_t rate = 0;
+// Number of bytes of a body received before the connection is cut, 0 if
+// connections are never cut.
+static size_t cut_after = 0;
+
+/**
+ * Get a monotonic time.
+ *
+ * @return The time in nanoseconds.
+ */
+static uint64_t host_now_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+/**
+ * Wait until the next bytes of the body would have arrived over a link with
+ * the configured rate. The link only runs ahead of the client by the window,
+ * so a client that stalls also stalls the transfer.
+ *
+ * @param[in] client The client.
+ * @param[in] length Number of bytes to be received.
+ */
+static void host_pace(esp_http_client_handle_t client, size_t length) {
+  if (rate == 0) {
+    return;
+  }
+  uint64_t now_ns = host_now_ns();
+  uint64_t window_ns = HOST_WINDOW_SIZE * 1000000000ULL / rate;
+  if (client->arrived_ns + window_ns < now_ns) {
+    client->arrived_ns = now_ns - window_ns;
+  }
+  client->arrived_ns += length * 1000000000ULL / rate;
+  if (client->arrived_ns > now_ns) {
+    struct timespec delay = {
+        .tv_sec = (time_t)((client->arrived_ns - now_ns) / 1000000000ULL),
+        .tv_nsec = (long)((client->arrived_ns - now_ns) % 1000000000ULL),
+    };
+    nanosleep(&delay, NULL);
+  }
+}
+
+/**
+ * Find the response to a URL.
+ *
+ * @param[in] url The URL.
+ *
+ * @return The response or NULL if the URL isn't served.
+ */
+static const host_response_t* host_find(const char* url) {
+  const host_response_t* response = NULL;
+  pthread_mutex_lock(&responses_mutex);
+  for (size_t i = 0; i < response_count; ++i) {
+    if (strcmp(responses[i].url, url) == 0) {
+      response = &responses[i];
+      break;
+    }
+  }
+  pthread_mutex_unlock(&responses_mutex);
+  return response;
+}
+
+/**
+ * Register or replace the response to a URL.
+ *
+ * @param[in] served The response, including the URL.
+ *
+ * @return ESP_OK or ESP_ERR_NO_MEM if too many responses are served.
+ */
+static esp_err_t host_register(const host_response_t* served) {
+  esp_err_t err = ESP_ERR_NO_MEM;
+  pthread_mutex_lock(&responses_mutex);
+  host_response_t* response = NULL;
+  for (size_t i = 0; i < response_count; ++i) {
+    if (strcmp(responses[i].url, served->url) == 0) {
+      response = &responses[i];
+    }
+  }
+  if (response == NULL && response_count < HOST_RESPONSES) {
+    response = &responses[response_count++];
+  }
+  if (response != NULL) {
+    *response = *served;
+    err = ESP_OK;
+  }
+  pthread_mutex_unlock(&responses_mutex);
+  return err;
+}
+
+esp_err_t esp_http_client_host_serve(const char* url, int status,
+                                     const void* body, size_t length) {
+  if (strlen(url) >= HOST_URL_SIZE) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  host_response_t response = {
+      .status = status,
+      .body = body,
+      .length = length,
+  };
+  strcpy(response.url, url);
+  return host_register(&response);
+}
+
+esp_err_t esp_http_client_host_receive(const char* url,
+                                       esp_http_client_host_receiver_t receiver,
+                                       void* ctx) {
+  if (strlen(url) >= HOST_URL_SIZE) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  host_response_t response = {
+      .receiver = receiver,
+      .receiver_ctx = ctx,
+  };
+  strcpy(response.url, url);
+  return host_register(&response);
+}
+
+void esp_http_client_host_set_rate(uint32_t bytes_per_second) {
+  rate = bytes_per_second;
+}
+
+void esp_http_client_host_set_cut(size_t bytes) { cut_after = bytes; }
+
+esp_http_client_handle_t esp_http_client_init(
+    const esp_http_client_config_t* config) {
+  if (config->url == NULL || strlen(config->url) >= HOST_URL_SIZE) {
+    return NULL;
+  }
+  esp_http_client_handle_t client = calloc(1, sizeof(*client));
+  if (client == NULL) {
+    return NULL;
+  }
+  client->config = *config;
+  strcpy(client->url, config->url);
+  client->method = config->method;
+  return client;
+}
+
+esp_err_t esp_http_client_cleanup(esp_http_client_handle_t client) {
+  free(client);
+  return ESP_OK;
+}
+
+esp_err_t esp_http_client_set_header(esp_http_client_handle_t client,
+                                     const char* key, const char* value) {
+  // Only the encoding of the body is of interest to the receivers, and only
+  // ranges up to the end of the body are supported.
+  if (strcasecmp(key, "Content-Encoding") == 0) {
+    snprintf(client->content_encoding, sizeof(client->content_encoding), "%s",
+             value);
+  } else if (strcasecmp(key, "Range") == 0) {
+    size_t range_start = 0;
+    char end = 0;
+    if (sscanf(value, "bytes=%zu%c", &range_start, &end) != 2 || end != '-') {
+      return ESP_ERR_INVALID_ARG;
+    }
+    client->range_start = range_start;
+  }
+  return ESP_OK;
+}
+
+esp_err_t esp_http_client_get_url(esp_http_client_handle_t client, char* url,
+                                  int len) {
+  if (strlen(client->url) >= (size_t)len) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+  strcpy(url, client->url);
+  return ESP_OK;
+}
+
+esp_err_t esp_http_client_set_redirection(esp_http_client_handle_t client) {
+  return ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t esp_http_client_set_method(esp_http_client_handle_t client,
+                                     esp_http_client_method_t method) {
+  client->method = method;
+  return ESP_OK;
+}
+
+esp_err_t esp_http_client_set_post_field(esp_http_client_handle_t client,
+                                         const char* data, int len) {
+  client->post_data = data;
+  client->post_length = (size_t)len;
+  return ESP_OK;
+}
+
+esp_err_t esp_http_client_perform(esp_http_client_handle_t client) {
+  esp_err_t err = esp_http_client_open(client, 0);
+  if (err != ESP_OK) {
+    return err;
+  }
+
+  const host_response_t* response = client->response;
+  if (client->method == HTTP_METHOD_POST && response->receiver != NULL) {
+    client->status =
+        response->receiver(response->receiver_ctx, client->content_encoding,
+                           client->post_data, client->post_length);
+    return ESP_OK;
+  }
+
+  // Hand the body to the event handler in chunks of the buffer size, like
+  // the device does for each received buffer.
+  int buffer_size =
+      client->config.buffer_size > 0 ? client->config.buffer_size : 512;
+  while (client->offset < response->length) {
+    size_t length = response->length - client->offset;
+    if (length > (size_t)buffer_size) {
+      length = (size_t)buffer_size;
+    }
+    host_pace(client, length);
+    if (client->config.event_handler != NULL) {
+      esp_http_client_event_t event = {
+          .event_id = HTTP_EVENT_ON_DATA,
+          .client = client,
+          .data = (void*)(response->body + client->offset),
+          .data_len = (int)length,
+          .user_data = client->config.user_data,
+      };
+      client->config.event_handler(&event);
+    }
+    client->offset += length;
+  }
+  return ESP_OK;
+}
+
+esp_err_t esp_http_client_open(esp_http_client_handle_t client, int write_len) {
+  client->response = host_find(client->url);
+  client->start = 0;
+  client->arrived_ns = host_now_ns();
+  if (client->response == NULL) {
+    return ESP_ERR_HTTP_CONNECT;
+  }
+  client->status = client->response->status;
+  if (client->status == 200 && client->range_start > 0 &&
+      client->range_start < client->response->length) {
+    client->status = 206;
+    client->start = client->range_start;
+  }
+  client->offset = client->start;
+  client->cut = cut_after > 0 ? client->start + cut_after : SIZE_MAX;
+  return ESP_OK;
+}
+
+int64_t esp_http_client_fetch_headers(esp_http_client_handle_t client) {
+  return client->response != NULL
+             ? (int64_t)(client->response->length - client->start)
+             : -1;
+}
+
+int esp_http_client_read(esp_http_client_handle_t client, char* buffer,
+                         int len) {
+  if (client->response == NULL) {
+    return -1;
+  }
+  if (client->offset >= client->cut &&
+      client->offset < client->response->length) {
+    errno = ECONNRESET;
+    return 0;
+  }
+  size_t end = client->response->length < client->cut ? client->response->length
+                                                       : client->cut;
+  size_t length = end - client->offset;
+  if (length > (size_t)len) {
+    length = (size_t)len;
+  }
+  host_pace(client, length);
+  memcpy(buffer, client->response->body + client->offset, length);
+  client->offset += length;
+  return (int)length;
+}
+
+int esp_http_client_get_status_code(esp_http_client_handle_t client) {
+  return client->response != NULL ? client->status : -1;
+}
+
+int64_t esp_http_client_get_content_length(esp_http_client_handle_t client) {
+  return esp_http_client_fetch_headers(client);
+}
+
+bool esp_http_client_is_complete_data_received(
+    esp_http_client_handle_t client) {
+  return client->response != NULL &&
+         client->offset == client->response->length;
+}
+
+esp_err_t esp_http_client_close(esp_http_client_handle_t client) {
+  client->response = NULL;
+  return ESP_OK;
+}
@@ -0,0 +1,68 @@
+#include "esp_http_server.h"
+
+#include <stddef.h>
+#include <string.h>
+
+esp_err_t httpd_query_key_value(const char* qry, const char* key, char* val,
+                                size_t val_size) {
+  if (qry == NULL || key == NULL || val == NULL) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  size_t key_length = strlen(key);
+  const char* cursor = qry;
+  while (*cursor != 0) {
+    const char* end = strchr(cursor, '&');
+    if (end == NULL) {
+      end = cursor + strlen(cursor);
+    }
+    if (strncmp(cursor, key, key_length) == 0 && cursor[key_length] == '=') {
+      const char* value = cursor + key_length + 1;
+      size_t length = (size_t)(end - value);
+      if (val_size == 0) {
+        return ESP_ERR_HTTPD_RESULT_TRUNC;
+      }
+      // Like on the device, the value is truncated to fit the buffer.
+      size_t copied = length < val_size ? length : val_size - 1;
+      memcpy(val, value, copied);
+      val[copied] = 0;
+      return copied < length ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+    }
+    cursor = *end == 0 ? end : end + 1;
+  }
+  return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t httpd_req_get_url_query_str(httpd_req_t* r, char* buf,
+                                      size_t buf_len) {
+  const char* query = strchr(r->uri, '?');
+  if (query == NULL) {
+    return ESP_ERR_NOT_FOUND;
+  }
+  if (strlen(query + 1) >= buf_len) {
+    return ESP_ERR_HTTPD_RESULT_TRUNC;
+  }
+  strcpy(buf, query + 1);
+  return ESP_OK;
+}
+
+int httpd_req_to_sockfd(httpd_req_t* r) { return -1; }
+
+esp_err_t httpd_ws_recv_frame(httpd_req_t* req, httpd_ws_frame_t* pkt,
+                              size_t max_len) {
+  return ESP_ERR_INVALID_STATE;
+}
+
+int httpd_socket_send(httpd_handle_t hd, int sockfd, const char* buf,
+                      size_t buf_len, int flags) {
+  return HTTPD_SOCK_ERR_INVALID;
+}
+
+esp_err_t httpd_queue_work(httpd_handle_t handle, httpd_work_fn_t work,
+                           void* arg) {
+  return ESP_ERR_INVALID_STATE;
+}
+
+esp_err_t httpd_sess_trigger_close(httpd_handle_t handle, int sockfd) {
+  return ESP_ERR_INVALID_STATE;
+}
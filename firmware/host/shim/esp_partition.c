@@ -0,0 +1,326 @@
+#include "esp_partition.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "esp_app_desc.h"
+#include "esp_image_format.h"
+#include "esp_ota_ops.h"
+
+// Size of a flash sector, which is the smallest unit that can be erased.
+#define HOST_SECTOR_SIZE 4096
+// Number of emulated partitions.
+#define HOST_PARTITIONS 2
+
+/**
+ * An OTA update in progress.
+ *
+ * @param partition The partition that is written.
+ * @param offset Number of bytes written.
+ * @param erased Number of bytes at the beginning that were erased.
+ * @param sequential Indicates that sectors are erased as they are written.
+ */
+typedef struct host_ota {
+  const esp_partition_t* partition;
+  size_t offset;
+  size_t erased;
+  bool sequential;
+} host_ota_t;
+
+// The app partitions, of which the first one is running.
+static const esp_partition_t partitions[HOST_PARTITIONS] = {
+    {
+        .type = ESP_PARTITION_TYPE_APP,
+        .subtype = ESP_PARTITION_SUBTYPE_APP_OTA_0,
+        .address = 0x10000,
+        .size = ESP_PARTITION_HOST_APP_SIZE,
+        .label = "ota_0",
+    },
+    {
+        .type = ESP_PARTITION_TYPE_APP,
+        .subtype = ESP_PARTITION_SUBTYPE_APP_OTA_1,
+        .address = 0x10000 + ESP_PARTITION_HOST_APP_SIZE,
+        .size = ESP_PARTITION_HOST_APP_SIZE,
+        .label = "ota_1",
+    },
+};
+// The flash of the partitions, which is allocated when first accessed.
+static uint8_t* flash[HOST_PARTITIONS];
+// The partition that is booted after a restart.
+static const esp_partition_t* boot = &partitions[0];
+// The update in progress.
+static host_ota_t ota;
+// Duration of erasing a sector in microseconds.
+static uint32_t erase_latency_us = 0;
+// Duration of writing a KiB in microseconds.
+static uint32_t write_latency_us = 0;
+
+/**
+ * Wait like the flash does for an operation.
+ *
+ * @param[in] delay_us The duration of the operation in microseconds.
+ */
+static void host_delay(uint64_t delay_us) {
+  if (delay_us == 0) {
+    return;
+  }
+  struct timespec delay = {
+      .tv_sec = (time_t)(delay_us / 1000000),
+      .tv_nsec = (long)(delay_us % 1000000 * 1000),
+  };
+  nanosleep(&delay, NULL);
+}
+
+/**
+ * Get the flash of a partition.
+ *
+ * @param[in] partition The partition.
+ *
+ * @return The flash or NULL if the partition is unknown or can't be allocated.
+ */
+static uint8_t* host_flash(const esp_partition_t* partition) {
+  ptrdiff_t index = partition - partitions;
+  if (index < 0 || index >= HOST_PARTITIONS) {
+    return NULL;
+  }
+  if (flash[index] == NULL) {
+    flash[index] = malloc(partition->size);
+    if (flash[index] != NULL) {
+      memset(flash[index], 0xff, partition->size);
+    }
+  }
+  return flash[index];
+}
+
+const esp_partition_t* esp_partition_find_first(esp_partition_type_t type,
+                                                esp_partition_subtype_t subtype,
+                                                const char* label) {
+  for (size_t i = 0; i < HOST_PARTITIONS; ++i) {
+    const esp_partition_t* partition = &partitions[i];
+    if ((type == ESP_PARTITION_TYPE_ANY || type == partition->type) &&
+        (subtype == ESP_PARTITION_SUBTYPE_ANY ||
+         subtype == partition->subtype) &&
+        (label == NULL || strcmp(label, partition->label) == 0)) {
+      return partition;
+    }
+  }
+  return NULL;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t* partition,
+                             size_t src_offset, void* dst, size_t size) {
+  uint8_t* data = host_flash(partition);
+  if (data == NULL) {
+    return ESP_ERR_NO_MEM;
+  }
+  if (src_offset > partition->size || size > partition->size - src_offset) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+  memcpy(dst, data + src_offset, size);
+  return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t* partition,
+                              size_t dst_offset, const void* src, size_t size) {
+  uint8_t* data = host_flash(partition);
+  if (data == NULL) {
+    return ESP_ERR_NO_MEM;
+  }
+  if (dst_offset > partition->size || size > partition->size - dst_offset) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+  host_delay((uint64_t)size * write_latency_us / 1024);
+  // Like NOR flash, writing can only clear bits.
+  const uint8_t* bytes = src;
+  for (size_t i = 0; i < size; ++i) {
+    data[dst_offset + i] &= bytes[i];
+  }
+  return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t* partition,
+                                    size_t offset, size_t size) {
+  uint8_t* data = host_flash(partition);
+  if (data == NULL) {
+    return ESP_ERR_NO_MEM;
+  }
+  if (offset % HOST_SECTOR_SIZE != 0 || size % HOST_SECTOR_SIZE != 0) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (offset > partition->size || size > partition->size - offset) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+  host_delay((uint64_t)size / HOST_SECTOR_SIZE * erase_latency_us);
+  memset(data + offset, 0xff, size);
+  return ESP_OK;
+}
+
+void esp_partition_host_set_latency(uint32_t erase_us, uint32_t write_us) {
+  erase_latency_us = erase_us;
+  write_latency_us = write_us;
+}
+
+const esp_partition_t* esp_ota_get_running_partition(void) {
+  return &partitions[0];
+}
+
+const esp_partition_t* esp_ota_get_boot_partition(void) { return boot; }
+
+const esp_partition_t* esp_ota_get_next_update_partition(
+    const esp_partition_t* start_from) {
+  if (start_from == NULL) {
+    start_from = esp_ota_get_running_partition();
+  }
+  return start_from == &partitions[0] ? &partitions[1] : &partitions[0];
+}
+
+esp_err_t esp_ota_begin(const esp_partition_t* partition, size_t image_size,
+                        esp_ota_handle_t* out_handle) {
+  if (partition == NULL || partition == esp_ota_get_running_partition()) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (ota.partition != NULL) {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  ota.partition = partition;
+  ota.offset = 0;
+  ota.erased = 0;
+  ota.sequential = image_size == OTA_WITH_SEQUENTIAL_WRITES;
+  if (!ota.sequential) {
+    size_t size = image_size == OTA_SIZE_UNKNOWN ? partition->size
+                                                 : image_size;
+    size = (size + HOST_SECTOR_SIZE - 1) / HOST_SECTOR_SIZE * HOST_SECTOR_SIZE;
+    esp_err_t err = esp_partition_erase_range(partition, 0, size);
+    if (err != ESP_OK) {
+      ota.partition = NULL;
+      return err;
+    }
+    ota.erased = size;
+  }
+  *out_handle = 1;
+  return ESP_OK;
+}
+
+esp_err_t esp_ota_resume(const esp_partition_t* partition, size_t erase_size,
+                         size_t image_offset, esp_ota_handle_t* out_handle) {
+  if (erase_size != OTA_WITH_SEQUENTIAL_WRITES || image_offset == 0 ||
+      image_offset >= partition->size) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  // Only sequential writes are emulated. The sector holding the offset was
+  // erased as a whole when the interrupted update first wrote to it.
+  esp_err_t err = esp_ota_begin(partition, erase_size, out_handle);
+  if (err != ESP_OK) {
+    return err;
+  }
+  ota.offset = image_offset;
+  ota.erased = (image_offset + HOST_SECTOR_SIZE - 1) / HOST_SECTOR_SIZE *
+               HOST_SECTOR_SIZE;
+  return ESP_OK;
+}
+
+esp_err_t esp_ota_write(esp_ota_handle_t handle, const void* data,
+                        size_t size) {
+  if (handle != 1 || ota.partition == NULL) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  while (ota.sequential && ota.offset + size > ota.erased) {
+    esp_err_t err =
+        esp_partition_erase_range(ota.partition, ota.erased, HOST_SECTOR_SIZE);
+    if (err != ESP_OK) {
+      return err;
+    }
+    ota.erased += HOST_SECTOR_SIZE;
+  }
+
+  esp_err_t err = esp_partition_write(ota.partition, ota.offset, data, size);
+  if (err == ESP_OK) {
+    ota.offset += size;
+  }
+  return err;
+}
+
+esp_err_t esp_ota_end(esp_ota_handle_t handle) {
+  if (handle != 1 || ota.partition == NULL) {
+    return ESP_ERR_NOT_FOUND;
+  }
+  ota.partition = NULL;
+  return ESP_OK;
+}
+
+esp_err_t esp_ota_abort(esp_ota_handle_t handle) { return esp_ota_end(handle); }
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t* partition) {
+  if (host_flash(partition) == NULL) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  boot = partition;
+  return ESP_OK;
+}
+
+esp_err_t esp_ota_get_partition_description(const esp_partition_t* partition,
+                                            esp_app_desc_t* app_desc) {
+  // The description is at the start of the first segment.
+  size_t offset =
+      sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t);
+  esp_err_t err =
+      esp_partition_read(partition, offset, app_desc, sizeof(*app_desc));
+  if (err != ESP_OK) {
+    return err;
+  }
+  return app_desc->magic_word == ESP_APP_DESC_MAGIC_WORD ? ESP_OK
+                                                         : ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t esp_image_get_metadata(const esp_partition_pos_t* part,
+                                 esp_image_metadata_t* metadata) {
+  const esp_partition_t* partition = NULL;
+  for (size_t i = 0; i < HOST_PARTITIONS; ++i) {
+    if (partitions[i].address == part->offset) {
+      partition = &partitions[i];
+    }
+  }
+  if (partition == NULL) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  memset(metadata, 0, sizeof(*metadata));
+  metadata->start_addr = part->offset;
+  esp_err_t err = esp_partition_read(partition, 0, &metadata->image,
+                                     sizeof(metadata->image));
+  if (err != ESP_OK) {
+    return err;
+  }
+  if (metadata->image.magic != ESP_IMAGE_HEADER_MAGIC ||
+      metadata->image.segment_count > ESP_IMAGE_MAX_SEGMENTS) {
+    return ESP_ERR_IMAGE_INVALID;
+  }
+
+  uint32_t length = sizeof(esp_image_header_t);
+  for (uint8_t i = 0; i < metadata->image.segment_count; ++i) {
+    esp_image_segment_header_t segment;
+    if (esp_partition_read(partition, length, &segment, sizeof(segment)) !=
+            ESP_OK ||
+        segment.data_len > part->size - length - sizeof(segment)) {
+      return ESP_ERR_IMAGE_INVALID;
+    }
+    length += sizeof(segment) + segment.data_len;
+  }
+  // The checksum byte is padded, so that the image ends at a 16 B boundary.
+  length = (length + 1 + 15) / 16 * 16;
+  if (metadata->image.hash_appended) {
+    length += ESP_IMAGE_HASH_LEN;
+  }
+  if (length > part->size) {
+    return ESP_ERR_IMAGE_INVALID;
+  }
+  metadata->image_len = length;
+
+  return ESP_OK;
+}
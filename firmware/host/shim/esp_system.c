@@ -0,0 +1,152 @@
+#include "esp_system.h"
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/random.h>
+#include <time.h>
+
+#include "esp_err.h"
+#include "esp_image_format.h"
+#include "esp_log.h"
+#include "esp_pthread.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+
+// Maximum number of shutdown handlers, like on the device.
+#define SHUTDOWN_HANDLERS_NO 5
+
+/**
+ * Associates an error code with its name.
+ *
+ * @param code The error code.
+ * @param name The name of the error code.
+ */
+typedef struct esp_err_name {
+  esp_err_t code;
+  const char* name;
+} esp_err_name_t;
+
+// The names of the error codes used by the portable modules.
+static const esp_err_name_t err_names[] = {
+    {ESP_OK, "ESP_OK"},
+    {ESP_FAIL, "ESP_FAIL"},
+    {ESP_ERR_NO_MEM, "ESP_ERR_NO_MEM"},
+    {ESP_ERR_INVALID_ARG, "ESP_ERR_INVALID_ARG"},
+    {ESP_ERR_INVALID_STATE, "ESP_ERR_INVALID_STATE"},
+    {ESP_ERR_INVALID_SIZE, "ESP_ERR_INVALID_SIZE"},
+    {ESP_ERR_NOT_FOUND, "ESP_ERR_NOT_FOUND"},
+    {ESP_ERR_NOT_SUPPORTED, "ESP_ERR_NOT_SUPPORTED"},
+    {ESP_ERR_TIMEOUT, "ESP_ERR_TIMEOUT"},
+    {ESP_ERR_INVALID_RESPONSE, "ESP_ERR_INVALID_RESPONSE"},
+    {ESP_ERR_INVALID_CRC, "ESP_ERR_INVALID_CRC"},
+    {ESP_ERR_INVALID_VERSION, "ESP_ERR_INVALID_VERSION"},
+    {ESP_ERR_NOT_FINISHED, "ESP_ERR_NOT_FINISHED"},
+    {ESP_ERR_NVS_NOT_FOUND, "ESP_ERR_NVS_NOT_FOUND"},
+    {ESP_ERR_HTTP_CONNECT, "ESP_ERR_HTTP_CONNECT"},
+    {ESP_ERR_HTTP_CONNECTION_CLOSED, "ESP_ERR_HTTP_CONNECTION_CLOSED"},
+    {ESP_ERR_IMAGE_INVALID, "ESP_ERR_IMAGE_INVALID"},
+};
+
+// Messages below this level are not logged, which keeps benchmarks quiet.
+esp_log_level_t esp_log_host_level = ESP_LOG_WARN;
+
+// The time at which the process was started.
+static struct timespec timer_start;
+
+// The registered shutdown handlers.
+static shutdown_handler_t shutdown_handlers[SHUTDOWN_HANDLERS_NO];
+// Guards the shutdown handlers.
+static pthread_mutex_t shutdown_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+const char* esp_err_to_name(esp_err_t code) {
+  for (size_t i = 0; i < sizeof(err_names) / sizeof(err_names[0]); ++i) {
+    if (err_names[i].code == code) {
+      return err_names[i].name;
+    }
+  }
+  return "UNKNOWN ERROR";
+}
+
+void esp_log_level_set(const char* tag, esp_log_level_t level) {
+  esp_log_host_level = level;
+}
+
+/**
+ * Record the time at which the process was started.
+ */
+__attribute__((constructor)) static void esp_timer_host_init(void) {
+  clock_gettime(CLOCK_MONOTONIC, &timer_start);
+}
+
+int64_t esp_timer_get_time(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (int64_t)(now.tv_sec - timer_start.tv_sec) * 1000000 +
+         (now.tv_nsec - timer_start.tv_nsec) / 1000;
+}
+
+esp_pthread_cfg_t esp_pthread_get_default_config(void) {
+  esp_pthread_cfg_t cfg = {
+      .stack_size = 3072,
+      .prio = 5,
+      .inherit_cfg = false,
+      .thread_name = NULL,
+      .pin_to_core = -1,
+  };
+  return cfg;
+}
+
+esp_err_t esp_pthread_set_cfg(const esp_pthread_cfg_t* cfg) { return ESP_OK; }
+
+esp_err_t esp_register_shutdown_handler(shutdown_handler_t handler) {
+  esp_err_t err = ESP_ERR_NO_MEM;
+  pthread_mutex_lock(&shutdown_mutex);
+  for (size_t i = 0; i < SHUTDOWN_HANDLERS_NO; ++i) {
+    if (shutdown_handlers[i] == handler) {
+      err = ESP_ERR_INVALID_STATE;
+      break;
+    }
+    if (shutdown_handlers[i] == NULL) {
+      shutdown_handlers[i] = handler;
+      err = ESP_OK;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&shutdown_mutex);
+  return err;
+}
+
+esp_err_t esp_unregister_shutdown_handler(shutdown_handler_t handler) {
+  esp_err_t err = ESP_ERR_INVALID_STATE;
+  pthread_mutex_lock(&shutdown_mutex);
+  for (size_t i = 0; i < SHUTDOWN_HANDLERS_NO; ++i) {
+    if (shutdown_handlers[i] == handler) {
+      shutdown_handlers[i] = NULL;
+      err = ESP_OK;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&shutdown_mutex);
+  return err;
+}
+
+void esp_restart(void) {
+  for (size_t i = SHUTDOWN_HANDLERS_NO; i > 0; --i) {
+    if (shutdown_handlers[i - 1] != NULL) {
+      shutdown_handlers[i - 1]();
+    }
+  }
+  exit(0);
+}
+
+uint32_t esp_get_free_heap_size(void) { return 0; }
+
+uint32_t esp_get_minimum_free_heap_size(void) { return 0; }
+
+uint32_t esp_random(void) {
+  uint32_t value = 0;
+  getentropy(&value, sizeof(value));
+  return value;
+}
@@ -0,0 +1,7 @@
+#include <pthread.h>
+
+#include "freertos/task.h"
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+  return (TaskHandle_t)pthread_self();
+}
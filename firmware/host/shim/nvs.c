@@ -0,0 +1,255 @@
+#include "nvs.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Maximum number of namespaces.
+#define NVS_HOST_NAMESPACES 8
+// Maximum number of entries.
+#define NVS_HOST_ENTRIES 64
+// Maximum length of a namespace or a key, like on the device.
+#define NVS_HOST_KEY_SIZE 16
+// Value of the remaining writes once a write was interrupted, after which
+// writes fail without effect.
+#define NVS_HOST_POWER_LOST -2
+
+/**
+ * An entry of the storage.
+ *
+ * @param namespace_index Index of the namespace or -1 if the entry is unused.
+ * @param key The key of the entry.
+ * @param value The value of the entry.
+ * @param length Number of bytes in the value.
+ */
+typedef struct nvs_host_entry {
+  int namespace_index;
+  char key[NVS_HOST_KEY_SIZE];
+  void* value;
+  size_t length;
+} nvs_host_entry_t;
+
+// The names of the namespaces.
+static char namespaces[NVS_HOST_NAMESPACES][NVS_HOST_KEY_SIZE];
+// The entries of all namespaces.
+static nvs_host_entry_t entries[NVS_HOST_ENTRIES];
+// Number of writes that still succeed, -1 if all writes succeed or
+// NVS_HOST_POWER_LOST once a write was interrupted.
+static int writes_left = -1;
+// Guards the storage.
+static pthread_mutex_t nvs_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Find an entry. The caller must hold the mutex.
+ *
+ * @param[in] handle The handle of the namespace.
+ * @param[in] key The key of the entry.
+ * @param[in] create Indicates that a missing entry is created.
+ *
+ * @return The entry or NULL if it doesn't exist or can't be created.
+ */
+static nvs_host_entry_t* nvs_host_find(nvs_handle_t handle, const char* key,
+                                       bool create) {
+  nvs_host_entry_t* unused = NULL;
+  for (size_t i = 0; i < NVS_HOST_ENTRIES; ++i) {
+    nvs_host_entry_t* entry = &entries[i];
+    if (entry->value != NULL && entry->namespace_index == (int)handle &&
+        strcmp(entry->key, key) == 0) {
+      return entry;
+    }
+    if (entry->value == NULL && unused == NULL) {
+      unused = entry;
+    }
+  }
+
+  if (!create || unused == NULL || strlen(key) >= NVS_HOST_KEY_SIZE) {
+    return NULL;
+  }
+  unused->namespace_index = (int)handle;
+  strcpy(unused->key, key);
+  return unused;
+}
+
+/**
+ * Count a write against the writes that still succeed. The caller must hold
+ * the mutex.
+ *
+ * @return ESP_OK if the write succeeds, ESP_ERR_INVALID_STATE if it is
+ * interrupted or ESP_FAIL if writes fail without effect.
+ */
+static esp_err_t nvs_host_write(void) {
+  if (writes_left == NVS_HOST_POWER_LOST) {
+    return ESP_FAIL;
+  }
+  if (writes_left == 0) {
+    writes_left = NVS_HOST_POWER_LOST;
+    return ESP_ERR_INVALID_STATE;
+  }
+  if (writes_left > 0) {
+    writes_left -= 1;
+  }
+  return ESP_OK;
+}
+
+/**
+ * Read the value of an entry.
+ *
+ * @param[in] handle The handle of the namespace.
+ * @param[in] key The key of the entry.
+ * @param[out] value Buffer receiving the value or NULL to query the length.
+ * @param[in,out] length Size of the buffer. Receives the length of the value.
+ *
+ * @return ESP_OK, ESP_ERR_NVS_NOT_FOUND or ESP_ERR_INVALID_SIZE if the buffer
+ * is too small.
+ */
+static esp_err_t nvs_host_get(nvs_handle_t handle, const char* key,
+                              void* value, size_t* length) {
+  esp_err_t err = ESP_OK;
+  pthread_mutex_lock(&nvs_mutex);
+  nvs_host_entry_t* entry = nvs_host_find(handle, key, false);
+  if (entry == NULL) {
+    err = ESP_ERR_NVS_NOT_FOUND;
+  } else if (value != NULL && *length < entry->length) {
+    err = ESP_ERR_INVALID_SIZE;
+  } else {
+    if (value != NULL) {
+      memcpy(value, entry->value, entry->length);
+    }
+    *length = entry->length;
+  }
+  pthread_mutex_unlock(&nvs_mutex);
+  return err;
+}
+
+/**
+ * Write the value of an entry.
+ *
+ * @param[in] handle The handle of the namespace.
+ * @param[in] key The key of the entry.
+ * @param[in] value The value.
+ * @param[in] length Number of bytes in the value.
+ *
+ * @return ESP_OK, ESP_ERR_NO_MEM if the storage is full or ESP_FAIL if writes
+ * fail and the value was torn.
+ */
+static esp_err_t nvs_host_set(nvs_handle_t handle, const char* key,
+                              const void* value, size_t length) {
+  // Allocate at least one byte, as an unused entry has no value.
+  void* copy = malloc(length > 0 ? length : 1);
+  if (copy == NULL) {
+    return ESP_ERR_NO_MEM;
+  }
+  memcpy(copy, value, length);
+
+  pthread_mutex_lock(&nvs_mutex);
+  esp_err_t err = nvs_host_write();
+  if (err == ESP_FAIL) {
+    pthread_mutex_unlock(&nvs_mutex);
+    free(copy);
+    return err;
+  }
+  if (err != ESP_OK) {
+    // The write was interrupted halfway, leaving the rest erased.
+    memset((uint8_t*)copy + length / 2, 0xff, length - length / 2);
+  }
+  nvs_host_entry_t* entry = nvs_host_find(handle, key, true);
+  if (entry != NULL) {
+    free(entry->value);
+    entry->value = copy;
+    entry->length = length;
+  }
+  pthread_mutex_unlock(&nvs_mutex);
+
+  if (entry == NULL) {
+    free(copy);
+    return ESP_ERR_NO_MEM;
+  }
+  return err == ESP_OK ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t nvs_open(const char* name, nvs_open_mode_t open_mode,
+                   nvs_handle_t* out_handle) {
+  if (strlen(name) >= NVS_HOST_KEY_SIZE) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  esp_err_t err = ESP_ERR_NO_MEM;
+  pthread_mutex_lock(&nvs_mutex);
+  for (size_t i = 0; i < NVS_HOST_NAMESPACES; ++i) {
+    if (namespaces[i][0] == 0) {
+      // Like on the device, namespaces are only created when writing.
+      if (open_mode == NVS_READONLY) {
+        err = ESP_ERR_NVS_NOT_FOUND;
+        break;
+      }
+      strcpy(namespaces[i], name);
+    }
+    if (strcmp(namespaces[i], name) == 0) {
+      *out_handle = (nvs_handle_t)i;
+      err = ESP_OK;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&nvs_mutex);
+  return err;
+}
+
+void nvs_close(nvs_handle_t handle) {}
+
+esp_err_t nvs_commit(nvs_handle_t handle) {
+  pthread_mutex_lock(&nvs_mutex);
+  esp_err_t err = nvs_host_write();
+  pthread_mutex_unlock(&nvs_mutex);
+  return err == ESP_OK ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char* key, void* out_value,
+                       size_t* length) {
+  return nvs_host_get(handle, key, out_value, length);
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char* key, const void* value,
+                       size_t length) {
+  return nvs_host_set(handle, key, value, length);
+}
+
+esp_err_t nvs_get_str(nvs_handle_t handle, const char* key, char* out_value,
+                      size_t* length) {
+  return nvs_host_get(handle, key, out_value, length);
+}
+
+esp_err_t nvs_set_str(nvs_handle_t handle, const char* key, const char* value) {
+  return nvs_host_set(handle, key, value, strlen(value) + 1);
+}
+
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char* key,
+                      uint32_t* out_value) {
+  size_t length = sizeof(*out_value);
+  return nvs_host_get(handle, key, out_value, &length);
+}
+
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char* key, uint32_t value) {
+  return nvs_host_set(handle, key, &value, sizeof(value));
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char* key) {
+  esp_err_t err = ESP_ERR_NVS_NOT_FOUND;
+  pthread_mutex_lock(&nvs_mutex);
+  nvs_host_entry_t* entry = nvs_host_find(handle, key, false);
+  if (entry != NULL) {
+    free(entry->value);
+    entry->value = NULL;
+    err = ESP_OK;
+  }
+  pthread_mutex_unlock(&nvs_mutex);
+  return err;
+}
+
+void nvs_host_fail_after(int writes) {
+  pthread_mutex_lock(&nvs_mutex);
+  writes_left = writes;
+  pthread_mutex_unlock(&nvs_mutex);
+}
@@ -0,0 +1,16 @@
+#include "host_string.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#ifdef HOST_STRLCPY
+size_t strlcpy(char* dst, const char* src, size_t size) {
+  size_t length = strlen(src);
+  if (size > 0) {
+    size_t copied = length < size ? length : size - 1;
+    memcpy(dst, src, copied);
+    dst[copied] = 0;
+  }
+  return length;
+}
+#endif
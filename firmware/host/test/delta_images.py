@@ -0,0 +1,97 @@
+#!/usr/bin/env python3
+"""Create two releases of a firmware image and the patch between them.
+
+The host tests apply the patch with firmware/main/delta.c and expect the newer
+image byte for byte, so that patches created by tools/delta.py are known to
+work on the device. The images are made-up, but are laid out like app images
+and change like a release does: code is inserted, removed and moved, constants
+change and the version is bumped.
+
+Usage:
+    delta_images.py DELTA OUTPUT_DIR
+"""
+
+import argparse
+import importlib.util
+import os
+import random
+import struct
+
+# Size of the base image, which is large enough for multi-byte varints.
+IMAGE_SIZE = 96 * 1024 + 37
+# Number of distinct instructions, so that the code repeats like real code.
+VOCABULARY = 512
+
+
+def load_delta(path):
+    """Import tools/delta.py, which is not a package."""
+    spec = importlib.util.spec_from_file_location("delta", path)
+    module = importlib.util.module_from_spec(spec)
+    spec.loader.exec_module(module)
+    return module
+
+
+def image(rng, version, code):
+    """Return an app image with a header, an app description and code."""
+    # Image header without an appended digest, followed by a segment header.
+    header = bytes([0xE9, 1, 2, 0x20]) + bytes(19) + bytes([0])
+    segment = struct.pack("<II", 0x3F400020, len(code))
+    desc = struct.pack("<II8x", 0xABCD5432, 0) + version.ljust(32, b"\0")
+    padding = bytes(rng.getrandbits(8) for _ in range(208))
+    return header + segment + desc + padding + code
+
+
+def base_code(rng):
+    """Return code made up of instructions of a small vocabulary."""
+    words = [rng.getrandbits(24).to_bytes(3, "little") for _ in range(VOCABULARY)]
+    code = bytearray()
+    while len(code) < IMAGE_SIZE:
+        code += rng.choice(words)
+    return bytes(code[:IMAGE_SIZE])
+
+
+def target_code(rng, code):
+    """Return the code of the next release."""
+    code = bytearray(code)
+    # A function grew and everything after it moved.
+    code[20000:20000] = bytes(rng.getrandbits(8) for _ in range(1500))
+    # A function was removed.
+    del code[50000:53000]
+    # A block of code moved towards the beginning.
+    moved = code[70000:74000]
+    del code[70000:74000]
+    code[8000:8000] = moved
+    # Constants changed all over the image.
+    for pos in rng.sample(range(len(code)), 200):
+        code[pos] ^= 0xFF
+    # New code was appended.
+    code += bytes(rng.getrandbits(8) for _ in range(2049))
+    return bytes(code)
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter
+    )
+    parser.add_argument("delta", help="path of tools/delta.py")
+    parser.add_argument("output", help="directory receiving the files")
+    args = parser.parse_args()
+
+    delta = load_delta(args.delta)
+    rng = random.Random(3)
+    code = base_code(rng)
+    base = image(rng, b"v1.4.0", code)
+    target = image(rng, b"v1.5.0", target_code(rng, code))
+    patch = delta.diff(base, target)
+    if delta.apply(base, patch) != target:
+        raise SystemExit("%s: round trip failed" % args.delta)
+
+    os.makedirs(args.output, exist_ok=True)
+    files = (("base.bin", base), ("target.bin", target), ("patch.bin", patch))
+    for name, data in files:
+        with open(os.path.join(args.output, name), "wb") as file:
+            file.write(data)
+
+
+if __name__ == "__main__":
+    main()
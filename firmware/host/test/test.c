@@ -0,0 +1,82 @@
+#include "test.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_log.h"
+
+// All suites of tests.
+static const test_case_t* const suites[] = {
+    test_decode_cases,
+    test_dsp_cases,
+    test_energy_cases,
+    test_health_cases,
+    test_metrics_cases,
+    test_peer_cases,
+    test_relay_cases,
+    test_update_cases,
+    test_verify_cases,
+    test_writer_cases,
+};
+
+void test_fail(const char* file, int line, const char* condition) {
+  fprintf(stderr, "%s:%d: check failed: %s\n", file, line, condition);
+}
+
+/**
+ * Print the usage of the program.
+ *
+ * @param[in] program The name of the program.
+ */
+static void test_usage(const char* program) {
+  fprintf(stderr,
+          "Usage: %s [--filter TEXT] [--list] [--verbose]\n"
+          "\n"
+          "Run the tests of the firmware modules whose name contains the\n"
+          "filter. The exit status is 1 if any test failed. The log of the\n"
+          "modules is only written if verbose, as many tests provoke errors.\n",
+          program);
+}
+
+int main(int argc, char* argv[]) {
+  const char* filter = "";
+  bool list = false;
+  esp_log_host_level = ESP_LOG_NONE;
+
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+      filter = argv[++i];
+    } else if (strcmp(argv[i], "--list") == 0) {
+      list = true;
+    } else if (strcmp(argv[i], "--verbose") == 0) {
+      esp_log_host_level = ESP_LOG_VERBOSE;
+    } else {
+      test_usage(argv[0]);
+      return 2;
+    }
+  }
+
+  int status = 0;
+  for (size_t s = 0; s < sizeof(suites) / sizeof(suites[0]); ++s) {
+    for (const test_case_t* test = suites[s]; test->name != NULL; ++test) {
+      if (strstr(test->name, filter) == NULL) {
+        continue;
+      }
+      if (list) {
+        printf("%s\n", test->name);
+        continue;
+      }
+
+      bool passed = test->run();
+      printf("%-4s %s\n", passed ? "ok" : "FAIL", test->name);
+      fflush(stdout);
+      if (!passed) {
+        status = 1;
+      }
+    }
+  }
+
+  return status;
+}
@@ -0,0 +1,94 @@
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Run a test.
+ *
+ * @return true if the test passed.
+ */
+typedef bool (*test_run_t)(void);
+
+/**
+ * Describes a test.
+ *
+ * @param name The name of the test, such as "metrics/concurrent_add".
+ * @param run Runs the test.
+ */
+typedef struct test_case {
+  const char* name;
+  test_run_t run;
+} test_case_t;
+
+/**
+ * Fail the current test unless a condition holds.
+ *
+ * @param COND The condition.
+ */
+#define TEST_CHECK(COND)                          \
+  do {                                            \
+    if (!(COND)) {                                \
+      test_fail(__FILE__, __LINE__, #COND);       \
+      return false;                               \
+    }                                             \
+  } while (0)
+
+/**
+ * Report a failed check of the current test.
+ *
+ * @param[in] file The source file of the check.
+ * @param[in] line The line of the check.
+ * @param[in] condition The condition that didn't hold.
+ */
+void test_fail(const char* file, int line, const char* condition);
+
+/**
+ * Get the number of allocations through malloc(), calloc() and realloc() by
+ * all threads so far. Allocations are only counted on Linux, where the
+ * allocator is wrapped by the linker.
+ *
+ * @return The number of allocations, or 0 if they are not counted.
+ */
+size_t test_heap_allocations(void);
+
+/**
+ * Get the memory currently allocated through malloc() by all threads,
+ * including the overhead of the allocator.
+ *
+ * @return The number of bytes, or 0 if allocations are not counted.
+ */
+size_t test_heap_used(void);
+
+/**
+ * Get a pseudo-random number, which is the same for every run, so that
+ * failures can be reproduced.
+ *
+ * @param[in,out] state The state of the generator, which must not be 0.
+ *
+ * @return The next number.
+ */
+static inline uint32_t test_random(uint32_t* state) {
+  uint32_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *state = x;
+  return x;
+}
+
+// The tests of the portable modules, each terminated by an empty case.
+extern const test_case_t test_decode_cases[];
+extern const test_case_t test_dsp_cases[];
+extern const test_case_t test_energy_cases[];
+extern const test_case_t test_health_cases[];
+extern const test_case_t test_metrics_cases[];
+extern const test_case_t test_peer_cases[];
+extern const test_case_t test_relay_cases[];
+extern const test_case_t test_update_cases[];
+extern const test_case_t test_verify_cases[];
+extern const test_case_t test_writer_cases[];
+
+#endif
@@ -0,0 +1,657 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "delta.h"
+#include "esp_err.h"
+#include "inflate.h"
+#include "test.h"
+
+#ifdef TEST_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef TEST_DELTA_IMAGES
+#include <stdio.h>
+
+#include "mbedtls/sha256.h"
+#endif
+
+// Size of the base and the target image of the patch.
+#define TEST_DECODE_IMAGE_SIZE (64 * 1024)
+// Every block of the base image is copied, followed by an inserted literal.
+#define TEST_DECODE_PATCH_BLOCK 4096
+// Number of literal bytes inserted for every block.
+#define TEST_DECODE_PATCH_LITERAL 16
+// Maximum size of an encoded stream.
+#define TEST_DECODE_STREAM_SIZE (80 * 1024)
+// Size of the chunks in which a stream is fed, like the buffers of the
+// download.
+#define TEST_DECODE_CHUNK_SIZE 1024
+// Only every so many truncations and bit flips of a compressed stream are
+// tried, as each decompresses the whole image. Odd, so that all bit positions
+// are covered.
+#define TEST_DECODE_SAMPLE 61
+
+/**
+ * An encoded stream together with the data it decodes to.
+ *
+ * @param base The base image of a patch.
+ * @param expected The data that the intact stream decodes to.
+ * @param output Receives the decoded data.
+ * @param output_length Number of bytes decoded.
+ * @param stream The encoded stream.
+ * @param stream_length Number of bytes in the stream.
+ * @param ops Marks the bytes of the stream that hold an operation of a patch.
+ * @param delta The decoder of patches.
+ * @param inflate The decompressor.
+ */
+typedef struct test_decode {
+  uint8_t base[TEST_DECODE_IMAGE_SIZE];
+  uint8_t expected[TEST_DECODE_IMAGE_SIZE];
+  uint8_t output[TEST_DECODE_IMAGE_SIZE];
+  size_t output_length;
+  uint8_t stream[TEST_DECODE_STREAM_SIZE];
+  size_t stream_length;
+  bool ops[TEST_DECODE_STREAM_SIZE];
+  delta_t delta;
+  inflate_t inflate;
+} test_decode_t;
+
+/**
+ * The outcome of decoding a stream.
+ */
+typedef enum test_decode_outcome {
+  // The decoder rejected the stream.
+  TEST_DECODE_REJECTED,
+  // The decoder accepted the stream and produced the expected data.
+  TEST_DECODE_EXPECTED,
+  // The decoder accepted the stream, but produced different data.
+  TEST_DECODE_DIFFERENT,
+} test_decode_outcome_t;
+
+/**
+ * Decode a stream in chunks.
+ *
+ * @param[in] ctx The stream.
+ * @param[in] length Number of bytes of the stream to be fed.
+ *
+ * @return The result of the decoder.
+ */
+typedef esp_err_t (*test_decode_run_t)(test_decode_t* ctx, size_t length);
+
+// The digest of the base image, which is not verified by the decoder itself.
+static const uint8_t base_sha256[DELTA_SHA256_LEN] = {1, 2, 3};
+
+/**
+ * Append decoded data. This is a `delta_write_t` and an `inflate_write_t`.
+ *
+ * @param[in] ctx The stream.
+ * @param[in] data The decoded data.
+ * @param[in] length Number of bytes.
+ *
+ * @return ESP_OK or ESP_ERR_INVALID_SIZE if the output is longer than
+ * expected.
+ */
+static esp_err_t test_decode_write(void* ctx, const void* data,
+                                   size_t length) {
+  test_decode_t* decode = ctx;
+  if (length > sizeof(decode->output) - decode->output_length) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+  memcpy(&decode->output[decode->output_length], data, length);
+  decode->output_length += length;
+  return ESP_OK;
+}
+
+/**
+ * Read a range of the base image. This is a `delta_read_t`.
+ *
+ * @param[in] ctx The stream.
+ * @param[in] offset Offset within the base image.
+ * @param[out] data Buffer receiving the data.
+ * @param[in] length Number of bytes to be read.
+ *
+ * @return ESP_OK or ESP_ERR_INVALID_SIZE if the range is out of bounds.
+ */
+static esp_err_t test_decode_read(void* ctx, size_t offset, void* data,
+                                  size_t length) {
+  test_decode_t* decode = ctx;
+  if (offset > sizeof(decode->base) || length > sizeof(decode->base) - offset) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+  memcpy(data, &decode->base[offset], length);
+  return ESP_OK;
+}
+
+/**
+ * Feed a stream in chunks to a decoder.
+ *
+ * @param[in] feed The function feeding the decoder.
+ * @param[in] ctx The decoder.
+ * @param[in] stream The stream.
+ * @param[in] length Number of bytes to be fed.
+ *
+ * @return ESP_OK or the first error of the decoder.
+ */
+static esp_err_t test_decode_feed(esp_err_t (*feed)(void*, const void*, size_t),
+                                  void* ctx, const uint8_t* stream,
+                                  size_t length) {
+  esp_err_t err = ESP_OK;
+  for (size_t offset = 0; offset < length && err == ESP_OK;
+       offset += TEST_DECODE_CHUNK_SIZE) {
+    size_t chunk = length - offset < TEST_DECODE_CHUNK_SIZE
+                       ? length - offset
+                       : TEST_DECODE_CHUNK_SIZE;
+    err = feed(ctx, &stream[offset], chunk);
+  }
+  return err;
+}
+
+/**
+ * Feed data to the decoder of patches.
+ *
+ * @param[in] ctx The decoder.
+ * @param[in] data The data.
+ * @param[in] length Number of bytes.
+ *
+ * @return The result of the decoder.
+ */
+static esp_err_t test_decode_delta_feed(void* ctx, const void* data,
+                                        size_t length) {
+  return delta_feed((delta_t*)ctx, data, length);
+}
+
+/**
+ * Feed data to the decompressor.
+ *
+ * @param[in] ctx The decompressor.
+ * @param[in] data The data.
+ * @param[in] length Number of bytes.
+ *
+ * @return The result of the decompressor.
+ */
+static esp_err_t test_decode_inflate_feed(void* ctx, const void* data,
+                                          size_t length) {
+  return inflate_feed((inflate_t*)ctx, data, length);
+}
+
+/**
+ * Apply the patch. This is a `test_decode_run_t`.
+ *
+ * @param[in] decode The patch.
+ * @param[in] length Number of bytes of the patch to be fed.
+ *
+ * @return The result of the decoder.
+ */
+static esp_err_t test_decode_delta(test_decode_t* decode, size_t length) {
+  decode->output_length = 0;
+  delta_init(&decode->delta, base_sha256, test_decode_read, decode,
+             test_decode_write, decode);
+  esp_err_t err = test_decode_feed(test_decode_delta_feed, &decode->delta,
+                                   decode->stream, length);
+  return err == ESP_OK ? delta_finish(&decode->delta) : err;
+}
+
+/**
+ * Decompress the stream. This is a `test_decode_run_t`.
+ *
+ * @param[in] decode The stream.
+ * @param[in] length Number of bytes of the stream to be fed.
+ *
+ * @return The result of the decompressor.
+ */
+static esp_err_t test_decode_inflate(test_decode_t* decode, size_t length) {
+  decode->output_length = 0;
+  inflate_init(&decode->inflate, test_decode_write, decode);
+  esp_err_t err = test_decode_feed(test_decode_inflate_feed, &decode->inflate,
+                                   decode->stream, length);
+  return err == ESP_OK ? inflate_finish(&decode->inflate) : err;
+}
+
+/**
+ * Decode the stream and compare the output with the expected data.
+ *
+ * @param[in] decode The stream.
+ * @param[in] run Decodes the stream.
+ * @param[in] length Number of bytes of the stream to be fed.
+ *
+ * @return The outcome.
+ */
+static test_decode_outcome_t test_decode_outcome(test_decode_t* decode,
+                                                 test_decode_run_t run,
+                                                 size_t length) {
+  if (run(decode, length) != ESP_OK) {
+    return TEST_DECODE_REJECTED;
+  }
+  return decode->output_length == sizeof(decode->expected) &&
+                 memcmp(decode->output, decode->expected,
+                        sizeof(decode->expected)) == 0
+             ? TEST_DECODE_EXPECTED
+             : TEST_DECODE_DIFFERENT;
+}
+
+/**
+ * Append an unsigned LEB128 varint to the stream.
+ *
+ * @param[in] decode The stream.
+ * @param[in] value The value.
+ */
+static void test_decode_varint(test_decode_t* decode, uint32_t value) {
+  do {
+    uint8_t byte = value & 0x7f;
+    value >>= 7;
+    decode->stream[decode->stream_length++] =
+        byte | (value != 0 ? 0x80 : 0);
+  } while (value != 0);
+}
+
+/**
+ * Store a 32-bit integer in little-endian byte order.
+ *
+ * @param[out] data The destination.
+ * @param[in] value The value.
+ */
+static void test_decode_u32(uint8_t* data, uint32_t value) {
+  for (size_t i = 0; i < 4; ++i) {
+    data[i] = (uint8_t)(value >> (8 * i));
+  }
+}
+
+/**
+ * Create a patch that keeps most of every block of the base image, but
+ * replaces its end with literal data, like a typical release does.
+ *
+ * @return The patch or NULL if it can't be allocated.
+ */
+static test_decode_t* test_decode_patch(void) {
+  test_decode_t* decode = calloc(1, sizeof(*decode));
+  if (decode == NULL) {
+    return NULL;
+  }
+  uint32_t random = 3;
+  for (size_t i = 0; i < TEST_DECODE_IMAGE_SIZE; ++i) {
+    decode->base[i] = (uint8_t)test_random(&random);
+  }
+
+  uint8_t* header = decode->stream;
+  memcpy(header, DELTA_MAGIC, 4);
+  header[4] = DELTA_FORMAT;
+  test_decode_u32(&header[8], TEST_DECODE_IMAGE_SIZE);
+  test_decode_u32(&header[12], TEST_DECODE_IMAGE_SIZE);
+  memcpy(&header[16], base_sha256, DELTA_SHA256_LEN);
+  memcpy(&header[48], "v1.0.0", 6);
+  decode->stream_length = DELTA_HEADER_SIZE;
+
+  for (uint32_t offset = 0; offset < TEST_DECODE_IMAGE_SIZE;
+       offset += TEST_DECODE_PATCH_BLOCK) {
+    uint32_t kept = TEST_DECODE_PATCH_BLOCK - TEST_DECODE_PATCH_LITERAL;
+    decode->ops[decode->stream_length] = true;
+    decode->stream[decode->stream_length++] = DELTA_OP_COPY;
+    test_decode_varint(decode, offset);
+    test_decode_varint(decode, kept);
+    memcpy(&decode->expected[offset], &decode->base[offset], kept);
+
+    decode->ops[decode->stream_length] = true;
+    decode->stream[decode->stream_length++] = DELTA_OP_INSERT;
+    test_decode_varint(decode, TEST_DECODE_PATCH_LITERAL);
+    for (size_t i = 0; i < TEST_DECODE_PATCH_LITERAL; ++i) {
+      uint8_t literal = (uint8_t)test_random(&random);
+      decode->stream[decode->stream_length++] = literal;
+      decode->expected[offset + kept + i] = literal;
+    }
+  }
+  return decode;
+}
+
+/**
+ * Check that the intact patch reconstructs the target image and that every
+ * truncation of it is rejected.
+ *
+ * @return true if the test passed.
+ */
+static bool test_decode_delta_truncated(void) {
+  test_decode_t* decode = test_decode_patch();
+  TEST_CHECK(decode != NULL);
+
+  bool intact = test_decode_outcome(decode, test_decode_delta,
+                                    decode->stream_length) ==
+                TEST_DECODE_EXPECTED;
+  bool rejected = true;
+  for (size_t length = 0; length < decode->stream_length && rejected;
+       ++length) {
+    rejected = test_decode_outcome(decode, test_decode_delta, length) ==
+               TEST_DECODE_REJECTED;
+  }
+  free(decode);
+  TEST_CHECK(intact);
+  TEST_CHECK(rejected);
+
+  return true;
+}
+
+/**
+ * Flip every bit of the patch. Flips of the validated header fields and of
+ * the operations must be rejected. The patch has no checksum of its own, so
+ * flips of the arguments and literals may produce a different image, which
+ * the block digests of the manifest catch, but it must never exceed the size
+ * of the target image.
+ *
+ * @return true if the test passed.
+ */
+static bool test_decode_delta_bit_flips(void) {
+  test_decode_t* decode = test_decode_patch();
+  TEST_CHECK(decode != NULL);
+
+  bool passed = true;
+  size_t different = 0;
+  for (size_t bit = 0; bit < decode->stream_length * 8 && passed; ++bit) {
+    size_t offset = bit / 8;
+    decode->stream[offset] ^= 1 << (bit % 8);
+    test_decode_outcome_t outcome =
+        test_decode_outcome(decode, test_decode_delta, decode->stream_length);
+    decode->stream[offset] ^= 1 << (bit % 8);
+
+    // The magic, the format, the target size and the base digest.
+    bool validated = offset < 5 || (offset >= 12 && offset < 48);
+    if (validated || decode->ops[offset]) {
+      passed = outcome == TEST_DECODE_REJECTED;
+    }
+    if (outcome == TEST_DECODE_DIFFERENT) {
+      different += 1;
+    }
+  }
+  free(decode);
+  TEST_CHECK(passed);
+  // Only flips of the literals and of some arguments go unnoticed.
+  TEST_CHECK(different > 0);
+
+  return true;
+}
+
+#ifdef TEST_DELTA_IMAGES
+/**
+ * The images created by `delta_images.py` and the image reconstructed from
+ * their patch.
+ *
+ * @param base The base image.
+ * @param base_length Number of bytes of the base image.
+ * @param target The target image.
+ * @param target_length Number of bytes of the target image.
+ * @param patch The patch created by `tools/delta.py`.
+ * @param patch_length Number of bytes of the patch.
+ * @param output Receives the reconstructed image.
+ * @param output_length Number of bytes reconstructed.
+ */
+typedef struct test_decode_images {
+  uint8_t* base;
+  size_t base_length;
+  uint8_t* target;
+  size_t target_length;
+  uint8_t* patch;
+  size_t patch_length;
+  uint8_t* output;
+  size_t output_length;
+} test_decode_images_t;
+
+/**
+ * Read a file created by `delta_images.py`.
+ *
+ * @param[in] name The name of the file.
+ * @param[out] length Receives the number of bytes of the file.
+ *
+ * @return The content of the file or NULL if it can't be read.
+ */
+static uint8_t* test_decode_load(const char* name, size_t* length) {
+  char path[512];
+  snprintf(path, sizeof(path), "%s/%s", TEST_DELTA_IMAGES, name);
+  FILE* file = fopen(path, "rb");
+  if (file == NULL) {
+    return NULL;
+  }
+  uint8_t* data = NULL;
+  long size = -1;
+  if (fseek(file, 0, SEEK_END) == 0) {
+    size = ftell(file);
+  }
+  if (size > 0 && fseek(file, 0, SEEK_SET) == 0) {
+    data = malloc((size_t)size);
+  }
+  if (data != NULL && fread(data, 1, (size_t)size, file) != (size_t)size) {
+    free(data);
+    data = NULL;
+  }
+  fclose(file);
+  *length = data != NULL ? (size_t)size : 0;
+  return data;
+}
+
+/**
+ * Append reconstructed data. This is a `delta_write_t`.
+ *
+ * @param[in] ctx The images.
+ * @param[in] data The reconstructed data.
+ * @param[in] length Number of bytes.
+ *
+ * @return ESP_OK or ESP_ERR_INVALID_SIZE if the output is longer than the
+ * target image.
+ */
+static esp_err_t test_decode_images_write(void* ctx, const void* data,
+                                          size_t length) {
+  test_decode_images_t* images = ctx;
+  if (length > images->target_length - images->output_length) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+  memcpy(&images->output[images->output_length], data, length);
+  images->output_length += length;
+  return ESP_OK;
+}
+
+/**
+ * Read a range of the base image. This is a `delta_read_t`.
+ *
+ * @param[in] ctx The images.
+ * @param[in] offset Offset within the base image.
+ * @param[out] data Buffer receiving the data.
+ * @param[in] length Number of bytes to be read.
+ *
+ * @return ESP_OK or ESP_ERR_INVALID_SIZE if the range is out of bounds.
+ */
+static esp_err_t test_decode_images_read(void* ctx, size_t offset, void* data,
+                                         size_t length) {
+  test_decode_images_t* images = ctx;
+  if (offset > images->base_length || length > images->base_length - offset) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+  memcpy(data, &images->base[offset], length);
+  return ESP_OK;
+}
+
+/**
+ * Apply a patch created by `tools/delta.py` from two releases of an image,
+ * which must reproduce the newer release byte for byte.
+ *
+ * @return true if the test passed.
+ */
+static bool test_decode_delta_tool(void) {
+  test_decode_images_t images = {0};
+  images.base = test_decode_load("base.bin", &images.base_length);
+  images.target = test_decode_load("target.bin", &images.target_length);
+  images.patch = test_decode_load("patch.bin", &images.patch_length);
+  images.output = malloc(images.target_length);
+
+  esp_err_t err = ESP_ERR_NOT_FOUND;
+  bool equal = false;
+  if (images.base != NULL && images.target != NULL && images.patch != NULL &&
+      images.output != NULL) {
+    uint8_t digest[DELTA_SHA256_LEN];
+    mbedtls_sha256_context sha256;
+    mbedtls_sha256_init(&sha256);
+    mbedtls_sha256_starts(&sha256, 0);
+    mbedtls_sha256_update(&sha256, images.base, images.base_length);
+    mbedtls_sha256_finish(&sha256, digest);
+    mbedtls_sha256_free(&sha256);
+
+    delta_t* delta = malloc(sizeof(*delta));
+    err = ESP_ERR_NO_MEM;
+    if (delta != NULL) {
+      delta_init(delta, digest, test_decode_images_read, &images,
+                 test_decode_images_write, &images);
+      err = test_decode_feed(test_decode_delta_feed, delta, images.patch,
+                             images.patch_length);
+      if (err == ESP_OK) {
+        err = delta_finish(delta);
+      }
+      free(delta);
+    }
+    equal = images.output_length == images.target_length &&
+            memcmp(images.output, images.target, images.target_length) == 0;
+  }
+  free(images.output);
+  free(images.patch);
+  free(images.target);
+  free(images.base);
+  TEST_CHECK(err == ESP_OK);
+  TEST_CHECK(equal);
+
+  return true;
+}
+#endif
+
+#ifdef TEST_ZLIB
+/**
+ * Compress data that compresses like machine code, like
+ * `tools/compress.py` does.
+ *
+ * @return The stream or NULL if it can't be created.
+ */
+static test_decode_t* test_decode_compressed(void) {
+  test_decode_t* decode = calloc(1, sizeof(*decode));
+  if (decode == NULL) {
+    return NULL;
+  }
+  uint32_t random = 9;
+  for (size_t i = 0; i < TEST_DECODE_IMAGE_SIZE; ++i) {
+    // Recurring words among random bytes.
+    uint32_t value = test_random(&random);
+    decode->expected[i] = value % 4 == 0 ? (uint8_t)(value >> 8)
+                                         : (uint8_t)"\x13\x37\xca\xfe"[i % 4];
+  }
+
+  z_stream stream = {
+      .next_in = decode->expected,
+      .avail_in = TEST_DECODE_IMAGE_SIZE,
+      .next_out = decode->stream,
+      .avail_out = TEST_DECODE_STREAM_SIZE,
+  };
+  if (deflateInit2(&stream, 9, Z_DEFLATED, INFLATE_WINDOW_BITS, 9,
+                   Z_DEFAULT_STRATEGY) != Z_OK) {
+    free(decode);
+    return NULL;
+  }
+  int status = deflate(&stream, Z_FINISH);
+  deflateEnd(&stream);
+  if (status != Z_STREAM_END) {
+    free(decode);
+    return NULL;
+  }
+  decode->stream_length = stream.total_out;
+  return decode;
+}
+
+/**
+ * Check that the intact stream decompresses to the original data and that
+ * truncations of it are rejected.
+ *
+ * @return true if the test passed.
+ */
+static bool test_decode_inflate_truncated(void) {
+  test_decode_t* decode = test_decode_compressed();
+  TEST_CHECK(decode != NULL);
+
+  bool intact = test_decode_outcome(decode, test_decode_inflate,
+                                    decode->stream_length) ==
+                TEST_DECODE_EXPECTED;
+  bool rejected = true;
+  // Every byte of the header and the trailer, and a sample of the blocks.
+  for (size_t length = 0; length < decode->stream_length && rejected;
+       length += length < 8 || decode->stream_length - length <= 8
+                     ? 1
+                     : TEST_DECODE_SAMPLE) {
+    rejected = test_decode_outcome(decode, test_decode_inflate, length) ==
+               TEST_DECODE_REJECTED;
+  }
+  free(decode);
+  TEST_CHECK(intact);
+  TEST_CHECK(rejected);
+
+  return true;
+}
+
+/**
+ * Flip a sample of bits throughout the stream. A flip must either be rejected,
+ * as malformed data or by the Adler-32 checksum of the trailer, or still
+ * produce the original data, like a match whose distance is changed to an
+ * identical earlier occurrence does.
+ *
+ * @return true if the test passed.
+ */
+static bool test_decode_inflate_bit_flips(void) {
+  test_decode_t* decode = test_decode_compressed();
+  TEST_CHECK(decode != NULL);
+
+  bool passed = true;
+  size_t flips = 0;
+  size_t rejected = 0;
+  for (size_t bit = 0; bit < decode->stream_length * 8 && passed;
+       bit += TEST_DECODE_SAMPLE) {
+    size_t offset = bit / 8;
+    decode->stream[offset] ^= 1 << (bit % 8);
+    test_decode_outcome_t outcome = test_decode_outcome(
+        decode, test_decode_inflate, decode->stream_length);
+    decode->stream[offset] ^= 1 << (bit % 8);
+
+    passed = outcome != TEST_DECODE_DIFFERENT;
+    flips += 1;
+    if (outcome == TEST_DECODE_REJECTED) {
+      rejected += 1;
+    }
+  }
+  free(decode);
+  TEST_CHECK(passed);
+  // Equivalent streams are the rare exception.
+  TEST_CHECK(rejected * 100 >= flips * 99);
+
+  return true;
+}
+#endif
+
+const test_case_t test_decode_cases[] = {
+    {
+        .name = "delta/truncated",
+        .run = test_decode_delta_truncated,
+    },
+    {
+        .name = "delta/bit_flips",
+        .run = test_decode_delta_bit_flips,
+    },
+#ifdef TEST_DELTA_IMAGES
+    {
+        .name = "delta/tool",
+        .run = test_decode_delta_tool,
+    },
+#endif
+#ifdef TEST_ZLIB
+    {
+        .name = "inflate/truncated",
+        .run = test_decode_inflate_truncated,
+    },
+    {
+        .name = "inflate/bit_flips",
+        .run = test_decode_inflate_bit_flips,
+    },
+#endif
+    {0},
+};
@@ -0,0 +1,139 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "dsp.h"
+#include "esp_err.h"
+#include "meter.h"
+#include "sdkconfig.h"
+#include "synth.h"
+#include "test.h"
+
+// Number of outlets of the synthesized samples.
+#define TEST_DSP_OUTLETS 8
+// Number of samples, which covers several folds and a remainder.
+#define TEST_DSP_SAMPLES (5 * DSP_FOLD + 7)
+
+/**
+ * Check that the fixed-point kernels match the floating-point reference
+ * exactly for every length of a block, also when adding to existing sums.
+ *
+ * @param[in] samples The samples.
+ *
+ * @return true if the sums match.
+ */
+static bool test_dsp_match(const meter_sample_t* samples) {
+  for (size_t count = 0; count <= TEST_DSP_SAMPLES; ++count) {
+    dsp_reference_t reference = {
+        .sum_vv = 1000,
+        .sum_ii = 2000,
+        .sum_vi = -3000,
+    };
+    dsp_sums_reference(&reference, samples, count);
+    meter_cycle_t sums = {.sum_vv = 1000, .sum_ii = 2000, .sum_vi = -3000};
+    dsp_sums(&sums, samples, count);
+    meter_cycle_t scalar = {.sum_vv = 1000, .sum_ii = 2000, .sum_vi = -3000};
+    dsp_sums_scalar(&scalar, samples, count);
+
+    TEST_CHECK((double)sums.sum_vv == reference.sum_vv);
+    TEST_CHECK((double)sums.sum_ii == reference.sum_ii);
+    TEST_CHECK((double)sums.sum_vi == reference.sum_vi);
+    TEST_CHECK(sums.count == count);
+    TEST_CHECK(scalar.sum_vv == sums.sum_vv);
+    TEST_CHECK(scalar.sum_ii == sums.sum_ii);
+    TEST_CHECK(scalar.sum_vi == sums.sum_vi);
+    TEST_CHECK(scalar.count == count);
+  }
+  return true;
+}
+
+/**
+ * Compare the kernels with the reference on the synthesized waveforms of all
+ * outlets.
+ *
+ * @return true if the test passed.
+ */
+static bool test_dsp_synth(void) {
+  synth_t synth;
+  synth_init(&synth, TEST_DSP_OUTLETS, CONFIG_ZEUS_METER_SAMPLE_RATE,
+             CONFIG_ZEUS_METER_MAINS_FREQUENCY, false);
+  meter_sample_t frames[TEST_DSP_SAMPLES * TEST_DSP_OUTLETS];
+  synth_read(&synth, frames, TEST_DSP_SAMPLES);
+
+  for (size_t outlet = 0; outlet < TEST_DSP_OUTLETS; ++outlet) {
+    meter_sample_t samples[TEST_DSP_SAMPLES];
+    for (size_t i = 0; i < TEST_DSP_SAMPLES; ++i) {
+      samples[i] = frames[i * TEST_DSP_OUTLETS + outlet];
+      TEST_CHECK(samples[i].voltage > -METER_SAMPLE_LIMIT &&
+                 samples[i].voltage < METER_SAMPLE_LIMIT);
+      TEST_CHECK(samples[i].current > -METER_SAMPLE_LIMIT &&
+                 samples[i].current < METER_SAMPLE_LIMIT);
+    }
+    TEST_CHECK(test_dsp_match(samples));
+  }
+  return true;
+}
+
+/**
+ * Compare the kernels with the reference on samples of the largest
+ * magnitude, whose products stress the 32-bit accumulators in both
+ * directions.
+ *
+ * @return true if the test passed.
+ */
+static bool test_dsp_limit(void) {
+  const int16_t max = METER_SAMPLE_LIMIT - 1;
+  meter_sample_t samples[TEST_DSP_SAMPLES];
+
+  // All products at their positive and then their negative maximum.
+  for (int sign = -1; sign <= 1; sign += 2) {
+    for (size_t i = 0; i < TEST_DSP_SAMPLES; ++i) {
+      samples[i].voltage = i % 2 == 0 ? max : -max;
+      samples[i].current = (int16_t)(sign * samples[i].voltage);
+    }
+    TEST_CHECK(test_dsp_match(samples));
+  }
+
+  uint32_t random = 3;
+  for (size_t i = 0; i < TEST_DSP_SAMPLES; ++i) {
+    uint32_t bits = test_random(&random);
+    samples[i].voltage = bits & 1 ? max : -max;
+    samples[i].current = bits & 2 ? max : -max;
+  }
+  TEST_CHECK(test_dsp_match(samples));
+  return true;
+}
+
+/**
+ * Run the benchmark of the kernels, which the firmware runs at boot if
+ * enabled. The fixed-point kernels must be exact and every kernel must take
+ * some cycles.
+ *
+ * @return true if the test passed.
+ */
+static bool test_dsp_bench(void) {
+  dsp_bench_t results[DSP_BENCH_KERNELS];
+  TEST_CHECK(dsp_bench(results) == ESP_OK);
+  for (size_t k = 0; k < DSP_BENCH_KERNELS; ++k) {
+    TEST_CHECK(results[k].name != NULL);
+    TEST_CHECK(results[k].max_error == 0.0);
+    TEST_CHECK(results[k].cycles_per_sample > 0.0f);
+  }
+  return true;
+}
+
+const test_case_t test_dsp_cases[] = {
+    {
+        .name = "dsp/synth",
+        .run = test_dsp_synth,
+    },
+    {
+        .name = "dsp/limit",
+        .run = test_dsp_limit,
+    },
+    {
+        .name = "dsp/bench",
+        .run = test_dsp_bench,
+    },
+    {0},
+};
@@ -0,0 +1,121 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "energy.h"
+#include "esp_err.h"
+#include "meter.h"
+#include "nvs.h"
+#include "test.h"
+
+// Number of simulated boots, each of which ends with a loss of power.
+#define TEST_ENERGY_BOOTS 64
+// Maximum number of commit intervals of a boot.
+#define TEST_ENERGY_INTERVALS 6
+// Number of cycles measured per commit interval.
+#define TEST_ENERGY_CYCLES 50
+// Number of outlets with a load.
+#define TEST_ENERGY_OUTLETS 2
+
+// The real power of the loads in watts, whose cycles at 50 Hz are worth a
+// whole number of millijoules.
+static const float loads[TEST_ENERGY_OUTLETS] = {100, 30};
+
+/**
+ * Get the energy of a cycle of a load.
+ *
+ * @param[in] outlet The index of the outlet.
+ *
+ * @return The energy in millijoules.
+ */
+static uint64_t test_energy_cycle_mj(size_t outlet) {
+  return (uint64_t)(loads[outlet] / 50 * 1000);
+}
+
+/**
+ * Measure cycles of all loads.
+ *
+ * @param[in] cycles Number of cycles.
+ * @param[in,out] consumed The energy consumed by every load, which is
+ * increased.
+ */
+static void test_energy_measure(uint32_t cycles,
+                                uint64_t consumed[TEST_ENERGY_OUTLETS]) {
+  for (uint32_t i = 0; i < cycles; ++i) {
+    for (size_t outlet = 0; outlet < TEST_ENERGY_OUTLETS; ++outlet) {
+      meter_reading_t reading = {
+          .real_power = loads[outlet],
+          .frequency = 50,
+          .cycles = 1,
+      };
+      energy_record(outlet, &reading);
+      consumed[outlet] += test_energy_cycle_mj(outlet);
+    }
+  }
+}
+
+/**
+ * Boot repeatedly, losing power while committing or in between commits. The
+ * counters must be restored from the newest slot that was written completely,
+ * which loses at most the energy of one commit interval.
+ *
+ * @return true if the test passed.
+ */
+static bool test_energy_power_loss(void) {
+  uint32_t random = 14;
+  // The energy that was actually consumed since the counters were restored.
+  uint64_t consumed[TEST_ENERGY_OUTLETS] = {0};
+  // The counters of the newest slot that was written completely.
+  uint64_t committed[TEST_ENERGY_OUTLETS] = {0};
+
+  for (size_t boot = 0; boot < TEST_ENERGY_BOOTS; ++boot) {
+    // Every commit writes a slot and commits it. The first boot commits
+    // once, as the counters would otherwise not be restored from any slot.
+    int writes = (int)(test_random(&random) % (2 * TEST_ENERGY_INTERVALS + 2));
+    if (boot == 0 && writes < 2) {
+      writes = 2;
+    }
+    nvs_host_fail_after(-1);
+    TEST_CHECK(energy_init() == ESP_OK);
+    nvs_host_fail_after(writes);
+
+    for (size_t outlet = 0; outlet < TEST_ENERGY_OUTLETS; ++outlet) {
+      uint64_t restored = energy_get(outlet);
+      TEST_CHECK(restored == committed[outlet]);
+      TEST_CHECK(restored <= consumed[outlet]);
+      TEST_CHECK(consumed[outlet] - restored <=
+                 TEST_ENERGY_CYCLES * test_energy_cycle_mj(outlet));
+      consumed[outlet] = restored;
+    }
+
+    bool lost = false;
+    for (size_t interval = 0; interval < TEST_ENERGY_INTERVALS && !lost;
+         ++interval) {
+      test_energy_measure(TEST_ENERGY_CYCLES, consumed);
+      lost = energy_flush() != ESP_OK;
+      // The slot is complete if only its commit failed.
+      if (!lost || writes == 1) {
+        for (size_t outlet = 0; outlet < TEST_ENERGY_OUTLETS; ++outlet) {
+          committed[outlet] = consumed[outlet];
+        }
+      }
+      writes -= 2;
+    }
+    if (!lost) {
+      // Lose power in the middle of the next interval.
+      test_energy_measure(test_random(&random) % TEST_ENERGY_CYCLES,
+                          consumed);
+    }
+  }
+  nvs_host_fail_after(-1);
+
+  return true;
+}
+
+const test_case_t test_energy_cases[] = {
+    {
+        .name = "energy/power_loss",
+        .run = test_energy_power_loss,
+    },
+    {0},
+};
@@ -0,0 +1,236 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "esp_app_desc.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "health.h"
+#include "test.h"
+
+#define TAG "test.health"
+
+// Number of health responses built by the soak test, like as many requests
+// were served before the response was cached.
+#define TEST_HEALTH_REQUESTS 100000
+// Number of requests whose latency is measured for each way of serving them.
+#define TEST_HEALTH_SAMPLES 20000
+
+// The ETag of the response described by `test_health_app()`.
+static const char expected_etag[] =
+    "\"000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f\"";
+// The health document of the firmware described by `test_health_app()`.
+static const char expected_body[] =
+    "{\"data\":{\"firmware\":{\"version\":\"v2.3.1\",\"sdk\":\"v5.1.2\","
+    "\"timestamp\":\"Oct 18 2026 03:05:41\",\"sha256\":"
+    "\"000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f\"}}}";
+
+/**
+ * Describe a running firmware.
+ *
+ * @param[out] app Receives the description.
+ */
+static void test_health_app(esp_app_desc_t* app) {
+  memset(app, 0, sizeof(*app));
+  strcpy(app->version, "v2.3.1");
+  strcpy(app->project_name, "zeus");
+  strcpy(app->time, "03:05:41");
+  strcpy(app->date, "Oct 18 2026");
+  strcpy(app->idf_ver, "v5.1.2");
+  for (size_t i = 0; i < sizeof(app->app_elf_sha256); ++i) {
+    app->app_elf_sha256[i] = (uint8_t)i;
+  }
+}
+
+/**
+ * Build the health response as often as requests would have been served, and
+ * check that the streaming JSON writer neither allocates nor leaks, and that
+ * every response is the same.
+ *
+ * @return true if the test passed.
+ */
+static bool test_health_soak(void) {
+  esp_app_desc_t app;
+  test_health_app(&app);
+  static health_t health;
+
+  size_t allocations = test_heap_allocations();
+  size_t used = test_heap_used();
+  bool identical = true;
+  for (size_t i = 0; i < TEST_HEALTH_REQUESTS && identical; ++i) {
+    identical = health_init(&health, &app) == ESP_OK &&
+                health.length == sizeof(expected_body) - 1 &&
+                memcmp(health.body, expected_body, health.length) == 0;
+  }
+  TEST_CHECK(identical);
+  TEST_CHECK(test_heap_allocations() == allocations);
+  TEST_CHECK(test_heap_used() == used);
+  TEST_CHECK(strcmp(health.etag, expected_etag) == 0);
+
+  return true;
+}
+
+/**
+ * Check that a response that doesn't fit is rejected rather than truncated.
+ *
+ * @return true if the test passed.
+ */
+static bool test_health_too_large(void) {
+  esp_app_desc_t app;
+  test_health_app(&app);
+  static health_t health;
+
+  // Every control character is escaped with six characters.
+  memset(app.version, '\x01', sizeof(app.version) - 1);
+  memset(app.idf_ver, '\x01', sizeof(app.idf_ver) - 1);
+  TEST_CHECK(health_init(&health, &app) == ESP_ERR_INVALID_SIZE);
+  TEST_CHECK(health.length <= sizeof(health.body));
+
+  return true;
+}
+
+/**
+ * Check which If-None-Match headers are answered with 304 Not Modified.
+ *
+ * @return true if the test passed.
+ */
+static bool test_health_not_modified(void) {
+  esp_app_desc_t app;
+  test_health_app(&app);
+  static health_t health;
+  TEST_CHECK(health_init(&health, &app) == ESP_OK);
+
+  char list[256];
+  snprintf(list, sizeof(list), "\"v1\", W/%s, \"v3\"", expected_etag);
+  TEST_CHECK(health_not_modified(&health, expected_etag));
+  TEST_CHECK(health_not_modified(&health, list));
+  TEST_CHECK(health_not_modified(&health, "*"));
+  TEST_CHECK(!health_not_modified(&health, NULL));
+  TEST_CHECK(!health_not_modified(&health, ""));
+  TEST_CHECK(!health_not_modified(&health, "\"v1\""));
+  // The digest without quotes is not the ETag.
+  char unquoted[sizeof(expected_etag)];
+  snprintf(unquoted, sizeof(unquoted), "%.*s", (int)sizeof(expected_etag) - 3,
+           &expected_etag[1]);
+  TEST_CHECK(!health_not_modified(&health, unquoted));
+  // The digest of another image.
+  app.app_elf_sha256[31] ^= 1;
+  static health_t other;
+  TEST_CHECK(health_init(&other, &app) == ESP_OK);
+  TEST_CHECK(!health_not_modified(&health, other.etag));
+
+  return true;
+}
+
+/**
+ * Get the time of a monotonic clock.
+ *
+ * @return The time in nanoseconds.
+ */
+static uint64_t test_health_now(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/**
+ * Compare two durations. This is a `qsort()` comparator.
+ *
+ * @param[in] a The first duration.
+ * @param[in] b The second duration.
+ *
+ * @return A negative number, zero or a positive number if the first duration
+ * is shorter, equal or longer.
+ */
+static int test_health_compare(const void* a, const void* b) {
+  uint64_t x = *(const uint64_t*)a;
+  uint64_t y = *(const uint64_t*)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * Measure the latency of serving requests from the cached response, and of
+ * building the response for every request like the handler did before. A
+ * request copies the body into the send buffer, or is answered with 304 Not
+ * Modified every other time.
+ *
+ * @param[in] cached Whether the cached response is served.
+ * @param[out] durations Receives the sorted durations in nanoseconds.
+ *
+ * @return false if the response couldn't be built.
+ */
+static bool test_health_serve(bool cached,
+                              uint64_t durations[TEST_HEALTH_SAMPLES]) {
+  esp_app_desc_t app;
+  test_health_app(&app);
+  static health_t health;
+  static char response[HEALTH_BODY_SIZE];
+  if (health_init(&health, &app) != ESP_OK) {
+    return false;
+  }
+
+  bool built = true;
+  for (size_t i = 0; i < TEST_HEALTH_SAMPLES; ++i) {
+    const char* if_none_match = i % 2 == 0 ? expected_etag : NULL;
+    uint64_t start = test_health_now();
+    if (!cached) {
+      built = health_init(&health, &app) == ESP_OK && built;
+    }
+    if (!health_not_modified(&health, if_none_match)) {
+      memcpy(response, health.body, health.length);
+    }
+    durations[i] = test_health_now() - start;
+  }
+  qsort(durations, TEST_HEALTH_SAMPLES, sizeof(durations[0]),
+        test_health_compare);
+  return built;
+}
+
+/**
+ * Compare the p50 and p99 latencies of serving the cached response and of
+ * building it for every request. The comparison is loose, as the machine
+ * running the test may be busy, and the latencies are logged if verbose.
+ *
+ * @return true if the test passed.
+ */
+static bool test_health_latency(void) {
+  static uint64_t cached[TEST_HEALTH_SAMPLES];
+  static uint64_t built[TEST_HEALTH_SAMPLES];
+  TEST_CHECK(test_health_serve(true, cached));
+  TEST_CHECK(test_health_serve(false, built));
+
+  size_t p50 = TEST_HEALTH_SAMPLES / 2;
+  size_t p99 = TEST_HEALTH_SAMPLES * 99 / 100;
+  ESP_LOGI(TAG, "cached: p50 %llu ns, p99 %llu ns",
+           (unsigned long long)cached[p50], (unsigned long long)cached[p99]);
+  ESP_LOGI(TAG, "built per request: p50 %llu ns, p99 %llu ns",
+           (unsigned long long)built[p50], (unsigned long long)built[p99]);
+  TEST_CHECK(cached[p50] < built[p50]);
+  TEST_CHECK(cached[p99] < built[p99]);
+
+  return true;
+}
+
+const test_case_t test_health_cases[] = {
+    {
+        .name = "health/soak",
+        .run = test_health_soak,
+    },
+    {
+        .name = "health/too_large",
+        .run = test_health_too_large,
+    },
+    {
+        .name = "health/not_modified",
+        .run = test_health_not_modified,
+    },
+    {
+        .name = "health/latency",
+        .run = test_health_latency,
+    },
+    {0},
+};
@@ -0,0 +1,88 @@
+#include <stdatomic.h>
+#include <stddef.h>
+
+#include "test.h"
+
+#ifdef TEST_HEAP
+
+#include <malloc.h>
+
+// Number of allocations through the wrapped allocator.
+static atomic_size_t heap_allocations = 0;
+// Number of bytes allocated through the wrapped allocator.
+static atomic_size_t heap_used = 0;
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+void __real_free(void* ptr);
+
+/**
+ * Account for an allocation.
+ *
+ * @param[in] ptr The allocated memory or NULL.
+ */
+static void test_heap_alloc(void* ptr) {
+  if (ptr != NULL) {
+    atomic_fetch_add(&heap_allocations, 1);
+    atomic_fetch_add(&heap_used, malloc_usable_size(ptr));
+  }
+}
+
+/**
+ * Account for memory that is about to be released.
+ *
+ * @param[in] ptr The allocated memory or NULL.
+ */
+static void test_heap_release(void* ptr) {
+  if (ptr != NULL) {
+    atomic_fetch_sub(&heap_used, malloc_usable_size(ptr));
+  }
+}
+
+// The allocator is wrapped by the linker, which redirects the calls of the
+// tests and the modules, but not those within the C library.
+void* __wrap_malloc(size_t size) {
+  void* ptr = __real_malloc(size);
+  test_heap_alloc(ptr);
+  return ptr;
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+  void* ptr = __real_calloc(count, size);
+  test_heap_alloc(ptr);
+  return ptr;
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+  test_heap_release(ptr);
+  void* result = __real_realloc(ptr, size);
+  // The original memory is kept if it can't be resized.
+  test_heap_alloc(result != NULL || size == 0 ? result : ptr);
+  return result;
+}
+
+void __wrap_free(void* ptr) {
+  test_heap_release(ptr);
+  __real_free(ptr);
+}
+
+size_t test_heap_allocations(void) {
+  return atomic_load(&heap_allocations);
+}
+
+size_t test_heap_used(void) {
+  return atomic_load(&heap_used);
+}
+
+#else
+
+size_t test_heap_allocations(void) {
+  return 0;
+}
+
+size_t test_heap_used(void) {
+  return 0;
+}
+
+#endif
@@ -0,0 +1,452 @@
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_err.h"
+#include "metrics.h"
+#include "outbuf.h"
+#include "prom.h"
+#include "test.h"
+
+// Number of threads recording concurrently.
+#define TEST_METRICS_THREADS 8
+// Number of values recorded by every thread.
+#define TEST_METRICS_VALUES 200000
+// Maximum size of an exported document.
+#define TEST_METRICS_DOCUMENT_SIZE (32 * 1024)
+// Amount added at once to a total, so that bit 31 flips often.
+#define TEST_METRICS_AMOUNT ((1u << 20) + 3)
+// The value of every observation of the snapshot test.
+#define TEST_METRICS_OBSERVATION 7
+// Number of spins between two observations of the snapshot test, like the
+// time between two requests.
+#define TEST_METRICS_PAUSE 200
+
+/**
+ * An exported document.
+ *
+ * @param text The text, which is terminated by a null character.
+ * @param length Number of characters of the text.
+ */
+typedef struct test_metrics_document {
+  char text[TEST_METRICS_DOCUMENT_SIZE];
+  size_t length;
+} test_metrics_document_t;
+
+// The upper bounds of the histogram.
+static const uint32_t latency_bounds[] = {10, 50, 90};
+
+// Counts the recorded values.
+static metrics_metric_t values_total = METRICS_COUNTER_INIT(
+    "test_metrics_values_total", "Number of recorded values.");
+// Sums the recorded values.
+static metrics_metric_t value_sum_total = METRICS_COUNTER_INIT(
+    "test_metrics_value_sum_total", "Sum of the recorded values.");
+// Distribution of the recorded values.
+static metrics_metric_t latency = METRICS_HISTOGRAM_INIT(
+    "test_metrics_latency", "Distribution of the recorded values.",
+    latency_bounds, 1);
+// Set by the last thread that recorded.
+static metrics_metric_t level = METRICS_GAUGE_INIT(
+    "test_metrics_level", "Index of a thread that recorded.");
+// Distribution of values that are all the same.
+static metrics_metric_t constant = METRICS_HISTOGRAM_INIT(
+    "test_metrics_constant", "Distribution of a constant value.",
+    latency_bounds, 1);
+// Tells the recording threads to start, so that they overlap.
+static _Atomic bool start = false;
+// A total that grows past 2^32 while being read.
+static metrics_total_t total;
+
+/**
+ * Get a value recorded by a thread.
+ *
+ * @param[in] i The index of the value.
+ *
+ * @return The value, which falls into every bucket of the histogram.
+ */
+static uint32_t test_metrics_value(uint32_t i) { return i % 100; }
+
+/**
+ * Record values in all metrics.
+ *
+ * @param[in] arg The index of the thread.
+ *
+ * @return NULL.
+ */
+static void* test_metrics_record(void* arg) {
+  while (!atomic_load(&start)) {
+  }
+  for (uint32_t i = 0; i < TEST_METRICS_VALUES; ++i) {
+    uint32_t value = test_metrics_value(i);
+    metrics_add(&values_total, 1);
+    metrics_add(&value_sum_total, value);
+    metrics_observe(&latency, value);
+  }
+  metrics_set(&level, (int32_t)(intptr_t)arg);
+  return NULL;
+}
+
+/**
+ * Append text to a document. This is an `outbuf_sink_t`.
+ *
+ * @param[in] ctx The document.
+ * @param[in] data The text.
+ * @param[in] length Number of characters.
+ *
+ * @return ESP_OK or ESP_ERR_NO_MEM if the document is full.
+ */
+static esp_err_t test_metrics_append(void* ctx, const char* data,
+                                     size_t length) {
+  test_metrics_document_t* document = (test_metrics_document_t*)ctx;
+  if (document->length + length >= sizeof(document->text)) {
+    return ESP_ERR_NO_MEM;
+  }
+  memcpy(&document->text[document->length], data, length);
+  document->length += length;
+  document->text[document->length] = '\0';
+  return ESP_OK;
+}
+
+/**
+ * Export all registered metrics in the text format.
+ *
+ * @param[out] document Receives the exported text.
+ *
+ * @return true if the document is complete.
+ */
+static bool test_metrics_export(test_metrics_document_t* document) {
+  outbuf_t out;
+  prom_t prom;
+  document->length = 0;
+  document->text[0] = '\0';
+  outbuf_init(&out, test_metrics_append, document);
+  prom_init(&prom, &out, PROM_TEXT);
+  metrics_export(&prom);
+  return outbuf_flush(&out) == ESP_OK;
+}
+
+/**
+ * Check that the exported histogram is consistent: the cumulative counts of
+ * its buckets never decrease and the last one equals its count.
+ *
+ * @param[in] document The exported text.
+ * @param[out] count Receives the count of the histogram.
+ *
+ * @return true if the histogram was found and is consistent.
+ */
+static bool test_metrics_check_histogram(const char* document,
+                                         uint64_t* count) {
+  static const char bucket_prefix[] = "test_metrics_latency_bucket{";
+  static const char count_prefix[] = "test_metrics_latency_count ";
+  uint64_t cumulative = 0;
+  size_t buckets = 0;
+
+  for (const char* line = document; *line != '\0';) {
+    if (strncmp(line, bucket_prefix, sizeof(bucket_prefix) - 1) == 0) {
+      uint64_t value = strtoull(strstr(line, "} ") + 2, NULL, 10);
+      TEST_CHECK(value >= cumulative);
+      cumulative = value;
+      buckets += 1;
+    } else if (strncmp(line, count_prefix, sizeof(count_prefix) - 1) == 0) {
+      *count = strtoull(line + sizeof(count_prefix) - 1, NULL, 10);
+      TEST_CHECK(buckets == latency.bound_count + 1);
+      TEST_CHECK(*count == cumulative);
+      return true;
+    }
+    const char* end = strchr(line, '\n');
+    line = end != NULL ? end + 1 : line + strlen(line);
+  }
+  test_fail(__FILE__, __LINE__, "the histogram is exported");
+  return false;
+}
+
+/**
+ * Record from many threads while exporting, then check that no update was
+ * lost and that every export was consistent.
+ *
+ * @return true if the test passed.
+ */
+static bool test_metrics_concurrent(void) {
+  static test_metrics_document_t document;
+
+  TEST_CHECK(metrics_register(&values_total) == ESP_OK);
+  TEST_CHECK(metrics_register(&value_sum_total) == ESP_OK);
+  TEST_CHECK(metrics_register(&latency) == ESP_OK);
+  TEST_CHECK(metrics_register(&level) == ESP_OK);
+
+  pthread_t threads[TEST_METRICS_THREADS];
+  for (size_t i = 0; i < TEST_METRICS_THREADS; ++i) {
+    TEST_CHECK(pthread_create(&threads[i], NULL, test_metrics_record,
+                              (void*)(intptr_t)(i + 1)) == 0);
+  }
+  atomic_store(&start, true);
+
+  // Export while the threads record, as the metrics endpoint does.
+  bool consistent = true;
+  uint64_t previous = 0;
+  for (size_t i = 0; i < 200 && consistent; ++i) {
+    uint64_t count = 0;
+    consistent = test_metrics_export(&document) &&
+                 test_metrics_check_histogram(document.text, &count) &&
+                 count >= previous;
+    previous = count;
+  }
+  for (size_t i = 0; i < TEST_METRICS_THREADS; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+  TEST_CHECK(consistent);
+
+  // Every thread records the same values.
+  uint64_t expected_sum = 0;
+  uint64_t expected_buckets[METRICS_MAX_BUCKETS + 1] = {0};
+  for (uint32_t i = 0; i < TEST_METRICS_VALUES; ++i) {
+    uint32_t value = test_metrics_value(i);
+    size_t bucket = 0;
+    while (bucket < latency.bound_count && value > latency_bounds[bucket]) {
+      bucket += 1;
+    }
+    expected_buckets[bucket] += TEST_METRICS_THREADS;
+    expected_sum += (uint64_t)value * TEST_METRICS_THREADS;
+  }
+  uint64_t expected_count =
+      (uint64_t)TEST_METRICS_THREADS * TEST_METRICS_VALUES;
+
+  TEST_CHECK(metrics_value(&values_total) == expected_count);
+  TEST_CHECK(metrics_value(&value_sum_total) == expected_sum);
+  TEST_CHECK(metrics_observations(&latency) == expected_count);
+  TEST_CHECK(metrics_value(&latency) == expected_sum);
+  for (size_t i = 0; i <= latency.bound_count; ++i) {
+    TEST_CHECK(atomic_load(&latency.buckets[i]) == expected_buckets[i]);
+  }
+  TEST_CHECK(metrics_value(&level) >= 1 &&
+             metrics_value(&level) <= TEST_METRICS_THREADS);
+
+  // The final export agrees with the values read directly.
+  uint64_t count = 0;
+  TEST_CHECK(test_metrics_export(&document));
+  TEST_CHECK(test_metrics_check_histogram(document.text, &count));
+  TEST_CHECK(count == expected_count);
+  char line[64];
+  snprintf(line, sizeof(line), "test_metrics_values_total %" PRIu64 "\n",
+           expected_count);
+  TEST_CHECK(strstr(document.text, line) != NULL);
+
+  return true;
+}
+
+/**
+ * Check that registering a metric twice exports it once and that histograms
+ * with too many buckets are rejected.
+ *
+ * @return true if the test passed.
+ */
+static bool test_metrics_register(void) {
+  static const uint32_t bounds[METRICS_MAX_BUCKETS + 1] = {0};
+  static metrics_metric_t oversized = METRICS_HISTOGRAM_INIT(
+      "test_metrics_oversized", "Has too many buckets.", bounds, 1);
+
+  TEST_CHECK(metrics_register(&values_total) == ESP_OK);
+  size_t count = metrics_count();
+  TEST_CHECK(metrics_register(&values_total) == ESP_OK);
+  TEST_CHECK(metrics_count() == count);
+  TEST_CHECK(metrics_register(&oversized) == ESP_ERR_INVALID_SIZE);
+  TEST_CHECK(metrics_count() == count);
+
+  return true;
+}
+
+/**
+ * Check that a gauge set in microseconds is read and exported in seconds.
+ *
+ * @return true if the test passed.
+ */
+static bool test_metrics_scaled_gauge(void) {
+  static metrics_metric_t ready = METRICS_GAUGE_SCALED_INIT(
+      "test_metrics_ready_seconds", "Time until ready.", 1e-6);
+  static test_metrics_document_t document;
+
+  TEST_CHECK(metrics_register(&ready) == ESP_OK);
+  metrics_set(&ready, 1250000);
+  TEST_CHECK(metrics_value(&ready) == 1.25);
+  TEST_CHECK(test_metrics_export(&document));
+  TEST_CHECK(strstr(document.text, "test_metrics_ready_seconds 1.25\n") !=
+             NULL);
+
+  return true;
+}
+
+/**
+ * Check that a total carries into its high word, also while the carry of a
+ * flip of bit 31 is still in flight.
+ *
+ * @return true if the test passed.
+ */
+static bool test_metrics_total(void) {
+  metrics_total_t carried = {0};
+  uint64_t expected = 0;
+  for (uint32_t i = 0; i < 40; ++i) {
+    uint32_t amount = 0x7fffffff - i * 12345;
+    metrics_total_add(&carried, amount);
+    expected += amount;
+    TEST_CHECK(metrics_total_load(&carried) == expected);
+  }
+  TEST_CHECK(expected > ((uint64_t)1 << 36));
+
+  // A writer interrupted between flipping bit 31 and the carry.
+  metrics_total_t pending = {0};
+  atomic_store(&pending.low, 0x80000005);
+  TEST_CHECK(metrics_total_load(&pending) == 0x80000005);
+  atomic_store(&pending.low, 0x00000009);
+  atomic_store(&pending.high, 1);
+  TEST_CHECK(metrics_total_load(&pending) == 0x100000009);
+
+  return true;
+}
+
+/**
+ * Add large amounts to a total.
+ *
+ * @param[in] arg Unused.
+ *
+ * @return NULL.
+ */
+static void* test_metrics_add_total(void* arg) {
+  while (!atomic_load(&start)) {
+  }
+  for (uint32_t i = 0; i < TEST_METRICS_VALUES; ++i) {
+    metrics_total_add(&total, TEST_METRICS_AMOUNT);
+  }
+  return NULL;
+}
+
+/**
+ * Add to a total from many threads while reading it, so that bit 31 flips
+ * many times. The total never decreases and no addition is lost.
+ *
+ * @return true if the test passed.
+ */
+static bool test_metrics_total_concurrent(void) {
+  atomic_store(&start, false);
+  pthread_t threads[TEST_METRICS_THREADS];
+  for (size_t i = 0; i < TEST_METRICS_THREADS; ++i) {
+    TEST_CHECK(pthread_create(&threads[i], NULL, test_metrics_add_total,
+                              NULL) == 0);
+  }
+  atomic_store(&start, true);
+
+  uint64_t expected = (uint64_t)TEST_METRICS_THREADS * TEST_METRICS_VALUES *
+                      TEST_METRICS_AMOUNT;
+  bool monotonic = true;
+  uint64_t previous = 0;
+  while (previous < expected && monotonic) {
+    uint64_t value = metrics_total_load(&total);
+    monotonic = value >= previous && value <= expected;
+    previous = value;
+  }
+  for (size_t i = 0; i < TEST_METRICS_THREADS; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+  TEST_CHECK(monotonic);
+  TEST_CHECK(metrics_total_load(&total) == expected);
+
+  return true;
+}
+
+/**
+ * Observe a constant value with pauses in between, like requests arrive.
+ *
+ * @param[in] arg Unused.
+ *
+ * @return NULL.
+ */
+static void* test_metrics_observe_constant(void* arg) {
+  while (!atomic_load(&start)) {
+  }
+  for (uint32_t i = 0; i < TEST_METRICS_VALUES; ++i) {
+    metrics_observe(&constant, TEST_METRICS_OBSERVATION);
+    for (volatile uint32_t spin = 0; spin < TEST_METRICS_PAUSE; ++spin) {
+    }
+  }
+  return NULL;
+}
+
+/**
+ * Take snapshots of a histogram while threads observe a constant value. The
+ * sum of every snapshot must match its count, which reading the buckets and
+ * the sum separately doesn't guarantee.
+ *
+ * @return true if the test passed.
+ */
+static bool test_metrics_snapshot(void) {
+  TEST_CHECK(metrics_register(&constant) == ESP_OK);
+
+  atomic_store(&start, false);
+  pthread_t threads[TEST_METRICS_THREADS / 2];
+  size_t thread_count = sizeof(threads) / sizeof(threads[0]);
+  for (size_t i = 0; i < thread_count; ++i) {
+    TEST_CHECK(pthread_create(&threads[i], NULL, test_metrics_observe_constant,
+                              NULL) == 0);
+  }
+  atomic_store(&start, true);
+
+  uint64_t expected = (uint64_t)thread_count * TEST_METRICS_VALUES;
+  size_t snapshots = 0;
+  size_t inconsistent = 0;
+  metrics_snapshot_t snapshot = {0};
+  while (snapshot.count < expected) {
+    metrics_snapshot(&constant, &snapshot);
+    snapshots += 1;
+    if (snapshot.sum != snapshot.count * TEST_METRICS_OBSERVATION ||
+        snapshot.value != (double)snapshot.sum) {
+      inconsistent += 1;
+    }
+  }
+  for (size_t i = 0; i < thread_count; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+  TEST_CHECK(snapshots > 1);
+  TEST_CHECK(inconsistent == 0);
+  TEST_CHECK(snapshot.buckets[0] == expected);
+  TEST_CHECK(snapshot.sum == expected * TEST_METRICS_OBSERVATION);
+
+  // Counters and gauges are read like their values.
+  metrics_snapshot(&values_total, &snapshot);
+  TEST_CHECK(snapshot.value == metrics_value(&values_total));
+
+  return true;
+}
+
+const test_case_t test_metrics_cases[] = {
+    {
+        .name = "metrics/concurrent",
+        .run = test_metrics_concurrent,
+    },
+    {
+        .name = "metrics/register",
+        .run = test_metrics_register,
+    },
+    {
+        .name = "metrics/scaled_gauge",
+        .run = test_metrics_scaled_gauge,
+    },
+    {
+        .name = "metrics/total",
+        .run = test_metrics_total,
+    },
+    {
+        .name = "metrics/total_concurrent",
+        .run = test_metrics_total_concurrent,
+    },
+    {
+        .name = "metrics/snapshot",
+        .run = test_metrics_snapshot,
+    },
+    {0},
+};
@@ -0,0 +1,408 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "esp_app_desc.h"
+#include "esp_err.h"
+#include "esp_http_client.h"
+#include "esp_image_format.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "manifest.h"
+#include "mbedtls/sha256.h"
+#include "peer.h"
+#include "sdkconfig.h"
+#include "test.h"
+
+// Number of other devices on the local network, each of which is emulated by
+// a socket bound to its own loopback address.
+#define TEST_PEER_FLEET 8
+// Size of the data of the only segment of the images, which makes the images
+// end at a 16 B boundary without padding.
+#define TEST_PEER_DATA_SIZE (200 * 1024 + 15)
+// Size of the images, including the headers, the checksum and the digest.
+#define TEST_PEER_IMAGE_SIZE                                        \
+  (sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t) + \
+   TEST_PEER_DATA_SIZE + 1 + ESP_IMAGE_HASH_LEN)
+// The URL of the release on the update source.
+#define TEST_PEER_UPSTREAM_URL "https://zeus.test/latest/zeus-esp32.bin"
+// The port of the HTTP server of every device.
+#define TEST_PEER_HTTP_PORT 80
+// Maximum time to wait for the peer thread in milliseconds.
+#define TEST_PEER_TIMEOUT_MS 5000
+
+/**
+ * An emulated device on the local network.
+ *
+ * @param sock The socket from which it announces its firmware.
+ * @param address The loopback address of the socket in network byte order.
+ * @param url The URL at which it serves its firmware.
+ * @param image The firmware image it downloaded.
+ */
+typedef struct test_peer_device {
+  int sock;
+  uint32_t address;
+  char url[PEER_URL_SIZE];
+  uint8_t image[TEST_PEER_IMAGE_SIZE];
+} test_peer_device_t;
+
+/**
+ * A fleet rolling out a release.
+ *
+ * @param running The image running on all devices before the rollout.
+ * @param release The image of the release.
+ * @param manifest The manifest of the release.
+ * @param devices The other devices.
+ * @param impostor A device that announces the release with a wrong digest.
+ * @param upstream_bytes Number of bytes downloaded from the update source.
+ * @param peer_bytes Number of bytes downloaded from peers.
+ */
+typedef struct test_peer_fleet {
+  uint8_t running[TEST_PEER_IMAGE_SIZE];
+  uint8_t release[TEST_PEER_IMAGE_SIZE];
+  manifest_t manifest;
+  test_peer_device_t devices[TEST_PEER_FLEET];
+  test_peer_device_t impostor;
+  size_t upstream_bytes;
+  size_t peer_bytes;
+} test_peer_fleet_t;
+
+/**
+ * The announcement of a device, in the format expected by the peer module,
+ * with all integers in network byte order.
+ *
+ * @param magic Identifies the announcement.
+ * @param format Version of the announcement format.
+ * @param reserved Must be zero.
+ * @param port The port of the HTTP server.
+ * @param nonce Random number identifying the sender.
+ * @param size Size of the firmware image in bytes.
+ * @param sha256 The SHA-256 digest of the firmware image.
+ * @param version The null-terminated version of the firmware.
+ */
+typedef struct __attribute__((packed)) test_peer_announcement {
+  char magic[4];
+  uint8_t format;
+  uint8_t reserved;
+  uint16_t port;
+  uint32_t nonce;
+  uint32_t size;
+  uint8_t sha256[MANIFEST_SHA256_LEN];
+  char version[33];
+} test_peer_announcement_t;
+
+/**
+ * Hash data.
+ *
+ * @param[in] data The data.
+ * @param[in] length Number of bytes.
+ * @param[out] digest Receives the SHA-256 digest.
+ */
+static void test_peer_sha256(const void* data, size_t length,
+                             uint8_t digest[MANIFEST_SHA256_LEN]) {
+  mbedtls_sha256_context sha256;
+  mbedtls_sha256_init(&sha256);
+  mbedtls_sha256_starts(&sha256, 0);
+  mbedtls_sha256_update(&sha256, data, length);
+  mbedtls_sha256_finish(&sha256, digest);
+  mbedtls_sha256_free(&sha256);
+}
+
+/**
+ * Create an app image with a single segment, which starts with the app
+ * description.
+ *
+ * @param[out] image Receives the image.
+ * @param[in] version The version of the firmware.
+ * @param[in] seed Seed of the data of the segment.
+ */
+static void test_peer_image(uint8_t image[TEST_PEER_IMAGE_SIZE],
+                            const char* version, uint32_t seed) {
+  uint32_t random = seed;
+  for (size_t i = 0; i < TEST_PEER_IMAGE_SIZE; ++i) {
+    image[i] = (uint8_t)test_random(&random);
+  }
+
+  esp_image_header_t header = {
+      .magic = ESP_IMAGE_HEADER_MAGIC,
+      .segment_count = 1,
+      .hash_appended = 1,
+  };
+  esp_image_segment_header_t segment = {
+      .load_addr = 0x3f400020,
+      .data_len = TEST_PEER_DATA_SIZE,
+  };
+  esp_app_desc_t app = {
+      .magic_word = ESP_APP_DESC_MAGIC_WORD,
+  };
+  strcpy(app.version, version);
+  strcpy(app.project_name, "zeus");
+  memcpy(image, &header, sizeof(header));
+  memcpy(&image[sizeof(header)], &segment, sizeof(segment));
+  memcpy(&image[sizeof(header) + sizeof(segment)], &app, sizeof(app));
+}
+
+/**
+ * Announce a firmware image from a device, like the peer thread does.
+ *
+ * @param[in] device The device.
+ * @param[in] image The image.
+ * @param[in] version The version of the image.
+ * @param[in] nonce Identifies the device.
+ *
+ * @return true if the announcement was sent.
+ */
+static bool test_peer_announce(const test_peer_device_t* device,
+                               const uint8_t* image, const char* version,
+                               uint32_t nonce) {
+  test_peer_announcement_t announcement = {
+      .magic = {'Z', 'E', 'U', 'S'},
+      .format = 1,
+      .port = htons(TEST_PEER_HTTP_PORT),
+      .nonce = nonce,
+      .size = htonl(TEST_PEER_IMAGE_SIZE),
+  };
+  test_peer_sha256(image, TEST_PEER_IMAGE_SIZE, announcement.sha256);
+  strcpy(announcement.version, version);
+
+  struct sockaddr_in address = {
+      .sin_family = AF_INET,
+      .sin_port = htons(CONFIG_ZEUS_PEER_PORT),
+      .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+  };
+  return sendto(device->sock, &announcement, sizeof(announcement), 0,
+                (struct sockaddr*)&address,
+                sizeof(address)) == sizeof(announcement);
+}
+
+/**
+ * Open the socket of a device on its own loopback address.
+ *
+ * @param[out] device The device.
+ * @param[in] index The index of the device, which selects its address.
+ *
+ * @return true if the socket was opened.
+ */
+static bool test_peer_open(test_peer_device_t* device, size_t index) {
+  device->address = htonl(INADDR_LOOPBACK + 2 + index);
+  const uint8_t* octets = (const uint8_t*)&device->address;
+  snprintf(device->url, sizeof(device->url), "http://%u.%u.%u.%u:%u%s",
+           octets[0], octets[1], octets[2], octets[3], TEST_PEER_HTTP_PORT,
+           PEER_PATH);
+
+  struct sockaddr_in address = {
+      .sin_family = AF_INET,
+      .sin_addr.s_addr = device->address,
+  };
+  device->sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (device->sock < 0) {
+    return false;
+  }
+  return bind(device->sock, (struct sockaddr*)&address, sizeof(address)) == 0;
+}
+
+/**
+ * Wait until the peer module knows a device running a version.
+ *
+ * @param[in] address The address of the device in network byte order, or 0
+ * for any device.
+ * @param[in] version The version.
+ * @param[in] count Number of devices that must be known.
+ *
+ * @return true if the devices are known before the timeout.
+ */
+static bool test_peer_wait(uint32_t address, const char* version,
+                           size_t count) {
+  for (int waited = 0; waited < TEST_PEER_TIMEOUT_MS; ++waited) {
+    peer_t peers[PEER_MAX];
+    size_t listed = peer_list(peers, PEER_MAX);
+    size_t matches = 0;
+    for (size_t i = 0; i < listed; ++i) {
+      if ((address == 0 || peers[i].address == address) &&
+          strcmp(peers[i].version, version) == 0) {
+        matches += 1;
+      }
+    }
+    if (matches >= count) {
+      return true;
+    }
+    usleep(1000);
+  }
+  return false;
+}
+
+/**
+ * Download an image and check it against the manifest of the release.
+ *
+ * @param[in] url The URL of the image.
+ * @param[in] manifest The manifest of the release.
+ * @param[out] image Receives the image.
+ * @param[out] downloaded Receives the number of bytes received.
+ *
+ * @return true if the image matches the manifest.
+ */
+static bool test_peer_download(const char* url, const manifest_t* manifest,
+                               uint8_t image[TEST_PEER_IMAGE_SIZE],
+                               size_t* downloaded) {
+  esp_http_client_config_t config = {
+      .url = url,
+  };
+  esp_http_client_handle_t client = esp_http_client_init(&config);
+  *downloaded = 0;
+  if (client == NULL) {
+    return false;
+  }
+
+  if (esp_http_client_open(client, 0) == ESP_OK &&
+      esp_http_client_fetch_headers(client) == TEST_PEER_IMAGE_SIZE &&
+      esp_http_client_get_status_code(client) == 200) {
+    int bytes_read = 0;
+    do {
+      bytes_read = esp_http_client_read(
+          client, (char*)&image[*downloaded],
+          TEST_PEER_IMAGE_SIZE - *downloaded);
+      if (bytes_read > 0) {
+        *downloaded += (size_t)bytes_read;
+      }
+    } while (bytes_read > 0 && *downloaded < TEST_PEER_IMAGE_SIZE);
+  }
+  esp_http_client_close(client);
+  esp_http_client_cleanup(client);
+
+  uint8_t digest[MANIFEST_SHA256_LEN];
+  test_peer_sha256(image, *downloaded, digest);
+  return *downloaded == manifest->size &&
+         memcmp(digest, manifest->sha256, MANIFEST_SHA256_LEN) == 0;
+}
+
+/**
+ * Update a device, preferring a peer running the release over the update
+ * source, like the update module does.
+ *
+ * @param[in,out] fleet The fleet.
+ * @param[in,out] device The device.
+ *
+ * @return true if the image was installed.
+ */
+static bool test_peer_update(test_peer_fleet_t* fleet,
+                             test_peer_device_t* device) {
+  char url[PEER_URL_SIZE];
+  size_t downloaded = 0;
+  bool installed = false;
+  if (peer_find(&fleet->manifest, url, sizeof(url)) == ESP_OK) {
+    installed =
+        test_peer_download(url, &fleet->manifest, device->image, &downloaded);
+    fleet->peer_bytes += downloaded;
+  }
+  if (!installed) {
+    installed = test_peer_download(TEST_PEER_UPSTREAM_URL, &fleet->manifest,
+                                   device->image, &downloaded);
+    fleet->upstream_bytes += downloaded;
+  }
+  return installed;
+}
+
+/**
+ * Roll out a release to a fleet on the local network, whose devices update one
+ * after another. Every device that installed the release announces it and
+ * serves it to the others, so only the first device downloads it from the
+ * update source. A device announcing the release with a wrong digest must
+ * never be picked.
+ *
+ * @return true if the test passed.
+ */
+static bool test_peer_rollout(void) {
+  test_peer_fleet_t* fleet = calloc(1, sizeof(*fleet));
+  TEST_CHECK(fleet != NULL);
+  test_peer_image(fleet->running, "v1.0.0", 1);
+  test_peer_image(fleet->release, "v1.1.0", 2);
+  strcpy(fleet->manifest.version, "v1.1.0");
+  fleet->manifest.size = TEST_PEER_IMAGE_SIZE;
+  test_peer_sha256(fleet->release, TEST_PEER_IMAGE_SIZE,
+                   fleet->manifest.sha256);
+  TEST_CHECK(esp_http_client_host_serve(TEST_PEER_UPSTREAM_URL, 200,
+                                        fleet->release,
+                                        TEST_PEER_IMAGE_SIZE) == ESP_OK);
+
+  // This device identifies its running image before it listens.
+  const esp_partition_t* running = esp_ota_get_running_partition();
+  size_t erase_size = (TEST_PEER_IMAGE_SIZE + 4095) / 4096 * 4096;
+  TEST_CHECK(esp_partition_erase_range(running, 0, erase_size) == ESP_OK);
+  TEST_CHECK(esp_partition_write(running, 0, fleet->running,
+                                 TEST_PEER_IMAGE_SIZE) == ESP_OK);
+  TEST_CHECK(peer_init() == ESP_OK);
+  peer_t identity;
+  esp_err_t err = ESP_ERR_INVALID_STATE;
+  for (int waited = 0; waited < TEST_PEER_TIMEOUT_MS && err != ESP_OK;
+       ++waited) {
+    err = peer_get_image(&identity);
+    usleep(1000);
+  }
+  TEST_CHECK(err == ESP_OK);
+  uint8_t digest[MANIFEST_SHA256_LEN];
+  test_peer_sha256(fleet->running, TEST_PEER_IMAGE_SIZE, digest);
+  TEST_CHECK(strcmp(identity.version, "v1.0.0") == 0);
+  TEST_CHECK(identity.size == TEST_PEER_IMAGE_SIZE);
+  TEST_CHECK(memcmp(identity.sha256, digest, sizeof(digest)) == 0);
+
+  // All other devices run the previous release, but one claims the new one.
+  for (size_t i = 0; i < TEST_PEER_FLEET; ++i) {
+    test_peer_device_t* device = &fleet->devices[i];
+    TEST_CHECK(test_peer_open(device, i));
+    TEST_CHECK(test_peer_announce(device, fleet->running, "v1.0.0", i + 1));
+  }
+  test_peer_device_t* impostor = &fleet->impostor;
+  TEST_CHECK(test_peer_open(impostor, TEST_PEER_FLEET));
+  TEST_CHECK(test_peer_announce(impostor, fleet->running, "v1.1.0", 100));
+  TEST_CHECK(esp_http_client_host_serve(impostor->url, 200, fleet->running,
+                                        TEST_PEER_IMAGE_SIZE) == ESP_OK);
+  TEST_CHECK(test_peer_wait(0, "v1.0.0", TEST_PEER_FLEET));
+  TEST_CHECK(test_peer_wait(impostor->address, "v1.1.0", 1));
+  char url[PEER_URL_SIZE];
+  TEST_CHECK(peer_find(&fleet->manifest, url, sizeof(url)) ==
+             ESP_ERR_NOT_FOUND);
+
+  bool installed = true;
+  for (size_t i = 0; i < TEST_PEER_FLEET && installed; ++i) {
+    test_peer_device_t* device = &fleet->devices[i];
+    installed = test_peer_update(fleet, device) &&
+                esp_http_client_host_serve(device->url, 200, device->image,
+                                           TEST_PEER_IMAGE_SIZE) == ESP_OK &&
+                test_peer_announce(device, device->image, "v1.1.0", i + 1) &&
+                test_peer_wait(device->address, "v1.1.0", 1);
+  }
+
+  for (size_t i = 0; i <= TEST_PEER_FLEET; ++i) {
+    test_peer_device_t* device =
+        i < TEST_PEER_FLEET ? &fleet->devices[i] : impostor;
+    esp_http_client_host_serve(device->url, 404, NULL, 0);
+    close(device->sock);
+  }
+  esp_http_client_host_serve(TEST_PEER_UPSTREAM_URL, 404, NULL, 0);
+  size_t upstream_bytes = fleet->upstream_bytes;
+  size_t peer_bytes = fleet->peer_bytes;
+  free(fleet);
+
+  TEST_CHECK(installed);
+  // Without peers, every device would download the release from the update
+  // source.
+  TEST_CHECK(upstream_bytes == TEST_PEER_IMAGE_SIZE);
+  TEST_CHECK(peer_bytes == (TEST_PEER_FLEET - 1) * TEST_PEER_IMAGE_SIZE);
+
+  return true;
+}
+
+const test_case_t test_peer_cases[] = {
+    {
+        .name = "peer/rollout",
+        .run = test_peer_rollout,
+    },
+    {0},
+};
@@ -0,0 +1,281 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "relay.h"
+#include "sdkconfig.h"
+#include "test.h"
+
+// Number of outlets of the emulated relay board.
+#define TEST_RELAY_OUTLETS 4
+// Maximum number of recorded switchings.
+#define TEST_RELAY_EVENTS 64
+// Maximum time to wait for the relay thread in milliseconds.
+#define TEST_RELAY_TIMEOUT_MS 2000
+// Minimum time between turning on two outlets in microseconds.
+#define TEST_RELAY_STAGGER_US (CONFIG_ZEUS_RELAY_STAGGER_MS * 1000LL)
+// Allowed delay of the relay thread beyond the stagger in microseconds.
+#define TEST_RELAY_SLACK_US (TEST_RELAY_STAGGER_US / 2)
+
+/**
+ * A switching of a relay.
+ *
+ * @param outlet The index of the outlet.
+ * @param on Indicates that the outlet was turned on.
+ * @param time_us The time of the switching.
+ */
+typedef struct test_relay_event {
+  size_t outlet;
+  bool on;
+  int64_t time_us;
+} test_relay_event_t;
+
+// The switchings since the log was last cleared.
+static test_relay_event_t events[TEST_RELAY_EVENTS];
+// Number of recorded switchings.
+static size_t event_count = 0;
+// Indicates that switching is held up, like by a slow relay.
+static bool held = false;
+// Indicates that the relay thread is held up in the driver.
+static bool holding = false;
+// Guards the log and the hold.
+static pthread_mutex_t events_mutex = PTHREAD_MUTEX_INITIALIZER;
+// Signals that the hold was released.
+static pthread_cond_t released = PTHREAD_COND_INITIALIZER;
+
+/**
+ * Record the switching of a relay, waiting while switching is held up.
+ *
+ * @param[in] ctx Unused.
+ * @param[in] outlet The index of the outlet.
+ * @param[in] on Indicates that the outlet is turned on.
+ *
+ * @return ESP_OK.
+ */
+static esp_err_t test_relay_write(void* ctx, size_t outlet, bool on) {
+  pthread_mutex_lock(&events_mutex);
+  holding = held;
+  while (held) {
+    pthread_cond_wait(&released, &events_mutex);
+  }
+  holding = false;
+  if (event_count < TEST_RELAY_EVENTS) {
+    events[event_count++] = (test_relay_event_t){
+        .outlet = outlet,
+        .on = on,
+        .time_us = esp_timer_get_time(),
+    };
+  }
+  pthread_mutex_unlock(&events_mutex);
+  return ESP_OK;
+}
+
+/**
+ * Start the relays once for all tests and clear the log.
+ *
+ * @return true if the relays were started.
+ */
+static bool test_relay_start(void) {
+  static bool started = false;
+  if (!started) {
+    relay_driver_t driver = {
+        .write = test_relay_write,
+        .ctx = NULL,
+        .outlet_count = TEST_RELAY_OUTLETS,
+    };
+    started = relay_start(&driver) == ESP_OK;
+  }
+  pthread_mutex_lock(&events_mutex);
+  event_count = 0;
+  pthread_mutex_unlock(&events_mutex);
+  return started;
+}
+
+/**
+ * Wait until an outlet is in a state.
+ *
+ * @param[in] outlet The index of the outlet.
+ * @param[in] on The expected state.
+ *
+ * @return true if the outlet reached the state in time.
+ */
+static bool test_relay_await(size_t outlet, bool on) {
+  for (int i = 0; i < TEST_RELAY_TIMEOUT_MS; ++i) {
+    if (relay_get(outlet) == on) {
+      return true;
+    }
+    usleep(1000);
+  }
+  return false;
+}
+
+/**
+ * Find the first recorded switching of an outlet into a state.
+ *
+ * @param[in] outlet The index of the outlet.
+ * @param[in] on The state.
+ *
+ * @return The switching or NULL if it wasn't recorded.
+ */
+static const test_relay_event_t* test_relay_find(size_t outlet, bool on) {
+  const test_relay_event_t* event = NULL;
+  pthread_mutex_lock(&events_mutex);
+  for (size_t i = 0; i < event_count && event == NULL; ++i) {
+    if (events[i].outlet == outlet && events[i].on == on) {
+      event = &events[i];
+    }
+  }
+  pthread_mutex_unlock(&events_mutex);
+  return event;
+}
+
+/**
+ * Turn all outlets off and wait for it.
+ *
+ * @return true if all outlets were turned off.
+ */
+static bool test_relay_reset(void) {
+  uint32_t all = (1UL << TEST_RELAY_OUTLETS) - 1;
+  if (relay_submit(all, 0, esp_timer_get_time()) != ESP_OK) {
+    return false;
+  }
+  for (size_t outlet = 0; outlet < TEST_RELAY_OUTLETS; ++outlet) {
+    if (!test_relay_await(outlet, false)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * Turn on all outlets at once and check that they are turned on one after
+ * the other, spaced by the stagger.
+ *
+ * @return true if the test passed.
+ */
+static bool test_relay_stagger(void) {
+  TEST_CHECK(test_relay_start());
+
+  uint32_t all = (1UL << TEST_RELAY_OUTLETS) - 1;
+  TEST_CHECK(relay_submit(all, all, esp_timer_get_time()) == ESP_OK);
+  TEST_CHECK(test_relay_await(TEST_RELAY_OUTLETS - 1, true));
+
+  const test_relay_event_t* previous = NULL;
+  for (size_t outlet = 0; outlet < TEST_RELAY_OUTLETS; ++outlet) {
+    const test_relay_event_t* event = test_relay_find(outlet, true);
+    TEST_CHECK(event != NULL);
+    if (previous != NULL) {
+      int64_t spacing_us = event->time_us - previous->time_us;
+      TEST_CHECK(spacing_us >= TEST_RELAY_STAGGER_US);
+      TEST_CHECK(spacing_us < TEST_RELAY_STAGGER_US + TEST_RELAY_SLACK_US);
+    }
+    previous = event;
+  }
+  TEST_CHECK(test_relay_reset());
+
+  return true;
+}
+
+/**
+ * Turn outlets off while a batch waits for its turns. The outlets must be
+ * turned off at once rather than after the batch, and a pending outlet that
+ * is turned off must never be turned on.
+ *
+ * @return true if the test passed.
+ */
+static bool test_relay_off_during_stagger(void) {
+  TEST_CHECK(test_relay_start());
+
+  uint32_t all = (1UL << TEST_RELAY_OUTLETS) - 1;
+  TEST_CHECK(relay_submit(all, all, esp_timer_get_time()) == ESP_OK);
+  TEST_CHECK(test_relay_await(0, true));
+
+  int64_t off_us = esp_timer_get_time();
+  TEST_CHECK(relay_submit(1UL << 0 | 1UL << 2, 0, off_us) == ESP_OK);
+  TEST_CHECK(test_relay_await(0, false));
+  const test_relay_event_t* off = test_relay_find(0, false);
+  TEST_CHECK(off != NULL);
+  TEST_CHECK(off->time_us - off_us < TEST_RELAY_SLACK_US);
+  TEST_CHECK(relay_get(TEST_RELAY_OUTLETS - 1) == false);
+
+  TEST_CHECK(test_relay_await(TEST_RELAY_OUTLETS - 1, true));
+  TEST_CHECK(relay_get(1));
+  TEST_CHECK(!relay_get(2));
+  TEST_CHECK(test_relay_find(2, true) == NULL);
+  TEST_CHECK(test_relay_reset());
+
+  return true;
+}
+
+/**
+ * Hold up the relay thread and check that commands are rejected once the
+ * queue is full, and accepted again once it was drained.
+ *
+ * @return true if the test passed.
+ */
+static bool test_relay_full_queue(void) {
+  TEST_CHECK(test_relay_start());
+  TEST_CHECK(relay_submit(1UL << TEST_RELAY_OUTLETS, 0,
+                          esp_timer_get_time()) == ESP_ERR_INVALID_ARG);
+
+  pthread_mutex_lock(&events_mutex);
+  held = true;
+  pthread_mutex_unlock(&events_mutex);
+  esp_err_t err = relay_submit(1, 1, esp_timer_get_time());
+  bool holding_now = false;
+  for (int i = 0; i < TEST_RELAY_TIMEOUT_MS && !holding_now; ++i) {
+    usleep(1000);
+    pthread_mutex_lock(&events_mutex);
+    holding_now = holding;
+    pthread_mutex_unlock(&events_mutex);
+  }
+
+  // The thread took the first command, so the whole queue is free.
+  size_t accepted = 0;
+  esp_err_t full_err = ESP_OK;
+  while (full_err == ESP_OK && accepted <= RELAY_QUEUE_SIZE) {
+    full_err = relay_submit(1, accepted % 2, esp_timer_get_time());
+    accepted += full_err == ESP_OK;
+  }
+
+  pthread_mutex_lock(&events_mutex);
+  held = false;
+  pthread_cond_broadcast(&released);
+  pthread_mutex_unlock(&events_mutex);
+
+  TEST_CHECK(err == ESP_OK);
+  TEST_CHECK(holding_now);
+  TEST_CHECK(accepted == RELAY_QUEUE_SIZE);
+  TEST_CHECK(full_err == ESP_ERR_NO_MEM);
+
+  esp_err_t drained_err = ESP_ERR_NO_MEM;
+  for (int i = 0; i < TEST_RELAY_TIMEOUT_MS && drained_err == ESP_ERR_NO_MEM;
+       ++i) {
+    usleep(1000);
+    drained_err = relay_submit(1, 0, esp_timer_get_time());
+  }
+  TEST_CHECK(drained_err == ESP_OK);
+  TEST_CHECK(test_relay_reset());
+
+  return true;
+}
+
+const test_case_t test_relay_cases[] = {
+    {
+        .name = "relay/stagger",
+        .run = test_relay_stagger,
+    },
+    {
+        .name = "relay/off_during_stagger",
+        .run = test_relay_off_during_stagger,
+    },
+    {
+        .name = "relay/full_queue",
+        .run = test_relay_full_queue,
+    },
+    {0},
+};
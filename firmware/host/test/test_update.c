@@ -0,0 +1,376 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "download.h"
+#include "esp_err.h"
+#include "esp_http_client.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "manifest.h"
+#include "mbedtls/sha256.h"
+#include "sdkconfig.h"
+#include "test.h"
+#include "writer.h"
+
+// Size of the firmware image, which doesn't end at a sector boundary.
+#define TEST_UPDATE_IMAGE_SIZE (300 * 1024 + 123)
+// Size of the blocks with a digest in the manifest, which fits the image into
+// the blocks a manifest can list.
+#define TEST_UPDATE_BLOCK_SIZE 8192
+// The URL of the firmware image served by the shim of the HTTP client.
+#define TEST_UPDATE_URL "http://zeus.test/zeus-esp32.bin"
+// Maximum number of attempts to download the image.
+#define TEST_UPDATE_ATTEMPTS 64
+// Minimum number of bytes received before the connection is cut, so that
+// every attempt makes progress.
+#define TEST_UPDATE_MIN_CUT (16 * 1024)
+// Number of bytes received before the connection is cut, which leaves
+// progress to be resumed.
+#define TEST_UPDATE_CUT (100 * 1024)
+
+/**
+ * An image together with its manifest.
+ *
+ * @param image The image.
+ * @param manifest The manifest of the image.
+ */
+typedef struct test_update_release {
+  uint8_t image[TEST_UPDATE_IMAGE_SIZE];
+  manifest_t manifest;
+} test_update_release_t;
+
+/**
+ * Hash data.
+ *
+ * @param[in] data The data.
+ * @param[in] length Number of bytes.
+ * @param[out] digest Receives the SHA-256 digest.
+ */
+static void test_update_sha256(const void* data, size_t length,
+                               uint8_t digest[MANIFEST_SHA256_LEN]) {
+  mbedtls_sha256_context sha256;
+  mbedtls_sha256_init(&sha256);
+  mbedtls_sha256_starts(&sha256, 0);
+  mbedtls_sha256_update(&sha256, data, length);
+  mbedtls_sha256_finish(&sha256, digest);
+  mbedtls_sha256_free(&sha256);
+}
+
+/**
+ * Create an image and its manifest, like `tools/manifest.py` does, and serve
+ * the image through the shim of the HTTP client.
+ *
+ * @param[in] seed Seeds the content of the image.
+ *
+ * @return The release or NULL if it can't be allocated.
+ */
+static test_update_release_t* test_update_release(uint32_t seed) {
+  test_update_release_t* release = calloc(1, sizeof(*release));
+  if (release == NULL) {
+    return NULL;
+  }
+  uint32_t random = seed;
+  for (size_t i = 0; i < TEST_UPDATE_IMAGE_SIZE; ++i) {
+    release->image[i] = (uint8_t)test_random(&random);
+  }
+
+  manifest_t* manifest = &release->manifest;
+  strcpy(manifest->version, "v2.0.0");
+  manifest->size = TEST_UPDATE_IMAGE_SIZE;
+  test_update_sha256(release->image, TEST_UPDATE_IMAGE_SIZE, manifest->sha256);
+  manifest->block_size = TEST_UPDATE_BLOCK_SIZE;
+  for (uint32_t offset = 0; offset < manifest->size;
+       offset += TEST_UPDATE_BLOCK_SIZE) {
+    uint32_t length = manifest->size - offset < TEST_UPDATE_BLOCK_SIZE
+                          ? manifest->size - offset
+                          : TEST_UPDATE_BLOCK_SIZE;
+    test_update_sha256(&release->image[offset], length,
+                       manifest->block_sha256[manifest->block_count++]);
+  }
+
+  if (esp_http_client_host_serve(TEST_UPDATE_URL, 200, release->image,
+                                 TEST_UPDATE_IMAGE_SIZE) != ESP_OK) {
+    free(release);
+    return NULL;
+  }
+  return release;
+}
+
+/**
+ * Stop serving the image and free the release.
+ *
+ * @param[in] release The release.
+ */
+static void test_update_release_free(test_update_release_t* release) {
+  esp_http_client_host_set_cut(0);
+  esp_http_client_host_serve(TEST_UPDATE_URL, 404, NULL, 0);
+  free(release);
+}
+
+/**
+ * Accept every image, like the update module does for a newer release. This
+ * is a `download_check_t`.
+ *
+ * @param[in] ctx Unused.
+ * @param[in] header The beginning of the image.
+ * @param[out] needed Receives true.
+ *
+ * @return ESP_OK.
+ */
+static esp_err_t test_update_check(void* ctx, const char* header,
+                                   bool* needed) {
+  *needed = true;
+  return ESP_OK;
+}
+
+/**
+ * Make an attempt to download the image with the download module, which
+ * continues where the previous attempt stopped.
+ *
+ * @param[in] release The manifest of the image.
+ * @param[out] resume_offset Receives the offset at which the attempt resumed.
+ * @param[out] downloaded Receives the number of bytes received.
+ *
+ * @return ESP_OK if the image was written and validated.
+ */
+static esp_err_t test_update_attempt(const manifest_t* release,
+                                     uint32_t* resume_offset,
+                                     size_t* downloaded) {
+  download_config_t config = {
+      .format = DOWNLOAD_FORMAT_IMAGE,
+      .release = release,
+      .block_size = CONFIG_ZEUS_UPDATE_BLOCK_SIZE,
+      .slot_count = DOWNLOAD_SLOT_COUNT,
+      .check = test_update_check,
+  };
+  download_t* download = malloc(sizeof(*download));
+  if (download == NULL) {
+    return ESP_ERR_NO_MEM;
+  }
+  esp_err_t err = download_prepare(download, &config);
+  if (err != ESP_OK) {
+    free(download);
+    return err;
+  }
+  *resume_offset = download->resume_offset;
+
+  esp_http_client_config_t client_config = {
+      .url = TEST_UPDATE_URL,
+      .buffer_size = DOWNLOAD_SLOT_SIZE,
+  };
+  esp_http_client_handle_t client = esp_http_client_init(&client_config);
+  err = client != NULL ? download_run(download, client) : ESP_ERR_NO_MEM;
+  if (client != NULL) {
+    esp_http_client_cleanup(client);
+  }
+
+  *downloaded = (size_t)download->download_length;
+  err = download_finish(download, err);
+  free(download);
+  return err;
+}
+
+/**
+ * Compare the update partition with the image.
+ *
+ * @param[in] release The release.
+ *
+ * @return true if the partition holds the image.
+ */
+static bool test_update_flashed(const test_update_release_t* release) {
+  uint8_t* flashed = malloc(TEST_UPDATE_IMAGE_SIZE);
+  if (flashed == NULL) {
+    return false;
+  }
+  const esp_partition_t* part = esp_ota_get_next_update_partition(NULL);
+  bool equal = esp_partition_read(part, 0, flashed, TEST_UPDATE_IMAGE_SIZE) ==
+                   ESP_OK &&
+               memcmp(release->image, flashed, TEST_UPDATE_IMAGE_SIZE) == 0;
+  free(flashed);
+  return equal;
+}
+
+/**
+ * Download an image over a link that cuts the connection at random offsets.
+ * Every attempt must resume where the previous one stopped, so that the
+ * image is complete after a few attempts and little is downloaded twice.
+ *
+ * @return true if the test passed.
+ */
+static bool test_update_resume(void) {
+  test_update_release_t* release = test_update_release(5);
+  TEST_CHECK(release != NULL);
+
+  uint32_t random = 5;
+  size_t attempts = 0;
+  size_t downloaded = 0;
+  bool resumed = false;
+  bool only_cut = true;
+  esp_err_t err = ESP_FAIL;
+  while (err != ESP_OK && attempts < TEST_UPDATE_ATTEMPTS) {
+    esp_http_client_host_set_cut(TEST_UPDATE_MIN_CUT +
+                                 test_random(&random) % (64 * 1024));
+    uint32_t resume_offset = 0;
+    size_t received = 0;
+    err = test_update_attempt(&release->manifest, &resume_offset, &received);
+    downloaded += received;
+    attempts += 1;
+    resumed |= resume_offset > 0;
+    only_cut &= err == ESP_OK || err == ESP_ERR_HTTP_CONNECTION_CLOSED;
+  }
+  uint32_t progress = download_load_progress(&release->manifest);
+  bool flashed = test_update_flashed(release);
+  test_update_release_free(release);
+
+  TEST_CHECK(err == ESP_OK);
+  TEST_CHECK(only_cut);
+  TEST_CHECK(attempts > 1);
+  TEST_CHECK(resumed);
+  TEST_CHECK(progress == 0);
+  TEST_CHECK(flashed);
+  // An attempt only loses what was not written and verified yet.
+  size_t lost = DOWNLOAD_SLOT_COUNT * DOWNLOAD_SLOT_SIZE +
+                CONFIG_ZEUS_UPDATE_BLOCK_SIZE + TEST_UPDATE_BLOCK_SIZE +
+                WRITER_SECTOR_SIZE;
+  TEST_CHECK(downloaded <= TEST_UPDATE_IMAGE_SIZE + (attempts - 1) * lost);
+
+  return true;
+}
+
+/**
+ * Check that the progress is only resumed for the very same image, so that a
+ * changed version or digest discards the stored offset.
+ *
+ * @return true if the test passed.
+ */
+static bool test_update_identity(void) {
+  test_update_release_t* release = test_update_release(6);
+  TEST_CHECK(release != NULL);
+
+  esp_http_client_host_set_cut(TEST_UPDATE_CUT);
+  uint32_t resume_offset = 0;
+  size_t received = 0;
+  esp_err_t cut_err =
+      test_update_attempt(&release->manifest, &resume_offset, &received);
+  esp_http_client_host_set_cut(0);
+  uint32_t progress = download_load_progress(&release->manifest);
+
+  manifest_t other_version = release->manifest;
+  strcpy(other_version.version, "v2.0.1");
+  manifest_t other_sha256 = release->manifest;
+  other_sha256.sha256[0] ^= 1;
+  uint32_t version_progress = download_load_progress(&other_version);
+  uint32_t sha256_progress = download_load_progress(&other_sha256);
+
+  // Preparing a download of another image must not resume either.
+  download_config_t config = {
+      .format = DOWNLOAD_FORMAT_IMAGE,
+      .release = &other_sha256,
+      .block_size = CONFIG_ZEUS_UPDATE_BLOCK_SIZE,
+      .slot_count = DOWNLOAD_SLOT_COUNT,
+      .check = test_update_check,
+  };
+  download_t* download = malloc(sizeof(*download));
+  esp_err_t prepare_err = ESP_ERR_NO_MEM;
+  uint32_t other_offset = UINT32_MAX;
+  if (download != NULL) {
+    prepare_err = download_prepare(download, &config);
+    if (prepare_err == ESP_OK) {
+      other_offset = download->resume_offset;
+      download_finish(download, ESP_FAIL);
+    }
+    free(download);
+  }
+  uint32_t kept_progress = download_load_progress(&release->manifest);
+
+  // The image is still completed from where it stopped.
+  uint32_t final_offset = 0;
+  esp_err_t final_err =
+      test_update_attempt(&release->manifest, &final_offset, &received);
+  bool flashed = test_update_flashed(release);
+  test_update_release_free(release);
+
+  TEST_CHECK(cut_err == ESP_ERR_HTTP_CONNECTION_CLOSED);
+  TEST_CHECK(progress > 0);
+  TEST_CHECK(progress % WRITER_SECTOR_SIZE == 0);
+  TEST_CHECK(version_progress == 0);
+  TEST_CHECK(sha256_progress == 0);
+  TEST_CHECK(prepare_err == ESP_OK);
+  TEST_CHECK(other_offset == 0);
+  TEST_CHECK(kept_progress == progress);
+  TEST_CHECK(final_err == ESP_OK);
+  TEST_CHECK(final_offset == progress);
+  TEST_CHECK(flashed);
+
+  return true;
+}
+
+/**
+ * Corrupt the part of the image written by an interrupted download. The next
+ * attempt must detect it before resuming and discard the progress, so that
+ * the attempt after it starts from scratch.
+ *
+ * @return true if the test passed.
+ */
+static bool test_update_corrupt_resume(void) {
+  test_update_release_t* release = test_update_release(7);
+  TEST_CHECK(release != NULL);
+
+  esp_http_client_host_set_cut(TEST_UPDATE_CUT);
+  uint32_t resume_offset = 0;
+  size_t received = 0;
+  esp_err_t cut_err =
+      test_update_attempt(&release->manifest, &resume_offset, &received);
+  esp_http_client_host_set_cut(0);
+  uint32_t progress = download_load_progress(&release->manifest);
+
+  // Flash can only clear bits, so clear one in the first non-zero byte.
+  const esp_partition_t* part = esp_ota_get_next_update_partition(NULL);
+  size_t offset = 0;
+  while (offset < progress && release->image[offset] == 0) {
+    ++offset;
+  }
+  uint8_t flipped = release->image[offset] & (release->image[offset] - 1);
+  esp_err_t flip_err = esp_partition_write(part, offset, &flipped, 1);
+
+  esp_err_t corrupt_err =
+      test_update_attempt(&release->manifest, &resume_offset, &received);
+  uint32_t corrupt_offset = resume_offset;
+  uint32_t reset_progress = download_load_progress(&release->manifest);
+
+  esp_err_t final_err =
+      test_update_attempt(&release->manifest, &resume_offset, &received);
+  bool flashed = test_update_flashed(release);
+  test_update_release_free(release);
+
+  TEST_CHECK(cut_err == ESP_ERR_HTTP_CONNECTION_CLOSED);
+  TEST_CHECK(progress > TEST_UPDATE_BLOCK_SIZE);
+  TEST_CHECK(flip_err == ESP_OK);
+  TEST_CHECK(corrupt_offset == progress);
+  TEST_CHECK(corrupt_err != ESP_OK);
+  TEST_CHECK(reset_progress == 0);
+  TEST_CHECK(final_err == ESP_OK);
+  TEST_CHECK(resume_offset == 0);
+  TEST_CHECK(flashed);
+
+  return true;
+}
+
+const test_case_t test_update_cases[] = {
+    {
+        .name = "update/resume",
+        .run = test_update_resume,
+    },
+    {
+        .name = "update/identity",
+        .run = test_update_identity,
+    },
+    {
+        .name = "update/corrupt_resume",
+        .run = test_update_corrupt_resume,
+    },
+    {0},
+};
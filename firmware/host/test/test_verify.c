@@ -0,0 +1,303 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_err.h"
+#include "manifest.h"
+#include "mbedtls/sha256.h"
+#include "test.h"
+#include "verify.h"
+
+// Size of the image, which doesn't end at a block boundary.
+#define TEST_VERIFY_IMAGE_SIZE (64 * 1024 + 500)
+// Size of the blocks with a digest in the manifest.
+#define TEST_VERIFY_BLOCK_SIZE 4096
+// Size of the chunks in which the image is fed, like the buffers of the
+// download.
+#define TEST_VERIFY_CHUNK_SIZE 1024
+
+/**
+ * An image together with its manifest.
+ *
+ * @param image The image.
+ * @param manifest The manifest of the image.
+ */
+typedef struct test_verify_release {
+  uint8_t image[TEST_VERIFY_IMAGE_SIZE];
+  manifest_t manifest;
+} test_verify_release_t;
+
+/**
+ * Hash data.
+ *
+ * @param[in] data The data.
+ * @param[in] length Number of bytes.
+ * @param[out] digest Receives the SHA-256 digest.
+ */
+static void test_verify_sha256(const void* data, size_t length,
+                               uint8_t digest[MANIFEST_SHA256_LEN]) {
+  mbedtls_sha256_context sha256;
+  mbedtls_sha256_init(&sha256);
+  mbedtls_sha256_starts(&sha256, 0);
+  mbedtls_sha256_update(&sha256, data, length);
+  mbedtls_sha256_finish(&sha256, digest);
+  mbedtls_sha256_free(&sha256);
+}
+
+/**
+ * Create an image and its manifest, like `tools/manifest.py` does.
+ *
+ * @param[in] block_size Size of the blocks with a digest or 0 to only list the
+ * digest of the whole image.
+ *
+ * @return The release or NULL if it can't be allocated.
+ */
+static test_verify_release_t* test_verify_release(uint32_t block_size) {
+  test_verify_release_t* release = calloc(1, sizeof(*release));
+  if (release == NULL) {
+    return NULL;
+  }
+  uint32_t random = 7;
+  for (size_t i = 0; i < TEST_VERIFY_IMAGE_SIZE; ++i) {
+    release->image[i] = (uint8_t)test_random(&random);
+  }
+
+  manifest_t* manifest = &release->manifest;
+  strcpy(manifest->version, "v2.0.0");
+  manifest->size = TEST_VERIFY_IMAGE_SIZE;
+  test_verify_sha256(release->image, TEST_VERIFY_IMAGE_SIZE, manifest->sha256);
+  manifest->block_size = block_size;
+  for (uint32_t offset = 0; block_size > 0 && offset < manifest->size;
+       offset += block_size) {
+    uint32_t length = manifest->size - offset < block_size
+                          ? manifest->size - offset
+                          : block_size;
+    test_verify_sha256(&release->image[offset], length,
+                       manifest->block_sha256[manifest->block_count++]);
+  }
+  return release;
+}
+
+/**
+ * Feed an image to a verification in chunks, until a chunk is rejected.
+ *
+ * @param[in] verify The verification.
+ * @param[in] image The image.
+ * @param[in] length Number of bytes of the image to be fed.
+ * @param[out] fed Receives the number of bytes fed, including the rejected
+ * chunk.
+ *
+ * @return ESP_OK or the error of the rejected chunk.
+ */
+static esp_err_t test_verify_feed(verify_t* verify, const uint8_t* image,
+                                  size_t length, size_t* fed) {
+  esp_err_t err = ESP_OK;
+  *fed = 0;
+  while (*fed < length && err == ESP_OK) {
+    size_t chunk = length - *fed < TEST_VERIFY_CHUNK_SIZE
+                       ? length - *fed
+                       : TEST_VERIFY_CHUNK_SIZE;
+    err = verify_update(verify, &image[*fed], chunk);
+    *fed += chunk;
+  }
+  return err;
+}
+
+/**
+ * Check the shim of SHA-256 against the test vectors of FIPS 180-2, as the
+ * other tests rely on it.
+ *
+ * @return true if the test passed.
+ */
+static bool test_verify_sha256_vectors(void) {
+  static const char two_blocks[] =
+      "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+  static const uint8_t abc_digest[MANIFEST_SHA256_LEN] = {
+      0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea, 0x41, 0x41, 0x40,
+      0xde, 0x5d, 0xae, 0x22, 0x23, 0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17,
+      0x7a, 0x9c, 0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad,
+  };
+  static const uint8_t two_blocks_digest[MANIFEST_SHA256_LEN] = {
+      0x24, 0x8d, 0x6a, 0x61, 0xd2, 0x06, 0x38, 0xb8, 0xe5, 0xc0, 0x26,
+      0x93, 0x0c, 0x3e, 0x60, 0x39, 0xa3, 0x3c, 0xe4, 0x59, 0x64, 0xff,
+      0x21, 0x67, 0xf6, 0xec, 0xed, 0xd4, 0x19, 0xdb, 0x06, 0xc1,
+  };
+
+  uint8_t digest[MANIFEST_SHA256_LEN];
+  test_verify_sha256("abc", 3, digest);
+  TEST_CHECK(memcmp(digest, abc_digest, sizeof(digest)) == 0);
+  test_verify_sha256(two_blocks, sizeof(two_blocks) - 1, digest);
+  TEST_CHECK(memcmp(digest, two_blocks_digest, sizeof(digest)) == 0);
+
+  return true;
+}
+
+/**
+ * Check that an intact image passes in chunks of any size.
+ *
+ * @return true if the test passed.
+ */
+static bool test_verify_intact(void) {
+  test_verify_release_t* release = test_verify_release(TEST_VERIFY_BLOCK_SIZE);
+  TEST_CHECK(release != NULL);
+
+  bool passed = true;
+  static const size_t chunks[] = {1, 100, TEST_VERIFY_BLOCK_SIZE,
+                                  TEST_VERIFY_IMAGE_SIZE};
+  for (size_t i = 0; i < sizeof(chunks) / sizeof(chunks[0]) && passed; ++i) {
+    verify_t verify;
+    verify_init(&verify, &release->manifest);
+    esp_err_t err = ESP_OK;
+    for (size_t offset = 0; offset < TEST_VERIFY_IMAGE_SIZE && err == ESP_OK;
+         offset += chunks[i]) {
+      size_t length = TEST_VERIFY_IMAGE_SIZE - offset < chunks[i]
+                          ? TEST_VERIFY_IMAGE_SIZE - offset
+                          : chunks[i];
+      err = verify_update(&verify, &release->image[offset], length);
+    }
+    passed = err == ESP_OK && verify_finish(&verify) == ESP_OK;
+    verify_free(&verify);
+  }
+  free(release);
+  TEST_CHECK(passed);
+
+  return true;
+}
+
+/**
+ * Flip bits at different offsets and check that the block holding the flip
+ * is reported as soon as it is complete.
+ *
+ * @return true if the test passed.
+ */
+static bool test_verify_bit_flips(void) {
+  static const size_t flips[] = {
+      0,
+      1,
+      TEST_VERIFY_BLOCK_SIZE - 1,
+      TEST_VERIFY_BLOCK_SIZE,
+      30000,
+      TEST_VERIFY_IMAGE_SIZE - TEST_VERIFY_BLOCK_SIZE,
+      TEST_VERIFY_IMAGE_SIZE - 1,
+  };
+  test_verify_release_t* release = test_verify_release(TEST_VERIFY_BLOCK_SIZE);
+  TEST_CHECK(release != NULL);
+
+  bool passed = true;
+  for (size_t i = 0; i < sizeof(flips) / sizeof(flips[0]) && passed; ++i) {
+    size_t flip = flips[i];
+    release->image[flip] ^= 1 << (flip % 8);
+
+    verify_t verify;
+    size_t fed = 0;
+    verify_init(&verify, &release->manifest);
+    esp_err_t err = test_verify_feed(&verify, release->image,
+                                     TEST_VERIFY_IMAGE_SIZE, &fed);
+    // The flip is detected within the chunk completing its block.
+    passed = err == ESP_ERR_INVALID_CRC && verify.failed_start <= flip &&
+             flip < verify.failed_end &&
+             verify.failed_end - verify.failed_start <=
+                 TEST_VERIFY_BLOCK_SIZE &&
+             fed - flip <= TEST_VERIFY_BLOCK_SIZE + TEST_VERIFY_CHUNK_SIZE;
+    verify_free(&verify);
+
+    release->image[flip] ^= 1 << (flip % 8);
+  }
+  free(release);
+  TEST_CHECK(passed);
+
+  return true;
+}
+
+/**
+ * Check that a flip is detected at the end if the manifest lists no block
+ * digests.
+ *
+ * @return true if the test passed.
+ */
+static bool test_verify_whole_image(void) {
+  test_verify_release_t* release = test_verify_release(0);
+  TEST_CHECK(release != NULL);
+  release->image[12345] ^= 0x10;
+
+  verify_t verify;
+  size_t fed = 0;
+  verify_init(&verify, &release->manifest);
+  esp_err_t err = test_verify_feed(&verify, release->image,
+                                   TEST_VERIFY_IMAGE_SIZE, &fed);
+  esp_err_t finish_err = verify_finish(&verify);
+  verify_free(&verify);
+  free(release);
+
+  TEST_CHECK(err == ESP_OK);
+  TEST_CHECK(finish_err == ESP_ERR_INVALID_CRC);
+  TEST_CHECK(verify.failed_start == 0);
+  TEST_CHECK(verify.failed_end == TEST_VERIFY_IMAGE_SIZE);
+
+  return true;
+}
+
+/**
+ * Check that truncated and oversized images are rejected with the missing or
+ * excess range.
+ *
+ * @return true if the test passed.
+ */
+static bool test_verify_size(void) {
+  test_verify_release_t* release = test_verify_release(TEST_VERIFY_BLOCK_SIZE);
+  TEST_CHECK(release != NULL);
+  static const uint8_t excess[1] = {0};
+
+  // Truncated at a block boundary, so that all fed blocks are intact.
+  verify_t truncated;
+  size_t fed = 0;
+  verify_init(&truncated, &release->manifest);
+  esp_err_t truncated_err = test_verify_feed(
+      &truncated, release->image, 2 * TEST_VERIFY_BLOCK_SIZE, &fed);
+  esp_err_t truncated_finish_err = verify_finish(&truncated);
+  verify_free(&truncated);
+
+  verify_t oversized;
+  verify_init(&oversized, &release->manifest);
+  esp_err_t oversized_err = test_verify_feed(
+      &oversized, release->image, TEST_VERIFY_IMAGE_SIZE, &fed);
+  esp_err_t excess_err = verify_update(&oversized, excess, sizeof(excess));
+  verify_free(&oversized);
+  free(release);
+
+  TEST_CHECK(truncated_err == ESP_OK);
+  TEST_CHECK(truncated_finish_err == ESP_ERR_INVALID_SIZE);
+  TEST_CHECK(truncated.failed_start == 2 * TEST_VERIFY_BLOCK_SIZE);
+  TEST_CHECK(truncated.failed_end == TEST_VERIFY_IMAGE_SIZE);
+  TEST_CHECK(oversized_err == ESP_OK);
+  TEST_CHECK(excess_err == ESP_ERR_INVALID_SIZE);
+  TEST_CHECK(oversized.failed_start == TEST_VERIFY_IMAGE_SIZE);
+
+  return true;
+}
+
+const test_case_t test_verify_cases[] = {
+    {
+        .name = "verify/sha256",
+        .run = test_verify_sha256_vectors,
+    },
+    {
+        .name = "verify/intact",
+        .run = test_verify_intact,
+    },
+    {
+        .name = "verify/bit_flips",
+        .run = test_verify_bit_flips,
+    },
+    {
+        .name = "verify/whole_image",
+        .run = test_verify_whole_image,
+    },
+    {
+        .name = "verify/size",
+        .run = test_verify_size,
+    },
+    {0},
+};
@@ -0,0 +1,271 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "esp_err.h"
+#include "sdkconfig.h"
+#include "test.h"
+#include "writer.h"
+
+// Size of the emulated partition, which doesn't end at a block boundary of
+// the written image.
+#define TEST_WRITER_PARTITION_SIZE (256 * 1024)
+// Size of the written image.
+#define TEST_WRITER_IMAGE_SIZE (200 * 1024 + 123)
+// Largest chunk fed to the writer, like a buffer of the download.
+#define TEST_WRITER_CHUNK_SIZE 1024
+// Duration of a write to the emulated flash in microseconds.
+#define TEST_WRITER_WRITE_US 200
+
+/**
+ * A partition that is written sequentially and counts its operations, like
+ * the update partition does with sequential writes.
+ *
+ * @param data The content of the partition.
+ * @param offset Number of bytes written.
+ * @param erased Number of bytes at the beginning that were erased.
+ * @param block_size The block size of the writer.
+ * @param erases Number of erased sectors.
+ * @param writes Number of writes.
+ * @param unaligned Number of writes that are not a multiple of the block size.
+ * @param last_length Number of bytes of the last write.
+ */
+typedef struct test_writer_partition {
+  uint8_t data[TEST_WRITER_PARTITION_SIZE];
+  size_t offset;
+  size_t erased;
+  size_t block_size;
+  size_t erases;
+  size_t writes;
+  size_t unaligned;
+  size_t last_length;
+} test_writer_partition_t;
+
+/**
+ * Write to the partition, erasing the sectors it reaches first. This is a
+ * `writer_sink_t`.
+ *
+ * @param[in] ctx The partition.
+ * @param[in] data The data to be written.
+ * @param[in] length Number of bytes to be written.
+ *
+ * @return ESP_OK or ESP_ERR_INVALID_SIZE if the partition is full.
+ */
+static esp_err_t test_writer_sink(void* ctx, const void* data, size_t length) {
+  test_writer_partition_t* part = ctx;
+  if (length > TEST_WRITER_PARTITION_SIZE - part->offset) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+  while (part->offset + length > part->erased) {
+    memset(&part->data[part->erased], 0xff, WRITER_SECTOR_SIZE);
+    part->erased += WRITER_SECTOR_SIZE;
+    part->erases += 1;
+  }
+
+  struct timespec delay = {.tv_nsec = TEST_WRITER_WRITE_US * 1000};
+  nanosleep(&delay, NULL);
+  memcpy(&part->data[part->offset], data, length);
+  part->offset += length;
+  part->writes += 1;
+  part->unaligned += length % part->block_size != 0;
+  part->last_length = length;
+  return ESP_OK;
+}
+
+/**
+ * Write an image through a writer in odd-sized chunks.
+ *
+ * @param[in] block_size The block size of the writer.
+ * @param[in] max_chunk The largest chunk.
+ * @param[out] image The written image.
+ * @param[out] part The partition receiving the image.
+ * @param[out] writer The writer, which is released.
+ *
+ * @return ESP_OK or the error of the writer.
+ */
+static esp_err_t test_writer_write(size_t block_size, size_t max_chunk,
+                                   uint8_t* image,
+                                   test_writer_partition_t* part,
+                                   writer_t* writer) {
+  uint32_t random = (uint32_t)(block_size + max_chunk);
+  for (size_t i = 0; i < TEST_WRITER_IMAGE_SIZE; ++i) {
+    image[i] = (uint8_t)test_random(&random);
+  }
+  memset(part, 0, sizeof(*part));
+  part->block_size = block_size;
+
+  esp_err_t err = writer_init(writer, block_size, test_writer_sink, part);
+  if (err != ESP_OK) {
+    return err;
+  }
+  for (size_t offset = 0; offset < TEST_WRITER_IMAGE_SIZE && err == ESP_OK;) {
+    // Odd sizes never line up with a sector.
+    size_t chunk = (test_random(&random) % max_chunk) | 1;
+    if (chunk > TEST_WRITER_IMAGE_SIZE - offset) {
+      chunk = TEST_WRITER_IMAGE_SIZE - offset;
+    }
+    err = writer_write(writer, &image[offset], chunk);
+    offset += chunk;
+  }
+  if (err == ESP_OK) {
+    err = writer_flush(writer);
+  }
+  writer_deinit(writer);
+  return err;
+}
+
+/**
+ * Check the writes of a writer fed with chunks smaller than a block, like
+ * the buffers of a download. Every write but the final flush is a whole
+ * block, so there is one write per block and every sector is erased once.
+ *
+ * @param[in] block_size The block size of the writer.
+ *
+ * @return true if the test passed.
+ */
+static bool test_writer_blocks(size_t block_size) {
+  uint8_t* image = malloc(TEST_WRITER_IMAGE_SIZE);
+  test_writer_partition_t* part = malloc(sizeof(*part));
+  writer_t writer;
+  esp_err_t err = ESP_ERR_NO_MEM;
+  bool equal = false;
+  if (image != NULL && part != NULL) {
+    err = test_writer_write(block_size, TEST_WRITER_CHUNK_SIZE, image, part,
+                            &writer);
+    equal = memcmp(part->data, image, TEST_WRITER_IMAGE_SIZE) == 0;
+  }
+  test_writer_partition_t counts = part != NULL ? *part
+                                                : (test_writer_partition_t){0};
+  free(part);
+  free(image);
+
+  size_t blocks = (TEST_WRITER_IMAGE_SIZE + block_size - 1) / block_size;
+  size_t sectors =
+      (TEST_WRITER_IMAGE_SIZE + WRITER_SECTOR_SIZE - 1) / WRITER_SECTOR_SIZE;
+  TEST_CHECK(err == ESP_OK);
+  TEST_CHECK(equal);
+  TEST_CHECK(counts.offset == TEST_WRITER_IMAGE_SIZE);
+  TEST_CHECK(counts.writes == blocks);
+  TEST_CHECK(counts.unaligned == 1);
+  TEST_CHECK(counts.last_length == TEST_WRITER_IMAGE_SIZE % block_size);
+  TEST_CHECK(counts.erases == sectors);
+  TEST_CHECK(writer.writes == counts.writes);
+  TEST_CHECK(writer.bytes_written == TEST_WRITER_IMAGE_SIZE);
+
+  // The time spent in the sink bounds the throughput.
+  uint32_t throughput = writer_throughput(&writer);
+  uint64_t max_throughput =
+      (uint64_t)block_size * 1000000 / TEST_WRITER_WRITE_US;
+  TEST_CHECK(throughput > 0);
+  TEST_CHECK(throughput <= max_throughput);
+
+  return true;
+}
+
+/**
+ * Write blocks of the configured size.
+ *
+ * @return true if the test passed.
+ */
+static bool test_writer_blocks_default(void) {
+  return test_writer_blocks(CONFIG_ZEUS_UPDATE_BLOCK_SIZE);
+}
+
+/**
+ * Write blocks of several sectors.
+ *
+ * @return true if the test passed.
+ */
+static bool test_writer_blocks_large(void) {
+  return test_writer_blocks(4 * WRITER_SECTOR_SIZE);
+}
+
+/**
+ * Feed chunks larger than a block, of which whole blocks are passed on
+ * directly. Writes still only hold whole blocks, so there are at most as many
+ * as blocks.
+ *
+ * @return true if the test passed.
+ */
+static bool test_writer_direct(void) {
+  uint8_t* image = malloc(TEST_WRITER_IMAGE_SIZE);
+  test_writer_partition_t* part = malloc(sizeof(*part));
+  writer_t writer;
+  esp_err_t err = ESP_ERR_NO_MEM;
+  bool equal = false;
+  if (image != NULL && part != NULL) {
+    err = test_writer_write(WRITER_SECTOR_SIZE, 5 * WRITER_SECTOR_SIZE, image,
+                            part, &writer);
+    equal = memcmp(part->data, image, TEST_WRITER_IMAGE_SIZE) == 0;
+  }
+  test_writer_partition_t counts = part != NULL ? *part
+                                                : (test_writer_partition_t){0};
+  free(part);
+  free(image);
+
+  size_t blocks =
+      (TEST_WRITER_IMAGE_SIZE + WRITER_SECTOR_SIZE - 1) / WRITER_SECTOR_SIZE;
+  TEST_CHECK(err == ESP_OK);
+  TEST_CHECK(equal);
+  TEST_CHECK(counts.writes <= blocks);
+  TEST_CHECK(counts.writes >= blocks / 5);
+  TEST_CHECK(counts.unaligned == 1);
+  TEST_CHECK(counts.erases == blocks);
+
+  return true;
+}
+
+/**
+ * Reject block sizes that are not a multiple of the sector size, and report
+ * no throughput before anything was written.
+ *
+ * @return true if the test passed.
+ */
+static bool test_writer_block_size(void) {
+  const size_t invalid[] = {
+      0, 1, 1024, WRITER_SECTOR_SIZE - 1, WRITER_SECTOR_SIZE + 1,
+      WRITER_SECTOR_SIZE + WRITER_SECTOR_SIZE / 2,
+  };
+  for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); ++i) {
+    writer_t writer;
+    TEST_CHECK(writer_init(&writer, invalid[i], test_writer_sink, NULL) ==
+               ESP_ERR_INVALID_SIZE);
+  }
+
+  const size_t valid[] = {WRITER_SECTOR_SIZE, 16 * WRITER_SECTOR_SIZE};
+  for (size_t i = 0; i < sizeof(valid) / sizeof(valid[0]); ++i) {
+    writer_t writer;
+    esp_err_t err = writer_init(&writer, valid[i], test_writer_sink, NULL);
+    uint32_t throughput = err == ESP_OK ? writer_throughput(&writer) : 1;
+    if (err == ESP_OK) {
+      writer_deinit(&writer);
+    }
+    TEST_CHECK(err == ESP_OK);
+    TEST_CHECK(throughput == 0);
+  }
+
+  return true;
+}
+
+const test_case_t test_writer_cases[] = {
+    {
+        .name = "writer/blocks",
+        .run = test_writer_blocks_default,
+    },
+    {
+        .name = "writer/blocks_large",
+        .run = test_writer_blocks_large,
+    },
+    {
+        .name = "writer/direct",
+        .run = test_writer_direct,
+    },
+    {
+        .name = "writer/block_size",
+        .run = test_writer_block_size,
+    },
+    {0},
+};
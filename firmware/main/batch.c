@@ -0,0 +1,296 @@
+#include "batch.h"
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gzip.h"
+#include "outbuf.h"
+#include "pb.h"
+#include "snappy.h"
+
+// Field numbers of the messages of the remote-write protocol.
+#define BATCH_WRITE_REQUEST_TIMESERIES 1
+#define BATCH_TIMESERIES_LABELS 1
+#define BATCH_TIMESERIES_SAMPLES 2
+#define BATCH_LABEL_NAME 1
+#define BATCH_LABEL_VALUE 2
+#define BATCH_SAMPLE_VALUE 1
+#define BATCH_SAMPLE_TIMESTAMP 2
+
+/**
+ * Order samples by series and then by time.
+ *
+ * @param[in] a The first sample.
+ * @param[in] b The second sample.
+ *
+ * @return A negative number, zero or a positive number if the first sample
+ * is ordered before, like or after the second one.
+ */
+static int batch_compare(const void* a, const void* b) {
+  const batch_sample_t* first = (const batch_sample_t*)a;
+  const batch_sample_t* second = (const batch_sample_t*)b;
+  if (first->series != second->series) {
+    return first->series < second->series ? -1 : 1;
+  }
+  if (first->time_ms != second->time_ms) {
+    return first->time_ms < second->time_ms ? -1 : 1;
+  }
+  return 0;
+}
+
+/**
+ * Append data to a buffer of fixed size.
+ *
+ * @param[in] buffer The buffer.
+ * @param[in] size Size of the buffer.
+ * @param[in] length Number of bytes in the buffer, which is updated.
+ * @param[in] data The data to be appended.
+ * @param[in] count Number of bytes to be appended.
+ *
+ * @return ESP_OK or ESP_ERR_NO_MEM if the data doesn't fit.
+ */
+static esp_err_t batch_append(char* buffer, size_t size, size_t* length,
+                              const char* data, size_t count) {
+  if (count > size - *length) {
+    return ESP_ERR_NO_MEM;
+  }
+  memcpy(&buffer[*length], data, count);
+  *length += count;
+  return ESP_OK;
+}
+
+/**
+ * Append to the uncompressed protobuf of remote write.
+ *
+ * @param[in] ctx The encoder.
+ * @param[in] data The data to be appended.
+ * @param[in] length Number of bytes to be appended.
+ *
+ * @return ESP_OK or ESP_ERR_NO_MEM if the data doesn't fit.
+ */
+static esp_err_t batch_write_scratch(void* ctx, const char* data,
+                                     size_t length) {
+  batch_t* batch = (batch_t*)ctx;
+  return batch_append(batch->scratch, batch->scratch_size,
+                      &batch->encoded_length, data, length);
+}
+
+/**
+ * Compress the next part of the line protocol.
+ *
+ * @param[in] ctx The encoder.
+ * @param[in] data The data to be appended.
+ * @param[in] length Number of bytes to be appended.
+ *
+ * @return ESP_OK or ESP_ERR_NO_MEM if the compressed data doesn't fit.
+ */
+static esp_err_t batch_write_line(void* ctx, const char* data, size_t length) {
+  batch_t* batch = (batch_t*)ctx;
+  batch->encoded_length += length;
+  return gzip_feed(&batch->gzip, data, length);
+}
+
+/**
+ * Append to the compressed line protocol.
+ *
+ * @param[in] ctx The encoder.
+ * @param[in] data The data to be appended.
+ * @param[in] length Number of bytes to be appended.
+ *
+ * @return ESP_OK or ESP_ERR_NO_MEM if the data doesn't fit.
+ */
+static esp_err_t batch_write_body(void* ctx, const char* data, size_t length) {
+  batch_t* batch = (batch_t*)ctx;
+  return batch_append(batch->body, batch->body_size, &batch->length, data,
+                      length);
+}
+
+/**
+ * Get the number of bytes of a Label message.
+ *
+ * @param[in] name The name of the label.
+ * @param[in] value The value of the label.
+ *
+ * @return Number of bytes.
+ */
+static size_t batch_label_size(const char* name, const char* value) {
+  return pb_string_size(BATCH_LABEL_NAME, name) +
+         pb_string_size(BATCH_LABEL_VALUE, value);
+}
+
+/**
+ * Write a Label message as a field of a TimeSeries message.
+ *
+ * @param[in] out The output buffer.
+ * @param[in] name The name of the label.
+ * @param[in] value The value of the label.
+ */
+static void batch_label(outbuf_t* out, const char* name, const char* value) {
+  pb_length(out, BATCH_TIMESERIES_LABELS, batch_label_size(name, value));
+  pb_string(out, BATCH_LABEL_NAME, name);
+  pb_string(out, BATCH_LABEL_VALUE, value);
+}
+
+/**
+ * Get the number of bytes of a Sample message.
+ *
+ * @param[in] sample The sample.
+ *
+ * @return Number of bytes.
+ */
+static size_t batch_sample_size(const batch_sample_t* sample) {
+  return pb_double_size(BATCH_SAMPLE_VALUE) +
+         pb_uint64_size(BATCH_SAMPLE_TIMESTAMP, (uint64_t)sample->time_ms);
+}
+
+/**
+ * Write a series as a TimeSeries message of a WriteRequest message.
+ *
+ * @param[in] batch A pointer to the encoder.
+ * @param[in] description The name and labels of the series.
+ * @param[in] samples The samples of the series.
+ * @param[in] count Number of samples.
+ */
+static void batch_remote_write(batch_t* batch,
+                               const batch_series_t* description,
+                               const batch_sample_t* samples, size_t count) {
+  char outlet[12] = "";
+  if (description->outlet >= 0) {
+    snprintf(outlet, sizeof(outlet), "%d", description->outlet);
+  }
+
+  // The labels are sorted by name, as required by the protocol.
+  size_t size =
+      pb_length_size(BATCH_TIMESERIES_LABELS,
+                     batch_label_size("__name__", description->name)) +
+      pb_length_size(BATCH_TIMESERIES_LABELS,
+                     batch_label_size("instance", batch->instance)) +
+      pb_length_size(BATCH_TIMESERIES_LABELS,
+                     batch_label_size("job", BATCH_JOB));
+  if (outlet[0] != 0) {
+    size += pb_length_size(BATCH_TIMESERIES_LABELS,
+                           batch_label_size("outlet", outlet));
+  }
+  for (size_t i = 0; i < count; i++) {
+    size += pb_length_size(BATCH_TIMESERIES_SAMPLES,
+                           batch_sample_size(&samples[i]));
+  }
+
+  outbuf_t* out = &batch->out;
+  pb_length(out, BATCH_WRITE_REQUEST_TIMESERIES, size);
+  batch_label(out, "__name__", description->name);
+  batch_label(out, "instance", batch->instance);
+  batch_label(out, "job", BATCH_JOB);
+  if (outlet[0] != 0) {
+    batch_label(out, "outlet", outlet);
+  }
+  for (size_t i = 0; i < count; i++) {
+    pb_length(out, BATCH_TIMESERIES_SAMPLES, batch_sample_size(&samples[i]));
+    pb_double(out, BATCH_SAMPLE_VALUE, samples[i].value);
+    pb_uint64(out, BATCH_SAMPLE_TIMESTAMP, (uint64_t)samples[i].time_ms);
+  }
+}
+
+/**
+ * Write a series as lines of the line protocol.
+ *
+ * @param[in] batch A pointer to the encoder.
+ * @param[in] description The name and labels of the series.
+ * @param[in] samples The samples of the series.
+ * @param[in] count Number of samples.
+ */
+static void batch_line(batch_t* batch, const batch_series_t* description,
+                       const batch_sample_t* samples, size_t count) {
+  outbuf_t* out = &batch->out;
+  for (size_t i = 0; i < count; i++) {
+    // The line protocol has no representation of NaN and infinities.
+    if (!isfinite(samples[i].value)) {
+      continue;
+    }
+    outbuf_puts(out, description->name);
+    outbuf_printf(out, ",instance=%s,job=" BATCH_JOB, batch->instance);
+    if (description->outlet >= 0) {
+      outbuf_printf(out, ",outlet=%d", description->outlet);
+    }
+    outbuf_printf(out, " value=%.9g %lld000000\n", samples[i].value,
+                  (long long)samples[i].time_ms);
+  }
+}
+
+void batch_init(batch_t* batch, batch_format_t format, const char* instance,
+                batch_describe_t describe, void* describe_ctx, char* body,
+                size_t body_size, char* scratch, size_t scratch_size) {
+  batch->format = format;
+  snprintf(batch->instance, sizeof(batch->instance), "%s", instance);
+  batch->describe = describe;
+  batch->describe_ctx = describe_ctx;
+  batch->body = body;
+  batch->body_size = body_size;
+  batch->scratch = scratch;
+  batch->scratch_size = scratch_size;
+  batch->length = 0;
+  batch->encoded_length = 0;
+}
+
+esp_err_t batch_encode(batch_t* batch, batch_sample_t* samples, size_t count,
+                       size_t* length) {
+  qsort(samples, count, sizeof(samples[0]), batch_compare);
+
+  batch->length = 0;
+  batch->encoded_length = 0;
+  if (batch->format == BATCH_REMOTE_WRITE) {
+    outbuf_init(&batch->out, batch_write_scratch, batch);
+  } else {
+    gzip_init(&batch->gzip, batch_write_body, batch);
+    outbuf_init(&batch->out, batch_write_line, batch);
+  }
+
+  batch_series_t description;
+  for (size_t start = 0; start < count;) {
+    size_t end = start + 1;
+    while (end < count && samples[end].series == samples[start].series) {
+      end++;
+    }
+    batch->describe(batch->describe_ctx, samples[start].series, &description);
+    if (batch->format == BATCH_REMOTE_WRITE) {
+      batch_remote_write(batch, &description, &samples[start], end - start);
+    } else {
+      batch_line(batch, &description, &samples[start], end - start);
+    }
+    start = end;
+  }
+
+  esp_err_t err = outbuf_flush(&batch->out);
+  if (err != ESP_OK) {
+    return err;
+  }
+
+  if (batch->format == BATCH_REMOTE_WRITE) {
+    if (snappy_max_length(batch->encoded_length) > batch->body_size) {
+      return ESP_ERR_NO_MEM;
+    }
+    batch->length = snappy_compress(batch->scratch, batch->encoded_length,
+                                    batch->body, batch->table);
+  } else {
+    err = gzip_finish(&batch->gzip);
+    if (err != ESP_OK) {
+      return err;
+    }
+  }
+
+  *length = batch->length;
+  return ESP_OK;
+}
+
+const char* batch_content_encoding(const batch_t* batch) {
+  return batch->format == BATCH_REMOTE_WRITE ? "snappy" : "gzip";
+}
+
+const char* batch_content_type(const batch_t* batch) {
+  return batch->format == BATCH_REMOTE_WRITE ? "application/x-protobuf"
+                                             : "text/plain; charset=utf-8";
+}
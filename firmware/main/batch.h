@@ -0,0 +1,152 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "gzip.h"
+#include "outbuf.h"
+#include "snappy.h"
+
+// Maximum length of the name of a series, including the null terminator.
+#define BATCH_NAME_SIZE 64
+// Maximum length of the instance label, including the null terminator.
+#define BATCH_INSTANCE_SIZE 32
+// Value of the job label.
+#define BATCH_JOB "zeus"
+
+/**
+ * A timestamped value of a series.
+ *
+ * @param time_ms The wall-clock time in milliseconds since the epoch.
+ * @param value The value.
+ * @param series Identifies the series, which is resolved into a name and
+ * labels by the describe callback when the batch is encoded.
+ */
+typedef struct batch_sample {
+  int64_t time_ms;
+  double value;
+  uint16_t series;
+} batch_sample_t;
+
+/**
+ * The name and labels of a series.
+ *
+ * @param name The name of the metric.
+ * @param outlet The index of the outlet or -1 if the series isn't one of an
+ * outlet.
+ */
+typedef struct batch_series {
+  char name[BATCH_NAME_SIZE];
+  int outlet;
+} batch_series_t;
+
+/**
+ * Resolve a series into its name and labels.
+ *
+ * @param[in] ctx The context passed to `batch_init()`.
+ * @param[in] series The series of a sample.
+ * @param[out] description Receives the name and labels.
+ */
+typedef void (*batch_describe_t)(void* ctx, uint16_t series,
+                                 batch_series_t* description);
+
+/**
+ * The formats in which batches are sent.
+ */
+typedef enum batch_format {
+  // Prometheus remote write: a snappy-compressed WriteRequest protobuf.
+  BATCH_REMOTE_WRITE,
+  // Gzip-compressed InfluxDB line protocol.
+  BATCH_LINE,
+} batch_format_t;
+
+/**
+ * Encodes batches of samples into compressed request bodies. All memory is
+ * provided by the caller, so that encoding a batch doesn't allocate any.
+ *
+ * @param format The format of the bodies.
+ * @param instance The value of the instance label.
+ * @param describe Resolves series into names and labels.
+ * @param describe_ctx The context passed to `describe`.
+ * @param body Buffer receiving the compressed body.
+ * @param body_size Size of the body buffer.
+ * @param scratch Buffer receiving the uncompressed protobuf.
+ * @param scratch_size Size of the scratch buffer.
+ * @param length Number of bytes of the compressed body.
+ * @param encoded_length Number of bytes of the uncompressed body, which is
+ * also counted for line protocol that is compressed on the fly.
+ * @param out Gathers the uncompressed body.
+ * @param gzip Compresses line protocol.
+ * @param table The hash table of the snappy compressor.
+ */
+typedef struct batch {
+  batch_format_t format;
+  char instance[BATCH_INSTANCE_SIZE];
+  batch_describe_t describe;
+  void* describe_ctx;
+  char* body;
+  size_t body_size;
+  char* scratch;
+  size_t scratch_size;
+  size_t length;
+  size_t encoded_length;
+  outbuf_t out;
+  gzip_t gzip;
+  uint16_t table[SNAPPY_TABLE_SIZE];
+} batch_t;
+
+/**
+ * Prepare an encoder.
+ *
+ * @param[out] batch A pointer to the encoder.
+ * @param[in] format The format of the bodies.
+ * @param[in] instance The value of the instance label.
+ * @param[in] describe Resolves series into names and labels.
+ * @param[in] describe_ctx The context passed to `describe`.
+ * @param[in] body Buffer receiving the compressed bodies.
+ * @param[in] body_size Size of the body buffer.
+ * @param[in] scratch Buffer holding the uncompressed protobuf, which is only
+ * used for remote write.
+ * @param[in] scratch_size Size of the scratch buffer.
+ */
+void batch_init(batch_t* batch, batch_format_t format, const char* instance,
+                batch_describe_t describe, void* describe_ctx, char* body,
+                size_t body_size, char* scratch, size_t scratch_size);
+
+/**
+ * Encode and compress a batch into the body buffer. The samples are sorted
+ * by series and time in place, as remote write expects the samples of each
+ * series in a single time series in ascending order.
+ *
+ * @param[in] batch A pointer to the encoder.
+ * @param[in] samples The samples.
+ * @param[in] count Number of samples, at least one.
+ * @param[out] length Receives the number of bytes of the body.
+ *
+ * @return ESP_OK or ESP_ERR_NO_MEM if the body doesn't fit into the buffers,
+ * in which case fewer samples have to be encoded.
+ */
+esp_err_t batch_encode(batch_t* batch, batch_sample_t* samples, size_t count,
+                       size_t* length);
+
+/**
+ * Get the content encoding of the bodies.
+ *
+ * @param[in] batch A pointer to the encoder.
+ *
+ * @return The value of the Content-Encoding header.
+ */
+const char* batch_content_encoding(const batch_t* batch);
+
+/**
+ * Get the content type of the bodies.
+ *
+ * @param[in] batch A pointer to the encoder.
+ *
+ * @return The value of the Content-Type header.
+ */
+const char* batch_content_type(const batch_t* batch);
+
+#endif
@@ -0,0 +1,217 @@
+#include "delta.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "util.h"
+
+/**
+ * Decode a little-endian 32-bit integer.
+ *
+ * @param[in] data A pointer to the first byte.
+ *
+ * @return The decoded integer.
+ */
+static uint32_t delta_u32(const uint8_t* data) {
+  return (uint32_t)data[0] | (uint32_t)data[1] << 8 |
+         (uint32_t)data[2] << 16 | (uint32_t)data[3] << 24;
+}
+
+/**
+ * Parse and validate the header once it has been received completely.
+ *
+ * @param[in] delta A pointer to the decoder.
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_RESPONSE if the header is malformed or
+ * ESP_ERR_INVALID_VERSION if the patch does not apply to the base image.
+ */
+static esp_err_t delta_parse_header(delta_t* delta) {
+  delta_header_t* header = &delta->header;
+
+  memcpy(header->magic, &delta->raw[0], sizeof(header->magic));
+  header->format = delta->raw[4];
+  header->base_size = delta_u32(&delta->raw[8]);
+  header->target_size = delta_u32(&delta->raw[12]);
+  memcpy(header->base_sha256, &delta->raw[16], DELTA_SHA256_LEN);
+  memcpy(header->base_version, &delta->raw[48], 32);
+  header->base_version[32] = 0;
+
+  if (memcmp(header->magic, DELTA_MAGIC, sizeof(header->magic)) != 0 ||
+      header->format != DELTA_FORMAT) {
+    return ESP_ERR_INVALID_RESPONSE;
+  }
+
+  if (memcmp(header->base_sha256, delta->base_sha256, DELTA_SHA256_LEN) != 0) {
+    return ESP_ERR_INVALID_VERSION;
+  }
+
+  return ESP_OK;
+}
+
+/**
+ * Copy a range of the base image to the target image.
+ *
+ * @param[in] delta A pointer to the decoder.
+ * @param[in] offset Offset within the base image.
+ * @param[in] length Number of bytes to be copied.
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_RESPONSE if the range is out of bounds or the
+ * error returned by the callbacks.
+ */
+static esp_err_t delta_copy(delta_t* delta, uint32_t offset, uint32_t length) {
+  if ((uint64_t)offset + length > delta->header.base_size ||
+      delta->output_length + length > delta->header.target_size) {
+    return ESP_ERR_INVALID_RESPONSE;
+  }
+
+  while (length > 0) {
+    size_t chunk = min(length, DELTA_BUFFER_SIZE);
+    esp_err_t err = delta->read(delta->read_ctx, offset, delta->buffer, chunk);
+    if (err != ESP_OK) {
+      return err;
+    }
+    err = delta->write(delta->write_ctx, delta->buffer, chunk);
+    if (err != ESP_OK) {
+      return err;
+    }
+    delta->output_length += chunk;
+    offset += chunk;
+    length -= chunk;
+  }
+
+  return ESP_OK;
+}
+
+/**
+ * Select the next state after an operation has been completed.
+ *
+ * @param[in] delta A pointer to the decoder.
+ */
+static void delta_next(delta_t* delta) {
+  if (delta->output_length == delta->header.target_size) {
+    delta->state = DELTA_STATE_DONE;
+  } else {
+    delta->state = DELTA_STATE_OP;
+  }
+}
+
+void delta_init(delta_t* delta, const uint8_t base_sha256[DELTA_SHA256_LEN],
+                delta_read_t read, void* read_ctx, delta_write_t write,
+                void* write_ctx) {
+  memset(delta, 0, sizeof(delta_t));
+  memcpy(delta->base_sha256, base_sha256, DELTA_SHA256_LEN);
+  delta->read = read;
+  delta->read_ctx = read_ctx;
+  delta->write = write;
+  delta->write_ctx = write_ctx;
+  delta->state = DELTA_STATE_HEADER;
+}
+
+esp_err_t delta_feed(delta_t* delta, const void* data, size_t length) {
+  const uint8_t* cursor = (const uint8_t*)data;
+  const uint8_t* end = cursor + length;
+  esp_err_t err = ESP_OK;
+
+  while (cursor < end) {
+    switch (delta->state) {
+      case DELTA_STATE_HEADER: {
+        size_t chunk = min((size_t)(end - cursor),
+                           DELTA_HEADER_SIZE - delta->raw_fill);
+        memcpy(&delta->raw[delta->raw_fill], cursor, chunk);
+        delta->raw_fill += chunk;
+        cursor += chunk;
+
+        if (delta->raw_fill == DELTA_HEADER_SIZE) {
+          err = delta_parse_header(delta);
+          if (err != ESP_OK) {
+            return err;
+          }
+          delta_next(delta);
+        }
+        break;
+      }
+      case DELTA_STATE_OP: {
+        delta->op = *cursor++;
+        if (delta->op != DELTA_OP_COPY && delta->op != DELTA_OP_INSERT) {
+          return ESP_ERR_INVALID_RESPONSE;
+        }
+        delta->args[0] = 0;
+        delta->args[1] = 0;
+        delta->arg_index = 0;
+        delta->arg_shift = 0;
+        delta->state = DELTA_STATE_ARGS;
+        break;
+      }
+      case DELTA_STATE_ARGS: {
+        uint8_t byte = *cursor++;
+        if (delta->arg_shift > 28) {
+          return ESP_ERR_INVALID_RESPONSE;
+        }
+        delta->args[delta->arg_index] |= (uint32_t)(byte & 0x7f)
+                                         << delta->arg_shift;
+        delta->arg_shift += 7;
+        if (byte & 0x80) {
+          break;
+        }
+
+        // The varint is complete. Copy operations take an offset and a length,
+        // while insert operations only take a length.
+        delta->arg_index += 1;
+        delta->arg_shift = 0;
+        if (delta->op == DELTA_OP_COPY && delta->arg_index < 2) {
+          break;
+        }
+
+        if (delta->op == DELTA_OP_COPY) {
+          err = delta_copy(delta, delta->args[0], delta->args[1]);
+          if (err != ESP_OK) {
+            return err;
+          }
+          delta_next(delta);
+        } else {
+          delta->remaining = delta->args[0];
+          if (delta->output_length + delta->remaining >
+              delta->header.target_size) {
+            return ESP_ERR_INVALID_RESPONSE;
+          }
+          delta->state = DELTA_STATE_INSERT;
+          if (delta->remaining == 0) {
+            delta_next(delta);
+          }
+        }
+        break;
+      }
+      case DELTA_STATE_INSERT: {
+        size_t chunk = min((size_t)(end - cursor), delta->remaining);
+        err = delta->write(delta->write_ctx, cursor, chunk);
+        if (err != ESP_OK) {
+          return err;
+        }
+        delta->output_length += chunk;
+        delta->remaining -= chunk;
+        cursor += chunk;
+
+        if (delta->remaining == 0) {
+          delta_next(delta);
+        }
+        break;
+      }
+      case DELTA_STATE_DONE: {
+        // Trailing data after the target image is complete.
+        return ESP_ERR_INVALID_RESPONSE;
+      }
+    }
+  }
+
+  return ESP_OK;
+}
+
+esp_err_t delta_finish(const delta_t* delta) {
+  if (delta->state != DELTA_STATE_DONE) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+
+  return ESP_OK;
+}
@@ -0,0 +1,160 @@
+#ifndef DELTA_H
+#define DELTA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+// Magic bytes at the beginning of every patch.
+#define DELTA_MAGIC "ZDLT"
+// Version of the patch format.
+#define DELTA_FORMAT 1
+// Size of the patch header in bytes.
+#define DELTA_HEADER_SIZE 80
+// Length of a SHA-256 digest in bytes.
+#define DELTA_SHA256_LEN 32
+// Size of the buffer used to copy data from the base image.
+#define DELTA_BUFFER_SIZE 512
+
+// Copy a range of the base image. Followed by the offset and the length.
+#define DELTA_OP_COPY 1
+// Insert literal data. Followed by the length and the data.
+#define DELTA_OP_INSERT 2
+
+/**
+ * Describes the header of a patch, which is encoded in little-endian byte
+ * order and padded to DELTA_HEADER_SIZE bytes.
+ *
+ * @param magic Always DELTA_MAGIC.
+ * @param format Version of the patch format.
+ * @param base_size Size of the base image in bytes.
+ * @param target_size Size of the target image in bytes.
+ * @param base_sha256 The SHA-256 digest of the base image as reported by
+ * `esp_partition_get_sha256()`.
+ * @param base_version The version of the base image.
+ */
+typedef struct delta_header {
+  char magic[4];
+  uint8_t format;
+  uint32_t base_size;
+  uint32_t target_size;
+  uint8_t base_sha256[DELTA_SHA256_LEN];
+  char base_version[33];
+} delta_header_t;
+
+/**
+ * Read a range of the base image.
+ *
+ * @param[in] ctx The context passed to `delta_init()`.
+ * @param[in] offset Offset within the base image.
+ * @param[out] data Buffer receiving the data.
+ * @param[in] length Number of bytes to be read.
+ *
+ * @return ESP_OK if the data was read.
+ */
+typedef esp_err_t (*delta_read_t)(void* ctx, size_t offset, void* data,
+                                  size_t length);
+
+/**
+ * Write a range of the target image.
+ *
+ * @param[in] ctx The context passed to `delta_init()`.
+ * @param[in] data The data to be written.
+ * @param[in] length Number of bytes to be written.
+ *
+ * @return ESP_OK if the data was written.
+ */
+typedef esp_err_t (*delta_write_t)(void* ctx, const void* data, size_t length);
+
+// States of the patch decoder.
+typedef enum delta_state {
+  DELTA_STATE_HEADER,
+  DELTA_STATE_OP,
+  DELTA_STATE_ARGS,
+  DELTA_STATE_INSERT,
+  DELTA_STATE_DONE,
+} delta_state_t;
+
+/**
+ * Reconstructs a target image from a base image and a patch that is streamed
+ * in chunks of arbitrary size. The patch consists of a header followed by
+ * operations, each of which either copies a range of the base image or
+ * inserts literal data. All integers of operations are encoded as unsigned
+ * LEB128 varints.
+ *
+ * @param read Reads from the base image.
+ * @param read_ctx The context passed to `read`.
+ * @param write Receives the target image.
+ * @param write_ctx The context passed to `write`.
+ * @param base_sha256 The expected digest of the base image.
+ * @param header The parsed header of the patch.
+ * @param state The current state of the decoder.
+ * @param raw Buffer holding the header while it is being received.
+ * @param raw_fill Number of header bytes received.
+ * @param op The current operation.
+ * @param args The arguments of the current operation.
+ * @param arg_index Index of the argument being decoded.
+ * @param arg_shift Bit offset of the next varint byte.
+ * @param remaining Number of literal bytes of an insert operation left.
+ * @param output_length Number of bytes of the target image written.
+ * @param buffer Buffer used to copy data from the base image.
+ */
+typedef struct delta {
+  delta_read_t read;
+  void* read_ctx;
+  delta_write_t write;
+  void* write_ctx;
+  uint8_t base_sha256[DELTA_SHA256_LEN];
+  delta_header_t header;
+  delta_state_t state;
+  uint8_t raw[DELTA_HEADER_SIZE];
+  size_t raw_fill;
+  uint8_t op;
+  uint32_t args[2];
+  uint8_t arg_index;
+  uint8_t arg_shift;
+  uint32_t remaining;
+  size_t output_length;
+  char buffer[DELTA_BUFFER_SIZE];
+} delta_t;
+
+/**
+ * Prepare the decoder for a new patch.
+ *
+ * @param[out] delta A pointer to the decoder.
+ * @param[in] base_sha256 The digest of the base image, which must match the
+ * digest recorded in the patch header.
+ * @param[in] read Reads from the base image.
+ * @param[in] read_ctx The context passed to `read`.
+ * @param[in] write Receives the target image.
+ * @param[in] write_ctx The context passed to `write`.
+ */
+void delta_init(delta_t* delta, const uint8_t base_sha256[DELTA_SHA256_LEN],
+                delta_read_t read, void* read_ctx, delta_write_t write,
+                void* write_ctx);
+
+/**
+ * Decode the next chunk of the patch and write the reconstructed data.
+ *
+ * @param[in] delta A pointer to the decoder.
+ * @param[in] data The next chunk of the patch.
+ * @param[in] length Number of bytes in the chunk.
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_VERSION if the patch was created for a
+ * different base image, ESP_ERR_INVALID_RESPONSE if the patch is malformed or
+ * the error returned by the callbacks.
+ */
+esp_err_t delta_feed(delta_t* delta, const void* data, size_t length);
+
+/**
+ * Check that the patch was decoded completely.
+ *
+ * @param[in] delta A pointer to the decoder.
+ *
+ * @return ESP_OK or ESP_ERR_INVALID_SIZE if the patch ended prematurely.
+ */
+esp_err_t delta_finish(const delta_t* delta);
+
+#endif
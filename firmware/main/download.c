@@ -0,0 +1,706 @@
+#include "download.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "http.h"
+#include "metrics.h"
+#include "nvs.h"
+#include "trace.h"
+#include "util.h"
+
+// Log prefix to be used.
+#define TAG "download"
+// Maximum size of the URL.
+#define URL_SIZE 512
+// Stack size of the thread writing the firmware to the flash.
+#define FLASH_THREAD_STACK_SIZE (4 * 1024)
+
+// The NVS namespace holding the progress, which is shared with the update
+// module.
+static const char nvs_namespace[] = "update";
+// Upper bounds of the duration of a flash write in microseconds.
+static const uint32_t flash_write_bounds[] = {
+    1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000,
+};
+// Counts bytes written to the update partition.
+static metrics_metric_t flash_written_total = METRICS_COUNTER_INIT(
+    "zeus_update_flash_written_bytes_total",
+    "Number of bytes written to the update partition.");
+// Measures the duration of flash writes.
+static metrics_metric_t flash_write_seconds = METRICS_HISTOGRAM_INIT(
+    "zeus_update_flash_write_seconds",
+    "Duration of a write to the update partition.", flash_write_bounds, 1e-6);
+
+void download_init(void) {
+  metrics_register(&flash_written_total);
+  metrics_register(&flash_write_seconds);
+}
+
+uint32_t download_load_progress(const manifest_t* release) {
+  nvs_handle_t nvs;
+  if (nvs_open(nvs_namespace, NVS_READONLY, &nvs) != ESP_OK) {
+    return 0;
+  }
+
+  // The progress is only valid for the very same image.
+  char version[sizeof(release->version)];
+  size_t version_size = sizeof(version);
+  uint8_t sha256[MANIFEST_SHA256_LEN];
+  size_t sha256_size = sizeof(sha256);
+  uint32_t offset = 0;
+  if (nvs_get_str(nvs, "progress_ver", version, &version_size) != ESP_OK ||
+      nvs_get_blob(nvs, "progress_sha", sha256, &sha256_size) != ESP_OK ||
+      nvs_get_u32(nvs, "progress", &offset) != ESP_OK ||
+      strcmp(version, release->version) != 0 ||
+      memcmp(sha256, release->sha256, sizeof(sha256)) != 0 ||
+      offset % WRITER_SECTOR_SIZE != 0 || offset >= release->size) {
+    offset = 0;
+  }
+
+  nvs_close(nvs);
+
+  return offset;
+}
+
+/**
+ * Persist the progress of the download of a firmware image. Only offsets at a
+ * sector boundary are persisted, as the download can only be resumed there.
+ *
+ * @param[in] release The manifest of the firmware image.
+ * @param[in] offset Number of bytes of the image that were written to the
+ * update partition, where 0 discards the progress.
+ */
+static void download_store_progress(const manifest_t* release,
+                                    uint32_t offset) {
+  if (offset % WRITER_SECTOR_SIZE != 0) {
+    return;
+  }
+
+  nvs_handle_t nvs;
+  if (nvs_open(nvs_namespace, NVS_READWRITE, &nvs) != ESP_OK) {
+    return;
+  }
+
+  if (nvs_set_str(nvs, "progress_ver", release->version) != ESP_OK ||
+      nvs_set_blob(nvs, "progress_sha", release->sha256,
+                   sizeof(release->sha256)) != ESP_OK ||
+      nvs_set_u32(nvs, "progress", offset) != ESP_OK ||
+      nvs_commit(nvs) != ESP_OK) {
+    ESP_LOGW(TAG, "Failed to persist download progress");
+  }
+
+  nvs_close(nvs);
+}
+
+/**
+ * Get the number of bytes at the beginning of the image that were written to
+ * the update partition and verified, including the bytes written before the
+ * download was resumed. Only sector-aligned offsets are reported, as the
+ * download can only be resumed there.
+ *
+ * @param[in] download The state of the download.
+ * @param[in] pending Number of bytes that are being written to the flash.
+ *
+ * @return The offset within the image.
+ */
+static uint32_t download_verified(const download_t* download,
+                                  size_t pending) {
+  uint32_t offset =
+      download->resume_offset + download->writer.bytes_written + pending;
+
+  // Only complete blocks have been verified.
+  const verify_t* verify = &download->verify;
+  uint32_t block_size = download->config.release->block_size;
+  if (block_size > 0) {
+    uint32_t verified = verify->failed_end > 0
+                            ? verify->failed_start
+                            : verify->offset - verify->offset % block_size;
+    offset = min(offset, verified);
+  }
+
+  return offset - offset % WRITER_SECTOR_SIZE;
+}
+
+/**
+ * Write a block of the firmware to the update partition and periodically
+ * persist the progress, if the download can be resumed.
+ *
+ * @param[in] ctx The state of the download.
+ * @param[in] data The data to be written.
+ * @param[in] length Number of bytes to be written.
+ *
+ * @return ESP_OK if the block was written.
+ */
+static esp_err_t download_flash_sink(void* ctx, const void* data,
+                                     size_t length) {
+  download_t* download = (download_t*)ctx;
+
+  TRACE_BEGIN("update.flash");
+  int64_t start = esp_timer_get_time();
+  esp_err_t err = esp_ota_write(download->handle, data, length);
+  TRACE_END(NULL);
+  metrics_observe(&flash_write_seconds,
+                  (uint32_t)(esp_timer_get_time() - start));
+  if (err == ESP_OK) {
+    metrics_add(&flash_written_total, length);
+  }
+  if (err != ESP_OK || !download->resumable) {
+    return err;
+  }
+
+  uint32_t offset = download_verified(download, length);
+  if (offset - download->persisted_offset >= DOWNLOAD_PROGRESS_INTERVAL) {
+    download_store_progress(download->config.release, offset);
+    download->persisted_offset = offset;
+  }
+
+  return ESP_OK;
+}
+
+/**
+ * Feed the part of the image written by an interrupted download into the
+ * verification, which also checks that this part is still intact.
+ *
+ * @param[in] download The state of the download.
+ * @param[in] part The partition being updated.
+ *
+ * @return ESP_OK if the written part is intact.
+ */
+static esp_err_t download_verify_written(download_t* download,
+                                         const esp_partition_t* part) {
+  char* buffer = (char*)malloc(WRITER_SECTOR_SIZE);
+  if (buffer == NULL) {
+    return ESP_ERR_NO_MEM;
+  }
+
+  esp_err_t err = ESP_OK;
+  for (uint32_t offset = 0; offset < download->resume_offset && err == ESP_OK;
+       offset += WRITER_SECTOR_SIZE) {
+    err = esp_partition_read(part, offset, buffer, WRITER_SECTOR_SIZE);
+    if (err == ESP_OK) {
+      err = verify_update(&download->verify, buffer, WRITER_SECTOR_SIZE);
+    }
+  }
+
+  free(buffer);
+
+  return err;
+}
+
+/**
+ * Continue writing an image that was partially written to the update partition
+ * by an interrupted download. The image header was already validated then.
+ *
+ * @param[in,out] download The state of the download.
+ *
+ * @return ESP_OK if the update was resumed.
+ */
+static esp_err_t download_resume(download_t* download) {
+  const esp_partition_t* part = esp_ota_get_next_update_partition(NULL);
+  esp_err_t err = download_verify_written(download, part);
+  if (err == ESP_OK) {
+    err = esp_ota_resume(part, OTA_WITH_SEQUENTIAL_WRITES,
+                         download->resume_offset, &download->handle);
+  }
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to resume update: %s", esp_err_to_name(err));
+    // Start from scratch with the next attempt.
+    download_store_progress(download->config.release, 0);
+    return err;
+  }
+  ESP_LOGI(TAG, "Resuming firmware update: %s at %u B",
+           download->config.release->version,
+           (unsigned)download->resume_offset);
+  download->started = true;
+
+  return ESP_OK;
+}
+
+/**
+ * Validate the header of the new firmware and start the firmware update.
+ *
+ * @param[in,out] download The state of the download.
+ *
+ * @return ESP_OK if the update was started or if it is not needed, which is
+ * indicated by `download->skipped`.
+ */
+static esp_err_t download_start(download_t* download) {
+  bool needed = false;
+  esp_err_t err =
+      download->config.check(download->config.ctx, download->header, &needed);
+  if (err != ESP_OK) {
+    return err;
+  }
+
+  if (!needed) {
+    ESP_LOGI(TAG, "Skipping firmware update");
+    // It's okay if the firmware is already up-to-date,
+    // we don't consider this an error.
+    download->skipped = true;
+    return ESP_OK;
+  }
+
+  // Erasing the partition takes seconds.
+  const esp_partition_t* part = esp_ota_get_next_update_partition(NULL);
+  TRACE_BEGIN("update.begin");
+  err = esp_ota_begin(part, OTA_WITH_SEQUENTIAL_WRITES, &download->handle);
+  TRACE_END(NULL);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to start update: %s", esp_err_to_name(err));
+    esp_ota_abort(download->handle);
+    return err;
+  }
+  ESP_LOGI(TAG, "Starting firmware update");
+  download->started = true;
+
+  return ESP_OK;
+}
+
+/**
+ * Write the next range of the firmware image. The beginning of the image is
+ * held back until its header has been validated and the update was started.
+ *
+ * @param[in] ctx The state of the download.
+ * @param[in] data The data to be written.
+ * @param[in] length Number of bytes to be written.
+ *
+ * @return ESP_OK if the data was written or ESP_FAIL if the update is not
+ * needed.
+ */
+static esp_err_t download_image_write(void* ctx, const void* data,
+                                      size_t length) {
+  download_t* download = (download_t*)ctx;
+  const char* cursor = (const char*)data;
+
+  if (!download->started && download->resume_offset > 0) {
+    esp_err_t err = download_resume(download);
+    if (err != ESP_OK) {
+      return err;
+    }
+  }
+
+  // Detect corrupt data long before the image is complete.
+  if (download->config.release != NULL) {
+    esp_err_t err = verify_update(&download->verify, data, length);
+    if (err != ESP_OK) {
+      return err;
+    }
+  }
+
+  if (!download->started) {
+    size_t chunk = min(length, DOWNLOAD_HEADER_SIZE - download->header_fill);
+    memcpy(&download->header[download->header_fill], cursor, chunk);
+    download->header_fill += chunk;
+    cursor += chunk;
+    length -= chunk;
+
+    if (download->header_fill < DOWNLOAD_HEADER_SIZE) {
+      return ESP_OK;
+    }
+
+    esp_err_t err = download_start(download);
+    if (err != ESP_OK) {
+      return err;
+    }
+    if (download->skipped) {
+      // Stop the download, as the rest of the image is not needed.
+      return ESP_FAIL;
+    }
+
+    err = writer_write(&download->writer, download->header,
+                       download->header_fill);
+    if (err != ESP_OK) {
+      return err;
+    }
+  }
+
+  return writer_write(&download->writer, cursor, length);
+}
+
+/**
+ * Decode the next buffer of the download and write the resulting part of the
+ * firmware image.
+ *
+ * @param[in] download The state of the download.
+ * @param[in] data The received data.
+ * @param[in] length Number of bytes received.
+ *
+ * @return ESP_OK if the data was processed.
+ */
+static esp_err_t download_decode(download_t* download, const char* data,
+                                 size_t length) {
+  switch (download->config.format) {
+    case DOWNLOAD_FORMAT_DELTA: {
+      esp_err_t err = delta_feed(&download->delta, data, length);
+      if (err == ESP_ERR_INVALID_VERSION) {
+        ESP_LOGW(TAG, "Patch was created for firmware: %s",
+                 download->delta.header.base_version);
+      }
+      return err;
+    }
+    case DOWNLOAD_FORMAT_COMPRESSED: {
+      return inflate_feed(download->inflate, data, length);
+    }
+    default: {
+      return download_image_write(download, data, length);
+    }
+  }
+}
+
+/**
+ * Complete the firmware image once the download has ended regularly.
+ *
+ * @param[in] download The state of the download.
+ *
+ * @return ESP_OK if the image is complete and was written.
+ */
+static esp_err_t download_complete(download_t* download) {
+  if (download->config.format == DOWNLOAD_FORMAT_DELTA) {
+    esp_err_t err = delta_finish(&download->delta);
+    if (err != ESP_OK) {
+      return err;
+    }
+  }
+  if (download->config.format == DOWNLOAD_FORMAT_COMPRESSED) {
+    esp_err_t err = inflate_finish(download->inflate);
+    if (err != ESP_OK) {
+      return err;
+    }
+    ESP_LOGI(TAG, "Decompressed image: %u B from %d B",
+             (unsigned)download->inflate->output_length,
+             (int)download->download_length);
+  }
+
+  if (!download->started) {
+    ESP_LOGE(TAG,
+             "Failed to download firmware: "
+             "Firmware image incomplete");
+    return ESP_FAIL;
+  }
+
+  if (download->config.release != NULL) {
+    esp_err_t err = verify_finish(&download->verify);
+    if (err != ESP_OK) {
+      return err;
+    }
+  }
+
+  // Write the incomplete last block.
+  return writer_flush(&download->writer);
+}
+
+/**
+ * Drain the download pipeline, decode its buffers and write the firmware to the
+ * update partition. The thread stops once the pipeline is closed and drained
+ * or as soon as processing a buffer fails, in which case the pipeline is closed
+ * with the error to also stop the download.
+ *
+ * @param[in] arg A pointer to the state of the download.
+ *
+ * @return NULL.
+ */
+static void* download_flash_thread(void* arg) {
+  download_t* download = (download_t*)arg;
+  pipeline_t* pipe = &download->pipeline;
+
+  size_t length = 0;
+  char* slot = NULL;
+  while ((slot = pipeline_peek(pipe, &length)) != NULL) {
+    TRACE_BEGIN("update.decode");
+    esp_err_t err = download_decode(download, slot, length);
+    TRACE_END(NULL);
+    pipeline_release(pipe);
+    if (err != ESP_OK) {
+      if (!download->skipped) {
+        ESP_LOGE(TAG, "Failed to write update: %s", esp_err_to_name(err));
+      }
+      pipeline_close(pipe, err);
+      return NULL;
+    }
+  }
+
+  if (pipeline_error(pipe) == ESP_OK) {
+    esp_err_t err = download_complete(download);
+    if (err != ESP_OK) {
+      ESP_LOGE(TAG, "Failed to write update: %s", esp_err_to_name(err));
+      pipeline_close(pipe, err);
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ * Receive the file into the pipeline, following redirects until the file is
+ * located.
+ *
+ * @param[in,out] download The state of the download.
+ *
+ * @return ESP_OK if the file was received completely, ESP_ERR_NOT_FOUND if the
+ * file does not exist or another error if the download failed.
+ */
+static esp_err_t download_receive(download_t* download) {
+  esp_http_client_handle_t client = download->client;
+  // Indicates whether we are downloading or still following redirects.
+  bool downloading = false;
+  esp_err_t err = ESP_OK;
+
+  // Stream data using the native API.
+  while (1) {
+    // Check if the firware is downloading or if we are still following
+    // redirects to locate it.
+    if (!downloading) {
+      char url[URL_SIZE];
+      esp_http_client_get_url(client, url, URL_SIZE);
+      ESP_LOGI(TAG, "Update location: %s", url);
+
+      err = esp_http_client_open(client, 0);
+      if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open HTTP connection: %s",
+                 esp_err_to_name(err));
+        return err;
+      }
+
+      int64_t content_length = esp_http_client_fetch_headers(client);
+      if (content_length < 0) {
+        ESP_LOGE(TAG, "Failed to fetch HTTP headers");
+        return ESP_FAIL;
+      }
+    }
+
+    // Receive straight into the next free buffer of the pipeline. This only
+    // blocks if the flash thread has fallen behind by all buffers.
+    TRACE_BEGIN("update.acquire");
+    char* buffer = pipeline_acquire(&download->pipeline);
+    TRACE_END(NULL);
+    if (buffer == NULL) {
+      // The flash thread closed the pipeline, because processing failed.
+      return pipeline_error(&download->pipeline);
+    }
+
+    // We always need to receive the payload irrespective if we are being
+    // redirected or if we are downloading. The error of a closed connection
+    // is only reported through `errno`, which may be left over otherwise.
+    TRACE_BEGIN("update.read");
+    errno = 0;
+    int32_t bytes_read =
+        esp_http_client_read(client, buffer, DOWNLOAD_SLOT_SIZE);
+    TRACE_END(NULL);
+    if (bytes_read < 0) {
+      ESP_LOGE(TAG, "Failed to read HTTP response");
+      return ESP_FAIL;
+    }
+
+    if (!downloading) {
+      int32_t status = esp_http_client_get_status_code(client);
+      // Follow redirects.
+      if (http_is_redirect(status)) {
+        // We need to handle the redirect manually, because we are using the
+        // native API. The buffer is not committed and thus reused.
+        esp_http_client_set_redirection(client);
+        continue;
+      }
+
+      // Servers may ignore the range request and send the whole image.
+      if (status == 200 && download->resume_offset > 0) {
+        ESP_LOGW(TAG, "Failed to resume download: Range not supported");
+        download->resume_offset = 0;
+      }
+
+      // Don't mistake an error page for the firmware.
+      if (status != 200 && status != 206) {
+        ESP_LOGW(TAG, "Failed to download update: HTTP %d", (int)status);
+        return status == 404 ? ESP_ERR_NOT_FOUND : ESP_FAIL;
+      }
+    }
+
+    // Indicate that the firmware has been located and is being downloaded.
+    downloading = true;
+
+    if (bytes_read > 0) {
+      pipeline_commit(&download->pipeline, bytes_read);
+
+      download->download_length += bytes_read;
+      ESP_LOGD(TAG, "Received: %d B", (int)download->download_length);
+    }
+
+    if (bytes_read == 0) {
+      // As esp_http_client_read never returns a negative error code. We rely on
+      // `errno` to check for underlying transport connectivity closure, if any.
+      if (errno == ECONNRESET || errno == ENOTCONN) {
+        ESP_LOGE(TAG, "Failed to receive update");
+        ESP_LOGE(TAG, "Connection closed prematurely: %s", strerror(errno));
+        return ESP_ERR_HTTP_CONNECTION_CLOSED;
+      }
+
+      if (esp_http_client_is_complete_data_received(client) == true) {
+        ESP_LOGI(TAG, "Received update: %d B", (int)download->download_length);
+        return ESP_OK;
+      }
+    }
+  }
+}
+
+esp_err_t download_prepare(download_t* download,
+                           const download_config_t* config) {
+  memset(download, 0, sizeof(*download));
+  download->config = *config;
+
+  // Only downloads of a known image can be verified and resumed, as the
+  // progress is tied to the identity of the image.
+  const manifest_t* release = config->release;
+  if (release != NULL) {
+    verify_init(&download->verify, release);
+  }
+  if (config->format == DOWNLOAD_FORMAT_IMAGE && release != NULL) {
+    download->resumable = true;
+    download->resume_offset = download_load_progress(release);
+    download->persisted_offset = download->resume_offset;
+  }
+
+  esp_err_t err = ESP_OK;
+  if (config->format == DOWNLOAD_FORMAT_DELTA) {
+    // Patches are applied to the running firmware, which is identified by the
+    // digest of its image.
+    delta_init(&download->delta, config->base_sha256, config->base_read,
+               config->base_ctx, download_image_write, download);
+  }
+
+  if (config->format == DOWNLOAD_FORMAT_COMPRESSED) {
+    // The window of the decompressor is only needed for compressed images.
+    download->inflate = (inflate_t*)malloc(sizeof(inflate_t));
+    if (download->inflate == NULL) {
+      err = ESP_ERR_NO_MEM;
+    } else {
+      inflate_init(download->inflate, download_image_write, download);
+    }
+  }
+
+  if (err == ESP_OK) {
+    err = pipeline_init(&download->pipeline, config->slot_count,
+                        DOWNLOAD_SLOT_SIZE);
+    if (err == ESP_OK) {
+      err = writer_init(&download->writer, config->block_size,
+                        download_flash_sink, download);
+      if (err != ESP_OK) {
+        pipeline_deinit(&download->pipeline);
+      }
+    }
+  }
+
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to prepare download: %s", esp_err_to_name(err));
+    if (release != NULL) {
+      verify_free(&download->verify);
+    }
+    free(download->inflate);
+    download->inflate = NULL;
+  }
+
+  return err;
+}
+
+esp_err_t download_run(download_t* download, esp_http_client_handle_t client) {
+  download->client = client;
+
+  // Request only the part of the image that is still missing.
+  if (download->resume_offset > 0) {
+    char range[32];
+    snprintf(range, sizeof(range), "bytes=%u-",
+             (unsigned)download->resume_offset);
+    esp_http_client_set_header(client, "Range", range);
+  }
+
+  // Decode and write to the flash in a separate thread, so that receiving the
+  // next buffer overlaps with writing the previous one.
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setstacksize(&attr, FLASH_THREAD_STACK_SIZE);
+  int ret = pthread_create(&download->flash_thread, &attr,
+                           download_flash_thread, download);
+  pthread_attr_destroy(&attr);
+  if (ret != 0) {
+    ESP_LOGE(TAG, "Failed to start flash thread");
+    return ESP_FAIL;
+  }
+
+  TRACE_BEGIN("update.download");
+  esp_err_t err = download_receive(download);
+
+  // Closing the pipeline regularly lets the flash thread drain the remaining
+  // buffers, while closing it with an error makes it stop immediately.
+  pipeline_close(&download->pipeline, err);
+  pthread_join(download->flash_thread, NULL);
+  if (err == ESP_OK) {
+    err = pipeline_error(&download->pipeline);
+  }
+  TRACE_END(NULL);
+
+  return err;
+}
+
+esp_err_t download_finish(download_t* download, esp_err_t err) {
+  pipeline_deinit(&download->pipeline);
+
+  if (download->writer.writes > 0) {
+    ESP_LOGI(TAG, "Written image: %u B in %u writes at %u B/s",
+             (unsigned)download->writer.bytes_written,
+             (unsigned)download->writer.writes,
+             (unsigned)writer_throughput(&download->writer));
+  }
+  writer_deinit(&download->writer);
+
+  const manifest_t* release = download->config.release;
+  uint32_t verified =
+      download->resumable ? download_verified(download, 0) : 0;
+  if (release != NULL) {
+    verify_free(&download->verify);
+  }
+  free(download->inflate);
+  download->inflate = NULL;
+
+  // The update is not needed or could not be started.
+  if (download->skipped) {
+    return ESP_OK;
+  }
+  if (!download->started) {
+    return err;
+  }
+
+  if (err != ESP_OK) {
+    esp_ota_abort(download->handle);
+    // Allow the next attempt to continue after the last verified block.
+    if (download->resumable) {
+      download_store_progress(release, verified);
+    }
+    return err;
+  }
+
+  // The next download starts from scratch, whether the image is valid or not.
+  if (download->resumable) {
+    download_store_progress(release, 0);
+  }
+
+  // End update by verifying firmware image.
+  TRACE_BEGIN("update.end");
+  err = esp_ota_end(download->handle);
+  TRACE_END(NULL);
+  if (err != ESP_OK) {
+    if (err == ESP_ERR_OTA_VALIDATE_FAILED) {
+      ESP_LOGE(TAG, "Failed to validate update: Checksum mismatch");
+    } else {
+      ESP_LOGE(TAG, "Failed to finish update: %s", esp_err_to_name(err));
+    }
+  }
+
+  return err;
+}
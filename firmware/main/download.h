@@ -0,0 +1,185 @@
+#ifndef DOWNLOAD_H
+#define DOWNLOAD_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "delta.h"
+#include "esp_err.h"
+#include "esp_http_client.h"
+#include "esp_image_format.h"
+#include "esp_ota_ops.h"
+#include "inflate.h"
+#include "manifest.h"
+#include "pipeline.h"
+#include "verify.h"
+#include "writer.h"
+
+// Number of bytes at the beginning of an image needed to validate its header.
+#define DOWNLOAD_HEADER_SIZE                                        \
+  (sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t) + \
+   sizeof(esp_app_desc_t))
+// Number of buffers between the download and the flash thread.
+#define DOWNLOAD_SLOT_COUNT 8
+// Size of each buffer between the download and the flash thread.
+#define DOWNLOAD_SLOT_SIZE 1024
+// Interval in bytes at which the download progress is persisted.
+#define DOWNLOAD_PROGRESS_INTERVAL (64 * 1024)
+
+// Formats in which an update may be downloaded.
+typedef enum download_format {
+  // The full firmware image.
+  DOWNLOAD_FORMAT_IMAGE,
+  // A patch that is applied to the running firmware.
+  DOWNLOAD_FORMAT_DELTA,
+  // The full firmware image compressed with zlib.
+  DOWNLOAD_FORMAT_COMPRESSED,
+} download_format_t;
+
+/**
+ * Validate the header of a new firmware image before the update partition is
+ * erased.
+ *
+ * @param[in] ctx The context of the download configuration.
+ * @param[in] header The first `DOWNLOAD_HEADER_SIZE` bytes of the image.
+ * @param[out] needed Receives whether the image should be installed.
+ *
+ * @return ESP_OK if the header is valid.
+ */
+typedef esp_err_t (*download_check_t)(void* ctx, const char* header,
+                                      bool* needed);
+
+/**
+ * Describes what is downloaded and how it is written.
+ *
+ * @param format The format of the downloaded file.
+ * @param release The manifest of the firmware image or NULL if unknown. Only
+ * known images are verified while they are written and only full images of a
+ * known release can be resumed.
+ * @param block_size Size of the blocks written to the flash, which is a
+ * multiple of the sector size.
+ * @param slot_count Number of buffers between the download and the flash
+ * thread, where 1 makes receiving and writing alternate.
+ * @param check Validates the header of the image.
+ * @param ctx The context passed to the check.
+ * @param base_sha256 The digest of the running firmware, which a patch must
+ * have been created for.
+ * @param base_read Reads the running firmware, which a patch is applied to.
+ * @param base_ctx The context passed to `base_read`.
+ */
+typedef struct download_config {
+  download_format_t format;
+  const manifest_t* release;
+  size_t block_size;
+  size_t slot_count;
+  download_check_t check;
+  void* ctx;
+  const uint8_t* base_sha256;
+  delta_read_t base_read;
+  void* base_ctx;
+} download_config_t;
+
+/**
+ * Describes the state of a firmware download into the update partition.
+ *
+ * @param config The configuration of the download.
+ * @param client The HTTP client receiving the file.
+ * @param handle The handle of the OTA update once it was started.
+ * @param resumable Indicates that the download can be resumed.
+ * @param resume_offset Offset within the image at which the download resumes.
+ * @param persisted_offset The offset persisted as download progress.
+ * @param pipeline Buffers handed from the download to the flash thread.
+ * @param delta Reconstructs the firmware image if a patch is downloaded.
+ * @param inflate Decompresses the firmware image if a compressed image is
+ * downloaded, which is only allocated for those.
+ * @param verify Verifies the firmware image against the manifest.
+ * @param writer Coalesces the firmware image into blocks written to the flash.
+ * @param flash_thread The thread writing the firmware to the flash.
+ * @param header The beginning of the firmware image, which is held back until
+ * it was validated.
+ * @param header_fill Number of bytes in the header.
+ * @param started Indicates that the update partition is being written.
+ * @param skipped Indicates that the update is not needed.
+ * @param download_length Number of bytes received so far.
+ */
+typedef struct download {
+  download_config_t config;
+  esp_http_client_handle_t client;
+  esp_ota_handle_t handle;
+  bool resumable;
+  uint32_t resume_offset;
+  uint32_t persisted_offset;
+  pipeline_t pipeline;
+  delta_t delta;
+  inflate_t* inflate;
+  verify_t verify;
+  writer_t writer;
+  pthread_t flash_thread;
+  char header[DOWNLOAD_HEADER_SIZE];
+  size_t header_fill;
+  bool started;
+  bool skipped;
+  int32_t download_length;
+} download_t;
+
+/**
+ * Register the metrics of the flash writes.
+ */
+void download_init(void);
+
+/**
+ * Load the progress of an interrupted download of a firmware image.
+ *
+ * @param[in] release The manifest of the firmware image.
+ *
+ * @return Number of bytes of the image that were written to the update
+ * partition or 0 if the download can't be resumed, such as if the progress
+ * belongs to another version or digest.
+ */
+uint32_t download_load_progress(const manifest_t* release);
+
+/**
+ * Prepare a download and load its progress if it can be resumed. The state
+ * is large, so it should not be placed on the stack.
+ *
+ * @param[out] download A pointer to the state of the download.
+ * @param[in] config The configuration, which is copied. The manifest must
+ * outlive the download.
+ *
+ * @return ESP_OK, ESP_ERR_NO_MEM if the buffers can't be allocated or
+ * ESP_ERR_INVALID_SIZE if the block size is not a multiple of the sector size.
+ */
+esp_err_t download_prepare(download_t* download,
+                           const download_config_t* config);
+
+/**
+ * Download a file and write the firmware image to the update partition, with
+ * the download and the flash writes on separate threads. Redirects are
+ * followed and only the missing part of a resumed image is requested.
+ *
+ * @param[in,out] download The state of the download.
+ * @param[in] client The HTTP client, which is configured with the URL.
+ *
+ * @return ESP_OK if the file was received and written completely,
+ * ESP_ERR_NOT_FOUND if the file does not exist, ESP_FAIL if the update is not
+ * needed or another error if the download or the write failed.
+ */
+esp_err_t download_run(download_t* download, esp_http_client_handle_t client);
+
+/**
+ * Release the resources of a download and complete the update of the
+ * partition. A failed update is aborted and its verified progress persisted,
+ * while a complete image is validated.
+ *
+ * @param[in,out] download The state of the download, of which `started` and
+ * `skipped` are still valid afterwards.
+ * @param[in] err The result of `download_run()`.
+ *
+ * @return ESP_OK if the image was written and validated or if the update is
+ * not needed, or the error of the download or the validation.
+ */
+esp_err_t download_finish(download_t* download, esp_err_t err);
+
+#endif
@@ -0,0 +1,290 @@
+#include "dsp.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "esp_cpu.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+#include "synth.h"
+
+// Log prefix to be used.
+#define TAG "dsp"
+// Number of samples of a cycle, which the meter sums at once.
+#define DSP_BENCH_CYCLE_SAMPLES \
+  (CONFIG_ZEUS_METER_SAMPLE_RATE / CONFIG_ZEUS_METER_MAINS_FREQUENCY)
+// Number of cycles measured per outlet and of samples of the largest
+// magnitude.
+#define DSP_BENCH_CYCLES 2
+// Number of times all cycles are summed per measurement.
+#define DSP_BENCH_ROUNDS 32
+
+/**
+ * Add the squares and products of a block of samples to the sums of a cycle.
+ *
+ * @param[in,out] cycle The sums of the cycle.
+ * @param[in] samples The block of samples.
+ * @param[in] count Number of samples.
+ */
+typedef void (*dsp_kernel_t)(meter_cycle_t* cycle,
+                             const meter_sample_t* samples, size_t count);
+
+// Keeps the compiler from optimizing away the measured sums.
+static volatile int64_t bench_sink;
+
+void dsp_sums(meter_cycle_t* cycle, const meter_sample_t* samples,
+              size_t count) {
+  int64_t sum_vv = cycle->sum_vv;
+  int64_t sum_ii = cycle->sum_ii;
+  int64_t sum_vi = cycle->sum_vi;
+
+  size_t i = 0;
+  for (; i + DSP_FOLD <= count; i += DSP_FOLD) {
+    // Independent accumulators hide the latency of the multiplier, as the
+    // ESP32 can issue a multiplication while the previous one completes.
+    int32_t vv0 = 0, vv1 = 0, ii0 = 0, ii1 = 0, vi0 = 0, vi1 = 0;
+    const meter_sample_t* block = &samples[i];
+    for (size_t j = 0; j < DSP_FOLD; j += 2) {
+      int32_t v0 = block[j].voltage;
+      int32_t c0 = block[j].current;
+      int32_t v1 = block[j + 1].voltage;
+      int32_t c1 = block[j + 1].current;
+      vv0 += v0 * v0;
+      ii0 += c0 * c0;
+      vi0 += v0 * c0;
+      vv1 += v1 * v1;
+      ii1 += c1 * c1;
+      vi1 += v1 * c1;
+    }
+    sum_vv += (int64_t)vv0 + vv1;
+    sum_ii += (int64_t)ii0 + ii1;
+    sum_vi += (int64_t)vi0 + vi1;
+  }
+
+  // The remainder is shorter than a fold and fits a single accumulator.
+  int32_t vv = 0, ii = 0, vi = 0;
+  for (; i < count; ++i) {
+    int32_t voltage = samples[i].voltage;
+    int32_t current = samples[i].current;
+    vv += voltage * voltage;
+    ii += current * current;
+    vi += voltage * current;
+  }
+
+  cycle->sum_vv = sum_vv + vv;
+  cycle->sum_ii = sum_ii + ii;
+  cycle->sum_vi = sum_vi + vi;
+  cycle->count += count;
+}
+
+void dsp_sums_scalar(meter_cycle_t* cycle, const meter_sample_t* samples,
+                     size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    int32_t voltage = samples[i].voltage;
+    int32_t current = samples[i].current;
+    cycle->sum_vv += voltage * voltage;
+    cycle->sum_ii += current * current;
+    cycle->sum_vi += voltage * current;
+  }
+  cycle->count += count;
+}
+
+void dsp_sums_reference(dsp_reference_t* sums, const meter_sample_t* samples,
+                        size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    double voltage = samples[i].voltage;
+    double current = samples[i].current;
+    sums->sum_vv += voltage * voltage;
+    sums->sum_ii += current * current;
+    sums->sum_vi += voltage * current;
+  }
+}
+
+size_t dsp_find_rising(const meter_sample_t* samples, size_t count,
+                       int16_t last_voltage) {
+  if (count == 0) {
+    return 0;
+  }
+  if (last_voltage < 0 && samples[0].voltage >= 0) {
+    return 0;
+  }
+
+  // Compare the sign bits of neighbouring samples, which needs no branch per
+  // sample until a crossing was found.
+  size_t i = 1;
+  for (; i + 4 <= count; i += 4) {
+    uint32_t rising =
+        ((uint16_t)samples[i - 1].voltage & ~(uint16_t)samples[i].voltage) |
+        ((uint16_t)samples[i].voltage & ~(uint16_t)samples[i + 1].voltage) |
+        ((uint16_t)samples[i + 1].voltage &
+         ~(uint16_t)samples[i + 2].voltage) |
+        ((uint16_t)samples[i + 2].voltage & ~(uint16_t)samples[i + 3].voltage);
+    if (rising & 0x8000) {
+      break;
+    }
+  }
+  for (; i < count; ++i) {
+    if (samples[i - 1].voltage < 0 && samples[i].voltage >= 0) {
+      return i;
+    }
+  }
+
+  return count;
+}
+
+/**
+ * Add the squares and products of a block of samples in floating point and
+ * round them to the sums of a cycle, so that the reference is measured like
+ * the kernels. This is a `dsp_kernel_t`.
+ *
+ * @param[in,out] cycle The sums of the cycle.
+ * @param[in] samples The block of samples.
+ * @param[in] count Number of samples.
+ */
+static void dsp_sums_float(meter_cycle_t* cycle, const meter_sample_t* samples,
+                           size_t count) {
+  dsp_reference_t sums = {0};
+  dsp_sums_reference(&sums, samples, count);
+  cycle->sum_vv += llround(sums.sum_vv);
+  cycle->sum_ii += llround(sums.sum_ii);
+  cycle->sum_vi += llround(sums.sum_vi);
+  cycle->count += count;
+}
+
+/**
+ * Get the error of a sum relative to the reference.
+ *
+ * @param[in] sum The sum of a kernel.
+ * @param[in] reference The reference sum.
+ *
+ * @return The relative error.
+ */
+static double dsp_bench_error(int64_t sum, double reference) {
+  double scale = fabs(reference) > 1.0 ? fabs(reference) : 1.0;
+  return fabs((double)sum - reference) / scale;
+}
+
+/**
+ * Fill cycles with the synthesized waveforms of all outlets, followed by
+ * samples of the largest magnitude with random signs. The products of their
+ * first cycle are all at the positive maximum and those of the second one at
+ * the negative maximum, which is the worst case of the fixed-point
+ * accumulation.
+ *
+ * @param[out] samples Receives the cycles.
+ * @param[in] outlet_count Number of synthesized outlets.
+ *
+ * @return ESP_OK or ESP_ERR_NO_MEM if the frames can't be allocated.
+ */
+static esp_err_t dsp_bench_samples(meter_sample_t* samples,
+                                   size_t outlet_count) {
+  meter_sample_t* frames = (meter_sample_t*)malloc(
+      DSP_BENCH_CYCLE_SAMPLES * outlet_count * sizeof(meter_sample_t));
+  if (frames == NULL) {
+    return ESP_ERR_NO_MEM;
+  }
+
+  synth_t synth;
+  synth_init(&synth, outlet_count, CONFIG_ZEUS_METER_SAMPLE_RATE,
+             CONFIG_ZEUS_METER_MAINS_FREQUENCY, false);
+  meter_sample_t* cursor = samples;
+  for (size_t cycle = 0; cycle < DSP_BENCH_CYCLES; ++cycle) {
+    synth_read(&synth, frames, DSP_BENCH_CYCLE_SAMPLES);
+    for (size_t outlet = 0; outlet < outlet_count; ++outlet) {
+      meter_sample_t* column =
+          &cursor[outlet * DSP_BENCH_CYCLES * DSP_BENCH_CYCLE_SAMPLES];
+      for (size_t i = 0; i < DSP_BENCH_CYCLE_SAMPLES; ++i) {
+        column[i] = frames[i * outlet_count + outlet];
+      }
+    }
+    cursor += DSP_BENCH_CYCLE_SAMPLES;
+  }
+  free(frames);
+
+  const int16_t max = METER_SAMPLE_LIMIT - 1;
+  uint32_t random = 1;
+  cursor = &samples[outlet_count * DSP_BENCH_CYCLES * DSP_BENCH_CYCLE_SAMPLES];
+  for (size_t i = 0; i < DSP_BENCH_CYCLES * DSP_BENCH_CYCLE_SAMPLES; ++i) {
+    random ^= random << 13;
+    random ^= random >> 17;
+    random ^= random << 5;
+    bool negative = random & 1;
+    bool opposite = i >= DSP_BENCH_CYCLE_SAMPLES;
+    cursor[i].voltage = negative ? -max : max;
+    cursor[i].current = negative != opposite ? -max : max;
+  }
+
+  return ESP_OK;
+}
+
+esp_err_t dsp_bench(dsp_bench_t results[DSP_BENCH_KERNELS]) {
+  static const dsp_kernel_t kernels[DSP_BENCH_KERNELS] = {
+      dsp_sums,
+      dsp_sums_scalar,
+      dsp_sums_float,
+  };
+  static const char* const names[DSP_BENCH_KERNELS] = {
+      "sums",
+      "sums_scalar",
+      "sums_reference",
+  };
+
+  // The synthesized outlets are followed by the samples of the largest
+  // magnitude, which are measured like another outlet.
+  size_t outlet_count = CONFIG_ZEUS_METER_OUTLETS;
+  size_t cycle_count = (outlet_count + 1) * DSP_BENCH_CYCLES;
+  meter_sample_t* samples = (meter_sample_t*)malloc(
+      cycle_count * DSP_BENCH_CYCLE_SAMPLES * sizeof(meter_sample_t));
+  if (samples == NULL) {
+    return ESP_ERR_NO_MEM;
+  }
+  esp_err_t err = dsp_bench_samples(samples, outlet_count);
+  if (err != ESP_OK) {
+    free(samples);
+    return err;
+  }
+
+  for (size_t k = 0; k < DSP_BENCH_KERNELS; ++k) {
+    dsp_bench_t* result = &results[k];
+    result->name = names[k];
+    result->max_error = 0.0;
+    for (size_t c = 0; c < cycle_count; ++c) {
+      const meter_sample_t* block = &samples[c * DSP_BENCH_CYCLE_SAMPLES];
+      dsp_reference_t reference = {0};
+      dsp_sums_reference(&reference, block, DSP_BENCH_CYCLE_SAMPLES);
+      meter_cycle_t cycle = {0};
+      kernels[k](&cycle, block, DSP_BENCH_CYCLE_SAMPLES);
+      double errors[] = {
+          dsp_bench_error(cycle.sum_vv, reference.sum_vv),
+          dsp_bench_error(cycle.sum_ii, reference.sum_ii),
+          dsp_bench_error(cycle.sum_vi, reference.sum_vi),
+      };
+      for (size_t i = 0; i < sizeof(errors) / sizeof(errors[0]); ++i) {
+        result->max_error = fmax(result->max_error, errors[i]);
+      }
+    }
+
+    esp_cpu_cycle_count_t start = esp_cpu_get_cycle_count();
+    for (size_t round = 0; round < DSP_BENCH_ROUNDS; ++round) {
+      for (size_t c = 0; c < cycle_count; ++c) {
+        meter_cycle_t cycle = {0};
+        kernels[k](&cycle, &samples[c * DSP_BENCH_CYCLE_SAMPLES],
+                   DSP_BENCH_CYCLE_SAMPLES);
+        bench_sink = cycle.sum_vi;
+      }
+    }
+    esp_cpu_cycle_count_t cycles = esp_cpu_get_cycle_count() - start;
+    result->cycles_per_sample =
+        (float)cycles /
+        (float)(DSP_BENCH_ROUNDS * cycle_count * DSP_BENCH_CYCLE_SAMPLES);
+
+    ESP_LOGI(TAG, "Kernel %s: %.1f cycles/sample, error %.3g", result->name,
+             result->cycles_per_sample, result->max_error);
+  }
+  free(samples);
+
+  return ESP_OK;
+}
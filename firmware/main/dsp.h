@@ -0,0 +1,107 @@
+#ifndef DSP_H
+#define DSP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "meter.h"
+
+// Number of samples whose products fit into a 32-bit accumulator, given that
+// samples stay below METER_SAMPLE_LIMIT in magnitude.
+#define DSP_FOLD 16
+// Number of kernels measured by `dsp_bench()`.
+#define DSP_BENCH_KERNELS 3
+
+/**
+ * Sums of a block of samples, computed in double precision as the reference
+ * for the fixed-point kernels.
+ *
+ * @param sum_vv Sum of the squared voltage samples.
+ * @param sum_ii Sum of the squared current samples.
+ * @param sum_vi Sum of the products of voltage and current samples.
+ */
+typedef struct dsp_reference {
+  double sum_vv;
+  double sum_ii;
+  double sum_vi;
+} dsp_reference_t;
+
+/**
+ * The measurement of a kernel summing the samples of a cycle.
+ *
+ * @param name The name of the kernel.
+ * @param cycles_per_sample Number of CPU cycles spent per sample.
+ * @param max_error The largest error of a sum relative to the floating-point
+ * reference.
+ */
+typedef struct dsp_bench {
+  const char* name;
+  float cycles_per_sample;
+  double max_error;
+} dsp_bench_t;
+
+/**
+ * Add the squares and products of a block of samples to the sums of a cycle.
+ * The products of up to DSP_FOLD samples are accumulated in 32-bit registers
+ * before they are added to the 64-bit sums, which avoids most of the cost of
+ * 64-bit arithmetic on the ESP32.
+ *
+ * @param[in,out] cycle The sums of the cycle.
+ * @param[in] samples The block of samples.
+ * @param[in] count Number of samples.
+ */
+void dsp_sums(meter_cycle_t* cycle, const meter_sample_t* samples,
+              size_t count);
+
+/**
+ * Add the squares and products of a block of samples to the sums of a cycle
+ * one sample at a time. This is the plain implementation the optimized kernel
+ * is compared with.
+ *
+ * @param[in,out] cycle The sums of the cycle.
+ * @param[in] samples The block of samples.
+ * @param[in] count Number of samples.
+ */
+void dsp_sums_scalar(meter_cycle_t* cycle, const meter_sample_t* samples,
+                     size_t count);
+
+/**
+ * Add the squares and products of a block of samples in floating point.
+ *
+ * @param[in,out] sums The sums.
+ * @param[in] samples The block of samples.
+ * @param[in] count Number of samples.
+ */
+void dsp_sums_reference(dsp_reference_t* sums, const meter_sample_t* samples,
+                        size_t count);
+
+/**
+ * Find the first rising zero crossing of the voltage, which is a negative
+ * sample followed by a non-negative one.
+ *
+ * @param[in] samples The block of samples.
+ * @param[in] count Number of samples.
+ * @param[in] last_voltage The voltage sample preceding the block.
+ *
+ * @return Index of the first non-negative sample of the crossing or `count`
+ * if the block contains no crossing.
+ */
+size_t dsp_find_rising(const meter_sample_t* samples, size_t count,
+                       int16_t last_voltage);
+
+/**
+ * Measure the kernels summing the samples of a cycle with the cycle counter
+ * of the CPU and check their sums against the floating-point reference. The
+ * samples are the synthesized waveforms of all outlets, followed by samples
+ * of the largest magnitude. The results are also logged, so that the kernels
+ * can be measured on the device like on the host.
+ *
+ * @param[out] results Receives the measurement of every kernel, which are
+ * the optimized, the plain and the floating-point one.
+ *
+ * @return ESP_OK or ESP_ERR_NO_MEM if the samples can't be allocated.
+ */
+esp_err_t dsp_bench(dsp_bench_t results[DSP_BENCH_KERNELS]);
+
+#endif
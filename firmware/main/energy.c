@@ -0,0 +1,239 @@
+#include "energy.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "esp_crc.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "metrics.h"
+#include "nvs.h"
+#include "sdkconfig.h"
+
+// Log prefix to be used.
+#define TAG "energy"
+
+/**
+ * The content of a slot in the NVS. Commits rotate through the slots, which
+ * spreads the writes and keeps the previous commit if a write is torn.
+ *
+ * @param sequence Incremented with every commit, so that the newest slot can
+ * be found.
+ * @param energy_mj The energy of every outlet in millijoules.
+ * @param crc The CRC-32 of the fields above.
+ */
+typedef struct energy_slot {
+  uint32_t sequence;
+  uint64_t energy_mj[METER_MAX_OUTLETS];
+  uint32_t crc;
+} energy_slot_t;
+
+// NVS namespace used to persist the counters.
+static const char nvs_namespace[] = "energy";
+// The counters in millijoules, which are only written by the meter thread.
+static _Atomic uint64_t counters[METER_MAX_OUTLETS];
+// Fractions of a millijoule that were not counted yet.
+static double residuals[METER_MAX_OUTLETS];
+// The sequence number of the last commit.
+static uint32_t sequence = 0;
+// The total energy of the last commit, which allows skipping idle commits.
+static uint64_t committed_total = 0;
+// Serializes commits of the thread and the shutdown handler.
+static pthread_mutex_t commit_mutex = PTHREAD_MUTEX_INITIALIZER;
+// The thread committing the counters.
+static pthread_t thread_handle;
+
+// Counts commits to the NVS.
+static metrics_metric_t commits_total = METRICS_COUNTER_INIT(
+    "zeus_energy_commits_total",
+    "Number of times the energy counters were written to the flash.");
+// Counts failed commits.
+static metrics_metric_t commit_failures_total = METRICS_COUNTER_INIT(
+    "zeus_energy_commit_failures_total",
+    "Number of times the energy counters couldn't be written to the flash.");
+
+/**
+ * Get the key of a slot.
+ *
+ * @param[out] key Buffer receiving the key.
+ * @param[in] index The index of the slot.
+ */
+static void energy_slot_key(char key[8], uint32_t index) {
+  snprintf(key, 8, "slot%u", (unsigned)(index % CONFIG_ZEUS_ENERGY_SLOTS));
+}
+
+/**
+ * Compute the checksum of a slot.
+ *
+ * @param[in] slot The slot.
+ *
+ * @return The CRC-32 of all fields except the checksum.
+ */
+static uint32_t energy_slot_crc(const energy_slot_t* slot) {
+  return esp_crc32_le(0, (const uint8_t*)slot, offsetof(energy_slot_t, crc));
+}
+
+/**
+ * Restore the counters from the newest valid slot.
+ */
+static void energy_load(void) {
+  nvs_handle_t nvs;
+  if (nvs_open(nvs_namespace, NVS_READONLY, &nvs) != ESP_OK) {
+    return;
+  }
+
+  energy_slot_t newest = {0};
+  bool found = false;
+  for (uint32_t index = 0; index < CONFIG_ZEUS_ENERGY_SLOTS; ++index) {
+    char key[8];
+    energy_slot_t slot;
+    size_t size = sizeof(slot);
+    energy_slot_key(key, index);
+    if (nvs_get_blob(nvs, key, &slot, &size) != ESP_OK ||
+        size != sizeof(slot) || slot.crc != energy_slot_crc(&slot)) {
+      continue;
+    }
+    // Compare sequence numbers in a way that survives their wrap-around.
+    if (!found || (int32_t)(slot.sequence - newest.sequence) > 0) {
+      newest = slot;
+      found = true;
+    }
+  }
+
+  nvs_close(nvs);
+
+  if (!found) {
+    return;
+  }
+
+  sequence = newest.sequence;
+  committed_total = 0;
+  for (size_t outlet = 0; outlet < METER_MAX_OUTLETS; ++outlet) {
+    atomic_store(&counters[outlet], newest.energy_mj[outlet]);
+    committed_total += newest.energy_mj[outlet];
+  }
+  ESP_LOGI(TAG, "Restored counters from commit %u", (unsigned)sequence);
+}
+
+/**
+ * Write the counters to the next slot if they changed since the last commit.
+ *
+ * @return ESP_OK or the error of the NVS.
+ */
+static esp_err_t energy_commit(void) {
+  energy_slot_t slot = {0};
+  uint64_t total = 0;
+  for (size_t outlet = 0; outlet < METER_MAX_OUTLETS; ++outlet) {
+    slot.energy_mj[outlet] = atomic_load(&counters[outlet]);
+    total += slot.energy_mj[outlet];
+  }
+  if (total == committed_total) {
+    return ESP_OK;
+  }
+  slot.sequence = sequence + 1;
+  slot.crc = energy_slot_crc(&slot);
+
+  nvs_handle_t nvs;
+  esp_err_t err = nvs_open(nvs_namespace, NVS_READWRITE, &nvs);
+  if (err == ESP_OK) {
+    char key[8];
+    energy_slot_key(key, slot.sequence);
+    err = nvs_set_blob(nvs, key, &slot, sizeof(slot));
+    if (err == ESP_OK) {
+      err = nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+  }
+
+  if (err != ESP_OK) {
+    ESP_LOGW(TAG, "Failed to commit counters: %s", esp_err_to_name(err));
+    metrics_add(&commit_failures_total, 1);
+    return err;
+  }
+
+  sequence = slot.sequence;
+  committed_total = total;
+  metrics_add(&commits_total, 1);
+
+  return ESP_OK;
+}
+
+/**
+ * Commit the counters before the device restarts.
+ */
+static void energy_shutdown_handler(void) { energy_flush(); }
+
+/**
+ * Commit the counters periodically.
+ *
+ * @param[in] arg Unused.
+ *
+ * @return NULL.
+ */
+static void* energy_thread(void* arg) {
+  while (true) {
+    sleep(CONFIG_ZEUS_ENERGY_COMMIT_INTERVAL);
+    energy_flush();
+  }
+
+  return NULL;
+}
+
+esp_err_t energy_init(void) {
+  metrics_register(&commits_total);
+  metrics_register(&commit_failures_total);
+
+  energy_load();
+
+  esp_err_t err = esp_register_shutdown_handler(energy_shutdown_handler);
+  if (err != ESP_OK) {
+    ESP_LOGW(TAG, "Failed to register shutdown handler: %s",
+             esp_err_to_name(err));
+  }
+
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setstacksize(&attr, 4 * 1024);
+  if (pthread_create(&thread_handle, &attr, energy_thread, NULL) != 0) {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  return ESP_OK;
+}
+
+void energy_record(size_t outlet, const meter_reading_t* reading) {
+  if (outlet >= METER_MAX_OUTLETS || reading->real_power <= 0 ||
+      reading->frequency <= 0) {
+    return;
+  }
+
+  // Carry fractions over to the next cycle, as a single cycle of a small load
+  // is worth less than a millijoule.
+  double energy_mj =
+      residuals[outlet] + reading->real_power / reading->frequency * 1000;
+  uint64_t whole = (uint64_t)energy_mj;
+  residuals[outlet] = energy_mj - whole;
+  if (whole > 0) {
+    atomic_fetch_add_explicit(&counters[outlet], whole, memory_order_relaxed);
+  }
+}
+
+uint64_t energy_get(size_t outlet) {
+  if (outlet >= METER_MAX_OUTLETS) {
+    return 0;
+  }
+  return atomic_load_explicit(&counters[outlet], memory_order_relaxed);
+}
+
+esp_err_t energy_flush(void) {
+  pthread_mutex_lock(&commit_mutex);
+  esp_err_t err = energy_commit();
+  pthread_mutex_unlock(&commit_mutex);
+  return err;
+}
@@ -0,0 +1,49 @@
+#ifndef ENERGY_H
+#define ENERGY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "meter.h"
+
+/**
+ * Restore the energy counters of all outlets from the NVS and start
+ * committing them periodically. The counters are also committed when the
+ * device restarts, such as after a firmware update. The NVS must be
+ * initialized before calling this.
+ *
+ * @return ESP_OK or ESP_ERR_INVALID_STATE if the commit thread can't be
+ * started.
+ */
+esp_err_t energy_init(void);
+
+/**
+ * Add the energy of a measured cycle to the counter of an outlet. Only
+ * consumed energy is counted. This function is lock-free, but must only be
+ * called from a single thread.
+ *
+ * @param[in] outlet The index of the outlet.
+ * @param[in] reading The reading of the cycle.
+ */
+void energy_record(size_t outlet, const meter_reading_t* reading);
+
+/**
+ * Get the energy consumed by an outlet since its counter was created. This
+ * function is thread-safe.
+ *
+ * @param[in] outlet The index of the outlet.
+ *
+ * @return The energy in millijoules.
+ */
+uint64_t energy_get(size_t outlet);
+
+/**
+ * Commit the counters of all outlets to the NVS now, regardless of the rate
+ * limit. This function is thread-safe.
+ *
+ * @return ESP_OK or the error of the NVS.
+ */
+esp_err_t energy_flush(void);
+
+#endif
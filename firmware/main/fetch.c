@@ -0,0 +1,161 @@
+#include "fetch.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_crt_bundle.h"
+#include "esp_http_client.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "metrics.h"
+#include "sdkconfig.h"
+
+// Log prefix to be used.
+#define TAG "fetch"
+// Size of the receive and transmit buffers of the client.
+#define FETCH_BUFFER_SIZE 1024
+// Time in seconds after which an idle connection is not reused, as servers
+// may have closed it in the meantime.
+#define FETCH_IDLE_S 15
+
+// The client shared by all requests to the update source.
+static esp_http_client_handle_t shared_client = NULL;
+// Receives the events of the current request.
+static http_event_handle_cb request_handler = NULL;
+// The user data of the current request.
+static void* request_user_data = NULL;
+// The time of the previous event of the client, from which the duration of
+// establishing a connection is measured.
+static int64_t last_event_us = 0;
+// The time at which the previous request was completed.
+static int64_t last_used_us = 0;
+// Upper bounds of the duration of establishing a connection in microseconds.
+static const uint32_t connect_bounds[] = {
+    10000,  25000,   50000,   100000,  250000,
+    500000, 1000000, 2500000, 5000000, 10000000,
+};
+// Counts requests to the update source.
+static metrics_metric_t requests_total = METRICS_COUNTER_INIT(
+    "zeus_update_requests_total",
+    "Number of HTTP requests to the update source, including redirects.");
+// Counts connections to the update source.
+static metrics_metric_t connections_total = METRICS_COUNTER_INIT(
+    "zeus_update_connections_total",
+    "Number of connections opened to the update source.");
+// Measures the duration of establishing a connection.
+static metrics_metric_t connect_seconds = METRICS_HISTOGRAM_INIT(
+    "zeus_update_connect_seconds",
+    "Duration of establishing a connection to the update source, including "
+    "the name lookup and the TLS handshake.",
+    connect_bounds, 1e-6);
+// Counts body bytes received from the update source.
+static metrics_metric_t received_total = METRICS_COUNTER_INIT(
+    "zeus_update_received_bytes_total",
+    "Number of body bytes received from the update source.");
+
+/**
+ * Record the metrics of the shared client and forward the event to the
+ * handler of the current request.
+ *
+ * @param[in] event An event of the HTTP client.
+ *
+ * @return The result of the request handler or ESP_OK.
+ */
+static esp_err_t fetch_event_handler(esp_http_client_event_t* event) {
+  int64_t now_us = esp_timer_get_time();
+
+  switch (event->event_id) {
+    case HTTP_EVENT_ON_CONNECTED: {
+      // Only new connections are announced, so the time since the previous
+      // event covers the name lookup, the TCP and the TLS handshake.
+      metrics_add(&connections_total, 1);
+      metrics_observe(&connect_seconds, (uint32_t)(now_us - last_event_us));
+      break;
+    }
+    case HTTP_EVENT_HEADERS_SENT: {
+      metrics_add(&requests_total, 1);
+      break;
+    }
+    case HTTP_EVENT_ON_DATA: {
+      metrics_add(&received_total, event->data_len);
+      break;
+    }
+    default: {
+      break;
+    }
+  }
+  last_event_us = now_us;
+
+  if (request_handler == NULL) {
+    return ESP_OK;
+  }
+  event->user_data = request_user_data;
+  return request_handler(event);
+}
+
+esp_http_client_handle_t fetch_begin(const char* url, const char* user_agent,
+                                     int timeout_ms,
+                                     http_event_handle_cb handler,
+                                     void* user_data) {
+  request_handler = handler;
+  request_user_data = user_data;
+  last_event_us = esp_timer_get_time();
+
+  if (shared_client == NULL) {
+    esp_http_client_config_t config = {
+        .url = url,
+        .crt_bundle_attach = esp_crt_bundle_attach,
+        .timeout_ms = timeout_ms,
+        .keep_alive_enable = true,
+#ifdef CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+        // Resume the TLS session of the previous connection, which saves a
+        // round trip and the key exchange of a full handshake.
+        .save_client_session = true,
+#endif
+        .user_agent = user_agent,
+        .buffer_size_tx = FETCH_BUFFER_SIZE,
+        .buffer_size = FETCH_BUFFER_SIZE,
+        .event_handler = fetch_event_handler,
+    };
+    shared_client = esp_http_client_init(&config);
+    if (shared_client == NULL) {
+      ESP_LOGE(TAG, "Failed to configure HTTP client");
+    }
+    return shared_client;
+  }
+
+  if (last_event_us - last_used_us > FETCH_IDLE_S * 1000000LL) {
+    esp_http_client_close(shared_client);
+  }
+
+  // Switching to another host closes the connection.
+  esp_http_client_set_url(shared_client, url);
+  esp_http_client_set_method(shared_client, HTTP_METHOD_GET);
+  esp_http_client_set_timeout_ms(shared_client, timeout_ms);
+  esp_http_client_delete_header(shared_client, "Range");
+  esp_http_client_delete_header(shared_client, "If-None-Match");
+
+  return shared_client;
+}
+
+void fetch_end(esp_http_client_handle_t client, bool keep) {
+  if (!keep) {
+    esp_http_client_close(client);
+  }
+  request_handler = NULL;
+  request_user_data = NULL;
+  last_used_us = esp_timer_get_time();
+}
+
+uint64_t fetch_received_bytes(void) {
+  return atomic_load(&received_total.value);
+}
+
+void fetch_init(void) {
+  metrics_register(&requests_total);
+  metrics_register(&connections_total);
+  metrics_register(&connect_seconds);
+  metrics_register(&received_total);
+}
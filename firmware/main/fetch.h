@@ -0,0 +1,56 @@
+#ifndef FETCH_H
+#define FETCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_http_client.h"
+
+/**
+ * Prepare the shared HTTP client for a request to the update source. The
+ * client and its connection are kept across requests, so that the manifest
+ * and the firmware of a check share a single connection if they are served
+ * by the same host, and TLS sessions are resumed across checks. The Range and
+ * If-None-Match headers of a previous request are removed. Please note that
+ * this function is NOT thread-safe and every call must be paired with
+ * `fetch_end()`.
+ *
+ * @param[in] url URL of the requested file.
+ * @param[in] user_agent Desired content of the HTTP User-Agent header, which
+ * is only applied when the client is created.
+ * @param[in] timeout_ms Network timeout of the request in milliseconds.
+ * @param[in] handler Receives the events of the request or NULL.
+ * @param[in] user_data Passed to the handler as the user data of the events.
+ *
+ * @return The client or NULL if it can't be created.
+ */
+esp_http_client_handle_t fetch_begin(const char* url, const char* user_agent,
+                                     int timeout_ms,
+                                     http_event_handle_cb handler,
+                                     void* user_data);
+
+/**
+ * Complete a request begun with `fetch_begin()`. The connection is closed
+ * unless it can be reused, which requires that the response was read
+ * completely through `esp_http_client_perform()`.
+ *
+ * @param[in] client The shared client.
+ * @param[in] keep Indicates that the connection may be kept open.
+ */
+void fetch_end(esp_http_client_handle_t client, bool keep);
+
+/**
+ * Get the number of body bytes received from the update source since the
+ * start. This function is thread-safe.
+ *
+ * @return Number of bytes.
+ */
+uint64_t fetch_received_bytes(void);
+
+/**
+ * Register the metrics of the update source connection.
+ */
+void fetch_init(void);
+
+#endif
@@ -0,0 +1,310 @@
+#include "gzip.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "esp_crc.h"
+
+// Symbol ending a block.
+#define GZIP_END_OF_BLOCK 256
+// Number of length codes.
+#define GZIP_LENGTHS 29
+// Number of distance codes.
+#define GZIP_DISTANCES 30
+
+// Smallest length of each length code.
+static const uint16_t length_base[GZIP_LENGTHS] = {
+    3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+    31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+// Number of extra bits of each length code.
+static const uint8_t length_extra[GZIP_LENGTHS] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+    2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+// Smallest distance of each distance code.
+static const uint16_t distance_base[GZIP_DISTANCES] = {
+    1,    2,    3,    4,    5,    7,     9,     13,    17,  25,
+    33,   49,   65,   97,   129,  193,   257,   385,   513, 769,
+    1025, 1537, 2049, 3073, 4097, 6145,  8193,  12289, 16385, 24577};
+// Number of extra bits of each distance code.
+static const uint8_t distance_extra[GZIP_DISTANCES] = {
+    0, 0, 0, 0, 1, 1, 2, 2,  3,  3,  4,  4,  5,  5,  6,
+    6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+// Reverses the order of the bits of a byte.
+static const uint8_t reversed_bits[256] = {
+    0x00, 0x80, 0x40, 0xc0, 0x20, 0xa0, 0x60, 0xe0, 0x10, 0x90, 0x50, 0xd0,
+    0x30, 0xb0, 0x70, 0xf0, 0x08, 0x88, 0x48, 0xc8, 0x28, 0xa8, 0x68, 0xe8,
+    0x18, 0x98, 0x58, 0xd8, 0x38, 0xb8, 0x78, 0xf8, 0x04, 0x84, 0x44, 0xc4,
+    0x24, 0xa4, 0x64, 0xe4, 0x14, 0x94, 0x54, 0xd4, 0x34, 0xb4, 0x74, 0xf4,
+    0x0c, 0x8c, 0x4c, 0xcc, 0x2c, 0xac, 0x6c, 0xec, 0x1c, 0x9c, 0x5c, 0xdc,
+    0x3c, 0xbc, 0x7c, 0xfc, 0x02, 0x82, 0x42, 0xc2, 0x22, 0xa2, 0x62, 0xe2,
+    0x12, 0x92, 0x52, 0xd2, 0x32, 0xb2, 0x72, 0xf2, 0x0a, 0x8a, 0x4a, 0xca,
+    0x2a, 0xaa, 0x6a, 0xea, 0x1a, 0x9a, 0x5a, 0xda, 0x3a, 0xba, 0x7a, 0xfa,
+    0x06, 0x86, 0x46, 0xc6, 0x26, 0xa6, 0x66, 0xe6, 0x16, 0x96, 0x56, 0xd6,
+    0x36, 0xb6, 0x76, 0xf6, 0x0e, 0x8e, 0x4e, 0xce, 0x2e, 0xae, 0x6e, 0xee,
+    0x1e, 0x9e, 0x5e, 0xde, 0x3e, 0xbe, 0x7e, 0xfe, 0x01, 0x81, 0x41, 0xc1,
+    0x21, 0xa1, 0x61, 0xe1, 0x11, 0x91, 0x51, 0xd1, 0x31, 0xb1, 0x71, 0xf1,
+    0x09, 0x89, 0x49, 0xc9, 0x29, 0xa9, 0x69, 0xe9, 0x19, 0x99, 0x59, 0xd9,
+    0x39, 0xb9, 0x79, 0xf9, 0x05, 0x85, 0x45, 0xc5, 0x25, 0xa5, 0x65, 0xe5,
+    0x15, 0x95, 0x55, 0xd5, 0x35, 0xb5, 0x75, 0xf5, 0x0d, 0x8d, 0x4d, 0xcd,
+    0x2d, 0xad, 0x6d, 0xed, 0x1d, 0x9d, 0x5d, 0xdd, 0x3d, 0xbd, 0x7d, 0xfd,
+    0x03, 0x83, 0x43, 0xc3, 0x23, 0xa3, 0x63, 0xe3, 0x13, 0x93, 0x53, 0xd3,
+    0x33, 0xb3, 0x73, 0xf3, 0x0b, 0x8b, 0x4b, 0xcb, 0x2b, 0xab, 0x6b, 0xeb,
+    0x1b, 0x9b, 0x5b, 0xdb, 0x3b, 0xbb, 0x7b, 0xfb, 0x07, 0x87, 0x47, 0xc7,
+    0x27, 0xa7, 0x67, 0xe7, 0x17, 0x97, 0x57, 0xd7, 0x37, 0xb7, 0x77, 0xf7,
+    0x0f, 0x8f, 0x4f, 0xcf, 0x2f, 0xaf, 0x6f, 0xef, 0x1f, 0x9f, 0x5f, 0xdf,
+    0x3f, 0xbf, 0x7f, 0xff,
+};
+
+/**
+ * Write the buffered compressed data.
+ *
+ * @param[in] gzip A pointer to the compressor.
+ */
+static void gzip_flush(gzip_t* gzip) {
+  if (gzip->fill == 0) {
+    return;
+  }
+  if (gzip->err == ESP_OK) {
+    gzip->err = gzip->write(gzip->write_ctx, gzip->output, gzip->fill);
+    gzip->output_length += gzip->fill;
+  }
+  gzip->fill = 0;
+}
+
+/**
+ * Append a byte to the compressed data.
+ *
+ * @param[in] gzip A pointer to the compressor.
+ * @param[in] byte The byte.
+ */
+static void gzip_put_byte(gzip_t* gzip, uint8_t byte) {
+  gzip->output[gzip->fill++] = (char)byte;
+  if (gzip->fill == GZIP_OUTPUT_SIZE) {
+    gzip_flush(gzip);
+  }
+}
+
+/**
+ * Append a little-endian 32-bit value to the compressed data.
+ *
+ * @param[in] gzip A pointer to the compressor.
+ * @param[in] value The value.
+ */
+static void gzip_put_u32(gzip_t* gzip, uint32_t value) {
+  for (int i = 0; i < 4; i++) {
+    gzip_put_byte(gzip, (uint8_t)(value >> (8 * i)));
+  }
+}
+
+/**
+ * Append bits to the compressed data, starting with the least significant
+ * bit.
+ *
+ * @param[in] gzip A pointer to the compressor.
+ * @param[in] value The bits.
+ * @param[in] count Number of bits, at most 16.
+ */
+static void gzip_put_bits(gzip_t* gzip, uint32_t value, uint8_t count) {
+  gzip->bits |= value << gzip->bit_count;
+  gzip->bit_count += count;
+  while (gzip->bit_count >= 8) {
+    gzip_put_byte(gzip, (uint8_t)gzip->bits);
+    gzip->bits >>= 8;
+    gzip->bit_count -= 8;
+  }
+}
+
+/**
+ * Append a Huffman code, which starts with the most significant bit.
+ *
+ * @param[in] gzip A pointer to the compressor.
+ * @param[in] code The code.
+ * @param[in] length Number of bits of the code.
+ */
+static void gzip_put_code(gzip_t* gzip, uint32_t code, uint8_t length) {
+  // The codes have at most 9 bits, whose highest one ends up lowest.
+  uint32_t reversed = length > 8
+                          ? (uint32_t)reversed_bits[code & 0xff] << 1 |
+                                code >> 8
+                          : reversed_bits[code] >> (8 - length);
+  gzip_put_bits(gzip, reversed, length);
+}
+
+/**
+ * Append a literal/length symbol with its fixed Huffman code.
+ *
+ * @param[in] gzip A pointer to the compressor.
+ * @param[in] symbol The symbol.
+ */
+static void gzip_put_symbol(gzip_t* gzip, uint16_t symbol) {
+  if (symbol < 144) {
+    gzip_put_code(gzip, 0x30 + symbol, 8);
+  } else if (symbol < 256) {
+    gzip_put_code(gzip, 0x190 + symbol - 144, 9);
+  } else if (symbol < 280) {
+    gzip_put_code(gzip, symbol - 256, 7);
+  } else {
+    gzip_put_code(gzip, 0xc0 + symbol - 280, 8);
+  }
+}
+
+/**
+ * Append a match.
+ *
+ * @param[in] gzip A pointer to the compressor.
+ * @param[in] length The length of the match.
+ * @param[in] distance The distance back to the matched bytes.
+ */
+static void gzip_put_match(gzip_t* gzip, uint16_t length, uint16_t distance) {
+  int code = GZIP_LENGTHS - 1;
+  while (length_base[code] > length) {
+    code--;
+  }
+  gzip_put_symbol(gzip, (uint16_t)(257 + code));
+  gzip_put_bits(gzip, length - length_base[code], length_extra[code]);
+
+  code = GZIP_DISTANCES - 1;
+  while (distance_base[code] > distance) {
+    code--;
+  }
+  gzip_put_code(gzip, (uint32_t)code, 5);
+  gzip_put_bits(gzip, distance - distance_base[code], distance_extra[code]);
+}
+
+/**
+ * Hash the three bytes at a position into an index of the hash table.
+ *
+ * @param[in] data A pointer to the first byte.
+ *
+ * @return The index.
+ */
+static inline uint32_t gzip_hash(const uint8_t* data) {
+  uint32_t bytes = (uint32_t)data[0] | (uint32_t)data[1] << 8 |
+                   (uint32_t)data[2] << 16;
+  return (bytes * 0x9e3779b1) >> (32 - GZIP_HASH_BITS);
+}
+
+/**
+ * Compress the bytes in the window up to a position.
+ *
+ * @param[in] gzip A pointer to the compressor.
+ * @param[in] limit The position before which to stop. Matches may extend
+ * beyond it up to the end of the window.
+ */
+static void gzip_deflate(gzip_t* gzip, size_t limit) {
+  const uint8_t* window = gzip->window;
+  size_t position = gzip->position;
+  while (position < limit) {
+    size_t available = gzip->window_length - position;
+    size_t matched = 0;
+    size_t candidate = 0;
+    if (available >= GZIP_MIN_MATCH) {
+      uint32_t hash = gzip_hash(&window[position]);
+      candidate = gzip->head[hash];
+      gzip->head[hash] = (uint16_t)position;
+      if (candidate < position && position - candidate <= GZIP_WINDOW_SIZE) {
+        size_t max = available < GZIP_MAX_MATCH ? available : GZIP_MAX_MATCH;
+        while (matched < max &&
+               window[candidate + matched] == window[position + matched]) {
+          matched++;
+        }
+      }
+    }
+
+    if (matched < GZIP_MIN_MATCH) {
+      gzip_put_symbol(gzip, window[position]);
+      position++;
+      continue;
+    }
+
+    gzip_put_match(gzip, (uint16_t)matched, (uint16_t)(position - candidate));
+    // Remember the positions within the match, so that later data can refer
+    // to them.
+    size_t end = position + matched;
+    for (position++; position < end; position++) {
+      if (position + GZIP_MIN_MATCH <= gzip->window_length) {
+        gzip->head[gzip_hash(&window[position])] = (uint16_t)position;
+      }
+    }
+  }
+  gzip->position = (uint16_t)position;
+}
+
+void gzip_init(gzip_t* gzip, gzip_write_t write, void* write_ctx) {
+  gzip->write = write;
+  gzip->write_ctx = write_ctx;
+  gzip->err = ESP_OK;
+  gzip->bits = 0;
+  gzip->bit_count = 0;
+  gzip->crc = 0;
+  gzip->input_length = 0;
+  gzip->output_length = 0;
+  gzip->position = 0;
+  gzip->window_length = 0;
+  memset(gzip->head, 0, sizeof(gzip->head));
+  gzip->fill = 0;
+
+  // The header has the deflate method, no flags, no modification time and
+  // an unknown operating system.
+  static const uint8_t header[] = {0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 0xff};
+  for (size_t i = 0; i < sizeof(header); i++) {
+    gzip_put_byte(gzip, header[i]);
+  }
+  // All data is compressed into a single block with the fixed codes, which
+  // isn't the last one, as the end of the stream isn't known yet.
+  gzip_put_bits(gzip, 1 << 1, 3);
+}
+
+esp_err_t gzip_feed(gzip_t* gzip, const void* data, size_t length) {
+  const uint8_t* input = (const uint8_t*)data;
+  gzip->crc = esp_crc32_le(gzip->crc, input, (uint32_t)length);
+  gzip->input_length += (uint32_t)length;
+
+  while (length > 0) {
+    if (gzip->window_length == sizeof(gzip->window)) {
+      // Move the second half of the window to the first half, forgetting
+      // the positions that are too far back.
+      memcpy(gzip->window, &gzip->window[GZIP_WINDOW_SIZE], GZIP_WINDOW_SIZE);
+      gzip->position -= GZIP_WINDOW_SIZE;
+      gzip->window_length -= GZIP_WINDOW_SIZE;
+      for (size_t i = 0; i < sizeof(gzip->head) / sizeof(gzip->head[0]);
+           i++) {
+        gzip->head[i] = gzip->head[i] >= GZIP_WINDOW_SIZE
+                            ? gzip->head[i] - GZIP_WINDOW_SIZE
+                            : 0;
+      }
+    }
+
+    size_t chunk = sizeof(gzip->window) - gzip->window_length;
+    if (chunk > length) {
+      chunk = length;
+    }
+    memcpy(&gzip->window[gzip->window_length], input, chunk);
+    gzip->window_length += (uint16_t)chunk;
+    input += chunk;
+    length -= chunk;
+
+    // Keep enough bytes back for the longest match.
+    if (gzip->window_length > GZIP_MAX_MATCH) {
+      gzip_deflate(gzip, gzip->window_length - GZIP_MAX_MATCH);
+    }
+  }
+  return gzip->err;
+}
+
+esp_err_t gzip_finish(gzip_t* gzip) {
+  gzip_deflate(gzip, gzip->window_length);
+  gzip_put_symbol(gzip, GZIP_END_OF_BLOCK);
+  // An empty last block ends the stream.
+  gzip_put_bits(gzip, 1 | 1 << 1, 3);
+  gzip_put_symbol(gzip, GZIP_END_OF_BLOCK);
+  if (gzip->bit_count > 0) {
+    gzip_put_bits(gzip, 0, 8 - gzip->bit_count);
+  }
+
+  gzip_put_u32(gzip, gzip->crc);
+  gzip_put_u32(gzip, gzip->input_length);
+  gzip_flush(gzip);
+  return gzip->err;
+}
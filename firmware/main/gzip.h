@@ -0,0 +1,107 @@
+#ifndef GZIP_H
+#define GZIP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+// Base-two logarithm of the maximum distance of a match.
+#define GZIP_WINDOW_BITS 12
+// Maximum distance of a match in bytes. The compressor holds twice as many
+// bytes, so that the window only needs to be moved once per GZIP_WINDOW_SIZE
+// bytes.
+#define GZIP_WINDOW_SIZE (1 << GZIP_WINDOW_BITS)
+// Base-two logarithm of the number of entries of the hash table.
+#define GZIP_HASH_BITS 10
+// Minimum length of a match.
+#define GZIP_MIN_MATCH 3
+// Maximum length of a match.
+#define GZIP_MAX_MATCH 258
+// Size of the buffer of the compressed data.
+#define GZIP_OUTPUT_SIZE 256
+
+/**
+ * Write a range of the compressed data.
+ *
+ * @param[in] ctx The context passed to `gzip_init()`.
+ * @param[in] data The data to be written.
+ * @param[in] length Number of bytes to be written.
+ *
+ * @return ESP_OK if the data was written.
+ */
+typedef esp_err_t (*gzip_write_t)(void* ctx, const char* data, size_t length);
+
+/**
+ * Compresses data that is streamed in chunks of arbitrary size into the gzip
+ * format (RFC 1952). Matches are found through a hash table that remembers
+ * the most recent position of every three-byte sequence, without chains, and
+ * are encoded with the fixed Huffman codes, so that the memory is fixed and
+ * the compressor doesn't allocate any. This gets most of the gain on
+ * repetitive text such as metrics at a fraction of the cost of zlib.
+ *
+ * @param write Receives the compressed data.
+ * @param write_ctx The context passed to `write`.
+ * @param err The first error of `write`, after which all further output is
+ * discarded.
+ * @param bits Holds the output bits that don't make up a byte yet.
+ * @param bit_count Number of bits held.
+ * @param crc The CRC-32 of the data compressed so far.
+ * @param input_length Number of bytes compressed.
+ * @param output_length Number of bytes passed to `write`.
+ * @param position Position of the next byte to be compressed in the window.
+ * @param window_length Number of bytes in the window.
+ * @param head Maps the hash of three bytes to the most recent position at
+ * which they were seen.
+ * @param fill Number of bytes in the output buffer.
+ * @param output Compressed data that was not written yet.
+ * @param window The most recent data.
+ */
+typedef struct gzip {
+  gzip_write_t write;
+  void* write_ctx;
+  esp_err_t err;
+  uint32_t bits;
+  uint8_t bit_count;
+  uint32_t crc;
+  uint32_t input_length;
+  size_t output_length;
+  uint16_t position;
+  uint16_t window_length;
+  uint16_t head[1 << GZIP_HASH_BITS];
+  uint16_t fill;
+  char output[GZIP_OUTPUT_SIZE];
+  uint8_t window[2 * GZIP_WINDOW_SIZE];
+} gzip_t;
+
+/**
+ * Prepare the compressor for a new stream.
+ *
+ * @param[out] gzip A pointer to the compressor.
+ * @param[in] write Receives the compressed data.
+ * @param[in] write_ctx The context passed to `write`.
+ */
+void gzip_init(gzip_t* gzip, gzip_write_t write, void* write_ctx);
+
+/**
+ * Compress the next chunk of the stream. The compressed data is buffered and
+ * written whenever the buffer is full.
+ *
+ * @param[in] gzip A pointer to the compressor.
+ * @param[in] data The next chunk of the stream.
+ * @param[in] length Number of bytes in the chunk.
+ *
+ * @return ESP_OK or the first error returned by the callback.
+ */
+esp_err_t gzip_feed(gzip_t* gzip, const void* data, size_t length);
+
+/**
+ * Compress the rest of the stream and write it together with the trailer.
+ *
+ * @param[in] gzip A pointer to the compressor.
+ *
+ * @return ESP_OK or the first error returned by the callback.
+ */
+esp_err_t gzip_finish(gzip_t* gzip);
+
+#endif
@@ -0,0 +1,84 @@
+#include "health.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_err.h"
+#include "json.h"
+#include "outbuf.h"
+
+/**
+ * Append generated text to the health response.
+ *
+ * @param[in] ctx A pointer to the response.
+ * @param[in] data The text to be appended.
+ * @param[in] length Number of bytes to be appended.
+ *
+ * @return ESP_OK or ESP_ERR_INVALID_SIZE if the text doesn't fit.
+ */
+static esp_err_t health_sink(void* ctx, const char* data, size_t length) {
+  health_t* health = ctx;
+  if (length > sizeof(health->body) - health->length) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+
+  memcpy(&health->body[health->length], data, length);
+  health->length += length;
+
+  return ESP_OK;
+}
+
+esp_err_t health_init(health_t* health, const esp_app_desc_t* app) {
+  static const char hex[] = "0123456789abcdef";
+
+  // Concatenate compile data and time to timestamp.
+  char timestamp[sizeof(app->date) + sizeof(app->time) + 2];
+  snprintf(timestamp, sizeof(timestamp), "%s %s", app->date, app->time);
+
+  // Create SHA256 hash string.
+  char sha256[sizeof(app->app_elf_sha256) * 2 + 1];
+  for (size_t i = 0; i < sizeof(app->app_elf_sha256); ++i) {
+    sha256[i * 2] = hex[app->app_elf_sha256[i] >> 4];
+    sha256[i * 2 + 1] = hex[app->app_elf_sha256[i] & 0xF];
+  }
+  sha256[sizeof(sha256) - 1] = 0;
+
+  // The digest of the image identifies the response.
+  snprintf(health->etag, sizeof(health->etag), "\"%s\"", sha256);
+
+  outbuf_t out;
+  json_t json;
+  health->length = 0;
+  outbuf_init(&out, health_sink, health);
+  json_init(&json, &out);
+
+  json_object_begin(&json);
+  json_key(&json, "data");
+  json_object_begin(&json);
+  json_key(&json, "firmware");
+  json_object_begin(&json);
+  json_key(&json, "version");
+  json_string(&json, app->version);
+  json_key(&json, "sdk");
+  json_string(&json, app->idf_ver);
+  json_key(&json, "timestamp");
+  json_string(&json, timestamp);
+  json_key(&json, "sha256");
+  json_string(&json, sha256);
+  json_object_end(&json);
+  json_object_end(&json);
+  json_object_end(&json);
+
+  return outbuf_flush(&out);
+}
+
+bool health_not_modified(const health_t* health, const char* if_none_match) {
+  if (if_none_match == NULL) {
+    return false;
+  }
+
+  return strcmp(if_none_match, "*") == 0 ||
+         strstr(if_none_match, health->etag) != NULL;
+}
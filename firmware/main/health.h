@@ -0,0 +1,54 @@
+#ifndef HEALTH_H
+#define HEALTH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "esp_app_desc.h"
+#include "esp_err.h"
+
+// Size of the buffer holding the health document.
+#define HEALTH_BODY_SIZE 512
+// Size of the buffer holding the ETag, which is the quoted, hex-encoded ELF
+// digest.
+#define HEALTH_ETAG_SIZE 67
+
+/**
+ * Holds the health response, which is built once at startup, as the running
+ * firmware can't change until the next restart.
+ *
+ * @param body The JSON document.
+ * @param length Number of bytes in the document.
+ * @param etag The quoted, strong ETag of the document.
+ */
+typedef struct health {
+  char body[HEALTH_BODY_SIZE];
+  size_t length;
+  char etag[HEALTH_ETAG_SIZE];
+} health_t;
+
+/**
+ * Build the health response and its ETag from the description of the running
+ * firmware. The document is generated with the streaming JSON writer, which
+ * allocates nothing.
+ *
+ * @param[out] health A pointer to the response.
+ * @param[in] app The description of the running firmware.
+ *
+ * @return ESP_OK or ESP_ERR_INVALID_SIZE if the response is too large.
+ */
+esp_err_t health_init(health_t* health, const esp_app_desc_t* app);
+
+/**
+ * Check whether a client already holds the current response, in which case
+ * it is answered with 304 Not Modified.
+ *
+ * @param[in] health A pointer to the response.
+ * @param[in] if_none_match The value of the If-None-Match header of the
+ * request, or NULL if it has none.
+ *
+ * @return true if the header lists the ETag of the response or is "*".
+ */
+bool health_not_modified(const health_t* health, const char* if_none_match);
+
+#endif
@@ -0,0 +1,309 @@
+#include "history.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "sdkconfig.h"
+
+/**
+ * The power of a single cycle.
+ *
+ * @param stamp The time of the point in milliseconds plus one, or 0 while the
+ * point is being written.
+ * @param power The real power in watts.
+ */
+typedef struct history_raw {
+  _Atomic uint32_t stamp;
+  float power;
+} history_raw_t;
+
+/**
+ * The aggregate of all cycles in an interval.
+ *
+ * @param stamp The start of the interval in its unit plus one, or 0 while the
+ * point is being written.
+ * @param min The lowest real power in watts.
+ * @param max The highest real power in watts.
+ * @param mean The mean real power in watts.
+ * @param energy The consumed energy in joules.
+ */
+typedef struct history_rollup {
+  _Atomic uint32_t stamp;
+  float min;
+  float max;
+  float mean;
+  float energy;
+} history_rollup_t;
+
+/**
+ * Gathers the cycles of the interval that is still open.
+ *
+ * @param start The start of the interval in its unit.
+ * @param count Number of cycles, where 0 means that the interval is empty.
+ * @param min The lowest real power in watts.
+ * @param max The highest real power in watts.
+ * @param sum The sum of the real power of all cycles.
+ * @param energy The consumed energy in joules.
+ */
+typedef struct history_open {
+  uint32_t start;
+  uint32_t count;
+  float min;
+  float max;
+  double sum;
+  double energy;
+} history_open_t;
+
+// Number of rollup levels.
+#define HISTORY_LEVELS 3
+
+/**
+ * The history of a single outlet, whose size is fixed at compile time.
+ *
+ * @param raw The ring of cycles.
+ * @param raw_head Number of cycles recorded so far.
+ * @param seconds The rollups at 1 s resolution.
+ * @param minutes The rollups at 1 min resolution.
+ * @param hours The rollups at 1 h resolution.
+ * @param open The open interval of every rollup level.
+ */
+typedef struct history_outlet {
+  history_raw_t raw[HISTORY_RAW_POINTS];
+  size_t raw_head;
+  history_rollup_t seconds[HISTORY_SECOND_POINTS];
+  history_rollup_t minutes[HISTORY_MINUTE_POINTS];
+  history_rollup_t hours[HISTORY_HOUR_POINTS];
+  history_open_t open[HISTORY_LEVELS];
+} history_outlet_t;
+
+// Length of an interval of every rollup level in milliseconds.
+static const uint32_t level_ms[HISTORY_LEVELS] = {1000, 60 * 1000,
+                                                  60 * 60 * 1000};
+// The history of all outlets.
+static history_outlet_t outlets[CONFIG_ZEUS_METER_OUTLETS];
+
+/**
+ * Get the ring of rollups of a level.
+ *
+ * @param[in] history The history of the outlet.
+ * @param[in] index The index of the level.
+ * @param[out] capacity Receives the number of rollups in the ring.
+ *
+ * @return The ring.
+ */
+static history_rollup_t* history_points(history_outlet_t* history,
+                                        size_t index, size_t* capacity) {
+  switch (index) {
+    case 0: {
+      *capacity = HISTORY_SECOND_POINTS;
+      return history->seconds;
+    }
+    case 1: {
+      *capacity = HISTORY_MINUTE_POINTS;
+      return history->minutes;
+    }
+    default: {
+      *capacity = HISTORY_HOUR_POINTS;
+      return history->hours;
+    }
+  }
+}
+
+/**
+ * Add a rollup or a single cycle to an open interval.
+ *
+ * @param[in,out] open The open interval.
+ * @param[in] add The rollup or cycle to be added.
+ */
+static void history_merge(history_open_t* open, const history_open_t* add) {
+  if (open->count == 0) {
+    open->min = add->min;
+    open->max = add->max;
+  } else {
+    open->min = add->min < open->min ? add->min : open->min;
+    open->max = add->max > open->max ? add->max : open->max;
+  }
+  open->sum += add->sum;
+  open->count += add->count;
+  open->energy += add->energy;
+}
+
+/**
+ * Add a rollup or a single cycle to the open interval of a level. If the
+ * interval changes, the open interval is stored as a rollup and passed on to
+ * the next coarser level first.
+ *
+ * @param[in] history The history of the outlet.
+ * @param[in] index The index of the level.
+ * @param[in] start The start of the interval in the unit of the level.
+ * @param[in] add The rollup or cycle to be added.
+ */
+static void history_add(history_outlet_t* history, size_t index,
+                        uint32_t start, const history_open_t* add) {
+  history_open_t* open = &history->open[index];
+
+  if (open->count > 0 && open->start != start) {
+    // Invalidate the slot while it is being written, so that readers skip it.
+    size_t capacity;
+    history_rollup_t* points = history_points(history, index, &capacity);
+    history_rollup_t* point = &points[open->start % capacity];
+    atomic_store_explicit(&point->stamp, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    point->min = open->min;
+    point->max = open->max;
+    point->mean = (float)(open->sum / open->count);
+    point->energy = (float)open->energy;
+    atomic_store_explicit(&point->stamp, open->start + 1,
+                          memory_order_release);
+
+    if (index + 1 < HISTORY_LEVELS) {
+      uint32_t next_start = (uint32_t)((uint64_t)open->start *
+                                       level_ms[index] / level_ms[index + 1]);
+      history_add(history, index + 1, next_start, open);
+    }
+    memset(open, 0, sizeof(*open));
+  }
+
+  open->start = start;
+  history_merge(open, add);
+}
+
+void history_record(size_t outlet, int64_t time_ms,
+                    const meter_reading_t* reading) {
+  if (outlet >= CONFIG_ZEUS_METER_OUTLETS) {
+    return;
+  }
+
+  history_outlet_t* history = &outlets[outlet];
+  float power = reading->real_power;
+
+  history_raw_t* raw = &history->raw[history->raw_head % HISTORY_RAW_POINTS];
+  atomic_store_explicit(&raw->stamp, 0, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  raw->power = power;
+  atomic_store_explicit(&raw->stamp, (uint32_t)time_ms + 1,
+                        memory_order_release);
+  history->raw_head += 1;
+
+  history_open_t cycle = {
+      .count = 1,
+      .min = power,
+      .max = power,
+      .sum = power,
+      .energy = reading->frequency > 0 && power > 0
+                    ? power / reading->frequency
+                    : 0,
+  };
+  history_add(history, 0, (uint32_t)(time_ms / level_ms[0]), &cycle);
+}
+
+esp_err_t history_parse_resolution(const char* name,
+                                   history_resolution_t* resolution) {
+  static const char* const names[] = {"raw", "1s", "1m", "1h"};
+  for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i) {
+    if (strcmp(name, names[i]) == 0) {
+      *resolution = (history_resolution_t)i;
+      return ESP_OK;
+    }
+  }
+  return ESP_ERR_INVALID_ARG;
+}
+
+/**
+ * Write the valid raw points of an outlet, oldest first.
+ *
+ * @param[in] json The writer receiving the points.
+ * @param[in] history The history of the outlet.
+ * @param[in] since_ms Only points that end after this time are written.
+ */
+static void history_query_raw(json_t* json, history_outlet_t* history,
+                              int64_t since_ms) {
+  // Walk the ring starting at the oldest slot. Points that are overwritten
+  // concurrently fail the stamp check and are skipped.
+  size_t head = history->raw_head;
+  for (size_t i = 0; i < HISTORY_RAW_POINTS; ++i) {
+    history_raw_t* raw = &history->raw[(head + i) % HISTORY_RAW_POINTS];
+    uint32_t stamp = atomic_load_explicit(&raw->stamp, memory_order_acquire);
+    float power = raw->power;
+    atomic_thread_fence(memory_order_acquire);
+    if (stamp == 0 || (int64_t)stamp - 1 <= since_ms ||
+        atomic_load_explicit(&raw->stamp, memory_order_relaxed) != stamp) {
+      continue;
+    }
+
+    json_array_begin(json);
+    json_int(json, stamp - 1);
+    json_double(json, power);
+    json_array_end(json);
+  }
+}
+
+/**
+ * Write the valid rollups of a level, oldest first.
+ *
+ * @param[in] json The writer receiving the points.
+ * @param[in] points The ring of rollups.
+ * @param[in] capacity Number of rollups in the ring.
+ * @param[in] unit_ms Length of an interval in milliseconds.
+ * @param[in] since_ms Only points that end after this time are written.
+ */
+static void history_query_rollups(json_t* json, history_rollup_t* points,
+                                  size_t capacity, uint32_t unit_ms,
+                                  int64_t since_ms) {
+  // Find the newest point, after which the ring continues with the oldest.
+  uint32_t newest = 0;
+  size_t newest_index = 0;
+  for (size_t i = 0; i < capacity; ++i) {
+    uint32_t stamp = atomic_load_explicit(&points[i].stamp,
+                                          memory_order_relaxed);
+    if (stamp > newest) {
+      newest = stamp;
+      newest_index = i;
+    }
+  }
+
+  for (size_t i = 1; i <= capacity; ++i) {
+    history_rollup_t* point = &points[(newest_index + i) % capacity];
+    uint32_t stamp = atomic_load_explicit(&point->stamp, memory_order_acquire);
+    history_rollup_t copy;
+    copy.min = point->min;
+    copy.max = point->max;
+    copy.mean = point->mean;
+    copy.energy = point->energy;
+    atomic_thread_fence(memory_order_acquire);
+    if (stamp == 0 || (int64_t)stamp * unit_ms <= since_ms ||
+        atomic_load_explicit(&point->stamp, memory_order_relaxed) != stamp) {
+      continue;
+    }
+
+    json_array_begin(json);
+    json_int(json, (int64_t)(stamp - 1) * unit_ms);
+    json_double(json, copy.min);
+    json_double(json, copy.max);
+    json_double(json, copy.mean);
+    json_double(json, copy.energy);
+    json_array_end(json);
+  }
+}
+
+void history_query(json_t* json, size_t outlet,
+                   history_resolution_t resolution, int64_t since_ms) {
+  json_array_begin(json);
+
+  if (outlet < CONFIG_ZEUS_METER_OUTLETS) {
+    history_outlet_t* history = &outlets[outlet];
+    if (resolution == HISTORY_RAW) {
+      history_query_raw(json, history, since_ms);
+    } else {
+      size_t index = resolution - HISTORY_SECOND;
+      size_t capacity;
+      history_rollup_t* points = history_points(history, index, &capacity);
+      history_query_rollups(json, points, capacity, level_ms[index], since_ms);
+    }
+  }
+
+  json_array_end(json);
+}
@@ -0,0 +1,71 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "json.h"
+#include "meter.h"
+
+// The sizes below fix the memory of every outlet at about 5 KiB.
+
+// Number of cycles kept at full resolution per outlet, about 2.5 s at 50 Hz.
+#define HISTORY_RAW_POINTS 128
+// Number of 1 s rollups kept per outlet.
+#define HISTORY_SECOND_POINTS 120
+// Number of 1 min rollups kept per outlet.
+#define HISTORY_MINUTE_POINTS 60
+// Number of 1 h rollups kept per outlet.
+#define HISTORY_HOUR_POINTS 24
+
+/**
+ * The resolutions at which the history is kept.
+ */
+typedef enum history_resolution {
+  HISTORY_RAW,
+  HISTORY_SECOND,
+  HISTORY_MINUTE,
+  HISTORY_HOUR,
+} history_resolution_t;
+
+/**
+ * Add the reading of a completed cycle to the history of an outlet. This
+ * function is lock-free, but must only be called from a single thread.
+ *
+ * @param[in] outlet The index of the outlet.
+ * @param[in] time_ms The time at the end of the cycle in milliseconds since
+ * the device was started.
+ * @param[in] reading The reading of the cycle.
+ */
+void history_record(size_t outlet, int64_t time_ms,
+                    const meter_reading_t* reading);
+
+/**
+ * Parse the name of a resolution, such as "1s".
+ *
+ * @param[in] name The name.
+ * @param[out] resolution Receives the resolution.
+ *
+ * @return ESP_OK or ESP_ERR_INVALID_ARG if the name is unknown.
+ */
+esp_err_t history_parse_resolution(const char* name,
+                                   history_resolution_t* resolution);
+
+/**
+ * Write the points of an outlet that end after the given time as a JSON array,
+ * oldest first. Raw points are `[time, power]` with the end of the cycle,
+ * rollups are `[time, min, max, mean, energy]` with the start of the interval.
+ * Times are in milliseconds since the device was started, the power is in
+ * watts and the energy in joules. This function is thread-safe and skips
+ * points that are overwritten while being read.
+ *
+ * @param[in] json The writer receiving the array.
+ * @param[in] outlet The index of the outlet.
+ * @param[in] resolution The resolution of the points.
+ * @param[in] since_ms Only points that end after this time are written.
+ */
+void history_query(json_t* json, size_t outlet,
+                   history_resolution_t resolution, int64_t since_ms);
+
+#endif
@@ -1,8 +1,18 @@
 #include "http.h"
 
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
 
 #include "cJSON.h"
+#include "energy.h"
 #include "esp_err.h"
 #include "esp_eth.h"
 #include "esp_event.h"
@@ -10,7 +20,24 @@
 #include "esp_log.h"
 #include "esp_netif.h"
 #include "esp_ota_ops.h"
+#include "esp_pthread.h"
+#include "esp_system.h"
+#include "esp_timer.h"
 #include "git.h"
+#include "gzip.h"
+#include "health.h"
+#include "history.h"
+#include "json.h"
+#include "meter.h"
+#include "metrics.h"
+#include "outbuf.h"
+#include "peer.h"
+#include "prom.h"
+#include "relay.h"
+#include "sdkconfig.h"
+#include "stream.h"
+#include "trace.h"
+#include "update.h"
 
 // TODO: Refactor this.
 
@@ -36,66 +63,592 @@ char* http_user_agent(void) {
   return user_agent;
 }
 
-bool http_is_redirect(int32_t status) {
-  return (bool)(status >= 300 && status < 400);
-}
-
 /////////////////
 // HTTP server //
 /////////////////
 
 #define TAG_SERVER "http.server"
+// Size of the If-None-Match header that is compared with an ETag.
+#define HTTP_ETAG_LIST_SIZE 256
+// Size of the query string of a request.
+#define HTTP_QUERY_SIZE 128
+// Maximum length of the Accept header of a scrape that is negotiated.
+#define HTTP_ACCEPT_SIZE 384
+// Maximum length of the Accept-Encoding header that is negotiated.
+#define HTTP_ACCEPT_ENCODING_SIZE 128
+// Number of requests waiting for a worker.
+#define HTTP_QUEUE_SIZE 4
+// Size of the body of a switching request.
+#define HTTP_BODY_SIZE 512
+// Prefix of the URI of a single outlet.
+#define HTTP_OUTLET_PREFIX "/outlets/"
+// Size of the chunks in which the firmware image is read from the flash.
+#define HTTP_FIRMWARE_CHUNK_SIZE 4096
+// Maximum number of peers downloading the firmware image at the same time, so
+// that the workers remain available for other requests.
+#define HTTP_FIRMWARE_MAX_UPLOADS 1
+
+/**
+ * Handles a request.
+ *
+ * @param[in] req The request.
+ *
+ * @return ESP_OK or an error that closes the connection.
+ */
+typedef esp_err_t (*http_handler_t)(httpd_req_t* req);
+
+/**
+ * A request handed off to the workers.
+ *
+ * @param req The copy of the request, which stays valid until the request is
+ * completed.
+ * @param handler The function handling the request.
+ */
+typedef struct http_job {
+  httpd_req_t* req;
+  http_handler_t handler;
+} http_job_t;
+
+/**
+ * Compresses the body of a response. The compressors are allocated once and
+ * handed to one response at a time, which bounds the memory regardless of
+ * the number of connections.
+ *
+ * @param gzip The compressor.
+ * @param out Collects the compressed data, so that it is sent in large chunks
+ * or at once if it is short.
+ * @param used Whether a response is being compressed.
+ */
+typedef struct http_compressor {
+  gzip_t gzip;
+  outbuf_t out;
+  bool used;
+} http_compressor_t;
+
+/**
+ * A response whose body is generated into an output buffer and streamed in
+ * chunks, compressed if the client accepts it.
+ *
+ * @param req The request.
+ * @param out The output buffer receiving the body.
+ * @param compressible Whether the client accepts a compressed body.
+ * @param chunked Whether the body is sent in chunks.
+ * @param compressor The compressor of the body or NULL if it is sent as is.
+ * @param compress_us Time spent in the compressor in microseconds.
+ * @param send_us Time spent sending the compressed body in microseconds.
+ */
+typedef struct http_response {
+  httpd_req_t* req;
+  outbuf_t out;
+  bool compressible;
+  bool chunked;
+  http_compressor_t* compressor;
+  int64_t compress_us;
+  int64_t send_us;
+} http_response_t;
 
 static httpd_handle_t http_server = NULL;
 
-static esp_err_t http_send_json(httpd_req_t* req, cJSON* data) {
-  // Set the content type to JSON.
-  httpd_resp_set_type(req, "application/json");
+// Requests waiting for a worker.
+static http_job_t jobs[HTTP_QUEUE_SIZE];
+// Index of the next request to be handled.
+static size_t jobs_tail = 0;
+// Number of waiting requests.
+static size_t jobs_used = 0;
+// Guards the waiting requests.
+static pthread_mutex_t jobs_mutex = PTHREAD_MUTEX_INITIALIZER;
+// Signals the workers that a request is waiting.
+static pthread_cond_t jobs_queued = PTHREAD_COND_INITIALIZER;
+// The threads handling slow requests.
+static pthread_t workers[CONFIG_ZEUS_HTTP_WORKERS];
 
-  // Encode JSON object to string and send it.
-  httpd_resp_send(req, cJSON_Print(data), HTTPD_RESP_USE_STRLEN);
+// Upper bounds of the duration of a request in microseconds.
+static const uint32_t request_bounds[] = {
+    250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000,
+};
+// Counts handled requests.
+static metrics_metric_t requests_total = METRICS_COUNTER_INIT(
+    "zeus_http_requests_total", "Number of handled HTTP requests.");
+// Measures the time spent in request handlers.
+static metrics_metric_t request_seconds = METRICS_HISTOGRAM_INIT(
+    "zeus_http_request_duration_seconds",
+    "Time spent handling an HTTP request.", request_bounds, 1e-6);
+// Counts requests that were handled on the server thread.
+static metrics_metric_t inline_requests_total = METRICS_COUNTER_INIT(
+    "zeus_http_inline_requests_total",
+    "Number of slow HTTP requests handled by the server because all workers "
+    "were busy.");
+// Counts bytes of the firmware image sent to peers.
+static metrics_metric_t firmware_sent_total = METRICS_COUNTER_INIT(
+    "zeus_http_firmware_sent_bytes_total",
+    "Number of bytes of the firmware image sent to other devices.");
+// The time from the start of the device until the server first listened.
+static metrics_metric_t ready_seconds = METRICS_GAUGE_SCALED_INIT(
+    "zeus_http_ready_seconds",
+    "Time from the start of the device until the HTTP server was ready.",
+    1e-3);
+// Number of peers downloading the firmware image.
+static _Atomic int firmware_uploads = 0;
 
-  return ESP_OK;
+#ifdef CONFIG_ZEUS_HTTP_COMPRESSION
+// The compressors of the responses or NULL if they couldn't be allocated.
+static http_compressor_t* compressors = NULL;
+// Guards the use of the compressors.
+static pthread_mutex_t compressors_mutex = PTHREAD_MUTEX_INITIALIZER;
+// Upper bounds of the compressed size relative to the body in thousandths.
+static const uint32_t compression_ratio_bounds[] = {
+    50, 100, 150, 200, 300, 400, 500, 700, 1000,
+};
+// Upper bounds of the time spent compressing a body in microseconds.
+static const uint32_t compression_bounds[] = {
+    100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000,
 };
+// Measures the compressed size of the bodies relative to their size.
+static metrics_metric_t compression_ratio = METRICS_HISTOGRAM_INIT(
+    "zeus_http_compression_ratio",
+    "Size of a compressed HTTP response body relative to its original size.",
+    compression_ratio_bounds, 1e-3);
+// Measures the CPU time spent compressing the bodies.
+static metrics_metric_t compression_seconds = METRICS_HISTOGRAM_INIT(
+    "zeus_http_compression_duration_seconds",
+    "Time spent compressing an HTTP response body, without sending it.",
+    compression_bounds, 1e-6);
+// Counts bytes of the bodies before compression.
+static metrics_metric_t compression_input_total = METRICS_COUNTER_INIT(
+    "zeus_http_compression_input_bytes_total",
+    "Number of bytes of HTTP response bodies that were compressed.");
+// Counts bytes of the bodies after compression.
+static metrics_metric_t compression_output_total = METRICS_COUNTER_INIT(
+    "zeus_http_compression_output_bytes_total",
+    "Number of bytes of compressed HTTP response bodies.");
+// Counts bodies sent as is because all compressors were busy.
+static metrics_metric_t compression_busy_total = METRICS_COUNTER_INIT(
+    "zeus_http_compression_busy_total",
+    "Number of HTTP responses sent uncompressed because all compressors "
+    "were busy.");
+#endif
 
-static esp_err_t health_list_endpoint(httpd_req_t* req) {
-  // Fetch information about currently running firmware.
-  const esp_partition_t* running = esp_ota_get_running_partition();
-  esp_app_desc_t running_app_info;
-  if (esp_ota_get_partition_description(running, &running_app_info) != ESP_OK) {
-    httpd_resp_set_status(req, "500 Internal Server Error");
-    // TODO: Create more descriptive error response!
-    return http_send_json(req, NULL);
+// The health response, which is built once at startup.
+static health_t health;
+
+/**
+ * Start handling a request, which begins a trace slice of the handler.
+ *
+ * @param[in] name The name of the slice, such as "GET /metrics".
+ *
+ * @return The time at which handling the request started.
+ */
+static int64_t http_begin_request(const char* name) {
+  TRACE_BEGIN(name);
+  return esp_timer_get_time();
+}
+
+/**
+ * Record the metrics of a handled request and end its trace slice.
+ *
+ * @param[in] start The time at which handling the request started.
+ */
+static void http_record_request(int64_t start) {
+  metrics_add(&requests_total, 1);
+  metrics_observe(&request_seconds, (uint32_t)(esp_timer_get_time() - start));
+  TRACE_END(NULL);
+}
+
+/**
+ * Handle the requests handed off by `http_dispatch()`.
+ *
+ * @param[in] arg Unused.
+ *
+ * @return NULL.
+ */
+static void* http_worker_thread(void* arg) {
+  while (true) {
+    pthread_mutex_lock(&jobs_mutex);
+    while (jobs_used == 0) {
+      pthread_cond_wait(&jobs_queued, &jobs_mutex);
+    }
+    http_job_t job = jobs[jobs_tail];
+    jobs_tail = (jobs_tail + 1) % HTTP_QUEUE_SIZE;
+    jobs_used -= 1;
+    pthread_mutex_unlock(&jobs_mutex);
+
+    job.handler(job.req);
+    httpd_req_async_handler_complete(job.req);
+  }
+
+  return NULL;
+}
+
+/**
+ * Start the workers handling slow requests.
+ *
+ * @return ESP_OK or ESP_ERR_INVALID_STATE if a worker can't be started.
+ */
+static esp_err_t http_workers_init(void) {
+  esp_pthread_cfg_t cfg = esp_pthread_get_default_config();
+  cfg.stack_size = CONFIG_ZEUS_HTTP_WORKER_STACK_SIZE + OUTBUF_SIZE +
+                   sizeof(meter_reading_t) * METER_MAX_OUTLETS;
+  cfg.thread_name = "http_worker";
+#if CONFIG_ZEUS_HTTP_CORE >= 0
+  cfg.pin_to_core = CONFIG_ZEUS_HTTP_CORE;
+#endif
+  esp_pthread_set_cfg(&cfg);
+
+  int ret = 0;
+  for (size_t i = 0; i < CONFIG_ZEUS_HTTP_WORKERS && ret == 0; ++i) {
+    ret = pthread_create(&workers[i], NULL, http_worker_thread, NULL);
+  }
+
+  cfg = esp_pthread_get_default_config();
+  esp_pthread_set_cfg(&cfg);
+
+  return ret == 0 ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
+
+/**
+ * Hand a slow request off to a worker, so that the server keeps serving other
+ * connections. The request is handled on the server thread if all workers are
+ * busy.
+ *
+ * @param[in] req The request.
+ * @param[in] handler The function handling the request.
+ *
+ * @return ESP_OK or the error of the handler.
+ */
+static esp_err_t http_dispatch(httpd_req_t* req, http_handler_t handler) {
+  httpd_req_t* copy = NULL;
+  if (httpd_req_async_handler_begin(req, &copy) != ESP_OK) {
+    metrics_add(&inline_requests_total, 1);
+    return handler(req);
   }
 
-  cJSON* firmware = cJSON_CreateObject();
-  cJSON_AddStringToObject(firmware, "version", running_app_info.version);
-  cJSON_AddStringToObject(firmware, "sdk", running_app_info.idf_ver);
+  pthread_mutex_lock(&jobs_mutex);
+  bool queued = jobs_used < HTTP_QUEUE_SIZE;
+  if (queued) {
+    jobs[(jobs_tail + jobs_used) % HTTP_QUEUE_SIZE] = (http_job_t){
+        .req = copy,
+        .handler = handler,
+    };
+    jobs_used += 1;
+    pthread_cond_signal(&jobs_queued);
+  }
+  pthread_mutex_unlock(&jobs_mutex);
+
+  if (!queued) {
+    httpd_req_async_handler_complete(copy);
+    metrics_add(&inline_requests_total, 1);
+    return handler(req);
+  }
 
-  // Concatenate compile data and time to timestamp.
-  int timestamp_len =
-      sizeof(running_app_info.date) + sizeof(running_app_info.time) + 2;
-  char timestamp[timestamp_len];
-  snprintf(timestamp, timestamp_len, "%s %s", running_app_info.date,
-           running_app_info.time);
-  cJSON_AddStringToObject(firmware, "timestamp", timestamp);
+  return ESP_OK;
+}
 
-  // Create SHA256 hash string.
-  int sha256_len = sizeof(running_app_info.app_elf_sha256);
-  char sha256[sha256_len * 2 + 1];
-  sha256[sha256_len * 2] = 0;
-  for (int i = 0; i < sha256_len; ++i) {
-    sprintf(&sha256[i * 2], "%02x", running_app_info.app_elf_sha256[i]);
+#ifdef CONFIG_ZEUS_HTTP_COMPRESSION
+/**
+ * Allocate the compressors of the responses.
+ *
+ * @return ESP_OK or ESP_ERR_NO_MEM if they can't be allocated.
+ */
+static esp_err_t http_compressors_init(void) {
+  metrics_register(&compression_ratio);
+  metrics_register(&compression_seconds);
+  metrics_register(&compression_input_total);
+  metrics_register(&compression_output_total);
+  metrics_register(&compression_busy_total);
+
+  compressors =
+      calloc(CONFIG_ZEUS_HTTP_COMPRESSORS, sizeof(http_compressor_t));
+  return compressors != NULL ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+/**
+ * Check whether a client accepts gzip-compressed bodies.
+ *
+ * @param[in] req The request.
+ *
+ * @return true if the Accept-Encoding header allows gzip.
+ */
+static bool http_accepts_gzip(httpd_req_t* req) {
+  char value[HTTP_ACCEPT_ENCODING_SIZE];
+  esp_err_t err = httpd_req_get_hdr_value_str(req, "Accept-Encoding", value,
+                                              sizeof(value));
+  if (err != ESP_OK && err != ESP_ERR_HTTPD_RESULT_TRUNC) {
+    return false;
   }
-  cJSON_AddStringToObject(firmware, "sha256", sha256);
 
-  cJSON* data = cJSON_CreateObject();
-  cJSON_AddItemReferenceToObject(data, "firmware", firmware);
+  // An explicit quality for gzip takes precedence over the wildcard.
+  double gzip = -1;
+  double any = -1;
+  char* saveptr = NULL;
+  for (char* coding = strtok_r(value, ",", &saveptr); coding != NULL;
+       coding = strtok_r(NULL, ",", &saveptr)) {
+    coding += strspn(coding, " \t");
+    size_t length = strcspn(coding, " \t;");
+    const char* quality = strstr(&coding[length], "q=");
+    double q = quality != NULL ? strtod(quality + 2, NULL) : 1;
+    if ((length == 4 && strncasecmp(coding, "gzip", 4) == 0) ||
+        (length == 6 && strncasecmp(coding, "x-gzip", 6) == 0)) {
+      gzip = q;
+    } else if (length == 1 && coding[0] == '*') {
+      any = q;
+    }
+  }
+  return gzip >= 0 ? gzip > 0 : any > 0;
+}
+
+/**
+ * Collect compressed data in the buffer of the compressor. This is a
+ * `gzip_write_t`.
+ *
+ * @param[in] ctx The output buffer of the compressor.
+ * @param[in] data The compressed data.
+ * @param[in] length Number of bytes.
+ *
+ * @return ESP_OK or the error of sending a previous chunk.
+ */
+static esp_err_t http_compress_write(void* ctx, const char* data,
+                                     size_t length) {
+  outbuf_t* out = ctx;
+  outbuf_write(out, data, length);
+  return out->err;
+}
+
+/**
+ * Send compressed data as a chunk of the response, measuring the time it
+ * takes, so that it can be told apart from the time spent compressing.
+ *
+ * @param[in] ctx The response.
+ * @param[in] data The compressed data.
+ * @param[in] length Number of bytes.
+ *
+ * @return ESP_OK if the chunk was sent.
+ */
+static esp_err_t http_send_compressed(void* ctx, const char* data,
+                                      size_t length) {
+  http_response_t* response = ctx;
+  int64_t start = esp_timer_get_time();
+  esp_err_t err = httpd_resp_send_chunk(response->req, data, length);
+  response->send_us += esp_timer_get_time() - start;
+  return err;
+}
+
+/**
+ * Start compressing the body of a response if the client accepts it and a
+ * compressor is available.
+ *
+ * @param[in] response The response.
+ */
+static void http_compress_begin(http_response_t* response) {
+  if (!response->compressible || compressors == NULL) {
+    return;
+  }
+
+  pthread_mutex_lock(&compressors_mutex);
+  for (size_t i = 0; i < CONFIG_ZEUS_HTTP_COMPRESSORS; ++i) {
+    if (!compressors[i].used) {
+      compressors[i].used = true;
+      response->compressor = &compressors[i];
+      break;
+    }
+  }
+  pthread_mutex_unlock(&compressors_mutex);
+
+  http_compressor_t* compressor = response->compressor;
+  if (compressor == NULL) {
+    metrics_add(&compression_busy_total, 1);
+    return;
+  }
+  httpd_resp_set_hdr(response->req, "Content-Encoding", "gzip");
+  outbuf_init(&compressor->out, http_send_compressed, response);
+  gzip_init(&compressor->gzip, http_compress_write, &compressor->out);
+}
+
+/**
+ * Compress the rest of the body, send it and record the metrics of the
+ * compression. The compressor is released.
+ *
+ * @param[in] response The response.
+ * @param[in] err ESP_OK or the error that occurred while sending the body,
+ * in which case the compressed data is discarded.
+ *
+ * @return ESP_OK if the response was sent.
+ */
+static esp_err_t http_compress_end(http_response_t* response, esp_err_t err) {
+  http_compressor_t* compressor = response->compressor;
+  if (err == ESP_OK) {
+    int64_t start = esp_timer_get_time();
+    err = gzip_finish(&compressor->gzip);
+    response->compress_us += esp_timer_get_time() - start;
+  }
+  if (err == ESP_OK && compressor->out.bytes_sent == 0) {
+    // The compressed body fits into the buffer, so it is sent at once.
+    err = httpd_resp_send(response->req, compressor->out.buffer,
+                          compressor->out.fill);
+  } else if (err == ESP_OK) {
+    err = outbuf_flush(&compressor->out);
+    if (err == ESP_OK) {
+      err = httpd_resp_send_chunk(response->req, NULL, 0);
+    }
+  }
+
+  uint32_t input_length = compressor->gzip.input_length;
+  size_t output_length = compressor->gzip.output_length;
+  if (err == ESP_OK && input_length > 0) {
+    metrics_add(&compression_input_total, input_length);
+    metrics_add(&compression_output_total, output_length);
+    metrics_observe(&compression_ratio,
+                    (uint32_t)((uint64_t)output_length * 1000 / input_length));
+    metrics_observe(&compression_seconds,
+                    (uint32_t)(response->compress_us - response->send_us));
+  }
+
+  pthread_mutex_lock(&compressors_mutex);
+  compressor->used = false;
+  pthread_mutex_unlock(&compressors_mutex);
+  response->compressor = NULL;
+  return err;
+}
+#endif
+
+/**
+ * Send the body as a chunk of the response, compressing it if the client
+ * accepts it. This is an `outbuf_sink_t`.
+ *
+ * @param[in] ctx The response.
+ * @param[in] data The body to be sent.
+ * @param[in] length Number of bytes to be sent.
+ *
+ * @return ESP_OK if the chunk was sent.
+ */
+static esp_err_t http_send_body(void* ctx, const char* data, size_t length) {
+  http_response_t* response = ctx;
+#ifdef CONFIG_ZEUS_HTTP_COMPRESSION
+  if (!response->chunked) {
+    response->chunked = true;
+    http_compress_begin(response);
+  }
+  if (response->compressor != NULL) {
+    int64_t start = esp_timer_get_time();
+    esp_err_t err = gzip_feed(&response->compressor->gzip, data, length);
+    response->compress_us += esp_timer_get_time() - start;
+    return err;
+  }
+#endif
+  return httpd_resp_send_chunk(response->req, data, length);
+}
+
+/**
+ * Prepare a response whose body is streamed in chunks.
+ *
+ * @param[in] req The request.
+ * @param[out] response The response, whose output buffer receives the body.
+ * @param[in] type The content type of the response.
+ */
+static void http_send_begin(httpd_req_t* req, http_response_t* response,
+                            const char* type) {
+  httpd_resp_set_type(req, type);
+  response->req = req;
+  response->compressible = false;
+  response->chunked = false;
+  response->compressor = NULL;
+  response->compress_us = 0;
+  response->send_us = 0;
+#ifdef CONFIG_ZEUS_HTTP_COMPRESSION
+  httpd_resp_set_hdr(req, "Vary", "Accept-Encoding");
+  response->compressible = http_accepts_gzip(req);
+#endif
+  outbuf_init(&response->out, http_send_body, response);
+}
+
+/**
+ * Complete a response whose body was generated into the output buffer of
+ * `http_send_begin()`. A body that fits into the buffer is sent at once with
+ * a Content-Length header instead of a chunked encoding, and is only
+ * compressed if it is at least as long as the configured minimum.
+ *
+ * @param[in] response The response holding the rest of the body.
+ *
+ * @return ESP_OK if the response was sent.
+ */
+static esp_err_t http_send_end(http_response_t* response) {
+  httpd_req_t* req = response->req;
+  outbuf_t* out = &response->out;
+#ifdef CONFIG_ZEUS_HTTP_COMPRESSION
+  if (out->bytes_sent == 0 &&
+      out->fill >= CONFIG_ZEUS_HTTP_COMPRESSION_MIN_SIZE) {
+    response->chunked = true;
+    http_compress_begin(response);
+  }
+#endif
+  bool compressed = response->compressor != NULL;
+  if (out->bytes_sent == 0 && !compressed) {
+    return httpd_resp_send(req, out->buffer, out->fill);
+  }
+
+  esp_err_t err = outbuf_flush(out);
+#ifdef CONFIG_ZEUS_HTTP_COMPRESSION
+  if (compressed) {
+    err = http_compress_end(response, err);
+  }
+#endif
+  if (err == ESP_OK && !compressed) {
+    err = httpd_resp_send_chunk(req, NULL, 0);
+  }
+  if (err != ESP_OK) {
+    ESP_LOGW(TAG_SERVER, "Failed to send response: %s", esp_err_to_name(err));
+  }
+  return err;
+}
+
+/**
+ * Send an error response with a JSON body.
+ *
+ * @param[in] req The request.
+ * @param[in] status The HTTP status line, such as "400 Bad Request".
+ * @param[in] message A description of the error.
+ *
+ * @return ESP_OK if the response was sent.
+ */
+static esp_err_t http_send_error(httpd_req_t* req, const char* status,
+                                 const char* message) {
+  http_response_t response;
+  json_t json;
+  httpd_resp_set_status(req, status);
+  http_send_begin(req, &response, JSON_CONTENT_TYPE);
+  json_init(&json, &response.out);
 
-  cJSON* response = cJSON_CreateObject();
-  cJSON_AddItemReferenceToObject(response, "data", data);
+  json_object_begin(&json);
+  json_key(&json, "error");
+  json_object_begin(&json);
+  json_key(&json, "message");
+  json_string(&json, message);
+  json_object_end(&json);
+  json_object_end(&json);
 
-  return http_send_json(req, response);
+  return http_send_end(&response);
+}
+
+static esp_err_t health_list_endpoint(httpd_req_t* req) {
+  int64_t start = http_begin_request("GET /health");
+
+  // The response is served from static memory, as it was built at startup.
+  char if_none_match[HTTP_ETAG_LIST_SIZE];
+  bool has_if_none_match =
+      httpd_req_get_hdr_value_str(req, "If-None-Match", if_none_match,
+                                  sizeof(if_none_match)) == ESP_OK;
+  esp_err_t err;
+  httpd_resp_set_hdr(req, "ETag", health.etag);
+  if (health_not_modified(&health,
+                          has_if_none_match ? if_none_match : NULL)) {
+    httpd_resp_set_status(req, "304 Not Modified");
+    err = httpd_resp_send(req, NULL, 0);
+  } else {
+    httpd_resp_set_type(req, JSON_CONTENT_TYPE);
+    err = httpd_resp_send(req, health.body, health.length);
+  }
+
+  http_record_request(start);
+  return err;
 }
 
 static const httpd_uri_t health_list = {
@@ -104,10 +657,894 @@ static const httpd_uri_t health_list = {
     .handler = health_list_endpoint,
 };
 
+/**
+ * Describes a per-outlet metric family.
+ *
+ * @param name The name of the metric family.
+ * @param help A description of the metric family.
+ * @param offset Offset of the value within a reading.
+ */
+typedef struct outlet_metric {
+  const char* name;
+  const char* help;
+  size_t offset;
+} outlet_metric_t;
+
+/**
+ * Write the latest readings of all outlets.
+ *
+ * @param[in] prom The writer of the exposition format.
+ */
+static void metrics_write_outlets(prom_t* prom) {
+  static const outlet_metric_t families[] = {
+      {"zeus_outlet_voltage_volts", "RMS voltage of the outlet.",
+       offsetof(meter_reading_t, voltage_rms)},
+      {"zeus_outlet_current_amperes", "RMS current of the outlet.",
+       offsetof(meter_reading_t, current_rms)},
+      {"zeus_outlet_power_watts", "Real power of the outlet.",
+       offsetof(meter_reading_t, real_power)},
+      {"zeus_outlet_apparent_power_voltamperes",
+       "Apparent power of the outlet.",
+       offsetof(meter_reading_t, apparent_power)},
+      {"zeus_outlet_power_factor", "Power factor of the outlet.",
+       offsetof(meter_reading_t, power_factor)},
+      {"zeus_outlet_frequency_hertz", "Mains frequency at the outlet.",
+       offsetof(meter_reading_t, frequency)},
+  };
+
+  size_t outlet_count = meter_outlet_count();
+  meter_reading_t readings[METER_MAX_OUTLETS];
+  char numbers[METER_MAX_OUTLETS][4];
+  prom_label_t labels[METER_MAX_OUTLETS];
+  size_t valid_count = 0;
+  size_t valid[METER_MAX_OUTLETS];
+  for (size_t outlet = 0; outlet < outlet_count; ++outlet) {
+    snprintf(numbers[outlet], sizeof(numbers[outlet]), "%u",
+             (unsigned)outlet);
+    labels[outlet] = (prom_label_t){.name = "outlet", .value = numbers[outlet]};
+    if (meter_get_reading(outlet, &readings[outlet]) == ESP_OK) {
+      valid[valid_count++] = outlet;
+    }
+  }
+
+  prom_sample_t samples[METER_MAX_OUTLETS];
+  for (size_t i = 0; i < sizeof(families) / sizeof(families[0]); ++i) {
+    for (size_t j = 0; j < valid_count; ++j) {
+      const char* reading = (const char*)&readings[valid[j]];
+      samples[j] = (prom_sample_t){
+          .labels = &labels[valid[j]],
+          .label_count = 1,
+          .value = *(const float*)(reading + families[i].offset),
+      };
+    }
+    prom_family(prom, families[i].name, PROM_GAUGE, families[i].help,
+                samples, valid_count);
+  }
+
+  for (size_t outlet = 0; outlet < outlet_count; ++outlet) {
+    samples[outlet] = (prom_sample_t){
+        .labels = &labels[outlet],
+        .label_count = 1,
+        .value = (double)energy_get(outlet) / 1000,
+    };
+  }
+  prom_family(prom, "zeus_outlet_energy_joules_total", PROM_COUNTER,
+              "Energy consumed by the outlet.", samples, outlet_count);
+}
+
+/**
+ * Write the metrics of the device.
+ *
+ * @param[in] prom The writer of the exposition format.
+ */
+static void metrics_write(prom_t* prom) {
+  const esp_app_desc_t* app = esp_app_get_description();
+  const prom_label_t build_labels[] = {
+      {.name = "version", .value = app->version},
+      {.name = "sdk", .value = app->idf_ver},
+  };
+  prom_sample_t sample = {
+      .labels = build_labels,
+      .label_count = sizeof(build_labels) / sizeof(build_labels[0]),
+      .value = 1,
+  };
+  prom_family(prom, "zeus_build_info", PROM_GAUGE,
+              "Version of the running firmware.", &sample, 1);
+
+  sample = (prom_sample_t){.value = (double)esp_timer_get_time() / 1000000};
+  prom_family(prom, "zeus_uptime_seconds", PROM_GAUGE,
+              "Time since the device was started.", &sample, 1);
+
+  sample.value = esp_get_free_heap_size();
+  prom_family(prom, "zeus_heap_free_bytes", PROM_GAUGE, "Free heap memory.",
+              &sample, 1);
+  sample.value = esp_get_minimum_free_heap_size();
+  prom_family(prom, "zeus_heap_min_free_bytes", PROM_GAUGE,
+              "Lowest amount of free heap memory since the start.", &sample,
+              1);
+
+  metrics_export(prom);
+  metrics_write_outlets(prom);
+}
+
+static esp_err_t metrics_list_endpoint(httpd_req_t* req) {
+  int64_t start = http_begin_request("GET /metrics");
+
+  // A truncated header is still negotiated on the media ranges that fit.
+  char accept[HTTP_ACCEPT_SIZE];
+  esp_err_t err =
+      httpd_req_get_hdr_value_str(req, "Accept", accept, sizeof(accept));
+  prom_format_t format = prom_negotiate(
+      err == ESP_OK || err == ESP_ERR_HTTPD_RESULT_TRUNC ? accept : NULL);
+
+  // The body is streamed from a buffer on the stack, so scraping doesn't
+  // allocate memory regardless of the number of metrics.
+  http_response_t response;
+  http_send_begin(req, &response, prom_content_type(format));
+  httpd_resp_set_hdr(req, "Vary", "Accept");
+  prom_t prom;
+  prom_init(&prom, &response.out, format);
+  metrics_write(&prom);
+  err = http_send_end(&response);
+  http_record_request(start);
+  return err;
+}
+
+static esp_err_t metrics_list_dispatch(httpd_req_t* req) {
+  return http_dispatch(req, metrics_list_endpoint);
+}
+
+static const httpd_uri_t metrics_list = {
+    .method = HTTP_GET,
+    .uri = "/metrics",
+    .handler = metrics_list_dispatch,
+};
+
+static esp_err_t history_list_endpoint(httpd_req_t* req) {
+  int64_t start = http_begin_request("GET /history");
+
+  // Parse the query, such as "?outlet=0&resolution=1s&since=0".
+  char query[HTTP_QUERY_SIZE] = {0};
+  char value[16];
+  httpd_req_get_url_query_str(req, query, sizeof(query));
+
+  char* end;
+  long outlet = -1;
+  if (httpd_query_key_value(query, "outlet", value, sizeof(value)) == ESP_OK) {
+    outlet = strtol(value, &end, 10);
+    if (*end != 0) {
+      outlet = -1;
+    }
+  }
+
+  history_resolution_t resolution = HISTORY_SECOND;
+  char resolution_name[8] = "1s";
+  if (httpd_query_key_value(query, "resolution", resolution_name,
+                            sizeof(resolution_name)) != ESP_OK) {
+    strcpy(resolution_name, "1s");
+  }
+
+  long long since_ms = -1;
+  if (httpd_query_key_value(query, "since", value, sizeof(value)) == ESP_OK) {
+    since_ms = strtoll(value, &end, 10);
+    if (*end != 0) {
+      since_ms = LLONG_MIN;
+    }
+  }
+
+  esp_err_t err;
+  if (outlet < 0 || outlet >= (long)meter_outlet_count()) {
+    err = http_send_error(req, "404 Not Found", "Unknown outlet");
+  } else if (history_parse_resolution(resolution_name, &resolution) !=
+             ESP_OK) {
+    err = http_send_error(req, "400 Bad Request", "Unknown resolution");
+  } else if (since_ms == LLONG_MIN) {
+    err = http_send_error(req, "400 Bad Request", "Invalid start time");
+  } else {
+    // The points are streamed from the preallocated history.
+    http_response_t response;
+    json_t json;
+    http_send_begin(req, &response, JSON_CONTENT_TYPE);
+    json_init(&json, &response.out);
+
+    json_object_begin(&json);
+    json_key(&json, "data");
+    json_object_begin(&json);
+    json_key(&json, "outlet");
+    json_int(&json, outlet);
+    json_key(&json, "resolution");
+    json_string(&json, resolution_name);
+    json_key(&json, "now");
+    json_int(&json, esp_timer_get_time() / 1000);
+    json_key(&json, "points");
+    history_query(&json, outlet, resolution, since_ms);
+    json_object_end(&json);
+    json_object_end(&json);
+
+    err = http_send_end(&response);
+  }
+
+  http_record_request(start);
+  return err;
+}
+
+static esp_err_t history_list_dispatch(httpd_req_t* req) {
+  return http_dispatch(req, history_list_endpoint);
+}
+
+static const httpd_uri_t history_list = {
+    .method = HTTP_GET,
+    .uri = "/history",
+    .handler = history_list_dispatch,
+};
+
+/**
+ * Write the state and the latest reading of an outlet as a JSON object.
+ *
+ * @param[in] json The JSON writer.
+ * @param[in] outlet The index of the outlet.
+ */
+static void http_write_outlet(json_t* json, size_t outlet) {
+  json_object_begin(json);
+  json_key(json, "id");
+  json_int(json, outlet);
+  json_key(json, "on");
+  json_bool(json, relay_get(outlet));
+
+  meter_reading_t reading;
+  if (meter_get_reading(outlet, &reading) == ESP_OK) {
+    json_key(json, "voltage");
+    json_double(json, reading.voltage_rms);
+    json_key(json, "current");
+    json_double(json, reading.current_rms);
+    json_key(json, "power");
+    json_double(json, reading.real_power);
+  }
+  json_key(json, "energy");
+  json_double(json, (double)energy_get(outlet) / 1000);
+  json_object_end(json);
+}
+
+/**
+ * Write the requested states of the switched outlets as JSON objects.
+ *
+ * @param[in] json The JSON writer.
+ * @param[in] outlets Bit mask of the switched outlets.
+ * @param[in] states Bit mask of the requested states.
+ */
+static void http_write_switches(json_t* json, uint32_t outlets,
+                                uint32_t states) {
+  for (size_t outlet = 0; outlet < RELAY_MAX_OUTLETS; ++outlet) {
+    if ((outlets & (1UL << outlet)) == 0) {
+      continue;
+    }
+    json_object_begin(json);
+    json_key(json, "id");
+    json_int(json, outlet);
+    json_key(json, "on");
+    json_bool(json, (states >> outlet) & 1);
+    json_object_end(json);
+  }
+}
+
+/**
+ * Get the outlet addressed by the URI of a request, such as "/outlets/3".
+ *
+ * @param[in] req The request.
+ *
+ * @return The index of the outlet or -1 if the outlet doesn't exist.
+ */
+static long http_outlet_id(httpd_req_t* req) {
+  const char* id = req->uri + strlen(HTTP_OUTLET_PREFIX);
+  char* end;
+  long outlet = strtol(id, &end, 10);
+  if (end == id || (*end != 0 && *end != '?') || outlet < 0 ||
+      outlet >= (long)relay_outlet_count()) {
+    return -1;
+  }
+  return outlet;
+}
+
+/**
+ * Receive the body of a request.
+ *
+ * @param[in] req The request.
+ * @param[out] body Buffer receiving the null-terminated body.
+ * @param[in] size Size of the buffer.
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_SIZE if the body doesn't fit into the buffer
+ * or ESP_FAIL if the body can't be received.
+ */
+static esp_err_t http_recv_body(httpd_req_t* req, char* body, size_t size) {
+  if (req->content_len >= size) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+
+  size_t length = 0;
+  while (length < req->content_len) {
+    int received =
+        httpd_req_recv(req, &body[length], req->content_len - length);
+    if (received <= 0) {
+      return ESP_FAIL;
+    }
+    length += received;
+  }
+  body[length] = 0;
+
+  return ESP_OK;
+}
+
+/**
+ * Parse the requested state of an outlet, such as {"on":true}.
+ *
+ * @param[in] item The JSON object.
+ * @param[out] on Receives the requested state.
+ *
+ * @return ESP_OK or ESP_ERR_INVALID_ARG if the state is malformed.
+ */
+static esp_err_t http_parse_switch(const cJSON* item, bool* on) {
+  const cJSON* state = cJSON_GetObjectItem(item, "on");
+  if (!cJSON_IsBool(state)) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  *on = cJSON_IsTrue(state);
+  return ESP_OK;
+}
+
+/**
+ * Queue a switching command and send the requested states, or an error if
+ * the command can't be queued.
+ *
+ * @param[in] req The request.
+ * @param[in] outlets Bit mask of the switched outlets.
+ * @param[in] states Bit mask of the requested states.
+ * @param[in] single Indicates that a single outlet is switched, whose state
+ * is sent as an object instead of an array.
+ * @param[in] start The time at which the request arrived.
+ *
+ * @return ESP_OK if the response was sent.
+ */
+static esp_err_t http_send_switches(httpd_req_t* req, uint32_t outlets,
+                                    uint32_t states, bool single,
+                                    int64_t start) {
+  esp_err_t err = relay_submit(outlets, states, start);
+  if (err == ESP_ERR_NO_MEM) {
+    return http_send_error(req, "503 Service Unavailable",
+                           "Too many pending commands");
+  }
+  if (err != ESP_OK) {
+    return http_send_error(req, "404 Not Found", "Unknown outlet");
+  }
+
+  // The relays are switched asynchronously, with outlets that are turned on
+  // being staggered.
+  http_response_t response;
+  json_t json;
+  httpd_resp_set_status(req, "202 Accepted");
+  http_send_begin(req, &response, JSON_CONTENT_TYPE);
+  json_init(&json, &response.out);
+
+  json_object_begin(&json);
+  json_key(&json, "data");
+  if (!single) {
+    json_array_begin(&json);
+  }
+  http_write_switches(&json, outlets, states);
+  if (!single) {
+    json_array_end(&json);
+  }
+  json_object_end(&json);
+
+  return http_send_end(&response);
+}
+
+static esp_err_t outlets_list_endpoint(httpd_req_t* req) {
+  int64_t start = http_begin_request("GET /outlets");
+
+  http_response_t response;
+  json_t json;
+  http_send_begin(req, &response, JSON_CONTENT_TYPE);
+  json_init(&json, &response.out);
+
+  json_object_begin(&json);
+  json_key(&json, "data");
+  json_array_begin(&json);
+  for (size_t outlet = 0; outlet < relay_outlet_count(); ++outlet) {
+    http_write_outlet(&json, outlet);
+  }
+  json_array_end(&json);
+  json_object_end(&json);
+
+  esp_err_t err = http_send_end(&response);
+  http_record_request(start);
+  return err;
+}
+
+static const httpd_uri_t outlets_list = {
+    .method = HTTP_GET,
+    .uri = "/outlets",
+    .handler = outlets_list_endpoint,
+};
+
+static esp_err_t outlets_update_endpoint(httpd_req_t* req) {
+  int64_t start = http_begin_request("PUT /outlets");
+
+  // Parse the batch, such as {"outlets":[{"id":0,"on":true}]}.
+  char body[HTTP_BODY_SIZE];
+  esp_err_t err = http_recv_body(req, body, sizeof(body));
+  if (err == ESP_ERR_INVALID_SIZE) {
+    err = http_send_error(req, "413 Payload Too Large", "Body is too large");
+    http_record_request(start);
+    return err;
+  }
+  if (err != ESP_OK) {
+    // The connection failed, so the request doesn't count as handled.
+    TRACE_END(NULL);
+    return err;
+  }
+
+  uint32_t outlets = 0;
+  uint32_t states = 0;
+  const char* message = NULL;
+  cJSON* root = cJSON_Parse(body);
+  const cJSON* items = cJSON_GetObjectItem(root, "outlets");
+  if (!cJSON_IsArray(items)) {
+    message = "Expected a list of outlets";
+    items = NULL;
+  }
+
+  const cJSON* item = NULL;
+  cJSON_ArrayForEach(item, items) {
+    const cJSON* id = cJSON_GetObjectItem(item, "id");
+    bool on;
+    if (!cJSON_IsNumber(id) || http_parse_switch(item, &on) != ESP_OK) {
+      message = "Expected an id and a state for every outlet";
+      break;
+    }
+    int outlet = id->valueint;
+    if (outlet < 0 || outlet >= (int)relay_outlet_count() ||
+        outlet != id->valuedouble) {
+      message = "Unknown outlet";
+      break;
+    }
+    if (outlets & (1UL << outlet)) {
+      message = "Outlet is listed more than once";
+      break;
+    }
+    outlets |= 1UL << outlet;
+    states |= (uint32_t)on << outlet;
+  }
+  cJSON_Delete(root);
+
+  if (message != NULL) {
+    err = http_send_error(req, "400 Bad Request", message);
+  } else {
+    err = http_send_switches(req, outlets, states, false, start);
+  }
+
+  http_record_request(start);
+  return err;
+}
+
+static const httpd_uri_t outlets_update = {
+    .method = HTTP_PUT,
+    .uri = "/outlets",
+    .handler = outlets_update_endpoint,
+};
+
+static esp_err_t outlet_get_endpoint(httpd_req_t* req) {
+  int64_t start = http_begin_request("GET " HTTP_OUTLET_PREFIX "*");
+
+  esp_err_t err;
+  long outlet = http_outlet_id(req);
+  if (outlet < 0) {
+    err = http_send_error(req, "404 Not Found", "Unknown outlet");
+  } else {
+    http_response_t response;
+    json_t json;
+    http_send_begin(req, &response, JSON_CONTENT_TYPE);
+    json_init(&json, &response.out);
+
+    json_object_begin(&json);
+    json_key(&json, "data");
+    http_write_outlet(&json, outlet);
+    json_object_end(&json);
+
+    err = http_send_end(&response);
+  }
+
+  http_record_request(start);
+  return err;
+}
+
+static const httpd_uri_t outlet_get = {
+    .method = HTTP_GET,
+    .uri = HTTP_OUTLET_PREFIX "*",
+    .handler = outlet_get_endpoint,
+};
+
+static esp_err_t outlet_update_endpoint(httpd_req_t* req) {
+  int64_t start = http_begin_request("PUT " HTTP_OUTLET_PREFIX "*");
+
+  // Parse the state, such as {"on":true}.
+  char body[HTTP_BODY_SIZE];
+  esp_err_t err = http_recv_body(req, body, sizeof(body));
+  if (err == ESP_ERR_INVALID_SIZE) {
+    err = http_send_error(req, "413 Payload Too Large", "Body is too large");
+    http_record_request(start);
+    return err;
+  }
+  if (err != ESP_OK) {
+    // The connection failed, so the request doesn't count as handled.
+    TRACE_END(NULL);
+    return err;
+  }
+
+  bool on = false;
+  cJSON* root = cJSON_Parse(body);
+  esp_err_t parsed = http_parse_switch(root, &on);
+  cJSON_Delete(root);
+
+  long outlet = http_outlet_id(req);
+  if (outlet < 0) {
+    err = http_send_error(req, "404 Not Found", "Unknown outlet");
+  } else if (parsed != ESP_OK) {
+    err = http_send_error(req, "400 Bad Request", "Expected a state");
+  } else {
+    err = http_send_switches(req, 1UL << outlet, (uint32_t)on << outlet, true,
+                             start);
+  }
+
+  http_record_request(start);
+  return err;
+}
+
+static const httpd_uri_t outlet_update = {
+    .method = HTTP_PUT,
+    .uri = HTTP_OUTLET_PREFIX "*",
+    .handler = outlet_update_endpoint,
+};
+
+/**
+ * Send the configured update source and the peers sharing their firmware.
+ *
+ * @param[in] req The request.
+ *
+ * @return ESP_OK if the response was sent.
+ */
+static esp_err_t http_send_update(httpd_req_t* req) {
+  char url[UPDATE_SOURCE_SIZE];
+  char name[UPDATE_CHANNEL_SIZE];
+  update_get_source(url, name);
+
+  // The peers are too large for the stack of the server thread.
+  peer_t* peers = (peer_t*)calloc(PEER_MAX, sizeof(peer_t));
+  if (peers == NULL) {
+    return http_send_error(req, "500 Internal Server Error",
+                           "Out of memory");
+  }
+  size_t peer_count = peer_list(peers, PEER_MAX);
+
+  http_response_t response;
+  json_t json;
+  http_send_begin(req, &response, JSON_CONTENT_TYPE);
+  json_init(&json, &response.out);
+
+  json_object_begin(&json);
+  json_key(&json, "data");
+  json_object_begin(&json);
+  json_key(&json, "source");
+  json_string(&json, url);
+  json_key(&json, "channel");
+  json_string(&json, name);
+  json_key(&json, "peers");
+  json_array_begin(&json);
+  for (size_t index = 0; index < peer_count; ++index) {
+    const uint8_t* octets = (const uint8_t*)&peers[index].address;
+    char address[16];
+    snprintf(address, sizeof(address), "%u.%u.%u.%u", octets[0], octets[1],
+             octets[2], octets[3]);
+    json_object_begin(&json);
+    json_key(&json, "address");
+    json_string(&json, address);
+    json_key(&json, "version");
+    json_string(&json, peers[index].version);
+    json_object_end(&json);
+  }
+  json_array_end(&json);
+  json_object_end(&json);
+  json_object_end(&json);
+  free(peers);
+
+  return http_send_end(&response);
+}
+
+static esp_err_t update_get_endpoint(httpd_req_t* req) {
+  int64_t start = http_begin_request("GET /update");
+  esp_err_t err = http_send_update(req);
+  http_record_request(start);
+  return err;
+}
+
+static const httpd_uri_t update_get = {
+    .method = HTTP_GET,
+    .uri = "/update",
+    .handler = update_get_endpoint,
+};
+
+#ifdef CONFIG_ZEUS_UPDATE_REMOTE_CONFIG
+static esp_err_t update_put_endpoint(httpd_req_t* req) {
+  int64_t start = http_begin_request("PUT /update");
+
+  // Parse the source, such as {"source":"https://mirror.local/zeus",
+  // "channel":"latest"}, where an empty source selects the GitHub releases.
+  char body[HTTP_BODY_SIZE];
+  esp_err_t err = http_recv_body(req, body, sizeof(body));
+  if (err == ESP_ERR_INVALID_SIZE) {
+    err = http_send_error(req, "413 Payload Too Large", "Body is too large");
+    http_record_request(start);
+    return err;
+  }
+  if (err != ESP_OK) {
+    // The connection failed, so the request doesn't count as handled.
+    TRACE_END(NULL);
+    return err;
+  }
+
+  cJSON* root = cJSON_Parse(body);
+  const cJSON* url = cJSON_GetObjectItem(root, "source");
+  const cJSON* name = cJSON_GetObjectItem(root, "channel");
+  esp_err_t updated = ESP_ERR_INVALID_ARG;
+  if (cJSON_IsString(url) && cJSON_IsString(name)) {
+    updated = update_set_source(url->valuestring, name->valuestring);
+  }
+  cJSON_Delete(root);
+
+  if (updated == ESP_ERR_INVALID_ARG) {
+    err = http_send_error(req, "400 Bad Request",
+                          "Expected an HTTPS URL and a channel");
+  } else if (updated != ESP_OK) {
+    err = http_send_error(req, "500 Internal Server Error",
+                          "Failed to persist the update source");
+  } else {
+    err = http_send_update(req);
+  }
+
+  http_record_request(start);
+  return err;
+}
+
+static const httpd_uri_t update_put = {
+    .method = HTTP_PUT,
+    .uri = "/update",
+    .handler = update_put_endpoint,
+};
+#endif
+
+/**
+ * Send raw bytes on the socket of a request.
+ *
+ * @param[in] req The request.
+ * @param[in] data The bytes to be sent.
+ * @param[in] length Number of bytes to be sent.
+ *
+ * @return ESP_OK or ESP_FAIL if the socket failed.
+ */
+static esp_err_t http_send_raw(httpd_req_t* req, const char* data,
+                               size_t length) {
+  while (length > 0) {
+    int sent = httpd_send(req, data, length);
+    if (sent <= 0) {
+      return ESP_FAIL;
+    }
+    data += sent;
+    length -= sent;
+  }
+
+  return ESP_OK;
+}
+
+/**
+ * Stream the running firmware image from the flash, starting at an offset.
+ * The image is larger than any buffer, so the response head is written by hand
+ * to announce its length instead of using the chunked encoding, which the
+ * update client doesn't accept.
+ *
+ * @param[in] req The request.
+ * @param[in] image The identity of the running image.
+ * @param[in] offset Offset of the first byte to be sent.
+ *
+ * @return ESP_OK or an error that closes the connection.
+ */
+static esp_err_t http_send_firmware(httpd_req_t* req, const peer_t* image,
+                                    uint32_t offset) {
+  char etag[2 * MANIFEST_SHA256_LEN + 1];
+  for (size_t index = 0; index < MANIFEST_SHA256_LEN; ++index) {
+    snprintf(&etag[2 * index], 3, "%02x", image->sha256[index]);
+  }
+
+  char head[256];
+  int length = snprintf(head, sizeof(head),
+                        "HTTP/1.1 %s\r\n"
+                        "Content-Type: application/octet-stream\r\n"
+                        "Content-Length: %u\r\n"
+                        "ETag: \"%s\"\r\n",
+                        offset > 0 ? "206 Partial Content" : "200 OK",
+                        image->size - offset, etag);
+  if (offset > 0) {
+    length += snprintf(&head[length], sizeof(head) - length,
+                       "Content-Range: bytes %u-%u/%u\r\n", offset,
+                       image->size - 1, image->size);
+  }
+  length += snprintf(&head[length], sizeof(head) - length, "\r\n");
+
+  esp_err_t err = http_send_raw(req, head, length);
+  if (err != ESP_OK) {
+    return err;
+  }
+
+  char* buffer = (char*)malloc(HTTP_FIRMWARE_CHUNK_SIZE);
+  if (buffer == NULL) {
+    return ESP_ERR_NO_MEM;
+  }
+
+  const esp_partition_t* running = esp_ota_get_running_partition();
+  while (offset < image->size && err == ESP_OK) {
+    size_t chunk = image->size - offset;
+    if (chunk > HTTP_FIRMWARE_CHUNK_SIZE) {
+      chunk = HTTP_FIRMWARE_CHUNK_SIZE;
+    }
+    err = esp_partition_read(running, offset, buffer, chunk);
+    if (err == ESP_OK) {
+      err = http_send_raw(req, buffer, chunk);
+    }
+    if (err == ESP_OK) {
+      metrics_add(&firmware_sent_total, chunk);
+      offset += chunk;
+    }
+  }
+  free(buffer);
+
+  return err;
+}
+
+/**
+ * Parse the range of a request for the rest of the firmware image, such as
+ * "bytes=4096-". Other ranges are ignored and the whole image is sent.
+ *
+ * @param[in] req The request.
+ *
+ * @return The offset of the first requested byte or 0.
+ */
+static uint32_t http_firmware_offset(httpd_req_t* req) {
+  char range[32];
+  if (httpd_req_get_hdr_value_str(req, "Range", range, sizeof(range)) !=
+          ESP_OK ||
+      strncmp(range, "bytes=", 6) != 0) {
+    return 0;
+  }
+
+  char* end = NULL;
+  unsigned long first = strtoul(&range[6], &end, 10);
+  if (end == &range[6] || strcmp(end, "-") != 0 || first > UINT32_MAX) {
+    return 0;
+  }
+
+  return (uint32_t)first;
+}
+
+static esp_err_t firmware_get_endpoint(httpd_req_t* req) {
+  int64_t start = http_begin_request("GET " PEER_PATH);
+
+  esp_err_t err;
+  peer_t image;
+  uint32_t offset = http_firmware_offset(req);
+  if (peer_get_image(&image) != ESP_OK) {
+    err = http_send_error(req, "503 Service Unavailable",
+                          "Firmware is not shared");
+  } else if (offset >= image.size) {
+    err = http_send_error(req, "416 Range Not Satisfiable",
+                          "Range starts beyond the firmware image");
+  } else if (atomic_fetch_add(&firmware_uploads, 1) >=
+             HTTP_FIRMWARE_MAX_UPLOADS) {
+    atomic_fetch_sub(&firmware_uploads, 1);
+    err = http_send_error(req, "503 Service Unavailable",
+                          "Firmware is being sent to another device");
+  } else {
+    err = http_send_firmware(req, &image, offset);
+    atomic_fetch_sub(&firmware_uploads, 1);
+  }
+
+  http_record_request(start);
+  return err;
+}
+
+static esp_err_t firmware_get_dispatch(httpd_req_t* req) {
+  return http_dispatch(req, firmware_get_endpoint);
+}
+
+static const httpd_uri_t firmware_get = {
+    .method = HTTP_GET,
+    .uri = PEER_PATH,
+    .handler = firmware_get_dispatch,
+};
+
+#ifdef CONFIG_ZEUS_TRACE
+static esp_err_t trace_get_endpoint(httpd_req_t* req) {
+  int64_t start = http_begin_request("GET /debug/trace");
+
+  // The events are streamed straight from the rings, which keep recording
+  // meanwhile.
+  http_response_t response;
+  json_t json;
+  http_send_begin(req, &response, TRACE_CONTENT_TYPE);
+  json_init(&json, &response.out);
+  trace_export(&json);
+
+  esp_err_t err = http_send_end(&response);
+  http_record_request(start);
+  return err;
+}
+
+static esp_err_t trace_get_dispatch(httpd_req_t* req) {
+  return http_dispatch(req, trace_get_endpoint);
+}
+
+static const httpd_uri_t trace_get = {
+    .method = HTTP_GET,
+    .uri = "/debug/trace",
+    .handler = trace_get_dispatch,
+};
+#endif
+
+static const httpd_uri_t stream_list = {
+    .method = HTTP_GET,
+    .uri = "/stream",
+    .handler = stream_endpoint,
+    .is_websocket = true,
+    .handle_ws_control_frames = true,
+};
+
+// The endpoints, which also determine the number of URI handlers of the
+// server.
+static const httpd_uri_t* const uri_handlers[] = {
+    &health_list,
+    &metrics_list,
+    &history_list,
+    &stream_list,
+    &outlets_list,
+    &outlets_update,
+    &outlet_get,
+    &outlet_update,
+    &update_get,
+#ifdef CONFIG_ZEUS_UPDATE_REMOTE_CONFIG
+    &update_put,
+#endif
+#ifdef CONFIG_ZEUS_PEER
+    &firmware_get,
+#endif
+#ifdef CONFIG_ZEUS_TRACE
+    &trace_get,
+#endif
+};
+
 static httpd_handle_t start_webserver(void) {
   httpd_handle_t server = NULL;
   httpd_config_t config = HTTPD_DEFAULT_CONFIG();
   config.lru_purge_enable = true;
+  config.max_open_sockets = CONFIG_ZEUS_HTTP_MAX_SOCKETS;
+  config.max_uri_handlers = sizeof(uri_handlers) / sizeof(uri_handlers[0]);
+  // Match the URIs of single outlets, such as "/outlets/3".
+  config.uri_match_fn = httpd_uri_match_wildcard;
+#if CONFIG_ZEUS_HTTP_CORE >= 0
+  config.core_id = CONFIG_ZEUS_HTTP_CORE;
+#endif
+  // Unsubscribe streaming clients when their socket is closed.
+  config.close_fn = stream_close;
+  // Leave room for the output buffer and the outlet readings of the endpoints,
+  // which run on the server thread while all workers are busy.
+  config.stack_size = CONFIG_ZEUS_HTTP_STACK_SIZE + OUTBUF_SIZE +
+                      sizeof(meter_reading_t) * METER_MAX_OUTLETS;
 
   // Start the httpd server.
   if (httpd_start(&server, &config) != ESP_OK) {
@@ -115,9 +1552,22 @@ static httpd_handle_t start_webserver(void) {
     return NULL;
   }
 
-  // Configure application endpoints.
-  httpd_register_uri_handler(server, &health_list);
+  // Configure application endpoints. A failed endpoint would answer 404
+  // without notice, while the others still work.
+  for (size_t i = 0; i < config.max_uri_handlers; ++i) {
+    esp_err_t err = httpd_register_uri_handler(server, uri_handlers[i]);
+    if (err != ESP_OK) {
+      ESP_LOGE(TAG_SERVER, "Failed to register %s: %s", uri_handlers[i]->uri,
+               esp_err_to_name(err));
+    }
+  }
   ESP_LOGI(TAG_SERVER, "Listening on: 0.0.0.0:%d", config.server_port);
+  // Only the first start follows the boot, later ones follow a reconnect.
+  int64_t ready = esp_timer_get_time();
+  if (metrics_value(&ready_seconds) == 0) {
+    metrics_set(&ready_seconds, (int32_t)(ready / 1000));
+  }
+  ESP_LOGI(TAG_SERVER, "Ready after: %lld ms", ready / 1000);
   return server;
 }
 
@@ -146,6 +1596,32 @@ static void connect_handler(void* arg, esp_event_base_t event_base,
 }
 
 esp_err_t http_server_init(void) {
+  metrics_register(&requests_total);
+  metrics_register(&request_seconds);
+  metrics_register(&inline_requests_total);
+  metrics_register(&firmware_sent_total);
+  metrics_register(&ready_seconds);
+
+  esp_err_t err = health_init(&health, esp_app_get_description());
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG_SERVER, "Failed to build health response: %s",
+             esp_err_to_name(err));
+    return err;
+  }
+
+  err = http_workers_init();
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG_SERVER, "Failed to start workers");
+    return err;
+  }
+
+#ifdef CONFIG_ZEUS_HTTP_COMPRESSION
+  // Responses are sent uncompressed without compressors.
+  if (http_compressors_init() != ESP_OK) {
+    ESP_LOGW(TAG_SERVER, "Failed to allocate the compressors");
+  }
+#endif
+
   // Start and stop the HTTP server based on the network connection status.
   ESP_ERROR_CHECK(esp_event_handler_register(IP_EVENT, IP_EVENT_ETH_GOT_IP,
                                              &connect_handler, &http_server));
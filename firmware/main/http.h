@@ -2,6 +2,7 @@
 #define HTTP_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "esp_err.h"
 
@@ -23,6 +24,8 @@ char* http_user_agent(void);
  *
  * @return true if the status indicates a redirect.
  */
-bool http_is_redirect(int32_t status);
+static inline bool http_is_redirect(int32_t status) {
+  return (bool)(status >= 300 && status < 400);
+}
 
 #endif
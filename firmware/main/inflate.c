@@ -0,0 +1,640 @@
+#include "inflate.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "util.h"
+
+// Compression method of deflate streams in the zlib header.
+#define INFLATE_METHOD_DEFLATE 8
+// Number of bits of a symbol in the fast lookup table.
+#define INFLATE_FAST_SHIFT 12
+// Largest prime smaller than 65536, the modulus of Adler-32.
+#define INFLATE_ADLER_BASE 65521
+// Number of bytes that can be summed up before the Adler-32 sums overflow.
+#define INFLATE_ADLER_NMAX 5552
+
+// Order in which the lengths of the code length code are stored.
+static const uint8_t code_length_order[] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15,
+};
+// Base lengths of the length symbols 257 to 285.
+static const uint16_t length_base[] = {
+    3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+    31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258,
+};
+// Number of extra bits of the length symbols 257 to 285.
+static const uint8_t length_extra[] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+    2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0,
+};
+// Base distances of the distance symbols.
+static const uint16_t distance_base[] = {
+    1,    2,    3,    4,    5,    7,     9,     13,    17,    25,
+    33,   49,   65,   97,   129,  193,   257,   385,   513,   769,
+    1025, 1537, 2049, 3073, 4097, 6145,  8193,  12289, 16385, 24577,
+};
+// Number of extra bits of the distance symbols.
+static const uint8_t distance_extra[] = {
+    0, 0, 0, 0, 1, 1, 2, 2,  3,  3,  4,  4,  5,  5,  6,
+    6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13,
+};
+
+/**
+ * A copy of the unconsumed input bits. Every item is decoded from a copy,
+ * which is only stored back once the item is complete, so that an item that
+ * is split across chunks is decoded again once the next chunk arrives.
+ *
+ * @param bits The input bits, starting with the least significant one.
+ * @param count Number of bits held.
+ */
+typedef struct inflate_bits {
+  uint64_t bits;
+  uint8_t count;
+} inflate_bits_t;
+
+/**
+ * Take bits from the input.
+ *
+ * @param[in,out] input The input bits.
+ * @param[in] count Number of bits to be taken, at most 16.
+ * @param[out] value Receives the bits.
+ *
+ * @return True if enough bits were available.
+ */
+static bool inflate_take(inflate_bits_t* input, uint8_t count,
+                         uint32_t* value) {
+  if (input->count < count) {
+    return false;
+  }
+  *value = (uint32_t)(input->bits & ((1u << count) - 1));
+  input->bits >>= count;
+  input->count -= count;
+  return true;
+}
+
+/**
+ * Decode a symbol of a canonical Huffman code, whose codes are stored with
+ * their most significant bit first.
+ *
+ * @param[in,out] input The input bits.
+ * @param[in] count Number of codes of each length.
+ * @param[in] symbol Symbols ordered by their codes.
+ *
+ * @return The symbol, ESP_ERR_NOT_FINISHED if more input is needed or
+ * ESP_ERR_INVALID_RESPONSE if the code is invalid, negated.
+ */
+static int inflate_decode(inflate_bits_t* input, const uint16_t* count,
+                          const uint16_t* symbol) {
+  int code = 0;
+  int first = 0;
+  int index = 0;
+  for (int length = 1; length <= INFLATE_MAX_BITS; length++) {
+    if (input->count == 0) {
+      return -ESP_ERR_NOT_FINISHED;
+    }
+    code |= (int)(input->bits & 1);
+    input->bits >>= 1;
+    input->count--;
+
+    if (code - count[length] < first) {
+      return symbol[index + (code - first)];
+    }
+    index += count[length];
+    first = (first + count[length]) << 1;
+    code <<= 1;
+  }
+
+  return -ESP_ERR_INVALID_RESPONSE;
+}
+
+/**
+ * Build the tables of a canonical Huffman code from its code lengths.
+ *
+ * @param[out] count Receives the number of codes of each length.
+ * @param[out] symbol Receives the symbols ordered by their codes.
+ * @param[in] lengths The code length of each symbol, zero if unused.
+ * @param[in] n Number of symbols.
+ *
+ * @return Zero for a complete code, a positive number for an incomplete code
+ * or a negative number if the code is over-subscribed.
+ */
+static int inflate_build(uint16_t* count, uint16_t* symbol,
+                         const uint8_t* lengths, size_t n) {
+  memset(count, 0, (INFLATE_MAX_BITS + 1) * sizeof(uint16_t));
+  for (size_t i = 0; i < n; i++) {
+    count[lengths[i]]++;
+  }
+  if (count[0] == n) {
+    return 0;
+  }
+
+  int left = 1;
+  for (int length = 1; length <= INFLATE_MAX_BITS; length++) {
+    left = (left << 1) - count[length];
+    if (left < 0) {
+      return left;
+    }
+  }
+
+  uint16_t offsets[INFLATE_MAX_BITS + 1];
+  offsets[1] = 0;
+  for (int length = 1; length < INFLATE_MAX_BITS; length++) {
+    offsets[length + 1] = offsets[length] + count[length];
+  }
+  for (size_t i = 0; i < n; i++) {
+    if (lengths[i] != 0) {
+      symbol[offsets[lengths[i]]++] = (uint16_t)i;
+    }
+  }
+
+  return left;
+}
+
+/**
+ * Build the lookup table of the literal/length codes of up to
+ * INFLATE_FAST_BITS bits. The codes are stored with their most significant bit
+ * first, so they are reversed to index the table with the input bits.
+ *
+ * @param[in] inflate A pointer to the decompressor, whose literal/length code
+ * was built.
+ * @param[in] lengths The code length of each literal/length symbol.
+ * @param[in] n Number of literal/length symbols.
+ */
+static void inflate_build_fast(inflate_t* inflate, const uint8_t* lengths,
+                               size_t n) {
+  memset(inflate->literal_fast, 0, sizeof(inflate->literal_fast));
+
+  // Canonical codes of a length are consecutive, starting after the codes of
+  // the shorter lengths.
+  uint16_t next[INFLATE_MAX_BITS + 1];
+  uint16_t code = 0;
+  next[0] = 0;
+  for (int length = 1; length <= INFLATE_MAX_BITS; length++) {
+    code = (code + inflate->literal_count[length - 1]) << 1;
+    next[length] = code;
+  }
+  // Codes of length zero don't exist.
+  next[1] = 0;
+
+  for (size_t symbol = 0; symbol < n; symbol++) {
+    uint8_t length = lengths[symbol];
+    if (length == 0) {
+      continue;
+    }
+    uint16_t assigned = next[length]++;
+    if (length > INFLATE_FAST_BITS) {
+      continue;
+    }
+
+    uint16_t reversed = 0;
+    for (uint8_t bit = 0; bit < length; bit++) {
+      reversed = (uint16_t)(reversed << 1 | ((assigned >> bit) & 1));
+    }
+    uint16_t entry = (uint16_t)(length << INFLATE_FAST_SHIFT | symbol);
+    for (uint16_t index = reversed; index < (1 << INFLATE_FAST_BITS);
+         index += 1 << length) {
+      inflate->literal_fast[index] = entry;
+    }
+  }
+}
+
+/**
+ * Update the checksum and pass the output that was not written yet to the
+ * callback. The pending output is contiguous in the window, as it is written
+ * before the window wraps around.
+ *
+ * @param[in] inflate A pointer to the decompressor.
+ *
+ * @return ESP_OK or the error returned by the callback.
+ */
+static esp_err_t inflate_flush(inflate_t* inflate) {
+  size_t length = inflate->output_length - inflate->flushed;
+  if (length == 0) {
+    return ESP_OK;
+  }
+  const uint8_t* data =
+      &inflate->window[inflate->flushed & (INFLATE_WINDOW_SIZE - 1)];
+
+  uint32_t a = inflate->adler & 0xffff;
+  uint32_t b = inflate->adler >> 16;
+  for (size_t offset = 0; offset < length;) {
+    size_t end = min(length, offset + INFLATE_ADLER_NMAX);
+    for (; offset < end; offset++) {
+      a += data[offset];
+      b += a;
+    }
+    a %= INFLATE_ADLER_BASE;
+    b %= INFLATE_ADLER_BASE;
+  }
+  inflate->adler = b << 16 | a;
+
+  inflate->flushed = inflate->output_length;
+  return inflate->write(inflate->write_ctx, data, length);
+}
+
+/**
+ * Append a byte to the output.
+ *
+ * @param[in] inflate A pointer to the decompressor.
+ * @param[in] byte The byte.
+ *
+ * @return ESP_OK or the error returned by the callback.
+ */
+static inline esp_err_t inflate_put(inflate_t* inflate, uint8_t byte) {
+  inflate->window[inflate->output_length++ & (INFLATE_WINDOW_SIZE - 1)] = byte;
+  if ((inflate->output_length & (INFLATE_WINDOW_SIZE - 1)) == 0) {
+    return inflate_flush(inflate);
+  }
+  return ESP_OK;
+}
+
+/**
+ * Prepare the tables of a block compressed with the fixed Huffman codes.
+ *
+ * @param[in] inflate A pointer to the decompressor.
+ */
+static void inflate_fixed(inflate_t* inflate) {
+  uint8_t* lengths = inflate->lengths;
+  memset(&lengths[0], 8, 144);
+  memset(&lengths[144], 9, 112);
+  memset(&lengths[256], 7, 24);
+  memset(&lengths[280], 8, 8);
+  inflate_build(inflate->literal_count, inflate->literal_symbol, lengths,
+                INFLATE_MAX_LITERALS);
+  inflate_build_fast(inflate, lengths, INFLATE_MAX_LITERALS);
+
+  memset(lengths, 5, INFLATE_MAX_DISTANCES);
+  inflate_build(inflate->distance_count, inflate->distance_symbol, lengths,
+                INFLATE_MAX_DISTANCES);
+}
+
+/**
+ * Build the tables of a dynamic block once all code lengths were read.
+ *
+ * @param[in] inflate A pointer to the decompressor.
+ *
+ * @return ESP_OK or ESP_ERR_INVALID_RESPONSE if the codes are invalid.
+ */
+static esp_err_t inflate_dynamic(inflate_t* inflate) {
+  const uint8_t* lengths = inflate->lengths;
+  // Without an end-of-block code, the block can't end.
+  if (lengths[256] == 0) {
+    return ESP_ERR_INVALID_RESPONSE;
+  }
+
+  // Incomplete codes are only allowed if they consist of a single code of
+  // one bit.
+  const uint16_t* count = inflate->literal_count;
+  int left = inflate_build(inflate->literal_count, inflate->literal_symbol,
+                           lengths, inflate->literals);
+  if (left < 0 || (left > 0 && inflate->literals != count[0] + count[1])) {
+    return ESP_ERR_INVALID_RESPONSE;
+  }
+  inflate_build_fast(inflate, lengths, inflate->literals);
+  count = inflate->distance_count;
+  left = inflate_build(inflate->distance_count, inflate->distance_symbol,
+                       &lengths[inflate->literals], inflate->distances);
+  if (left < 0 || (left > 0 && inflate->distances != count[0] + count[1])) {
+    return ESP_ERR_INVALID_RESPONSE;
+  }
+
+  return ESP_OK;
+}
+
+/**
+ * Decode a literal, a match or the end of the block.
+ *
+ * @param[in] inflate A pointer to the decompressor.
+ * @param[in,out] input The input bits, which are only consumed if the item is
+ * complete.
+ *
+ * @return ESP_OK, ESP_ERR_NOT_FINISHED if more input is needed,
+ * ESP_ERR_INVALID_RESPONSE if the data is malformed or the error returned by
+ * the callback.
+ */
+static esp_err_t inflate_code(inflate_t* inflate, inflate_bits_t* input) {
+  inflate_bits_t item = *input;
+  int symbol = -ESP_ERR_NOT_FINISHED;
+  uint16_t entry =
+      inflate->literal_fast[item.bits & ((1 << INFLATE_FAST_BITS) - 1)];
+  uint8_t length = entry >> INFLATE_FAST_SHIFT;
+  if (length > 0 && length <= item.count) {
+    item.bits >>= length;
+    item.count -= length;
+    symbol = entry & ((1 << INFLATE_FAST_SHIFT) - 1);
+  } else {
+    symbol =
+        inflate_decode(&item, inflate->literal_count, inflate->literal_symbol);
+  }
+  if (symbol < 0) {
+    return -symbol;
+  }
+
+  if (symbol < 256) {
+    *input = item;
+    return inflate_put(inflate, (uint8_t)symbol);
+  }
+  if (symbol == 256) {
+    *input = item;
+    inflate->state =
+        inflate->last ? INFLATE_STATE_TRAILER : INFLATE_STATE_BLOCK;
+    return ESP_OK;
+  }
+
+  symbol -= 257;
+  if (symbol >= (int)sizeof(length_base) / (int)sizeof(length_base[0])) {
+    return ESP_ERR_INVALID_RESPONSE;
+  }
+  uint32_t extra = 0;
+  if (!inflate_take(&item, length_extra[symbol], &extra)) {
+    return ESP_ERR_NOT_FINISHED;
+  }
+  uint32_t match = length_base[symbol] + extra;
+
+  symbol =
+      inflate_decode(&item, inflate->distance_count, inflate->distance_symbol);
+  if (symbol < 0) {
+    return -symbol;
+  }
+  if (symbol >= INFLATE_MAX_DISTANCES) {
+    return ESP_ERR_INVALID_RESPONSE;
+  }
+  if (!inflate_take(&item, distance_extra[symbol], &extra)) {
+    return ESP_ERR_NOT_FINISHED;
+  }
+  uint32_t distance = distance_base[symbol] + extra;
+  if (distance > INFLATE_WINDOW_SIZE || distance > inflate->output_length) {
+    return ESP_ERR_INVALID_RESPONSE;
+  }
+  *input = item;
+
+  size_t from = inflate->output_length - distance;
+  for (uint32_t i = 0; i < match; i++) {
+    esp_err_t err = inflate_put(
+        inflate, inflate->window[(from + i) & (INFLATE_WINDOW_SIZE - 1)]);
+    if (err != ESP_OK) {
+      return err;
+    }
+  }
+
+  return ESP_OK;
+}
+
+/**
+ * Decode the next item of the stream in the current state.
+ *
+ * @param[in] inflate A pointer to the decompressor.
+ * @param[in,out] input The input bits, which are only consumed if the item is
+ * complete.
+ *
+ * @return ESP_OK, ESP_ERR_NOT_FINISHED if more input is needed,
+ * ESP_ERR_INVALID_RESPONSE if the data is malformed, ESP_ERR_INVALID_CRC if
+ * the checksum doesn't match or the error returned by the callback.
+ */
+static esp_err_t inflate_step(inflate_t* inflate, inflate_bits_t* input) {
+  inflate_bits_t item = *input;
+  uint32_t value = 0;
+
+  switch (inflate->state) {
+    case INFLATE_STATE_HEADER: {
+      if (!inflate_take(&item, 16, &value)) {
+        return ESP_ERR_NOT_FINISHED;
+      }
+      uint32_t cmf = value & 0xff;
+      uint32_t flg = value >> 8;
+      // Streams with a preset dictionary can't be decompressed without it.
+      if ((cmf << 8 | flg) % 31 != 0 ||
+          (cmf & 0x0f) != INFLATE_METHOD_DEFLATE ||
+          (cmf >> 4) + 8 > INFLATE_WINDOW_BITS || (flg & 0x20) != 0) {
+        return ESP_ERR_INVALID_RESPONSE;
+      }
+      inflate->state = INFLATE_STATE_BLOCK;
+      break;
+    }
+    case INFLATE_STATE_BLOCK: {
+      if (!inflate_take(&item, 3, &value)) {
+        return ESP_ERR_NOT_FINISHED;
+      }
+      inflate->last = (value & 1) != 0;
+      switch (value >> 1) {
+        case 0: {
+          // Stored blocks start at the next byte boundary.
+          uint32_t length = 0;
+          uint32_t inverse = 0;
+          if (!inflate_take(&item, item.count % 8, &value) ||
+              !inflate_take(&item, 16, &length) ||
+              !inflate_take(&item, 16, &inverse)) {
+            return ESP_ERR_NOT_FINISHED;
+          }
+          if (length != (~inverse & 0xffff)) {
+            return ESP_ERR_INVALID_RESPONSE;
+          }
+          inflate->remaining = (uint16_t)length;
+          inflate->state = INFLATE_STATE_STORED;
+          break;
+        }
+        case 1: {
+          inflate_fixed(inflate);
+          inflate->state = INFLATE_STATE_CODES;
+          break;
+        }
+        case 2: {
+          inflate->state = INFLATE_STATE_TABLE;
+          break;
+        }
+        default: {
+          return ESP_ERR_INVALID_RESPONSE;
+        }
+      }
+      break;
+    }
+    case INFLATE_STATE_STORED: {
+      if (inflate->remaining == 0) {
+        inflate->state =
+            inflate->last ? INFLATE_STATE_TRAILER : INFLATE_STATE_BLOCK;
+        break;
+      }
+      if (!inflate_take(&item, 8, &value)) {
+        return ESP_ERR_NOT_FINISHED;
+      }
+      *input = item;
+      inflate->remaining--;
+      return inflate_put(inflate, (uint8_t)value);
+    }
+    case INFLATE_STATE_TABLE: {
+      uint32_t literals = 0;
+      uint32_t distances = 0;
+      uint32_t codes = 0;
+      if (!inflate_take(&item, 5, &literals) ||
+          !inflate_take(&item, 5, &distances) ||
+          !inflate_take(&item, 4, &codes)) {
+        return ESP_ERR_NOT_FINISHED;
+      }
+      inflate->literals = (uint16_t)(literals + 257);
+      inflate->distances = (uint8_t)(distances + 1);
+      inflate->codes = (uint8_t)(codes + 4);
+      if (inflate->literals > 286 ||
+          inflate->distances > INFLATE_MAX_DISTANCES) {
+        return ESP_ERR_INVALID_RESPONSE;
+      }
+      memset(inflate->lengths, 0, sizeof(code_length_order));
+      inflate->index = 0;
+      inflate->state = INFLATE_STATE_CODE_LENGTHS;
+      break;
+    }
+    case INFLATE_STATE_CODE_LENGTHS: {
+      if (!inflate_take(&item, 3, &value)) {
+        return ESP_ERR_NOT_FINISHED;
+      }
+      inflate->lengths[code_length_order[inflate->index++]] = (uint8_t)value;
+      if (inflate->index < inflate->codes) {
+        break;
+      }
+
+      // The code length code is kept in the distance tables until the
+      // distance code is read.
+      if (inflate_build(inflate->distance_count, inflate->distance_symbol,
+                        inflate->lengths, sizeof(code_length_order)) != 0) {
+        return ESP_ERR_INVALID_RESPONSE;
+      }
+      inflate->index = 0;
+      inflate->state = INFLATE_STATE_LENGTHS;
+      break;
+    }
+    case INFLATE_STATE_LENGTHS: {
+      int symbol = inflate_decode(&item, inflate->distance_count,
+                                  inflate->distance_symbol);
+      if (symbol < 0) {
+        return -symbol;
+      }
+
+      uint8_t length = 0;
+      uint32_t repeat = 1;
+      if (symbol < 16) {
+        length = (uint8_t)symbol;
+      } else if (symbol == 16) {
+        if (inflate->index == 0 || !inflate_take(&item, 2, &repeat)) {
+          return inflate->index == 0 ? ESP_ERR_INVALID_RESPONSE
+                                     : ESP_ERR_NOT_FINISHED;
+        }
+        length = inflate->lengths[inflate->index - 1];
+        repeat += 3;
+      } else if (symbol == 17) {
+        if (!inflate_take(&item, 3, &repeat)) {
+          return ESP_ERR_NOT_FINISHED;
+        }
+        repeat += 3;
+      } else {
+        if (!inflate_take(&item, 7, &repeat)) {
+          return ESP_ERR_NOT_FINISHED;
+        }
+        repeat += 11;
+      }
+
+      uint32_t total = inflate->literals + inflate->distances;
+      if (inflate->index + repeat > total) {
+        return ESP_ERR_INVALID_RESPONSE;
+      }
+      memset(&inflate->lengths[inflate->index], length, repeat);
+      inflate->index += repeat;
+      if (inflate->index == total) {
+        esp_err_t err = inflate_dynamic(inflate);
+        if (err != ESP_OK) {
+          return err;
+        }
+        inflate->state = INFLATE_STATE_CODES;
+      }
+      break;
+    }
+    case INFLATE_STATE_CODES: {
+      return inflate_code(inflate, input);
+    }
+    case INFLATE_STATE_TRAILER: {
+      // The checksum is stored at the next byte boundary in big-endian order.
+      uint32_t adler = 0;
+      for (int i = 0; i < 4; i++) {
+        if (!inflate_take(&item, i == 0 ? item.count % 8 : 0, &value) ||
+            !inflate_take(&item, 8, &value)) {
+          return ESP_ERR_NOT_FINISHED;
+        }
+        adler = adler << 8 | value;
+      }
+      *input = item;
+      esp_err_t err = inflate_flush(inflate);
+      if (err != ESP_OK) {
+        return err;
+      }
+      if (adler != inflate->adler) {
+        return ESP_ERR_INVALID_CRC;
+      }
+      inflate->state = INFLATE_STATE_DONE;
+      return ESP_OK;
+    }
+    case INFLATE_STATE_DONE: {
+      return ESP_ERR_INVALID_RESPONSE;
+    }
+  }
+
+  *input = item;
+  return ESP_OK;
+}
+
+void inflate_init(inflate_t* inflate, inflate_write_t write, void* write_ctx) {
+  memset(inflate, 0, offsetof(inflate_t, window));
+  inflate->write = write;
+  inflate->write_ctx = write_ctx;
+  inflate->state = INFLATE_STATE_HEADER;
+  inflate->adler = 1;
+}
+
+esp_err_t inflate_feed(inflate_t* inflate, const void* data, size_t length) {
+  const uint8_t* cursor = (const uint8_t*)data;
+  const uint8_t* end = cursor + length;
+  inflate_bits_t input = {
+      .bits = inflate->bits,
+      .count = inflate->bit_count,
+  };
+
+  if (inflate->state == INFLATE_STATE_DONE) {
+    // Nothing may follow the end of the stream.
+    return length > 0 ? ESP_ERR_INVALID_RESPONSE : ESP_OK;
+  }
+
+  esp_err_t err = ESP_OK;
+  while (err == ESP_OK) {
+    // Whole bytes are added until more bits are held than the largest item,
+    // a match of up to 48 bits, needs or the chunk is exhausted.
+    while (input.count <= 64 - 8 && cursor < end) {
+      input.bits |= (uint64_t)*cursor++ << input.count;
+      input.count += 8;
+    }
+
+    err = inflate_step(inflate, &input);
+    if (err == ESP_ERR_NOT_FINISHED) {
+      // Wait for the rest of the item in the next chunk, as it can't be
+      // longer than the bits held otherwise.
+      err = cursor == end ? ESP_OK : ESP_ERR_INVALID_RESPONSE;
+      break;
+    }
+    if (err == ESP_OK && inflate->state == INFLATE_STATE_DONE) {
+      if (input.count > 0 || cursor < end) {
+        err = ESP_ERR_INVALID_RESPONSE;
+      }
+      break;
+    }
+  }
+  inflate->bits = input.bits;
+  inflate->bit_count = input.count;
+
+  if (err != ESP_OK) {
+    return err;
+  }
+  return inflate_flush(inflate);
+}
+
+esp_err_t inflate_finish(const inflate_t* inflate) {
+  return inflate->state == INFLATE_STATE_DONE ? ESP_OK : ESP_ERR_INVALID_SIZE;
+}
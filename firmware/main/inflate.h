@@ -0,0 +1,137 @@
+#ifndef INFLATE_H
+#define INFLATE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+// Base-two logarithm of the size of the window holding the recent output.
+#define INFLATE_WINDOW_BITS 13
+// Size of the window in bytes, which is the maximum distance of a match.
+#define INFLATE_WINDOW_SIZE (1 << INFLATE_WINDOW_BITS)
+// Maximum length of a Huffman code in bits.
+#define INFLATE_MAX_BITS 15
+// Number of symbols of the literal/length code.
+#define INFLATE_MAX_LITERALS 288
+// Number of symbols of the distance code.
+#define INFLATE_MAX_DISTANCES 30
+// Number of bits of the literal/length codes that are decoded with a single
+// table lookup, which covers almost all of them.
+#define INFLATE_FAST_BITS 9
+
+/**
+ * Write a range of the decompressed data.
+ *
+ * @param[in] ctx The context passed to `inflate_init()`.
+ * @param[in] data The data to be written.
+ * @param[in] length Number of bytes to be written.
+ *
+ * @return ESP_OK if the data was written.
+ */
+typedef esp_err_t (*inflate_write_t)(void* ctx, const void* data,
+                                     size_t length);
+
+// States of the decompressor.
+typedef enum inflate_state {
+  INFLATE_STATE_HEADER,
+  INFLATE_STATE_BLOCK,
+  INFLATE_STATE_STORED,
+  INFLATE_STATE_TABLE,
+  INFLATE_STATE_CODE_LENGTHS,
+  INFLATE_STATE_LENGTHS,
+  INFLATE_STATE_CODES,
+  INFLATE_STATE_TRAILER,
+  INFLATE_STATE_DONE,
+} inflate_state_t;
+
+/**
+ * Decompresses a zlib stream (RFC 1950 and RFC 1951) that is streamed in
+ * chunks of arbitrary size. Only the last INFLATE_WINDOW_SIZE bytes of the
+ * output are kept to resolve matches, so the stream must have been compressed
+ * with a window of at most that size. The memory of the decompressor is fixed
+ * and it doesn't allocate any.
+ *
+ * @param write Receives the decompressed data.
+ * @param write_ctx The context passed to `write`.
+ * @param state The current state of the decompressor.
+ * @param last Indicates that the current block is the last one.
+ * @param bits Holds the input bits that were not consumed yet.
+ * @param bit_count Number of bits held.
+ * @param remaining Number of bytes of a stored block left.
+ * @param literal_count Number of literal/length codes of each length.
+ * @param literal_symbol Literal/length symbols ordered by their codes.
+ * @param literal_fast Maps the next INFLATE_FAST_BITS input bits to the
+ * literal/length symbol in the lower and the length of its code in the upper
+ * bits, which is zero if the code is longer.
+ * @param distance_count Number of distance codes of each length.
+ * @param distance_symbol Distance symbols ordered by their codes.
+ * @param lengths Code lengths of a dynamic block while they are being read.
+ * @param literals Number of literal/length codes of a dynamic block.
+ * @param distances Number of distance codes of a dynamic block.
+ * @param codes Number of code length codes of a dynamic block.
+ * @param index Index of the code length being read.
+ * @param adler The Adler-32 checksum of the data written so far.
+ * @param output_length Number of bytes decompressed.
+ * @param flushed Number of bytes passed to `write`.
+ * @param window The most recent output.
+ */
+typedef struct inflate {
+  inflate_write_t write;
+  void* write_ctx;
+  inflate_state_t state;
+  bool last;
+  uint64_t bits;
+  uint8_t bit_count;
+  uint16_t remaining;
+  uint16_t literal_count[INFLATE_MAX_BITS + 1];
+  uint16_t literal_symbol[INFLATE_MAX_LITERALS];
+  uint16_t literal_fast[1 << INFLATE_FAST_BITS];
+  uint16_t distance_count[INFLATE_MAX_BITS + 1];
+  uint16_t distance_symbol[INFLATE_MAX_DISTANCES];
+  uint8_t lengths[INFLATE_MAX_LITERALS + INFLATE_MAX_DISTANCES];
+  uint16_t literals;
+  uint8_t distances;
+  uint8_t codes;
+  uint16_t index;
+  uint32_t adler;
+  size_t output_length;
+  size_t flushed;
+  uint8_t window[INFLATE_WINDOW_SIZE];
+} inflate_t;
+
+/**
+ * Prepare the decompressor for a new stream.
+ *
+ * @param[out] inflate A pointer to the decompressor.
+ * @param[in] write Receives the decompressed data.
+ * @param[in] write_ctx The context passed to `write`.
+ */
+void inflate_init(inflate_t* inflate, inflate_write_t write, void* write_ctx);
+
+/**
+ * Decompress the next chunk of the stream and write the resulting data. The
+ * output is buffered in the window and written once the window is full or
+ * the chunk has been consumed.
+ *
+ * @param[in] inflate A pointer to the decompressor.
+ * @param[in] data The next chunk of the stream.
+ * @param[in] length Number of bytes in the chunk.
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_RESPONSE if the stream is malformed or
+ * needs a larger window, ESP_ERR_INVALID_CRC if the checksum doesn't match or
+ * the error returned by the callback.
+ */
+esp_err_t inflate_feed(inflate_t* inflate, const void* data, size_t length);
+
+/**
+ * Check that the stream was decompressed completely.
+ *
+ * @param[in] inflate A pointer to the decompressor.
+ *
+ * @return ESP_OK or ESP_ERR_INVALID_SIZE if the stream ended prematurely.
+ */
+esp_err_t inflate_finish(const inflate_t* inflate);
+
+#endif
@@ -0,0 +1,160 @@
+#include "json.h"
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * Write the separator that precedes a value or a key, if any, and mark the
+ * current container as populated.
+ *
+ * @param[in] json A pointer to the writer.
+ */
+static void json_separate(json_t* json) {
+  if (json->after_key) {
+    json->after_key = false;
+    return;
+  }
+  if (json->depth == 0 || json->depth > JSON_MAX_DEPTH) {
+    return;
+  }
+
+  uint32_t bit = 1u << (json->depth - 1);
+  if (json->populated & bit) {
+    outbuf_write(json->out, ",", 1);
+  }
+  json->populated |= bit;
+}
+
+/**
+ * Open a container.
+ *
+ * @param[in] json A pointer to the writer.
+ * @param[in] bracket The opening bracket.
+ */
+static void json_begin(json_t* json, char bracket) {
+  json_separate(json);
+  outbuf_write(json->out, &bracket, 1);
+  json->depth += 1;
+  if (json->depth <= JSON_MAX_DEPTH) {
+    json->populated &= ~(1u << (json->depth - 1));
+  }
+}
+
+/**
+ * Close the innermost container.
+ *
+ * @param[in] json A pointer to the writer.
+ * @param[in] bracket The closing bracket.
+ */
+static void json_end(json_t* json, char bracket) {
+  outbuf_write(json->out, &bracket, 1);
+  if (json->depth > 0) {
+    json->depth -= 1;
+  }
+}
+
+/**
+ * Write a quoted and escaped string.
+ *
+ * @param[in] out The output buffer.
+ * @param[in] value The null-terminated string.
+ */
+static void json_quote(outbuf_t* out, const char* value) {
+  static const char hex[] = "0123456789abcdef";
+
+  outbuf_write(out, "\"", 1);
+
+  // Copy runs of characters that need no escaping at once.
+  const char* run = value;
+  for (const char* cursor = value; *cursor != 0; ++cursor) {
+    unsigned char charcode = (unsigned char)*cursor;
+    if (charcode >= 0x20 && charcode != '"' && charcode != '\\') {
+      continue;
+    }
+
+    outbuf_write(out, run, cursor - run);
+    run = cursor + 1;
+
+    char escaped[6] = {'\\', (char)charcode};
+    size_t length = 2;
+    switch (charcode) {
+      case '"':
+      case '\\':
+        break;
+      case '\n':
+        escaped[1] = 'n';
+        break;
+      case '\r':
+        escaped[1] = 'r';
+        break;
+      case '\t':
+        escaped[1] = 't';
+        break;
+      default:
+        memcpy(escaped, "\\u00", 4);
+        escaped[4] = hex[charcode >> 4];
+        escaped[5] = hex[charcode & 0xF];
+        length = 6;
+        break;
+    }
+    outbuf_write(out, escaped, length);
+  }
+  outbuf_puts(out, run);
+
+  outbuf_write(out, "\"", 1);
+}
+
+void json_init(json_t* json, outbuf_t* out) {
+  json->out = out;
+  json->depth = 0;
+  json->populated = 0;
+  json->after_key = false;
+}
+
+void json_object_begin(json_t* json) { json_begin(json, '{'); }
+
+void json_object_end(json_t* json) { json_end(json, '}'); }
+
+void json_array_begin(json_t* json) { json_begin(json, '['); }
+
+void json_array_end(json_t* json) { json_end(json, ']'); }
+
+void json_key(json_t* json, const char* key) {
+  json_separate(json);
+  json_quote(json->out, key);
+  outbuf_write(json->out, ":", 1);
+  json->after_key = true;
+}
+
+void json_string(json_t* json, const char* value) {
+  json_separate(json);
+  json_quote(json->out, value);
+}
+
+void json_int(json_t* json, int64_t value) {
+  json_separate(json);
+  outbuf_printf(json->out, "%" PRId64, value);
+}
+
+void json_double(json_t* json, double value) {
+  json_separate(json);
+  if (!isfinite(value)) {
+    outbuf_write(json->out, "null", 4);
+    return;
+  }
+  outbuf_printf(json->out, "%.9g", value);
+}
+
+void json_bool(json_t* json, bool value) {
+  json_separate(json);
+  outbuf_puts(json->out, value ? "true" : "false");
+}
+
+void json_null(json_t* json) {
+  json_separate(json);
+  outbuf_write(json->out, "null", 4);
+}
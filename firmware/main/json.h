@@ -0,0 +1,120 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "outbuf.h"
+
+// Maximum nesting depth of objects and arrays, which is limited by the width of
+// the bit set tracking populated containers.
+#define JSON_MAX_DEPTH 32
+
+// Content type of JSON documents.
+#define JSON_CONTENT_TYPE "application/json"
+
+/**
+ * Writes a JSON document to an output buffer while it is generated, without
+ * building a tree in memory. The writer only inserts separators and escapes
+ * strings; the caller is responsible for emitting a well-formed sequence of
+ * keys and values.
+ *
+ * @param out The output buffer receiving the document.
+ * @param depth Number of objects and arrays that are currently open.
+ * @param populated A bit per open container, which is set once the container
+ * holds a member, so that the next member is preceded by a comma.
+ * @param after_key Indicates that a key was written and awaits its value.
+ */
+typedef struct json {
+  outbuf_t* out;
+  uint8_t depth;
+  uint32_t populated;
+  bool after_key;
+} json_t;
+
+/**
+ * Prepare a writer for a new document.
+ *
+ * @param[out] json A pointer to the writer.
+ * @param[in] out The output buffer receiving the document.
+ */
+void json_init(json_t* json, outbuf_t* out);
+
+/**
+ * Open an object.
+ *
+ * @param[in] json A pointer to the writer.
+ */
+void json_object_begin(json_t* json);
+
+/**
+ * Close the innermost object.
+ *
+ * @param[in] json A pointer to the writer.
+ */
+void json_object_end(json_t* json);
+
+/**
+ * Open an array.
+ *
+ * @param[in] json A pointer to the writer.
+ */
+void json_array_begin(json_t* json);
+
+/**
+ * Close the innermost array.
+ *
+ * @param[in] json A pointer to the writer.
+ */
+void json_array_end(json_t* json);
+
+/**
+ * Write the key of the next member of an object.
+ *
+ * @param[in] json A pointer to the writer.
+ * @param[in] key The key, which is escaped as needed.
+ */
+void json_key(json_t* json, const char* key);
+
+/**
+ * Write a string value.
+ *
+ * @param[in] json A pointer to the writer.
+ * @param[in] value The null-terminated string, which is escaped as needed.
+ */
+void json_string(json_t* json, const char* value);
+
+/**
+ * Write an integer value.
+ *
+ * @param[in] json A pointer to the writer.
+ * @param[in] value The value.
+ */
+void json_int(json_t* json, int64_t value);
+
+/**
+ * Write a floating-point value. Values that can't be represented in JSON,
+ * such as NaN, are written as null.
+ *
+ * @param[in] json A pointer to the writer.
+ * @param[in] value The value.
+ */
+void json_double(json_t* json, double value);
+
+/**
+ * Write a boolean value.
+ *
+ * @param[in] json A pointer to the writer.
+ * @param[in] value The value.
+ */
+void json_bool(json_t* json, bool value);
+
+/**
+ * Write a null value.
+ *
+ * @param[in] json A pointer to the writer.
+ */
+void json_null(json_t* json);
+
+#endif
@@ -0,0 +1,235 @@
+#include "manifest.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "cJSON.h"
+#include "esp_http_client.h"
+#include "esp_log.h"
+#include "fetch.h"
+#include "util.h"
+
+// Log prefix to be used.
+#define TAG "manifest"
+
+/**
+ * Describes the response to a manifest request.
+ *
+ * @param etag The ETag header of the response.
+ * @param body The response body.
+ * @param body_length Number of bytes in the body.
+ */
+typedef struct manifest_response {
+  char etag[MANIFEST_ETAG_SIZE];
+  char body[MANIFEST_SIZE];
+  size_t body_length;
+} manifest_response_t;
+
+/**
+ * Convert a hexadecimal character to its value.
+ *
+ * @param charcode A character.
+ *
+ * @return The value or -1 if the character is not hexadecimal.
+ */
+static int8_t manifest_hex_value(char charcode) {
+  if (charcode >= '0' && charcode <= '9') {
+    return charcode - '0';
+  }
+  if (charcode >= 'a' && charcode <= 'f') {
+    return charcode - 'a' + 10;
+  }
+  if (charcode >= 'A' && charcode <= 'F') {
+    return charcode - 'A' + 10;
+  }
+  return -1;
+}
+
+/**
+ * Decode a hex-encoded SHA-256 digest.
+ *
+ * @param[out] sha256 Buffer receiving the digest.
+ * @param[in] hex The hex-encoded digest.
+ *
+ * @return ESP_OK or ESP_ERR_INVALID_RESPONSE if the digest is malformed.
+ */
+static esp_err_t manifest_parse_sha256(uint8_t sha256[MANIFEST_SHA256_LEN],
+                                       const char* hex) {
+  if (strlen(hex) != MANIFEST_SHA256_LEN * 2) {
+    return ESP_ERR_INVALID_RESPONSE;
+  }
+
+  for (int i = 0; i < MANIFEST_SHA256_LEN; ++i) {
+    int8_t high = manifest_hex_value(hex[i * 2]);
+    int8_t low = manifest_hex_value(hex[i * 2 + 1]);
+    if (high < 0 || low < 0) {
+      return ESP_ERR_INVALID_RESPONSE;
+    }
+    sha256[i] = (uint8_t)(high << 4 | low);
+  }
+
+  return ESP_OK;
+}
+
+/**
+ * Parse the optional block digests of a manifest.
+ *
+ * @param[out] manifest A pointer to the manifest.
+ * @param[in] blocks The "blocks" object of the manifest or NULL.
+ *
+ * @return ESP_OK or ESP_ERR_INVALID_RESPONSE if the blocks are malformed or
+ * don't cover the image.
+ */
+static esp_err_t manifest_parse_blocks(manifest_t* manifest,
+                                       const cJSON* blocks) {
+  manifest->block_size = 0;
+  manifest->block_count = 0;
+  if (blocks == NULL) {
+    return ESP_OK;
+  }
+
+  const cJSON* size = cJSON_GetObjectItem(blocks, "size");
+  const cJSON* sha256 = cJSON_GetObjectItem(blocks, "sha256");
+  if (!cJSON_IsNumber(size) || size->valuedouble < 1 ||
+      !cJSON_IsArray(sha256)) {
+    return ESP_ERR_INVALID_RESPONSE;
+  }
+
+  uint32_t block_size = (uint32_t)size->valuedouble;
+  uint32_t block_count = (manifest->size + block_size - 1) / block_size;
+  if (cJSON_GetArraySize(sha256) != block_count ||
+      block_count > MANIFEST_MAX_BLOCKS) {
+    return ESP_ERR_INVALID_RESPONSE;
+  }
+
+  uint32_t i = 0;
+  const cJSON* digest = NULL;
+  cJSON_ArrayForEach(digest, sha256) {
+    if (!cJSON_IsString(digest) ||
+        manifest_parse_sha256(manifest->block_sha256[i],
+                              digest->valuestring) != ESP_OK) {
+      return ESP_ERR_INVALID_RESPONSE;
+    }
+    i += 1;
+  }
+
+  manifest->block_size = block_size;
+  manifest->block_count = block_count;
+
+  return ESP_OK;
+}
+
+esp_err_t manifest_parse(manifest_t* manifest, const char* json,
+                         size_t length) {
+  cJSON* root = cJSON_ParseWithLength(json, length);
+  if (root == NULL) {
+    return ESP_ERR_INVALID_RESPONSE;
+  }
+
+  esp_err_t err = ESP_ERR_INVALID_RESPONSE;
+  const cJSON* version = cJSON_GetObjectItem(root, "version");
+  const cJSON* size = cJSON_GetObjectItem(root, "size");
+  const cJSON* sha256 = cJSON_GetObjectItem(root, "sha256");
+  if (cJSON_IsString(version) && cJSON_IsNumber(size) &&
+      cJSON_IsString(sha256) &&
+      strlen(version->valuestring) < sizeof(manifest->version)) {
+    strcpy(manifest->version, version->valuestring);
+    manifest->size = (uint32_t)size->valuedouble;
+    err = manifest_parse_sha256(manifest->sha256, sha256->valuestring);
+  }
+
+  if (err == ESP_OK) {
+    err = manifest_parse_blocks(manifest, cJSON_GetObjectItem(root, "blocks"));
+  }
+
+  cJSON_Delete(root);
+
+  return err;
+}
+
+/**
+ * Capture the ETag and the body of the manifest response.
+ *
+ * @param[in] event An event of the HTTP client.
+ *
+ * @return ESP_OK.
+ */
+static esp_err_t manifest_event_handler(esp_http_client_event_t* event) {
+  manifest_response_t* response = (manifest_response_t*)event->user_data;
+
+  switch (event->event_id) {
+    case HTTP_EVENT_ON_HEADER: {
+      if (strcasecmp(event->header_key, "ETag") == 0) {
+        strlcpy(response->etag, event->header_value, MANIFEST_ETAG_SIZE);
+      }
+      break;
+    }
+    case HTTP_EVENT_ON_DATA: {
+      // Ignore the bodies of redirects and errors.
+      if (esp_http_client_get_status_code(event->client) != 200) {
+        break;
+      }
+      size_t chunk = min((size_t)event->data_len,
+                         MANIFEST_SIZE - response->body_length);
+      memcpy(&response->body[response->body_length], event->data, chunk);
+      response->body_length += chunk;
+      break;
+    }
+    default: {
+      break;
+    }
+  }
+
+  return ESP_OK;
+}
+
+esp_err_t manifest_fetch(const char* url, const char* user_agent,
+                         char etag[MANIFEST_ETAG_SIZE], manifest_t* manifest,
+                         bool* modified) {
+  // The response is too large for the stack of the update thread.
+  manifest_response_t* response =
+      (manifest_response_t*)calloc(1, sizeof(manifest_response_t));
+  if (response == NULL) {
+    return ESP_ERR_NO_MEM;
+  }
+
+  // The manifest is fetched through the client shared with the firmware
+  // download, so that both use the same connection.
+  esp_http_client_handle_t client = fetch_begin(
+      url, user_agent, 10 * 1000, manifest_event_handler, response);
+  if (client == NULL) {
+    free(response);
+    return ESP_FAIL;
+  }
+
+  if (etag[0] != 0) {
+    esp_http_client_set_header(client, "If-None-Match", etag);
+  }
+
+  esp_err_t err = esp_http_client_perform(client);
+  int32_t status = esp_http_client_get_status_code(client);
+  fetch_end(client, err == ESP_OK);
+
+  if (err != ESP_OK) {
+    ESP_LOGW(TAG, "Failed to fetch manifest: %s", esp_err_to_name(err));
+  } else if (status == 304) {
+    *modified = false;
+  } else if (status == 200) {
+    *modified = true;
+    err = manifest_parse(manifest, response->body, response->body_length);
+    if (err == ESP_OK) {
+      strlcpy(etag, response->etag, MANIFEST_ETAG_SIZE);
+    }
+  } else {
+    ESP_LOGW(TAG, "Failed to fetch manifest: HTTP %d", status);
+    err = status == 404 ? ESP_ERR_NOT_FOUND : ESP_FAIL;
+  }
+
+  free(response);
+
+  return err;
+}
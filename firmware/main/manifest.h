@@ -0,0 +1,74 @@
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+// Maximum size of a release manifest.
+#define MANIFEST_SIZE 8192
+// Maximum size of an ETag, including the terminating null byte.
+#define MANIFEST_ETAG_SIZE 128
+// Length of a SHA-256 digest in bytes.
+#define MANIFEST_SHA256_LEN 32
+// Maximum number of blocks with a separate digest.
+#define MANIFEST_MAX_BLOCKS 64
+
+/**
+ * Describes a small JSON file published alongside every release, which allows
+ * devices to find out whether an update is available without downloading the
+ * firmware image.
+ *
+ * @param version The version of the firmware image.
+ * @param size Size of the firmware image in bytes.
+ * @param sha256 The SHA-256 digest of the firmware image.
+ * @param block_size Size of the blocks into which the image is divided for
+ * verification or 0 if the manifest doesn't list block digests.
+ * @param block_count Number of blocks.
+ * @param block_sha256 The SHA-256 digest of each block.
+ */
+typedef struct manifest {
+  char version[33];
+  uint32_t size;
+  uint8_t sha256[MANIFEST_SHA256_LEN];
+  uint32_t block_size;
+  uint32_t block_count;
+  uint8_t block_sha256[MANIFEST_MAX_BLOCKS][MANIFEST_SHA256_LEN];
+} manifest_t;
+
+/**
+ * Parse a release manifest.
+ *
+ * @param[out] manifest A pointer to the manifest.
+ * @param[in] json The JSON document.
+ * @param[in] length Length of the JSON document.
+ *
+ * @return ESP_OK or ESP_ERR_INVALID_RESPONSE if the manifest is malformed.
+ */
+esp_err_t manifest_parse(manifest_t* manifest, const char* json,
+                         size_t length);
+
+/**
+ * Fetch and parse a release manifest. If an ETag is given, the request is
+ * conditional and the manifest is only transferred if it was modified. The
+ * request uses the client shared by `fetch_begin()`, so this function is NOT
+ * thread-safe.
+ *
+ * @param[in] url URL to the manifest.
+ * @param[in] user_agent Desired content of the HTTP User-Agent header.
+ * @param[in,out] etag The ETag of a previously fetched manifest or an empty
+ * string. Receives the ETag of the fetched manifest.
+ * @param[out] manifest A pointer to the manifest.
+ * @param[out] modified Set to false if the manifest was not modified, in which
+ * case `manifest` is left untouched.
+ *
+ * @return ESP_OK, ESP_ERR_NOT_FOUND if no manifest was published or another
+ * error if the request failed.
+ */
+esp_err_t manifest_fetch(const char* url, const char* user_agent,
+                         char etag[MANIFEST_ETAG_SIZE], manifest_t* manifest,
+                         bool* modified);
+
+#endif
@@ -0,0 +1,328 @@
+#include "meter.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "dsp.h"
+#include "energy.h"
+#include "esp_log.h"
+#include "esp_pthread.h"
+#include "esp_timer.h"
+#include "history.h"
+#include "metrics.h"
+#include "ring.h"
+#include "sdkconfig.h"
+#include "stream.h"
+#include "synth.h"
+#include "util.h"
+
+// Log prefix to be used.
+#define TAG "meter"
+
+// Number of frames moved from the source at once.
+#define METER_BLOCK_FRAMES 32
+// Priority of the thread draining the source, which is above the network
+// stack and the HTTP server.
+#define METER_ACQUIRE_PRIORITY 20
+
+/**
+ * Holds the latest reading of an outlet. The sequence number is odd while the
+ * reading is being written, which allows readers to detect torn copies
+ * without a lock.
+ *
+ * @param sequence Incremented before and after every update.
+ * @param reading The latest reading.
+ */
+typedef struct meter_published {
+  _Atomic uint32_t sequence;
+  meter_reading_t reading;
+} meter_published_t;
+
+// The source of the samples.
+static meter_source_t source;
+// Buffers the samples of every outlet between the two threads.
+static ring_t rings[METER_MAX_OUTLETS];
+// Detects the cycles of every outlet.
+static meter_channel_t channels[METER_MAX_OUTLETS];
+// The latest reading of every outlet.
+static meter_published_t published[METER_MAX_OUTLETS];
+// Number of samples processed per outlet, which serves as a clock.
+static uint64_t sample_clocks[METER_MAX_OUTLETS];
+// The time at which sampling started in milliseconds.
+static int64_t start_ms;
+// Indicates that sampling was started.
+static _Atomic bool started = false;
+// The thread draining the source.
+static pthread_t acquire_thread;
+// The thread computing the readings.
+static pthread_t process_thread;
+
+// Counts samples read from the source.
+static metrics_metric_t samples_total = METRICS_COUNTER_INIT(
+    "zeus_meter_samples_total", "Number of samples read from all outlets.");
+// Counts samples that were lost because a ring was full.
+static metrics_metric_t dropped_total = METRICS_COUNTER_INIT(
+    "zeus_meter_dropped_samples_total",
+    "Number of samples lost because they couldn't be processed in time.");
+// Counts completed cycles.
+static metrics_metric_t cycles_total =
+    METRICS_COUNTER_INIT("zeus_meter_cycles_total",
+                         "Number of mains cycles measured on all outlets.");
+
+void meter_channel_init(meter_channel_t* channel, uint32_t sample_rate,
+                        uint32_t mains_frequency) {
+  memset(&channel->cycle, 0, sizeof(channel->cycle));
+  channel->last_voltage = 0;
+  channel->min_samples = sample_rate / mains_frequency / 2;
+  channel->max_samples = sample_rate / mains_frequency * 2;
+}
+
+bool meter_channel_feed(meter_channel_t* channel, const meter_sample_t* samples,
+                        size_t count, size_t* consumed,
+                        meter_cycle_t* completed) {
+  meter_cycle_t* cycle = &channel->cycle;
+
+  // The cycle ends at the first rising zero crossing of the voltage once it
+  // reached the minimum length, or at the maximum length.
+  size_t limit = min(count, channel->max_samples - cycle->count);
+  size_t start = cycle->count < channel->min_samples
+                     ? min(limit, channel->min_samples - cycle->count)
+                     : 0;
+  int16_t before = start > 0 ? samples[start - 1].voltage
+                             : channel->last_voltage;
+  size_t end = start + dsp_find_rising(&samples[start], limit - start, before);
+  bool cut = end < limit || limit < count;
+
+  dsp_sums(cycle, samples, end);
+  if (end > 0) {
+    channel->last_voltage = samples[end - 1].voltage;
+  }
+  *consumed = end;
+
+  if (!cut) {
+    return false;
+  }
+
+  *completed = *cycle;
+  memset(cycle, 0, sizeof(*cycle));
+  return true;
+}
+
+void meter_cycle_reading(const meter_cycle_t* cycle,
+                         const meter_source_t* source,
+                         meter_reading_t* reading) {
+  if (cycle->count == 0) {
+    memset(reading, 0, sizeof(*reading));
+    return;
+  }
+
+  float count = (float)cycle->count;
+  reading->voltage_rms =
+      sqrtf((float)cycle->sum_vv / count) * source->voltage_scale;
+  reading->current_rms =
+      sqrtf((float)cycle->sum_ii / count) * source->current_scale;
+  reading->real_power = (float)cycle->sum_vi / count * source->voltage_scale *
+                        source->current_scale;
+  reading->apparent_power = reading->voltage_rms * reading->current_rms;
+  reading->power_factor = reading->apparent_power > 0
+                              ? reading->real_power / reading->apparent_power
+                              : 0;
+  reading->frequency = (float)source->sample_rate / count;
+}
+
+/**
+ * Publish the reading of a completed cycle.
+ *
+ * @param[in] outlet The index of the outlet.
+ * @param[in] cycle The sums of the cycle.
+ */
+static void meter_publish(size_t outlet, const meter_cycle_t* cycle) {
+  meter_published_t* entry = &published[outlet];
+  uint32_t cycles = entry->reading.cycles + 1;
+
+  uint32_t sequence =
+      atomic_load_explicit(&entry->sequence, memory_order_relaxed);
+  atomic_store_explicit(&entry->sequence, sequence + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  meter_cycle_reading(cycle, &source, &entry->reading);
+  entry->reading.cycles = cycles;
+  atomic_store_explicit(&entry->sequence, sequence + 2, memory_order_release);
+
+  // Derive the time from the number of samples, which is exact regardless of
+  // when the cycle is processed.
+  sample_clocks[outlet] += cycle->count;
+  int64_t time_ms =
+      start_ms + (int64_t)(sample_clocks[outlet] * 1000 / source.sample_rate);
+
+  energy_record(outlet, &entry->reading);
+  history_record(outlet, time_ms, &entry->reading);
+  stream_publish(outlet, time_ms, &entry->reading);
+
+  metrics_add(&cycles_total, 1);
+}
+
+/**
+ * Move samples from the source into the rings of the outlets.
+ *
+ * @param[in] arg Unused.
+ *
+ * @return NULL.
+ */
+static void* meter_acquire_thread(void* arg) {
+  static meter_sample_t frames[METER_BLOCK_FRAMES * METER_MAX_OUTLETS];
+  static meter_sample_t column[METER_BLOCK_FRAMES];
+  size_t outlet_count = source.outlet_count;
+
+  while (true) {
+    esp_err_t err = source.read(source.ctx, frames, METER_BLOCK_FRAMES);
+    if (err != ESP_OK) {
+      ESP_LOGW(TAG, "Failed to read samples: %s", esp_err_to_name(err));
+      usleep(100 * 1000);
+      continue;
+    }
+
+    for (size_t outlet = 0; outlet < outlet_count; ++outlet) {
+      for (size_t frame = 0; frame < METER_BLOCK_FRAMES; ++frame) {
+        column[frame] = frames[frame * outlet_count + outlet];
+      }
+      size_t pushed = ring_push(&rings[outlet], column, METER_BLOCK_FRAMES);
+      if (pushed < METER_BLOCK_FRAMES) {
+        metrics_add(&dropped_total, METER_BLOCK_FRAMES - pushed);
+      }
+    }
+    metrics_add(&samples_total, METER_BLOCK_FRAMES * outlet_count);
+  }
+
+  return NULL;
+}
+
+/**
+ * Compute the readings of all outlets from the samples in their rings.
+ *
+ * @param[in] arg Unused.
+ *
+ * @return NULL.
+ */
+static void* meter_process_thread(void* arg) {
+  static meter_sample_t block[METER_BLOCK_FRAMES];
+  size_t outlet_count = source.outlet_count;
+
+  // Wait for about half a block when all rings are empty.
+  useconds_t idle_us = METER_BLOCK_FRAMES * 1000000ULL / source.sample_rate / 2;
+
+  while (true) {
+    bool idle = true;
+    for (size_t outlet = 0; outlet < outlet_count; ++outlet) {
+      size_t count = ring_pop(&rings[outlet], block, METER_BLOCK_FRAMES);
+      idle = idle && count == 0;
+
+      const meter_sample_t* cursor = block;
+      while (count > 0) {
+        size_t consumed;
+        meter_cycle_t cycle;
+        if (meter_channel_feed(&channels[outlet], cursor, count, &consumed,
+                               &cycle)) {
+          meter_publish(outlet, &cycle);
+        }
+        cursor += consumed;
+        count -= consumed;
+      }
+    }
+
+    if (idle) {
+      usleep(idle_us);
+    }
+  }
+
+  return NULL;
+}
+
+esp_err_t meter_start(const meter_source_t* config) {
+  if (config->outlet_count == 0 || config->outlet_count > METER_MAX_OUTLETS) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (atomic_load(&started)) {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  source = *config;
+  for (size_t outlet = 0; outlet < source.outlet_count; ++outlet) {
+    esp_err_t err = ring_init(&rings[outlet], CONFIG_ZEUS_METER_RING_SIZE,
+                              sizeof(meter_sample_t));
+    if (err != ESP_OK) {
+      return err;
+    }
+    meter_channel_init(&channels[outlet], source.sample_rate,
+                       CONFIG_ZEUS_METER_MAINS_FREQUENCY);
+  }
+
+  start_ms = esp_timer_get_time() / 1000;
+  metrics_register(&samples_total);
+  metrics_register(&dropped_total);
+  metrics_register(&cycles_total);
+
+  // Drain the source with a priority above the network stack.
+  esp_pthread_cfg_t cfg = esp_pthread_get_default_config();
+  cfg.prio = METER_ACQUIRE_PRIORITY;
+  cfg.thread_name = "meter_acquire";
+  esp_pthread_set_cfg(&cfg);
+  int ret = pthread_create(&acquire_thread, NULL, meter_acquire_thread, NULL);
+  cfg = esp_pthread_get_default_config();
+  esp_pthread_set_cfg(&cfg);
+  if (ret != 0) {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  if (pthread_create(&process_thread, NULL, meter_process_thread, NULL) != 0) {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  atomic_store(&started, true);
+
+  return ESP_OK;
+}
+
+esp_err_t meter_init(void) {
+#ifdef CONFIG_ZEUS_METER_SYNTHETIC
+  static synth_t synth;
+  meter_source_t config;
+  synth_init(&synth, CONFIG_ZEUS_METER_OUTLETS, CONFIG_ZEUS_METER_SAMPLE_RATE,
+             CONFIG_ZEUS_METER_MAINS_FREQUENCY, true);
+  synth_source(&synth, &config);
+  ESP_LOGW(TAG, "Sampling synthetic waveforms");
+  return meter_start(&config);
+#else
+  // The analog front end of the outlets has no driver yet.
+  ESP_LOGW(TAG, "No sample source configured");
+  return ESP_OK;
+#endif
+}
+
+size_t meter_outlet_count(void) {
+  return atomic_load(&started) ? source.outlet_count : 0;
+}
+
+esp_err_t meter_get_reading(size_t outlet, meter_reading_t* reading) {
+  if (outlet >= meter_outlet_count()) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  // Retry until the copy wasn't torn by the processing thread.
+  meter_published_t* entry = &published[outlet];
+  uint32_t before;
+  uint32_t after;
+  do {
+    before = atomic_load_explicit(&entry->sequence, memory_order_acquire);
+    *reading = entry->reading;
+    atomic_thread_fence(memory_order_acquire);
+    after = atomic_load_explicit(&entry->sequence, memory_order_relaxed);
+  } while ((before & 1) != 0 || before != after);
+
+  return reading->cycles > 0 ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
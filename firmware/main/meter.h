@@ -0,0 +1,195 @@
+#ifndef METER_H
+#define METER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+// Maximum number of outlets that can be sampled.
+#define METER_MAX_OUTLETS 16
+// Exclusive bound of the magnitude of a sample, which leaves headroom for
+// fixed-point accumulation.
+#define METER_SAMPLE_LIMIT 8192
+
+/**
+ * A simultaneous voltage and current measurement of one outlet. Samples are
+ * signed and centered around zero, so the source must remove the DC offset of
+ * the analog front end. Their magnitude must stay below METER_SAMPLE_LIMIT,
+ * which covers the 12-bit ADC of the ESP32.
+ *
+ * @param voltage The voltage in units of the voltage scale.
+ * @param current The current in units of the current scale.
+ */
+typedef struct meter_sample {
+  int16_t voltage;
+  int16_t current;
+} meter_sample_t;
+
+/**
+ * Read the next frames from the analog front end, blocking until they are
+ * available. A frame holds one sample per outlet, so sample `o` of frame `f`
+ * is stored at index `f * outlet_count + o`.
+ *
+ * @param[in] ctx The context of the source.
+ * @param[out] samples Buffer receiving the frames.
+ * @param[in] frames Number of frames to be read.
+ *
+ * @return ESP_OK if all frames were read.
+ */
+typedef esp_err_t (*meter_read_t)(void* ctx, meter_sample_t* samples,
+                                  size_t frames);
+
+/**
+ * Describes where samples come from, such as the ADC or a synthetic waveform
+ * generator.
+ *
+ * @param read The function reading frames.
+ * @param ctx The context passed to the function.
+ * @param outlet_count Number of outlets in a frame.
+ * @param sample_rate Number of frames per second.
+ * @param voltage_scale Volts per unit of a voltage sample.
+ * @param current_scale Amperes per unit of a current sample.
+ */
+typedef struct meter_source {
+  meter_read_t read;
+  void* ctx;
+  size_t outlet_count;
+  uint32_t sample_rate;
+  float voltage_scale;
+  float current_scale;
+} meter_source_t;
+
+/**
+ * The sums accumulated over a mains cycle.
+ *
+ * @param sum_vv Sum of the squared voltage samples.
+ * @param sum_ii Sum of the squared current samples.
+ * @param sum_vi Sum of the products of voltage and current samples.
+ * @param count Number of samples.
+ */
+typedef struct meter_cycle {
+  int64_t sum_vv;
+  int64_t sum_ii;
+  int64_t sum_vi;
+  uint32_t count;
+} meter_cycle_t;
+
+/**
+ * Splits the samples of an outlet into mains cycles at the rising zero
+ * crossings of the voltage. Cycles that are implausibly short are merged with
+ * the next one and cycles are cut off after twice the nominal period, so that
+ * readings continue without mains voltage.
+ *
+ * @param cycle The sums of the current cycle.
+ * @param last_voltage The previous voltage sample.
+ * @param min_samples Minimum number of samples in a cycle.
+ * @param max_samples Maximum number of samples in a cycle.
+ */
+typedef struct meter_channel {
+  meter_cycle_t cycle;
+  int16_t last_voltage;
+  uint32_t min_samples;
+  uint32_t max_samples;
+} meter_channel_t;
+
+/**
+ * The electrical quantities of an outlet over the last mains cycle.
+ *
+ * @param voltage_rms The RMS voltage in volts.
+ * @param current_rms The RMS current in amperes.
+ * @param real_power The real power in watts.
+ * @param apparent_power The apparent power in volt-amperes.
+ * @param power_factor The ratio of real and apparent power.
+ * @param frequency The frequency of the cycle in hertz.
+ * @param cycles Number of cycles measured so far.
+ */
+typedef struct meter_reading {
+  float voltage_rms;
+  float current_rms;
+  float real_power;
+  float apparent_power;
+  float power_factor;
+  float frequency;
+  uint32_t cycles;
+} meter_reading_t;
+
+/**
+ * Prepare the cycle detection of an outlet.
+ *
+ * @param[out] channel A pointer to the channel.
+ * @param[in] sample_rate Number of samples per second.
+ * @param[in] mains_frequency The nominal mains frequency in hertz.
+ */
+void meter_channel_init(meter_channel_t* channel, uint32_t sample_rate,
+                        uint32_t mains_frequency);
+
+/**
+ * Accumulate samples up to the end of the current cycle.
+ *
+ * @param[in] channel A pointer to the channel.
+ * @param[in] samples The next samples of the outlet.
+ * @param[in] count Number of samples.
+ * @param[out] consumed Receives the number of samples that were accumulated,
+ * which is less than `count` if a cycle was completed.
+ * @param[out] completed Receives the sums of the cycle if it was completed.
+ *
+ * @return true if a cycle was completed.
+ */
+bool meter_channel_feed(meter_channel_t* channel, const meter_sample_t* samples,
+                        size_t count, size_t* consumed,
+                        meter_cycle_t* completed);
+
+/**
+ * Compute the electrical quantities of a cycle.
+ *
+ * @param[in] cycle The sums of the cycle.
+ * @param[in] source The source of the samples.
+ * @param[out] reading Receives the quantities.
+ */
+void meter_cycle_reading(const meter_cycle_t* cycle,
+                         const meter_source_t* source,
+                         meter_reading_t* reading);
+
+/**
+ * Start sampling all outlets continuously. One thread with a high priority
+ * moves samples from the source into a lock-free ring per outlet, so that
+ * the source is drained even while the other thread computing the readings
+ * is delayed, for example by network traffic.
+ *
+ * @param[in] source The source of the samples, which is copied.
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_ARG if the source has too many outlets,
+ * ESP_ERR_NO_MEM if the buffers can't be allocated or ESP_ERR_INVALID_STATE if
+ * the threads can't be started.
+ */
+esp_err_t meter_start(const meter_source_t* source);
+
+/**
+ * Start sampling with the source selected in the configuration.
+ *
+ * @return ESP_OK or an error of `meter_start()`.
+ */
+esp_err_t meter_init(void);
+
+/**
+ * Get the number of outlets being sampled.
+ *
+ * @return Number of outlets or 0 if sampling was not started.
+ */
+size_t meter_outlet_count(void);
+
+/**
+ * Get the latest reading of an outlet. This function is thread-safe and
+ * lock-free.
+ *
+ * @param[in] outlet The index of the outlet.
+ * @param[out] reading Receives the reading.
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_ARG if the outlet doesn't exist or
+ * ESP_ERR_NOT_FOUND if no cycle was completed yet.
+ */
+esp_err_t meter_get_reading(size_t outlet, meter_reading_t* reading);
+
+#endif
@@ -0,0 +1,195 @@
+#include "metrics.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "esp_log.h"
+#include "prom.h"
+
+#define TAG "metrics"
+// Number of times a histogram is read again while an observation is being
+// recorded.
+#define METRICS_SNAPSHOT_RETRIES 10
+// Delay before a histogram is read again in microseconds, which lets a task
+// of lower priority that was interrupted during an observation complete it.
+#define METRICS_SNAPSHOT_DELAY_US 1000
+
+// Recording relies on 32-bit atomics, which must not fall back to a lock.
+_Static_assert(ATOMIC_INT_LOCK_FREE == 2, "32-bit atomics are not lock-free");
+
+// The registered metrics, which are only appended.
+static metrics_metric_t* registry[METRICS_MAX];
+// Number of published entries in the registry.
+static _Atomic size_t registry_count = 0;
+// Serializes registrations, which are rare and never on a hot path.
+static pthread_mutex_t registry_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+esp_err_t metrics_register(metrics_metric_t* metric) {
+  if (metric->type == METRICS_HISTOGRAM &&
+      metric->bound_count > METRICS_MAX_BUCKETS) {
+    ESP_LOGE(TAG, "Too many buckets: %s", metric->name);
+    return ESP_ERR_INVALID_SIZE;
+  }
+
+  pthread_mutex_lock(&registry_mutex);
+
+  esp_err_t err = ESP_OK;
+  size_t count = atomic_load_explicit(&registry_count, memory_order_relaxed);
+  for (size_t i = 0; i < count; ++i) {
+    if (registry[i] == metric) {
+      pthread_mutex_unlock(&registry_mutex);
+      return ESP_OK;
+    }
+  }
+
+  if (count < METRICS_MAX) {
+    // Publish the entry only after it was stored.
+    registry[count] = metric;
+    atomic_store_explicit(&registry_count, count + 1, memory_order_release);
+  } else {
+    err = ESP_ERR_NO_MEM;
+  }
+
+  pthread_mutex_unlock(&registry_mutex);
+
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Registry is full: %s", metric->name);
+  }
+  return err;
+}
+
+void metrics_observe(metrics_metric_t* metric, uint32_t value) {
+  size_t bucket = 0;
+  while (bucket < metric->bound_count && value > metric->bounds[bucket]) {
+    bucket += 1;
+  }
+
+  // Readers that see the bucket or the sum also see the start, so that they
+  // notice the observation in progress.
+  atomic_fetch_add_explicit(&metric->started, 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  atomic_fetch_add_explicit(&metric->buckets[bucket], 1, memory_order_relaxed);
+  metrics_total_add(&metric->sum, value);
+  atomic_fetch_add_explicit(&metric->completed, 1, memory_order_release);
+}
+
+uint64_t metrics_total_load(metrics_total_t* total) {
+  uint32_t high = atomic_load_explicit(&total->high, memory_order_acquire);
+  uint32_t low = atomic_load_explicit(&total->low, memory_order_relaxed);
+  // The parity differs while the carry of a flip is in flight.
+  if ((high & 1) != low >> 31) {
+    high += 1;
+  }
+  return ((uint64_t)high << 31) | (low & 0x7fffffff);
+}
+
+size_t metrics_count(void) {
+  return atomic_load_explicit(&registry_count, memory_order_acquire);
+}
+
+metrics_metric_t* metrics_get(size_t index) { return registry[index]; }
+
+double metrics_value(metrics_metric_t* metric) {
+  switch (metric->type) {
+    case METRICS_COUNTER:
+      return (double)metrics_total_load(&metric->value);
+    case METRICS_GAUGE:
+      return atomic_load_explicit(&metric->level, memory_order_relaxed) *
+             metric->scale;
+    case METRICS_HISTOGRAM:
+      return metrics_total_load(&metric->sum) * metric->scale;
+  }
+  return 0;
+}
+
+uint64_t metrics_observations(metrics_metric_t* metric) {
+  uint64_t count = 0;
+  for (size_t i = 0; i <= metric->bound_count; ++i) {
+    count += atomic_load_explicit(&metric->buckets[i], memory_order_relaxed);
+  }
+  return count;
+}
+
+/**
+ * Read the buckets and the sum of a histogram.
+ *
+ * @param[in] metric The histogram.
+ * @param[out] snapshot Receives the buckets, the count and the sum.
+ *
+ * @return true if no observation was being recorded meanwhile.
+ */
+static bool metrics_snapshot_histogram(metrics_metric_t* metric,
+                                       metrics_snapshot_t* snapshot) {
+  uint32_t completed =
+      atomic_load_explicit(&metric->completed, memory_order_acquire);
+  snapshot->count = 0;
+  for (size_t i = 0; i <= metric->bound_count; ++i) {
+    snapshot->buckets[i] =
+        atomic_load_explicit(&metric->buckets[i], memory_order_relaxed);
+    snapshot->count += snapshot->buckets[i];
+  }
+  snapshot->sum = metrics_total_load(&metric->sum);
+  atomic_thread_fence(memory_order_acquire);
+
+  // Every observation started by now was completed before the buckets were
+  // read, so none of them was read in part.
+  return atomic_load_explicit(&metric->started, memory_order_relaxed) ==
+         completed;
+}
+
+void metrics_snapshot(metrics_metric_t* metric, metrics_snapshot_t* snapshot) {
+  if (metric->type != METRICS_HISTOGRAM) {
+    snapshot->value = metrics_value(metric);
+    snapshot->count = 0;
+    snapshot->sum = 0;
+    return;
+  }
+
+  for (size_t i = 0; !metrics_snapshot_histogram(metric, snapshot) &&
+                     i < METRICS_SNAPSHOT_RETRIES;
+       ++i) {
+    usleep(METRICS_SNAPSHOT_DELAY_US);
+  }
+  snapshot->value = snapshot->sum * metric->scale;
+}
+
+/**
+ * Write a histogram family.
+ *
+ * @param[in] prom The writer.
+ * @param[in] metric The histogram.
+ */
+static void metrics_export_histogram(prom_t* prom, metrics_metric_t* metric) {
+  metrics_snapshot_t snapshot;
+  metrics_snapshot(metric, &snapshot);
+
+  prom_histogram_t histogram = {
+      .bounds = metric->bounds,
+      .scale = metric->scale,
+      .buckets = snapshot.buckets,
+      .bound_count = metric->bound_count,
+      .sum = snapshot.sum,
+  };
+  prom_histogram(prom, metric->name, metric->help, &histogram);
+}
+
+void metrics_export(prom_t* prom) {
+  size_t count = atomic_load_explicit(&registry_count, memory_order_acquire);
+
+  for (size_t i = 0; i < count; ++i) {
+    metrics_metric_t* metric = registry[i];
+    if (metric->type == METRICS_HISTOGRAM) {
+      metrics_export_histogram(prom, metric);
+      continue;
+    }
+    prom_sample_t sample = {.value = metrics_value(metric)};
+    prom_family(prom, metric->name,
+                metric->type == METRICS_COUNTER ? PROM_COUNTER : PROM_GAUGE,
+                metric->help, &sample, 1);
+  }
+}
@@ -0,0 +1,261 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "prom.h"
+
+// Maximum number of registered metrics, which leaves room for about as many
+// metrics as the firmware registers with all features enabled.
+#define METRICS_MAX 96
+// Maximum number of upper bounds of a histogram, excluding +Inf.
+#define METRICS_MAX_BUCKETS 12
+
+/**
+ * The kinds of metrics supported by the registry.
+ */
+typedef enum metrics_type {
+  METRICS_COUNTER,
+  METRICS_GAUGE,
+  METRICS_HISTOGRAM,
+} metrics_type_t;
+
+/**
+ * A total of up to 63 bits built from 32-bit atomics, which are the widest
+ * ones the ESP32 updates without a lock. The low word wraps freely, while the
+ * high word counts the flips of bit 31 of the low word. A reader that finds
+ * the parity of the high word differing from that bit sees an addition whose
+ * carry is still in flight and accounts for it.
+ *
+ * @param low The low word.
+ * @param high Number of flips of bit 31 of the low word.
+ */
+typedef struct metrics_total {
+  _Atomic uint32_t low;
+  _Atomic uint32_t high;
+} metrics_total_t;
+
+/**
+ * A metric that is owned by the module recording it. Metrics are meant to be
+ * defined with static storage using the initializer macros below, so that
+ * recording a value takes a few 32-bit atomic operations without locks or
+ * lookups.
+ *
+ * @param name The name of the metric family.
+ * @param help A description of the metric family.
+ * @param type The kind of metric.
+ * @param bounds The ascending upper bounds of the buckets of a histogram.
+ * @param bound_count Number of upper bounds.
+ * @param scale Factor converting recorded values of a histogram or a gauge into
+ * the exported unit, such as 1e-6 for microseconds recorded as seconds.
+ * @param value The value of a counter.
+ * @param level The value of a gauge.
+ * @param buckets Number of observations per bucket, where the last bucket
+ * holds the observations above the largest bound.
+ * @param sum The sum of all observations.
+ * @param started Number of observations of a histogram that were started.
+ * @param completed Number of observations of a histogram that were completed,
+ * which lags behind `started` while one is being recorded.
+ */
+typedef struct metrics_metric {
+  const char* name;
+  const char* help;
+  metrics_type_t type;
+  const uint32_t* bounds;
+  size_t bound_count;
+  double scale;
+  metrics_total_t value;
+  _Atomic int32_t level;
+  _Atomic uint32_t buckets[METRICS_MAX_BUCKETS + 1];
+  metrics_total_t sum;
+  _Atomic uint32_t started;
+  _Atomic uint32_t completed;
+} metrics_metric_t;
+
+/**
+ * A reading of a metric, whose parts are consistent with each other.
+ *
+ * @param value The value of a counter, the value of a gauge in the exported
+ * unit or the sum of the observations of a histogram in the exported unit.
+ * @param count Number of observations of a histogram.
+ * @param sum The sum of the observations of a histogram in the unit of its
+ * bounds.
+ * @param buckets Number of observations per bucket of a histogram.
+ */
+typedef struct metrics_snapshot {
+  double value;
+  uint64_t count;
+  uint64_t sum;
+  uint64_t buckets[METRICS_MAX_BUCKETS + 1];
+} metrics_snapshot_t;
+
+/**
+ * Initialize a counter, which only ever increases.
+ *
+ * @param NAME The name of the metric.
+ * @param HELP A description of the metric.
+ */
+#define METRICS_COUNTER_INIT(NAME, HELP) \
+  { .name = (NAME), .help = (HELP), .type = METRICS_COUNTER }
+
+/**
+ * Initialize a gauge, which can be set to any value.
+ *
+ * @param NAME The name of the metric.
+ * @param HELP A description of the metric.
+ */
+#define METRICS_GAUGE_INIT(NAME, HELP) \
+  { .name = (NAME), .help = (HELP), .type = METRICS_GAUGE, .scale = 1 }
+
+/**
+ * Initialize a gauge whose value is set in another unit than it is exported.
+ *
+ * @param NAME The name of the metric.
+ * @param HELP A description of the metric.
+ * @param SCALE Factor converting set values into the exported unit.
+ */
+#define METRICS_GAUGE_SCALED_INIT(NAME, HELP, SCALE) \
+  { .name = (NAME), .help = (HELP), .type = METRICS_GAUGE, .scale = (SCALE) }
+
+/**
+ * Initialize a histogram with fixed buckets.
+ *
+ * @param NAME The name of the metric.
+ * @param HELP A description of the metric.
+ * @param BOUNDS A static array of ascending upper bounds.
+ * @param SCALE Factor converting recorded values into the exported unit.
+ */
+#define METRICS_HISTOGRAM_INIT(NAME, HELP, BOUNDS, SCALE)            \
+  {                                                                  \
+    .name = (NAME), .help = (HELP), .type = METRICS_HISTOGRAM,       \
+    .bounds = (BOUNDS),                                              \
+    .bound_count = sizeof(BOUNDS) / sizeof((BOUNDS)[0]), .scale = (SCALE) \
+  }
+
+/**
+ * Add a metric to the registry, so that it is exported. Registering a metric
+ * more than once has no effect. A failure is logged, as the metric would
+ * otherwise be missing from the export without notice.
+ *
+ * @param[in] metric The metric, which must have static storage.
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_SIZE if a histogram has too many buckets or
+ * ESP_ERR_NO_MEM if the registry is full.
+ */
+esp_err_t metrics_register(metrics_metric_t* metric);
+
+/**
+ * Add to a total.
+ *
+ * @param[in] total The total.
+ * @param[in] amount The amount to be added, which is less than 2^31.
+ */
+static inline void metrics_total_add(metrics_total_t* total, uint32_t amount) {
+  uint32_t low =
+      atomic_fetch_add_explicit(&total->low, amount, memory_order_relaxed);
+  // The carry is published after the low word, so that a reader seeing it
+  // also sees the addition it belongs to.
+  if ((uint32_t)(((uint64_t)low + amount) >> 31) != low >> 31) {
+    atomic_fetch_add_explicit(&total->high, 1, memory_order_release);
+  }
+}
+
+/**
+ * Read a total.
+ *
+ * @param[in] total The total.
+ *
+ * @return The total.
+ */
+uint64_t metrics_total_load(metrics_total_t* total);
+
+/**
+ * Increase a counter.
+ *
+ * @param[in] metric The counter.
+ * @param[in] amount The amount to be added, which is less than 2^31.
+ */
+static inline void metrics_add(metrics_metric_t* metric, uint32_t amount) {
+  metrics_total_add(&metric->value, amount);
+}
+
+/**
+ * Set the value of a gauge.
+ *
+ * @param[in] metric The gauge.
+ * @param[in] level The new value in the unit of its scale.
+ */
+static inline void metrics_set(metrics_metric_t* metric, int32_t level) {
+  atomic_store_explicit(&metric->level, level, memory_order_relaxed);
+}
+
+/**
+ * Record an observation in a histogram.
+ *
+ * @param[in] metric The histogram.
+ * @param[in] value The observed value in the unit of the bounds, which is
+ * less than 2^31.
+ */
+void metrics_observe(metrics_metric_t* metric, uint32_t value);
+
+/**
+ * Get the number of registered metrics.
+ *
+ * @return Number of metrics.
+ */
+size_t metrics_count(void);
+
+/**
+ * Get a registered metric, so that its values can be sampled.
+ *
+ * @param[in] index The index of the metric, less than `metrics_count()`.
+ *
+ * @return The metric.
+ */
+metrics_metric_t* metrics_get(size_t index);
+
+/**
+ * Read the value of a counter, the value of a gauge in the exported unit or the
+ * sum of all observations of a histogram in the exported unit.
+ *
+ * @param[in] metric The metric.
+ *
+ * @return The value.
+ */
+double metrics_value(metrics_metric_t* metric);
+
+/**
+ * Read the number of observations of a histogram.
+ *
+ * @param[in] metric The histogram.
+ *
+ * @return Number of observations.
+ */
+uint64_t metrics_observations(metrics_metric_t* metric);
+
+/**
+ * Read a metric at once. The buckets, the count and the sum of a histogram
+ * are read again after a short delay while an observation is being recorded,
+ * up to a few times, so that they are consistent with each other even while
+ * other threads keep recording. Only an observation that stays interrupted
+ * for about 10 ms is read in part, which still keeps the buckets consistent
+ * with the count.
+ *
+ * @param[in] metric The metric.
+ * @param[out] snapshot Receives the reading.
+ */
+void metrics_snapshot(metrics_metric_t* metric, metrics_snapshot_t* snapshot);
+
+/**
+ * Write all registered metrics in an exposition format. Every histogram is
+ * written from a snapshot, so that its cumulative bucket counts, its count and
+ * its sum are consistent with each other.
+ *
+ * @param[in] prom The writer of the exposition format.
+ */
+void metrics_export(prom_t* prom);
+
+#endif
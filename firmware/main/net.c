@@ -9,10 +9,24 @@
 #include "esp_event.h"
 #include "esp_log.h"
 #include "esp_netif.h"
+#include "metrics.h"
+#include "trace.h"
 
 // TODO: Abstract network interfaces.
 // TODO: Signal online status.
 
+// Indicates whether the Ethernet link is up.
+static metrics_metric_t link_up = METRICS_GAUGE_INIT(
+    "zeus_net_eth_link_up", "Whether the Ethernet link is up.");
+// Counts changes of the Ethernet link state.
+static metrics_metric_t link_changes_total = METRICS_COUNTER_INIT(
+    "zeus_net_eth_link_changes_total",
+    "Number of times the Ethernet link went up or down.");
+// Counts acquired IP addresses.
+static metrics_metric_t ip_acquired_total =
+    METRICS_COUNTER_INIT("zeus_net_ip_acquired_total",
+                         "Number of times an IP address was acquired.");
+
 static uint8_t netmask2prefix(const esp_ip4_addr_t *netmask) {
   return (uint8_t)round(log2(netmask->addr));
 }
@@ -26,20 +40,28 @@ static void net_eth_event_handler(void *arg, esp_event_base_t event_base,
 
   switch (event_id) {
     case ETHERNET_EVENT_CONNECTED: {
+      TRACE_INSTANT("net.eth.up");
       esp_eth_ioctl(eth_handle, ETH_CMD_G_MAC_ADDR, mac_addr);
       ESP_LOGI(TAG_ETH, "Link up: %02x:%02x:%02x:%02x:%02x:%02x", mac_addr[0],
                mac_addr[1], mac_addr[2], mac_addr[3], mac_addr[4], mac_addr[5]);
+      metrics_set(&link_up, 1);
+      metrics_add(&link_changes_total, 1);
       break;
     }
     case ETHERNET_EVENT_DISCONNECTED: {
+      TRACE_INSTANT("net.eth.down");
       ESP_LOGI(TAG_ETH, "Link down");
+      metrics_set(&link_up, 0);
+      metrics_add(&link_changes_total, 1);
       break;
     }
     case ETHERNET_EVENT_START: {
+      TRACE_INSTANT("net.eth.start");
       ESP_LOGI(TAG_ETH, "Started");
       break;
     }
     case ETHERNET_EVENT_STOP: {
+      TRACE_INSTANT("net.eth.stop");
       ESP_LOGI(TAG_ETH, "Stopped");
       break;
     }
@@ -52,6 +74,8 @@ static void net_eth_event_handler(void *arg, esp_event_base_t event_base,
 // Log IP status information.
 static void net_ip_event_handler(void *arg, esp_event_base_t event_base,
                                  int32_t event_id, void *event_data) {
+  TRACE_INSTANT("net.ip.acquired");
+
   // Obtain information about the IP status.
   ip_event_got_ip_t *event = (ip_event_got_ip_t *)event_data;
   const esp_netif_ip_info_t *ip_info = &event->ip_info;
@@ -62,9 +86,14 @@ static void net_ip_event_handler(void *arg, esp_event_base_t event_base,
   // Log information about the IP status.
   ESP_LOGI(TAG_IP, "Address: " IPSTR "/%d", IP2STR(&ip_info->ip), prefix);
   ESP_LOGI(TAG_IP, "Gateway: " IPSTR, IP2STR(&ip_info->gw));
+  metrics_add(&ip_acquired_total, 1);
 }
 
 esp_err_t net_eth_init(void) {
+  metrics_register(&link_up);
+  metrics_register(&link_changes_total);
+  metrics_register(&ip_acquired_total);
+
   // Register event handlers for logging.
   ESP_ERROR_CHECK(esp_event_handler_register(ETH_EVENT, ESP_EVENT_ANY_ID,
                                              &net_eth_event_handler, NULL));
@@ -0,0 +1,79 @@
+#include "outbuf.h"
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "util.h"
+
+/**
+ * Pass the buffered data on to the sink, unless an error occurred before.
+ *
+ * @param[in] out A pointer to the output buffer.
+ */
+static void outbuf_drain(outbuf_t* out) {
+  if (out->fill > 0 && out->err == ESP_OK) {
+    out->err = out->sink(out->ctx, out->buffer, out->fill);
+    out->bytes_sent += out->fill;
+  }
+  out->fill = 0;
+}
+
+void outbuf_init(outbuf_t* out, outbuf_sink_t sink, void* ctx) {
+  out->sink = sink;
+  out->ctx = ctx;
+  out->fill = 0;
+  out->bytes_sent = 0;
+  out->err = ESP_OK;
+}
+
+void outbuf_write(outbuf_t* out, const char* data, size_t length) {
+  while (length > 0) {
+    size_t chunk = min(length, OUTBUF_SIZE - out->fill);
+    memcpy(&out->buffer[out->fill], data, chunk);
+    out->fill += chunk;
+    data += chunk;
+    length -= chunk;
+
+    if (out->fill == OUTBUF_SIZE) {
+      outbuf_drain(out);
+    }
+  }
+}
+
+void outbuf_puts(outbuf_t* out, const char* str) {
+  outbuf_write(out, str, strlen(str));
+}
+
+void outbuf_printf(outbuf_t* out, const char* format, ...) {
+  va_list args;
+
+  // Format into the free space of the buffer and only drain it if the text
+  // doesn't fit, which avoids an intermediate copy.
+  for (int attempt = 0; attempt < 2; ++attempt) {
+    size_t available = OUTBUF_SIZE - out->fill;
+    va_start(args, format);
+    int length = vsnprintf(&out->buffer[out->fill], available, format, args);
+    va_end(args);
+    if (length < 0) {
+      return;
+    }
+    if ((size_t)length < available) {
+      out->fill += length;
+      return;
+    }
+    if (out->fill == 0) {
+      // Keep the truncated text, as it won't fit into any buffer.
+      out->fill = available - 1;
+      return;
+    }
+    outbuf_drain(out);
+  }
+}
+
+esp_err_t outbuf_flush(outbuf_t* out) {
+  outbuf_drain(out);
+  return out->err;
+}
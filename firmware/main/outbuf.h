@@ -0,0 +1,92 @@
+#ifndef OUTBUF_H
+#define OUTBUF_H
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+// Size of the buffer of an output buffer.
+#define OUTBUF_SIZE 1024
+
+/**
+ * Send data to the underlying stream, such as an HTTP response.
+ *
+ * @param[in] ctx The context passed to `outbuf_init()`.
+ * @param[in] data The data to be sent.
+ * @param[in] length Number of bytes to be sent.
+ *
+ * @return ESP_OK if the data was sent.
+ */
+typedef esp_err_t (*outbuf_sink_t)(void* ctx, const char* data, size_t length);
+
+/**
+ * Gathers generated text in a buffer of fixed size and passes it on to a sink
+ * whenever the buffer is full. Documents of any size can be generated without
+ * allocating memory. The first error of the sink is kept and all further
+ * output is discarded.
+ *
+ * @param sink The function receiving the buffered text.
+ * @param ctx The context passed to the sink.
+ * @param buffer Memory holding the text that was not sent yet.
+ * @param fill Number of bytes in the buffer.
+ * @param bytes_sent Number of bytes passed on to the sink.
+ * @param err The first error of the sink.
+ */
+typedef struct outbuf {
+  outbuf_sink_t sink;
+  void* ctx;
+  char buffer[OUTBUF_SIZE];
+  size_t fill;
+  size_t bytes_sent;
+  esp_err_t err;
+} outbuf_t;
+
+/**
+ * Prepare an output buffer.
+ *
+ * @param[out] out A pointer to the output buffer.
+ * @param[in] sink The function receiving the buffered text.
+ * @param[in] ctx The context passed to the sink.
+ */
+void outbuf_init(outbuf_t* out, outbuf_sink_t sink, void* ctx);
+
+/**
+ * Append data to the buffer, passing it on to the sink whenever the buffer
+ * is full.
+ *
+ * @param[in] out A pointer to the output buffer.
+ * @param[in] data The data to be appended.
+ * @param[in] length Number of bytes to be appended.
+ */
+void outbuf_write(outbuf_t* out, const char* data, size_t length);
+
+/**
+ * Append a null-terminated string to the buffer.
+ *
+ * @param[in] out A pointer to the output buffer.
+ * @param[in] str The string to be appended.
+ */
+void outbuf_puts(outbuf_t* out, const char* str);
+
+/**
+ * Append formatted text to the buffer. The formatted text must fit into an
+ * empty buffer and is truncated otherwise.
+ *
+ * @param[in] out A pointer to the output buffer.
+ * @param[in] format The format string as used by `printf()`.
+ */
+void outbuf_printf(outbuf_t* out, const char* format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+/**
+ * Pass the remaining data in the buffer on to the sink.
+ *
+ * @param[in] out A pointer to the output buffer.
+ *
+ * @return ESP_OK or the first error of the sink.
+ */
+esp_err_t outbuf_flush(outbuf_t* out);
+
+#endif
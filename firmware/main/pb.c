@@ -0,0 +1,83 @@
+#include "pb.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * Get the key of a field, which combines the field number and the wire type.
+ *
+ * @param[in] field The field number.
+ * @param[in] type The wire type.
+ *
+ * @return The key.
+ */
+static uint64_t pb_key(uint32_t field, uint8_t type) {
+  return (uint64_t)field << 3 | type;
+}
+
+size_t pb_varint_size(uint64_t value) {
+  size_t size = 1;
+  while (value >= 0x80) {
+    value >>= 7;
+    size++;
+  }
+  return size;
+}
+
+size_t pb_uint64_size(uint32_t field, uint64_t value) {
+  return pb_varint_size(pb_key(field, PB_VARINT)) + pb_varint_size(value);
+}
+
+size_t pb_double_size(uint32_t field) {
+  return pb_varint_size(pb_key(field, PB_FIXED64)) + sizeof(uint64_t);
+}
+
+size_t pb_length_size(uint32_t field, size_t length) {
+  return pb_varint_size(pb_key(field, PB_LENGTH)) + pb_varint_size(length) +
+         length;
+}
+
+size_t pb_string_size(uint32_t field, const char* str) {
+  return pb_length_size(field, strlen(str));
+}
+
+void pb_varint(outbuf_t* out, uint64_t value) {
+  char data[10];
+  size_t length = 0;
+  while (value >= 0x80) {
+    data[length++] = (char)(value | 0x80);
+    value >>= 7;
+  }
+  data[length++] = (char)value;
+  outbuf_write(out, data, length);
+}
+
+void pb_uint64(outbuf_t* out, uint32_t field, uint64_t value) {
+  pb_varint(out, pb_key(field, PB_VARINT));
+  pb_varint(out, value);
+}
+
+void pb_double(outbuf_t* out, uint32_t field, double value) {
+  pb_varint(out, pb_key(field, PB_FIXED64));
+
+  // Doubles are encoded in little-endian byte order.
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  char data[sizeof(bits)];
+  for (size_t i = 0; i < sizeof(bits); i++) {
+    data[i] = (char)(bits >> (8 * i));
+  }
+  outbuf_write(out, data, sizeof(data));
+}
+
+void pb_length(outbuf_t* out, uint32_t field, size_t length) {
+  pb_varint(out, pb_key(field, PB_LENGTH));
+  pb_varint(out, length);
+}
+
+void pb_string(outbuf_t* out, uint32_t field, const char* str) {
+  size_t length = strlen(str);
+  pb_length(out, field, length);
+  outbuf_write(out, str, length);
+}
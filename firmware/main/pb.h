@@ -0,0 +1,117 @@
+#ifndef PB_H
+#define PB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "outbuf.h"
+
+// Wire type of varints.
+#define PB_VARINT 0
+// Wire type of 64-bit values, such as doubles.
+#define PB_FIXED64 1
+// Wire type of length-delimited values, such as strings and messages.
+#define PB_LENGTH 2
+
+// Writes the protocol buffers wire format to an output buffer. Messages are
+// written without any schema: fields are written in order, and every nested
+// message is preceded by its length, which is calculated beforehand with the
+// size functions.
+
+/**
+ * Get the number of bytes of a varint.
+ *
+ * @param[in] value The value.
+ *
+ * @return Number of bytes.
+ */
+size_t pb_varint_size(uint64_t value);
+
+/**
+ * Get the number of bytes of a varint field, including its key.
+ *
+ * @param[in] field The field number.
+ * @param[in] value The value.
+ *
+ * @return Number of bytes.
+ */
+size_t pb_uint64_size(uint32_t field, uint64_t value);
+
+/**
+ * Get the number of bytes of a double field, including its key.
+ *
+ * @param[in] field The field number.
+ *
+ * @return Number of bytes.
+ */
+size_t pb_double_size(uint32_t field);
+
+/**
+ * Get the number of bytes of a length-delimited field, including its key and
+ * the length.
+ *
+ * @param[in] field The field number.
+ * @param[in] length Number of bytes of the value.
+ *
+ * @return Number of bytes.
+ */
+size_t pb_length_size(uint32_t field, size_t length);
+
+/**
+ * Get the number of bytes of a string field, including its key and the
+ * length.
+ *
+ * @param[in] field The field number.
+ * @param[in] str The null-terminated string.
+ *
+ * @return Number of bytes.
+ */
+size_t pb_string_size(uint32_t field, const char* str);
+
+/**
+ * Write a varint.
+ *
+ * @param[in] out The output buffer.
+ * @param[in] value The value.
+ */
+void pb_varint(outbuf_t* out, uint64_t value);
+
+/**
+ * Write a varint field, which is used for all unsigned and signed integer
+ * types except sint32 and sint64. Negative values take ten bytes.
+ *
+ * @param[in] out The output buffer.
+ * @param[in] field The field number.
+ * @param[in] value The value.
+ */
+void pb_uint64(outbuf_t* out, uint32_t field, uint64_t value);
+
+/**
+ * Write a double field.
+ *
+ * @param[in] out The output buffer.
+ * @param[in] field The field number.
+ * @param[in] value The value.
+ */
+void pb_double(outbuf_t* out, uint32_t field, double value);
+
+/**
+ * Write the key and the length of a length-delimited field, such as a nested
+ * message, whose content must follow.
+ *
+ * @param[in] out The output buffer.
+ * @param[in] field The field number.
+ * @param[in] length Number of bytes of the content.
+ */
+void pb_length(outbuf_t* out, uint32_t field, size_t length);
+
+/**
+ * Write a string field.
+ *
+ * @param[in] out The output buffer.
+ * @param[in] field The field number.
+ * @param[in] str The null-terminated string.
+ */
+void pb_string(outbuf_t* out, uint32_t field, const char* str);
+
+#endif
@@ -0,0 +1,497 @@
+#include "peer.h"
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "esp_image_format.h"
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "lwip/sockets.h"
+#include "mbedtls/sha256.h"
+#include "metrics.h"
+#include "nvs.h"
+#include "sdkconfig.h"
+#include "util.h"
+
+// Log prefix to be used.
+#define TAG "peer"
+// Identifies the announcements of other devices.
+#define PEER_MAGIC "ZEUS"
+// Version of the announcement format.
+#define PEER_FORMAT 1
+// Port of the HTTP server serving the firmware image.
+#define PEER_HTTP_PORT 80
+// Number of announcement intervals after which a silent peer is forgotten.
+#define PEER_EXPIRY_INTERVALS 3
+// Size of the buffer used to hash the firmware image.
+#define PEER_CHUNK_SIZE 4096
+// Stack size of the thread announcing the firmware image.
+#define PEER_THREAD_STACK_SIZE (4 * 1024)
+
+/**
+ * The announcement broadcast by every device, with all integers in network
+ * byte order.
+ *
+ * @param magic Identifies the announcement.
+ * @param format Version of the announcement format.
+ * @param reserved Must be zero.
+ * @param port The port of the HTTP server.
+ * @param nonce Random number identifying the sender, so that a device ignores
+ * its own announcements.
+ * @param size Size of the firmware image in bytes.
+ * @param sha256 The SHA-256 digest of the firmware image.
+ * @param version The null-terminated version of the firmware.
+ */
+typedef struct __attribute__((packed)) peer_announcement {
+  char magic[4];
+  uint8_t format;
+  uint8_t reserved;
+  uint16_t port;
+  uint32_t nonce;
+  uint32_t size;
+  uint8_t sha256[MANIFEST_SHA256_LEN];
+  char version[33];
+} peer_announcement_t;
+
+// NVS namespace used to persist the identity of the running image.
+static const char nvs_namespace[] = "peer";
+// The identity of the running image, which is written once by the peer thread
+// before it is marked as known.
+static peer_t image;
+// Indicates that the identity of the running image is known.
+static _Atomic bool image_known = false;
+// The partition of the running image.
+static const esp_partition_t* running = NULL;
+// Identifies the announcements of this device.
+static uint32_t nonce = 0;
+// The peers that announced themselves recently.
+static peer_t peers[PEER_MAX];
+// Number of peers.
+static size_t peer_count = 0;
+// Protects access to the peers.
+static pthread_mutex_t peers_mutex = PTHREAD_MUTEX_INITIALIZER;
+// Gives access to the peer thread.
+static pthread_t thread_handle;
+// Indicates the number of peers that announced themselves recently.
+static metrics_metric_t peers_gauge = METRICS_GAUGE_INIT(
+    "zeus_peer_peers",
+    "Number of devices on the local network that announced their firmware.");
+// Counts announcements received from other devices.
+static metrics_metric_t announcements_total = METRICS_COUNTER_INIT(
+    "zeus_peer_announcements_total",
+    "Number of announcements received from other devices.");
+
+/**
+ * Get the time after which a silent peer is forgotten.
+ *
+ * @return The time in microseconds.
+ */
+static int64_t peer_expiry_us(void) {
+  return PEER_EXPIRY_INTERVALS * CONFIG_ZEUS_PEER_INTERVAL * 1000000LL;
+}
+
+/**
+ * Persist the identity of a firmware image.
+ *
+ * @param[in] address The address of the partition holding the image.
+ * @param[in] identity The identity of the image.
+ */
+static void peer_store(uint32_t address, const peer_t* identity) {
+  nvs_handle_t nvs;
+  if (nvs_open(nvs_namespace, NVS_READWRITE, &nvs) != ESP_OK) {
+    return;
+  }
+
+  if (nvs_set_str(nvs, "version", identity->version) != ESP_OK ||
+      nvs_set_u32(nvs, "address", address) != ESP_OK ||
+      nvs_set_u32(nvs, "size", identity->size) != ESP_OK ||
+      nvs_set_blob(nvs, "sha256", identity->sha256, MANIFEST_SHA256_LEN) !=
+          ESP_OK ||
+      nvs_commit(nvs) != ESP_OK) {
+    ESP_LOGW(TAG, "Failed to persist firmware identity");
+  }
+
+  nvs_close(nvs);
+}
+
+/**
+ * Load the persisted identity of the running image. The identity is only valid
+ * if it was stored for the same version in the same partition.
+ *
+ * @return true if the identity was loaded.
+ */
+static bool peer_load_image(void) {
+  nvs_handle_t nvs;
+  if (nvs_open(nvs_namespace, NVS_READONLY, &nvs) != ESP_OK) {
+    return false;
+  }
+
+  char version[sizeof(image.version)];
+  size_t version_size = sizeof(version);
+  uint32_t address = 0;
+  size_t sha256_size = MANIFEST_SHA256_LEN;
+  bool loaded =
+      nvs_get_str(nvs, "version", version, &version_size) == ESP_OK &&
+      strcmp(version, image.version) == 0 &&
+      nvs_get_u32(nvs, "address", &address) == ESP_OK &&
+      address == running->address &&
+      nvs_get_u32(nvs, "size", &image.size) == ESP_OK &&
+      nvs_get_blob(nvs, "sha256", image.sha256, &sha256_size) == ESP_OK;
+
+  nvs_close(nvs);
+
+  return loaded;
+}
+
+/**
+ * Hash the running image. The digest covers the whole image file, including
+ * the appended digest of the bootloader, like the digest in the manifest.
+ *
+ * @return ESP_OK or the error of reading the image.
+ */
+static esp_err_t peer_hash_image(void) {
+  esp_partition_pos_t position = {
+      .offset = running->address,
+      .size = running->size,
+  };
+  esp_image_metadata_t metadata;
+  esp_err_t err = esp_image_get_metadata(&position, &metadata);
+  if (err != ESP_OK) {
+    return err;
+  }
+
+  uint8_t* buffer = (uint8_t*)malloc(PEER_CHUNK_SIZE);
+  if (buffer == NULL) {
+    return ESP_ERR_NO_MEM;
+  }
+
+  mbedtls_sha256_context sha256;
+  mbedtls_sha256_init(&sha256);
+  mbedtls_sha256_starts(&sha256, 0);
+  for (uint32_t offset = 0; offset < metadata.image_len;) {
+    size_t chunk = min(metadata.image_len - offset, PEER_CHUNK_SIZE);
+    err = esp_partition_read(running, offset, buffer, chunk);
+    if (err != ESP_OK) {
+      break;
+    }
+    mbedtls_sha256_update(&sha256, buffer, chunk);
+    offset += chunk;
+  }
+  if (err == ESP_OK) {
+    mbedtls_sha256_finish(&sha256, image.sha256);
+    image.size = metadata.image_len;
+  }
+  mbedtls_sha256_free(&sha256);
+  free(buffer);
+
+  return err;
+}
+
+/**
+ * Identify the running image, either from the NVS or by hashing it.
+ *
+ * @return ESP_OK or the error of hashing the image.
+ */
+static esp_err_t peer_identify(void) {
+  running = esp_ota_get_running_partition();
+  esp_app_desc_t app;
+  esp_err_t err = esp_ota_get_partition_description(running, &app);
+  if (err != ESP_OK) {
+    return err;
+  }
+  strlcpy(image.version, app.version, sizeof(image.version));
+
+  if (peer_load_image()) {
+    return ESP_OK;
+  }
+
+  int64_t start_us = esp_timer_get_time();
+  err = peer_hash_image();
+  if (err != ESP_OK) {
+    return err;
+  }
+  ESP_LOGI(TAG, "Hashed firmware: %u B in %" PRId64 " ms", image.size,
+           (esp_timer_get_time() - start_us) / 1000);
+  peer_store(running->address, &image);
+
+  return ESP_OK;
+}
+
+/**
+ * Open the socket on which announcements are sent and received.
+ *
+ * @return The socket or -1 if it can't be opened.
+ */
+static int peer_open_socket(void) {
+  int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (sock < 0) {
+    return -1;
+  }
+
+  int enable = 1;
+  struct sockaddr_in address = {
+      .sin_family = AF_INET,
+      .sin_port = htons(CONFIG_ZEUS_PEER_PORT),
+      .sin_addr.s_addr = htonl(INADDR_ANY),
+  };
+  if (setsockopt(sock, SOL_SOCKET, SO_BROADCAST, &enable, sizeof(enable)) !=
+          0 ||
+      setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable)) !=
+          0 ||
+      bind(sock, (struct sockaddr*)&address, sizeof(address)) != 0) {
+    close(sock);
+    return -1;
+  }
+
+  return sock;
+}
+
+/**
+ * Broadcast the identity of the running image.
+ *
+ * @param[in] sock The socket.
+ */
+static void peer_announce(int sock) {
+  peer_announcement_t announcement = {
+      .format = PEER_FORMAT,
+      .port = htons(PEER_HTTP_PORT),
+      .nonce = nonce,
+      .size = htonl(image.size),
+  };
+  memcpy(announcement.magic, PEER_MAGIC, sizeof(announcement.magic));
+  memcpy(announcement.sha256, image.sha256, MANIFEST_SHA256_LEN);
+  strlcpy(announcement.version, image.version, sizeof(announcement.version));
+
+  struct sockaddr_in address = {
+      .sin_family = AF_INET,
+      .sin_port = htons(CONFIG_ZEUS_PEER_PORT),
+      .sin_addr.s_addr = htonl(INADDR_BROADCAST),
+  };
+  if (sendto(sock, &announcement, sizeof(announcement), 0,
+             (struct sockaddr*)&address, sizeof(address)) < 0) {
+    // The network may not be up yet.
+    ESP_LOGD(TAG, "Failed to send announcement: %d", errno);
+  }
+}
+
+/**
+ * Receive an announcement and remember the peer that sent it. The peer
+ * replaces an earlier entry of the same address or, if the table is full, the
+ * peer that was silent the longest.
+ *
+ * @param[in] sock The socket.
+ */
+static void peer_receive(int sock) {
+  peer_announcement_t announcement;
+  struct sockaddr_in address;
+  socklen_t address_length = sizeof(address);
+  ssize_t length = recvfrom(sock, &announcement, sizeof(announcement), 0,
+                            (struct sockaddr*)&address, &address_length);
+  if (length != sizeof(announcement) ||
+      memcmp(announcement.magic, PEER_MAGIC, sizeof(announcement.magic)) !=
+          0 ||
+      announcement.format != PEER_FORMAT || announcement.nonce == nonce) {
+    return;
+  }
+  announcement.version[sizeof(announcement.version) - 1] = 0;
+  metrics_add(&announcements_total, 1);
+
+  pthread_mutex_lock(&peers_mutex);
+  size_t index = 0;
+  while (index < peer_count &&
+         peers[index].address != address.sin_addr.s_addr) {
+    ++index;
+  }
+  if (index == PEER_MAX) {
+    index = 0;
+    for (size_t other = 1; other < peer_count; ++other) {
+      if (peers[other].seen_us < peers[index].seen_us) {
+        index = other;
+      }
+    }
+  } else if (index == peer_count) {
+    ++peer_count;
+  }
+
+  peer_t* peer = &peers[index];
+  peer->address = address.sin_addr.s_addr;
+  peer->port = ntohs(announcement.port);
+  strlcpy(peer->version, announcement.version, sizeof(peer->version));
+  peer->size = ntohl(announcement.size);
+  memcpy(peer->sha256, announcement.sha256, MANIFEST_SHA256_LEN);
+  peer->seen_us = esp_timer_get_time();
+  metrics_set(&peers_gauge, peer_count);
+  pthread_mutex_unlock(&peers_mutex);
+}
+
+/**
+ * Forget the peers that were silent for too long.
+ *
+ * @param[in] now_us The current time.
+ */
+static void peer_expire(int64_t now_us) {
+  pthread_mutex_lock(&peers_mutex);
+  for (size_t index = 0; index < peer_count;) {
+    if (now_us - peers[index].seen_us > peer_expiry_us()) {
+      peers[index] = peers[--peer_count];
+    } else {
+      ++index;
+    }
+  }
+  metrics_set(&peers_gauge, peer_count);
+  pthread_mutex_unlock(&peers_mutex);
+}
+
+/**
+ * Identify the running image, then announce it periodically while listening
+ * for the announcements of other devices.
+ *
+ * @param[in] arg Unused.
+ *
+ * @return NULL.
+ */
+static void* peer_thread(void* arg) {
+  esp_err_t err = peer_identify();
+  if (err != ESP_OK) {
+    ESP_LOGW(TAG, "Failed to identify firmware: %s", esp_err_to_name(err));
+    return NULL;
+  }
+  atomic_store(&image_known, true);
+  ESP_LOGI(TAG, "Sharing firmware: %s (%u B)", image.version, image.size);
+
+  int64_t interval_us = CONFIG_ZEUS_PEER_INTERVAL * 1000000LL;
+  int64_t next_announce_us = 0;
+  int sock = -1;
+  while (1) {
+    if (sock < 0) {
+      sock = peer_open_socket();
+      if (sock < 0) {
+        ESP_LOGW(TAG, "Failed to open socket: %d", errno);
+        sleep(CONFIG_ZEUS_PEER_INTERVAL);
+        continue;
+      }
+    }
+
+    int64_t now_us = esp_timer_get_time();
+    if (now_us >= next_announce_us) {
+      peer_announce(sock);
+      peer_expire(now_us);
+      // Deviate by up to 10 % from the interval, so that devices that were
+      // started together don't keep announcing at the same time.
+      next_announce_us =
+          now_us + interval_us - esp_random() % (interval_us / 10 + 1);
+    }
+
+    int64_t wait_us = next_announce_us - now_us;
+    struct timeval timeout = {
+        .tv_sec = wait_us / 1000000,
+        .tv_usec = wait_us % 1000000,
+    };
+    fd_set readable;
+    FD_ZERO(&readable);
+    FD_SET(sock, &readable);
+    int ready = select(sock + 1, &readable, NULL, NULL, &timeout);
+    if (ready < 0) {
+      close(sock);
+      sock = -1;
+    } else if (ready > 0) {
+      peer_receive(sock);
+    }
+  }
+
+  return NULL;
+}
+
+esp_err_t peer_init(void) {
+#ifdef CONFIG_ZEUS_PEER
+  metrics_register(&peers_gauge);
+  metrics_register(&announcements_total);
+
+  nonce = esp_random();
+
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setstacksize(&attr, PEER_THREAD_STACK_SIZE);
+  if (pthread_create(&thread_handle, &attr, peer_thread, NULL) != 0) {
+    return ESP_ERR_INVALID_STATE;
+  }
+#endif
+
+  return ESP_OK;
+}
+
+esp_err_t peer_find(const manifest_t* release, char* url, size_t size) {
+  int64_t now_us = esp_timer_get_time();
+  size_t matches[PEER_MAX];
+  size_t match_count = 0;
+
+  pthread_mutex_lock(&peers_mutex);
+  for (size_t index = 0; index < peer_count; ++index) {
+    const peer_t* peer = &peers[index];
+    if (now_us - peer->seen_us <= peer_expiry_us() &&
+        peer->size == release->size &&
+        strcmp(peer->version, release->version) == 0 &&
+        memcmp(peer->sha256, release->sha256, MANIFEST_SHA256_LEN) == 0) {
+      matches[match_count++] = index;
+    }
+  }
+
+  peer_t peer;
+  if (match_count > 0) {
+    peer = peers[matches[esp_random() % match_count]];
+  }
+  pthread_mutex_unlock(&peers_mutex);
+
+  if (match_count == 0) {
+    return ESP_ERR_NOT_FOUND;
+  }
+
+  const uint8_t* octets = (const uint8_t*)&peer.address;
+  snprintf(url, size, "http://%u.%u.%u.%u:%u%s", octets[0], octets[1],
+           octets[2], octets[3], peer.port, PEER_PATH);
+
+  return ESP_OK;
+}
+
+size_t peer_list(peer_t* list, size_t count) {
+  int64_t now_us = esp_timer_get_time();
+  size_t listed = 0;
+
+  pthread_mutex_lock(&peers_mutex);
+  for (size_t index = 0; index < peer_count && listed < count; ++index) {
+    if (now_us - peers[index].seen_us <= peer_expiry_us()) {
+      list[listed++] = peers[index];
+    }
+  }
+  pthread_mutex_unlock(&peers_mutex);
+
+  return listed;
+}
+
+void peer_store_image(const esp_partition_t* partition,
+                      const manifest_t* release) {
+  peer_t identity = {
+      .size = release->size,
+  };
+  strlcpy(identity.version, release->version, sizeof(identity.version));
+  memcpy(identity.sha256, release->sha256, MANIFEST_SHA256_LEN);
+  peer_store(partition->address, &identity);
+}
+
+esp_err_t peer_get_image(peer_t* identity) {
+  if (!atomic_load(&image_known)) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  *identity = image;
+  return ESP_OK;
+}
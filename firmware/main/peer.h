@@ -0,0 +1,94 @@
+#ifndef PEER_H
+#define PEER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_partition.h"
+#include "manifest.h"
+
+// Maximum number of peers that are remembered.
+#define PEER_MAX 16
+// Maximum length of the URL of the firmware image of a peer.
+#define PEER_URL_SIZE 48
+// Path at which every device serves its firmware image.
+#define PEER_PATH "/firmware"
+
+/**
+ * Describes another device on the local network.
+ *
+ * @param address The IPv4 address in network byte order.
+ * @param port The port of the HTTP server.
+ * @param version The version of the firmware the peer is running.
+ * @param size Size of the firmware image in bytes.
+ * @param sha256 The SHA-256 digest of the firmware image.
+ * @param seen_us The time at which the peer last announced itself.
+ */
+typedef struct peer {
+  uint32_t address;
+  uint16_t port;
+  char version[33];
+  uint32_t size;
+  uint8_t sha256[MANIFEST_SHA256_LEN];
+  int64_t seen_us;
+} peer_t;
+
+/**
+ * Start announcing the running firmware image to other devices on the local
+ * network and listening for their announcements. The image is identified by
+ * its version and the digest of the whole image, just like in the release
+ * manifest, so a peer running a release can serve it in place of the update
+ * source. Does nothing unless CONFIG_ZEUS_PEER is enabled.
+ *
+ * @return ESP_OK or ESP_ERR_INVALID_STATE if the thread can't be started.
+ */
+esp_err_t peer_init(void);
+
+/**
+ * Find a peer running the firmware image described by a release manifest. If
+ * several peers run it, one of them is picked at random to spread the load.
+ * This function is thread-safe.
+ *
+ * @param[in] release The manifest of the firmware image.
+ * @param[out] url Buffer receiving the URL of the image on the peer.
+ * @param[in] size Size of the buffer.
+ *
+ * @return ESP_OK or ESP_ERR_NOT_FOUND if no peer runs the image.
+ */
+esp_err_t peer_find(const manifest_t* release, char* url, size_t size);
+
+/**
+ * Get the peers that announced themselves recently. This function is
+ * thread-safe.
+ *
+ * @param[out] list Buffer receiving the peers.
+ * @param[in] count Maximum number of peers.
+ *
+ * @return Number of peers.
+ */
+size_t peer_list(peer_t* list, size_t count);
+
+/**
+ * Remember the identity of a firmware image that was installed, so that it
+ * needn't be hashed after the restart.
+ *
+ * @param[in] partition The partition holding the image.
+ * @param[in] release The manifest of the image.
+ */
+void peer_store_image(const esp_partition_t* partition,
+                      const manifest_t* release);
+
+/**
+ * Get the identity of the running firmware image, which is shared with other
+ * devices. This function is thread-safe.
+ *
+ * @param[out] identity Receives the version, the size and the digest of the
+ * image.
+ *
+ * @return ESP_OK or ESP_ERR_INVALID_STATE if the image is not shared, because
+ * sharing is disabled or the image wasn't hashed yet.
+ */
+esp_err_t peer_get_image(peer_t* identity);
+
+#endif
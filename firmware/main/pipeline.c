@@ -0,0 +1,106 @@
+#include "pipeline.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+esp_err_t pipeline_init(pipeline_t* pipe, size_t slot_count, size_t slot_size) {
+  pipe->data = (char*)malloc(slot_count * slot_size);
+  pipe->lengths = (size_t*)calloc(slot_count, sizeof(size_t));
+  if (pipe->data == NULL || pipe->lengths == NULL) {
+    free(pipe->data);
+    free(pipe->lengths);
+    return ESP_ERR_NO_MEM;
+  }
+
+  pipe->slot_size = slot_size;
+  pipe->slot_count = slot_count;
+  pipe->head = 0;
+  pipe->tail = 0;
+  pipe->used = 0;
+  pipe->closed = false;
+  pipe->err = ESP_OK;
+  pthread_mutex_init(&pipe->mutex, NULL);
+  pthread_cond_init(&pipe->filled, NULL);
+  pthread_cond_init(&pipe->drained, NULL);
+
+  return ESP_OK;
+}
+
+void pipeline_deinit(pipeline_t* pipe) {
+  pthread_cond_destroy(&pipe->drained);
+  pthread_cond_destroy(&pipe->filled);
+  pthread_mutex_destroy(&pipe->mutex);
+  free(pipe->lengths);
+  free(pipe->data);
+  pipe->lengths = NULL;
+  pipe->data = NULL;
+}
+
+char* pipeline_acquire(pipeline_t* pipe) {
+  pthread_mutex_lock(&pipe->mutex);
+  while (pipe->used == pipe->slot_count && !pipe->closed) {
+    pthread_cond_wait(&pipe->drained, &pipe->mutex);
+  }
+  char* slot = NULL;
+  if (!pipe->closed) {
+    slot = &pipe->data[pipe->head * pipe->slot_size];
+  }
+  pthread_mutex_unlock(&pipe->mutex);
+
+  return slot;
+}
+
+void pipeline_commit(pipeline_t* pipe, size_t length) {
+  pthread_mutex_lock(&pipe->mutex);
+  pipe->lengths[pipe->head] = length;
+  pipe->head = (pipe->head + 1) % pipe->slot_count;
+  pipe->used += 1;
+  pthread_cond_signal(&pipe->filled);
+  pthread_mutex_unlock(&pipe->mutex);
+}
+
+char* pipeline_peek(pipeline_t* pipe, size_t* length) {
+  pthread_mutex_lock(&pipe->mutex);
+  while (pipe->used == 0 && !pipe->closed) {
+    pthread_cond_wait(&pipe->filled, &pipe->mutex);
+  }
+  // Remaining slots are still drained after a regular end of the stream, but
+  // discarded if the pipeline was closed due to an error.
+  char* slot = NULL;
+  if (pipe->used > 0 && pipe->err == ESP_OK) {
+    slot = &pipe->data[pipe->tail * pipe->slot_size];
+    *length = pipe->lengths[pipe->tail];
+  }
+  pthread_mutex_unlock(&pipe->mutex);
+
+  return slot;
+}
+
+void pipeline_release(pipeline_t* pipe) {
+  pthread_mutex_lock(&pipe->mutex);
+  pipe->tail = (pipe->tail + 1) % pipe->slot_count;
+  pipe->used -= 1;
+  pthread_cond_signal(&pipe->drained);
+  pthread_mutex_unlock(&pipe->mutex);
+}
+
+void pipeline_close(pipeline_t* pipe, esp_err_t err) {
+  pthread_mutex_lock(&pipe->mutex);
+  if (!pipe->closed || pipe->err == ESP_OK) {
+    pipe->err = err;
+  }
+  pipe->closed = true;
+  pthread_cond_broadcast(&pipe->filled);
+  pthread_cond_broadcast(&pipe->drained);
+  pthread_mutex_unlock(&pipe->mutex);
+}
+
+esp_err_t pipeline_error(pipeline_t* pipe) {
+  pthread_mutex_lock(&pipe->mutex);
+  esp_err_t err = pipe->err;
+  pthread_mutex_unlock(&pipe->mutex);
+
+  return err;
+}
@@ -0,0 +1,117 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "esp_err.h"
+
+/**
+ * A bounded ring of equally sized buffers that hands data from a single
+ * producer thread to a single consumer thread. This allows the producer, such
+ * as a network download, to fill the next buffer while the consumer, such as a
+ * flash write, is still busy with the previous one.
+ *
+ * @param data Memory backing all slots.
+ * @param lengths Number of valid bytes in each slot.
+ * @param slot_size Capacity of a single slot in bytes.
+ * @param slot_count Number of slots in the ring.
+ * @param head Index of the next slot to be filled by the producer.
+ * @param tail Index of the next slot to be drained by the consumer.
+ * @param used Number of filled slots that have not been drained yet.
+ * @param closed Indicates that no further slots will be filled.
+ * @param err The reason for closing the pipeline, where ESP_OK means that the
+ * stream ended regularly.
+ */
+typedef struct pipeline {
+  char* data;
+  size_t* lengths;
+  size_t slot_size;
+  size_t slot_count;
+  size_t head;
+  size_t tail;
+  size_t used;
+  bool closed;
+  esp_err_t err;
+  pthread_mutex_t mutex;
+  pthread_cond_t filled;
+  pthread_cond_t drained;
+} pipeline_t;
+
+/**
+ * Allocate the slots of a pipeline and initialize its synchronization
+ * primitives.
+ *
+ * @param[out] pipe A pointer to the pipeline.
+ * @param[in] slot_count Number of slots in the ring.
+ * @param[in] slot_size Capacity of a single slot in bytes.
+ *
+ * @return ESP_OK or ESP_ERR_NO_MEM if the slots can't be allocated.
+ */
+esp_err_t pipeline_init(pipeline_t* pipe, size_t slot_count, size_t slot_size);
+
+/**
+ * Release all resources of a pipeline. Both threads must have stopped using the
+ * pipeline before calling this.
+ *
+ * @param[in] pipe A pointer to the pipeline.
+ */
+void pipeline_deinit(pipeline_t* pipe);
+
+/**
+ * Obtain the next empty slot, blocking until the consumer has drained one.
+ * Calling this again without committing returns the same slot, which allows
+ * the producer to discard data.
+ *
+ * @param[in] pipe A pointer to the pipeline.
+ *
+ * @return A slot of `slot_size` bytes or NULL if the pipeline was closed.
+ */
+char* pipeline_acquire(pipeline_t* pipe);
+
+/**
+ * Hand the slot obtained by `pipeline_acquire()` over to the consumer.
+ *
+ * @param[in] pipe A pointer to the pipeline.
+ * @param[in] length Number of valid bytes in the slot.
+ */
+void pipeline_commit(pipeline_t* pipe, size_t length);
+
+/**
+ * Obtain the next filled slot, blocking until the producer has committed one.
+ *
+ * @param[in] pipe A pointer to the pipeline.
+ * @param[out] length Number of valid bytes in the slot.
+ *
+ * @return A slot or NULL if the pipeline was closed and all slots were drained
+ * or if the pipeline was closed due to an error.
+ */
+char* pipeline_peek(pipeline_t* pipe, size_t* length);
+
+/**
+ * Return the slot obtained by `pipeline_peek()` to the producer.
+ *
+ * @param[in] pipe A pointer to the pipeline.
+ */
+void pipeline_release(pipeline_t* pipe);
+
+/**
+ * Close the pipeline and wake up both threads. Only the first reason is kept,
+ * so an error can't be overwritten by a regular end of the stream.
+ *
+ * @param[in] pipe A pointer to the pipeline.
+ * @param[in] err ESP_OK if the stream ended regularly or an error otherwise.
+ */
+void pipeline_close(pipeline_t* pipe, esp_err_t err);
+
+/**
+ * Get the reason why the pipeline was closed.
+ *
+ * @param[in] pipe A pointer to the pipeline.
+ *
+ * @return ESP_OK if the pipeline is open or ended regularly.
+ */
+esp_err_t pipeline_error(pipeline_t* pipe);
+
+#endif
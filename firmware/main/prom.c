@@ -0,0 +1,417 @@
+#include "prom.h"
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "pb.h"
+
+// Fields of the MetricFamily message.
+#define PROM_FAMILY_NAME 1
+#define PROM_FAMILY_HELP 2
+#define PROM_FAMILY_TYPE 3
+#define PROM_FAMILY_METRIC 4
+// Fields of the Metric message.
+#define PROM_METRIC_LABEL 1
+#define PROM_METRIC_GAUGE 2
+#define PROM_METRIC_COUNTER 3
+#define PROM_METRIC_HISTOGRAM 7
+// Fields of the LabelPair message.
+#define PROM_LABEL_NAME 1
+#define PROM_LABEL_VALUE 2
+// Field of the value of the Counter and the Gauge messages.
+#define PROM_VALUE 1
+// Fields of the Histogram message.
+#define PROM_HISTOGRAM_COUNT 1
+#define PROM_HISTOGRAM_SUM 2
+#define PROM_HISTOGRAM_BUCKET 3
+// Fields of the Bucket message.
+#define PROM_BUCKET_COUNT 1
+#define PROM_BUCKET_BOUND 2
+// Values of the MetricType enum.
+#define PROM_TYPE_COUNTER 0
+#define PROM_TYPE_GAUGE 1
+#define PROM_TYPE_HISTOGRAM 4
+// Largest magnitude up to which all integers are exactly representable.
+#define PROM_EXACT_INTEGER 9007199254740992.0
+
+/**
+ * Check whether a part of a header, without surrounding whitespace and
+ * quotes, equals a token regardless of case.
+ *
+ * @param[in] start The start of the part.
+ * @param[in] end The end of the part.
+ * @param[in] token The token.
+ *
+ * @return true if the part equals the token.
+ */
+static bool prom_token(const char* start, const char* end,
+                       const char* token) {
+  while (start < end && (*start == ' ' || *start == '\t')) {
+    ++start;
+  }
+  while (end > start && (end[-1] == ' ' || end[-1] == '\t')) {
+    --end;
+  }
+  if (end - start >= 2 && *start == '"' && end[-1] == '"') {
+    ++start;
+    --end;
+  }
+  size_t length = strlen(token);
+  return (size_t)(end - start) == length &&
+         strncasecmp(start, token, length) == 0;
+}
+
+/**
+ * Raise the qualities of the formats with a media range of an Accept header.
+ *
+ * @param[in] range The media range, such as `text/plain;q=0.5`.
+ * @param[in] end The end of the media range.
+ * @param[in,out] protobuf The quality of the protobuf format.
+ * @param[in,out] text The quality of the text format.
+ */
+static void prom_accept_range(const char* range, const char* end,
+                              double* protobuf, double* text) {
+  const char* param = memchr(range, ';', end - range);
+  const char* type_end = param != NULL ? param : end;
+  bool is_protobuf =
+      prom_token(range, type_end, "application/vnd.google.protobuf");
+  // Scrapers asking for OpenMetrics also understand the text format.
+  bool is_text = prom_token(range, type_end, "text/plain") ||
+                 prom_token(range, type_end, "text/*") ||
+                 prom_token(range, type_end, "*/*") ||
+                 prom_token(range, type_end, "application/openmetrics-text");
+
+  bool family = false;
+  bool delimited = false;
+  double quality = 1;
+  while (param != NULL) {
+    const char* name = param + 1;
+    param = memchr(name, ';', end - name);
+    const char* param_end = param != NULL ? param : end;
+    const char* equals = memchr(name, '=', param_end - name);
+    if (equals == NULL) {
+      continue;
+    }
+    if (prom_token(name, equals, "q")) {
+      quality = strtod(equals + 1, NULL);
+    } else if (prom_token(name, equals, "proto")) {
+      family = prom_token(equals + 1, param_end,
+                          "io.prometheus.client.MetricFamily");
+    } else if (prom_token(name, equals, "encoding")) {
+      delimited = prom_token(equals + 1, param_end, "delimited");
+    }
+  }
+
+  if (is_protobuf && family && delimited && quality > *protobuf) {
+    *protobuf = quality;
+  }
+  if (is_text && quality > *text) {
+    *text = quality;
+  }
+}
+
+prom_format_t prom_negotiate(const char* accept) {
+  if (accept == NULL) {
+    return PROM_TEXT;
+  }
+
+  double protobuf = 0;
+  double text = 0;
+  while (*accept != 0) {
+    size_t length = strcspn(accept, ",");
+    prom_accept_range(accept, accept + length, &protobuf, &text);
+    accept += length;
+    if (*accept == ',') {
+      ++accept;
+    }
+  }
+  return protobuf > 0 && protobuf >= text ? PROM_PROTOBUF : PROM_TEXT;
+}
+
+const char* prom_content_type(prom_format_t format) {
+  return format == PROM_PROTOBUF ? PROM_PROTOBUF_CONTENT_TYPE
+                                 : PROM_CONTENT_TYPE;
+}
+
+void prom_init(prom_t* prom, outbuf_t* out, prom_format_t format) {
+  prom->out = out;
+  prom->format = format;
+}
+
+/**
+ * Write the HELP and TYPE lines that precede the samples of a metric family.
+ *
+ * @param[in] out The output buffer receiving the text.
+ * @param[in] name The name of the metric family.
+ * @param[in] type The type of the metric family, such as "counter".
+ * @param[in] help A description of the metric family.
+ */
+static void prom_text_family(outbuf_t* out, const char* name,
+                             const char* type, const char* help) {
+  outbuf_printf(out, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+/**
+ * Write a label value, escaping backslashes, quotes and line feeds.
+ *
+ * @param[in] out The output buffer receiving the text.
+ * @param[in] value The label value.
+ */
+static void prom_text_escape(outbuf_t* out, const char* value) {
+  for (;;) {
+    size_t length = strcspn(value, "\\\"\n");
+    outbuf_write(out, value, length);
+    value += length;
+    if (*value == 0) {
+      return;
+    }
+    outbuf_write(out,
+                 *value == '\n'  ? "\\n"
+                 : *value == '"' ? "\\\""
+                                 : "\\\\",
+                 2);
+    ++value;
+  }
+}
+
+/**
+ * Write a sample value, exactly if it is an integer.
+ *
+ * @param[in] out The output buffer receiving the text.
+ * @param[in] value The value.
+ */
+static void prom_text_value(outbuf_t* out, double value) {
+  if (isnan(value)) {
+    outbuf_puts(out, " NaN\n");
+  } else if (isinf(value)) {
+    outbuf_puts(out, value > 0 ? " +Inf\n" : " -Inf\n");
+  } else if (fabs(value) < PROM_EXACT_INTEGER &&
+             value == (double)(int64_t)value) {
+    outbuf_printf(out, " %" PRId64 "\n", (int64_t)value);
+  } else {
+    outbuf_printf(out, " %.9g\n", value);
+  }
+}
+
+/**
+ * Write a sample of a counter or a gauge in the text format.
+ *
+ * @param[in] out The output buffer receiving the text.
+ * @param[in] name The name of the metric.
+ * @param[in] sample The sample.
+ */
+static void prom_text_sample(outbuf_t* out, const char* name,
+                             const prom_sample_t* sample) {
+  outbuf_puts(out, name);
+  for (size_t i = 0; i < sample->label_count; ++i) {
+    outbuf_write(out, i == 0 ? "{" : ",", 1);
+    outbuf_puts(out, sample->labels[i].name);
+    outbuf_write(out, "=\"", 2);
+    prom_text_escape(out, sample->labels[i].value);
+    outbuf_write(out, "\"", 1);
+  }
+  if (sample->label_count > 0) {
+    outbuf_write(out, "}", 1);
+  }
+  prom_text_value(out, sample->value);
+}
+
+/**
+ * Get the size of the labels of a sample in a Metric message.
+ *
+ * @param[in] sample The sample.
+ *
+ * @return Number of bytes.
+ */
+static size_t prom_labels_size(const prom_sample_t* sample) {
+  size_t size = 0;
+  for (size_t i = 0; i < sample->label_count; ++i) {
+    size_t label_size =
+        pb_string_size(PROM_LABEL_NAME, sample->labels[i].name) +
+        pb_string_size(PROM_LABEL_VALUE, sample->labels[i].value);
+    size += pb_length_size(PROM_METRIC_LABEL, label_size);
+  }
+  return size;
+}
+
+/**
+ * Write the labels of a sample in a Metric message.
+ *
+ * @param[in] out The output buffer.
+ * @param[in] sample The sample.
+ */
+static void prom_labels(outbuf_t* out, const prom_sample_t* sample) {
+  for (size_t i = 0; i < sample->label_count; ++i) {
+    const prom_label_t* label = &sample->labels[i];
+    pb_length(out, PROM_METRIC_LABEL,
+              pb_string_size(PROM_LABEL_NAME, label->name) +
+                  pb_string_size(PROM_LABEL_VALUE, label->value));
+    pb_string(out, PROM_LABEL_NAME, label->name);
+    pb_string(out, PROM_LABEL_VALUE, label->value);
+  }
+}
+
+/**
+ * Write a counter or a gauge family as a delimited MetricFamily message.
+ *
+ * @param[in] out The output buffer.
+ * @param[in] name The name of the metric family.
+ * @param[in] type The type of the metric family.
+ * @param[in] help A description of the metric family.
+ * @param[in] samples The samples.
+ * @param[in] count Number of samples.
+ */
+static void prom_protobuf_family(outbuf_t* out, const char* name,
+                                 prom_type_t type, const char* help,
+                                 const prom_sample_t* samples, size_t count) {
+  uint32_t value_field =
+      type == PROM_COUNTER ? PROM_METRIC_COUNTER : PROM_METRIC_GAUGE;
+  uint64_t type_value =
+      type == PROM_COUNTER ? PROM_TYPE_COUNTER : PROM_TYPE_GAUGE;
+  size_t value_size = pb_length_size(value_field, pb_double_size(PROM_VALUE));
+
+  size_t size = pb_string_size(PROM_FAMILY_NAME, name) +
+                pb_string_size(PROM_FAMILY_HELP, help) +
+                pb_uint64_size(PROM_FAMILY_TYPE, type_value);
+  for (size_t i = 0; i < count; ++i) {
+    size += pb_length_size(PROM_FAMILY_METRIC,
+                           prom_labels_size(&samples[i]) + value_size);
+  }
+
+  pb_varint(out, size);
+  pb_string(out, PROM_FAMILY_NAME, name);
+  pb_string(out, PROM_FAMILY_HELP, help);
+  pb_uint64(out, PROM_FAMILY_TYPE, type_value);
+  for (size_t i = 0; i < count; ++i) {
+    pb_length(out, PROM_FAMILY_METRIC,
+              prom_labels_size(&samples[i]) + value_size);
+    prom_labels(out, &samples[i]);
+    pb_length(out, value_field, pb_double_size(PROM_VALUE));
+    pb_double(out, PROM_VALUE, samples[i].value);
+  }
+}
+
+void prom_family(prom_t* prom, const char* name, prom_type_t type,
+                 const char* help, const prom_sample_t* samples,
+                 size_t count) {
+  if (prom->format == PROM_PROTOBUF) {
+    prom_protobuf_family(prom->out, name, type, help, samples, count);
+    return;
+  }
+
+  prom_text_family(prom->out, name, type == PROM_COUNTER ? "counter" : "gauge",
+                   help);
+  for (size_t i = 0; i < count; ++i) {
+    prom_text_sample(prom->out, name, &samples[i]);
+  }
+}
+
+/**
+ * Write a histogram family in the text format.
+ *
+ * @param[in] out The output buffer receiving the text.
+ * @param[in] name The name of the metric family.
+ * @param[in] help A description of the metric family.
+ * @param[in] histogram The histogram.
+ */
+static void prom_text_histogram(outbuf_t* out, const char* name,
+                                const char* help,
+                                const prom_histogram_t* histogram) {
+  prom_text_family(out, name, "histogram", help);
+
+  uint64_t cumulative = 0;
+  for (size_t i = 0; i <= histogram->bound_count; ++i) {
+    cumulative += histogram->buckets[i];
+    outbuf_puts(out, name);
+    if (i < histogram->bound_count) {
+      outbuf_printf(out, "_bucket{le=\"%.9g\"} %" PRIu64 "\n",
+                    histogram->bounds[i] * histogram->scale, cumulative);
+    } else {
+      outbuf_printf(out, "_bucket{le=\"+Inf\"} %" PRIu64 "\n", cumulative);
+    }
+  }
+
+  outbuf_puts(out, name);
+  outbuf_printf(out, "_sum %.9g\n", histogram->sum * histogram->scale);
+  outbuf_puts(out, name);
+  outbuf_printf(out, "_count %" PRIu64 "\n", cumulative);
+}
+
+/**
+ * Get the size of the Histogram message of a histogram. The bucket above the
+ * last bound is implied by the count of observations.
+ *
+ * @param[in] histogram The histogram.
+ *
+ * @return Number of bytes.
+ */
+static size_t prom_histogram_size(const prom_histogram_t* histogram) {
+  uint64_t cumulative = 0;
+  size_t size = 0;
+  for (size_t i = 0; i < histogram->bound_count; ++i) {
+    cumulative += histogram->buckets[i];
+    size += pb_length_size(PROM_HISTOGRAM_BUCKET,
+                           pb_uint64_size(PROM_BUCKET_COUNT, cumulative) +
+                               pb_double_size(PROM_BUCKET_BOUND));
+  }
+  cumulative += histogram->buckets[histogram->bound_count];
+  return size + pb_uint64_size(PROM_HISTOGRAM_COUNT, cumulative) +
+         pb_double_size(PROM_HISTOGRAM_SUM);
+}
+
+/**
+ * Write a histogram family as a delimited MetricFamily message.
+ *
+ * @param[in] out The output buffer.
+ * @param[in] name The name of the metric family.
+ * @param[in] help A description of the metric family.
+ * @param[in] histogram The histogram.
+ */
+static void prom_protobuf_histogram(outbuf_t* out, const char* name,
+                                    const char* help,
+                                    const prom_histogram_t* histogram) {
+  size_t histogram_size = prom_histogram_size(histogram);
+  size_t metric_size = pb_length_size(PROM_METRIC_HISTOGRAM, histogram_size);
+  pb_varint(out, pb_string_size(PROM_FAMILY_NAME, name) +
+                     pb_string_size(PROM_FAMILY_HELP, help) +
+                     pb_uint64_size(PROM_FAMILY_TYPE, PROM_TYPE_HISTOGRAM) +
+                     pb_length_size(PROM_FAMILY_METRIC, metric_size));
+  pb_string(out, PROM_FAMILY_NAME, name);
+  pb_string(out, PROM_FAMILY_HELP, help);
+  pb_uint64(out, PROM_FAMILY_TYPE, PROM_TYPE_HISTOGRAM);
+  pb_length(out, PROM_FAMILY_METRIC, metric_size);
+  pb_length(out, PROM_METRIC_HISTOGRAM, histogram_size);
+
+  uint64_t count = 0;
+  for (size_t i = 0; i <= histogram->bound_count; ++i) {
+    count += histogram->buckets[i];
+  }
+  pb_uint64(out, PROM_HISTOGRAM_COUNT, count);
+  pb_double(out, PROM_HISTOGRAM_SUM, histogram->sum * histogram->scale);
+
+  uint64_t cumulative = 0;
+  for (size_t i = 0; i < histogram->bound_count; ++i) {
+    cumulative += histogram->buckets[i];
+    pb_length(out, PROM_HISTOGRAM_BUCKET,
+              pb_uint64_size(PROM_BUCKET_COUNT, cumulative) +
+                  pb_double_size(PROM_BUCKET_BOUND));
+    pb_uint64(out, PROM_BUCKET_COUNT, cumulative);
+    pb_double(out, PROM_BUCKET_BOUND,
+              histogram->bounds[i] * histogram->scale);
+  }
+}
+
+void prom_histogram(prom_t* prom, const char* name, const char* help,
+                    const prom_histogram_t* histogram) {
+  if (prom->format == PROM_PROTOBUF) {
+    prom_protobuf_histogram(prom->out, name, help, histogram);
+  } else {
+    prom_text_histogram(prom->out, name, help, histogram);
+  }
+}
@@ -0,0 +1,140 @@
+#ifndef PROM_H
+#define PROM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "outbuf.h"
+
+// Content type of the Prometheus text exposition format.
+#define PROM_CONTENT_TYPE "text/plain; version=0.0.4; charset=utf-8"
+// Content type of the Prometheus protobuf exposition format, a stream of
+// MetricFamily messages each preceded by its length.
+#define PROM_PROTOBUF_CONTENT_TYPE     \
+  "application/vnd.google.protobuf; " \
+  "proto=io.prometheus.client.MetricFamily; encoding=delimited"
+
+/**
+ * The exposition formats.
+ */
+typedef enum prom_format {
+  PROM_TEXT,
+  PROM_PROTOBUF,
+} prom_format_t;
+
+/**
+ * The types of metric families with a single value per sample.
+ */
+typedef enum prom_type {
+  PROM_COUNTER,
+  PROM_GAUGE,
+} prom_type_t;
+
+/**
+ * A label of a sample.
+ *
+ * @param name The name of the label.
+ * @param value The value of the label, which is escaped as needed.
+ */
+typedef struct prom_label {
+  const char* name;
+  const char* value;
+} prom_label_t;
+
+/**
+ * A sample of a counter or a gauge.
+ *
+ * @param labels The labels of the sample or NULL.
+ * @param label_count Number of labels.
+ * @param value The value of the sample.
+ */
+typedef struct prom_sample {
+  const prom_label_t* labels;
+  size_t label_count;
+  double value;
+} prom_sample_t;
+
+/**
+ * A histogram with cumulative buckets.
+ *
+ * @param bounds The upper bounds of the buckets, in ascending order.
+ * @param scale Factor converting the bounds and the sum to the base unit.
+ * @param buckets Number of observations per bucket, with an extra bucket for
+ * the observations above the last bound.
+ * @param bound_count Number of bounds.
+ * @param sum The sum of the observations, before scaling.
+ */
+typedef struct prom_histogram {
+  const uint32_t* bounds;
+  double scale;
+  const uint64_t* buckets;
+  size_t bound_count;
+  uint64_t sum;
+} prom_histogram_t;
+
+/**
+ * Writes metric families in an exposition format.
+ *
+ * @param out The output buffer receiving the encoded families.
+ * @param format The exposition format.
+ */
+typedef struct prom {
+  outbuf_t* out;
+  prom_format_t format;
+} prom_t;
+
+/**
+ * Choose the exposition format from the Accept header of a scrape. The
+ * protobuf format is only chosen when it is explicitly accepted with a
+ * quality that is at least the one of the text format.
+ *
+ * @param[in] accept The value of the Accept header or NULL if there is none.
+ *
+ * @return The exposition format.
+ */
+prom_format_t prom_negotiate(const char* accept);
+
+/**
+ * Get the content type of an exposition format.
+ *
+ * @param[in] format The exposition format.
+ *
+ * @return The content type.
+ */
+const char* prom_content_type(prom_format_t format);
+
+/**
+ * Prepare to write metric families.
+ *
+ * @param[out] prom The writer.
+ * @param[in] out The output buffer receiving the encoded families.
+ * @param[in] format The exposition format.
+ */
+void prom_init(prom_t* prom, outbuf_t* out, prom_format_t format);
+
+/**
+ * Write a counter or a gauge family with all its samples.
+ *
+ * @param[in] prom The writer.
+ * @param[in] name The name of the metric family.
+ * @param[in] type The type of the metric family.
+ * @param[in] help A description of the metric family.
+ * @param[in] samples The samples.
+ * @param[in] count Number of samples.
+ */
+void prom_family(prom_t* prom, const char* name, prom_type_t type,
+                 const char* help, const prom_sample_t* samples,
+                 size_t count);
+
+/**
+ * Write a histogram family with a single histogram without labels.
+ *
+ * @param[in] prom The writer.
+ * @param[in] name The name of the metric family.
+ * @param[in] help A description of the metric family.
+ * @param[in] histogram The histogram.
+ */
+void prom_histogram(prom_t* prom, const char* name, const char* help,
+                    const prom_histogram_t* histogram);
+
+#endif
@@ -0,0 +1,456 @@
+#include "push.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "batch.h"
+#include "energy.h"
+#include "esp_crt_bundle.h"
+#include "esp_http_client.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_netif_sntp.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "http.h"
+#include "meter.h"
+#include "metrics.h"
+#include "ring.h"
+#include "sdkconfig.h"
+#include "util.h"
+
+// Log prefix to be used.
+#define TAG "push"
+
+#ifdef CONFIG_ZEUS_PUSH
+
+// Size of the buffer holding the compressed body of a request.
+#define PUSH_BODY_SIZE (16 * 1024)
+// Size of the buffer holding the uncompressed protobuf of remote write.
+#define PUSH_SCRATCH_SIZE (16 * 1024)
+// Network timeout of a request in milliseconds.
+#define PUSH_TIMEOUT_MS (10 * 1000)
+// Stack size of the sampling thread.
+#define PUSH_SAMPLER_STACK_SIZE (3 * 1024)
+// Stack size of the sending thread, which runs the TLS handshake.
+#define PUSH_SENDER_STACK_SIZE (8 * 1024)
+// Delay before the first retry of a failed request in seconds.
+#define PUSH_BACKOFF_MIN_S 2
+// Maximum delay between retries in seconds.
+#define PUSH_BACKOFF_MAX_S 300
+// Maximum exponent of the backoff, which keeps the shift from overflowing.
+#define PUSH_BACKOFF_MAX_SHIFT 16
+// The first series of the outlets, after the series of the registered
+// metrics. Every registered metric has two series, so that a histogram can
+// export its sum and its count.
+#define PUSH_SERIES_OUTLETS (2 * METRICS_MAX)
+
+#ifdef CONFIG_ZEUS_PUSH_FORMAT_LINE
+#define PUSH_FORMAT BATCH_LINE
+#else
+#define PUSH_FORMAT BATCH_REMOTE_WRITE
+#endif
+
+/**
+ * Describes a per-outlet series that is taken from the readings.
+ *
+ * @param name The name of the metric.
+ * @param offset Offset of the value within a reading.
+ */
+typedef struct push_outlet_series {
+  const char* name;
+  size_t offset;
+} push_outlet_series_t;
+
+// The per-outlet series, which are followed by the energy of the outlet.
+static const push_outlet_series_t outlet_series[] = {
+    {"zeus_outlet_voltage_volts", offsetof(meter_reading_t, voltage_rms)},
+    {"zeus_outlet_current_amperes", offsetof(meter_reading_t, current_rms)},
+    {"zeus_outlet_power_watts", offsetof(meter_reading_t, real_power)},
+    {"zeus_outlet_apparent_power_voltamperes",
+     offsetof(meter_reading_t, apparent_power)},
+    {"zeus_outlet_power_factor", offsetof(meter_reading_t, power_factor)},
+    {"zeus_outlet_frequency_hertz", offsetof(meter_reading_t, frequency)},
+};
+// Number of series per outlet, including the energy.
+#define PUSH_OUTLET_FIELDS \
+  (sizeof(outlet_series) / sizeof(outlet_series[0]) + 1)
+
+// Indicates that the wall clock was synchronized, so samples can be taken.
+static _Atomic bool time_synced = false;
+// Hands the samples from the sampling to the sending thread.
+static ring_t queue;
+// The thread sampling the metrics.
+static pthread_t sampler_handle;
+// The thread sending the samples.
+static pthread_t sender_handle;
+
+// Counts samples accepted by the endpoint.
+static metrics_metric_t samples_total = METRICS_COUNTER_INIT(
+    "zeus_push_samples_total",
+    "Number of samples accepted by the push endpoint.");
+// Counts samples lost because the queue was full.
+static metrics_metric_t dropped_total = METRICS_COUNTER_INIT(
+    "zeus_push_dropped_samples_total",
+    "Number of samples dropped because the push queue was full.");
+// Counts samples the endpoint refused.
+static metrics_metric_t rejected_total = METRICS_COUNTER_INIT(
+    "zeus_push_rejected_samples_total",
+    "Number of samples dropped because the push endpoint rejected them.");
+// Counts requests to the endpoint.
+static metrics_metric_t requests_total = METRICS_COUNTER_INIT(
+    "zeus_push_requests_total", "Number of requests to the push endpoint.");
+// Counts requests that will be retried.
+static metrics_metric_t failures_total = METRICS_COUNTER_INIT(
+    "zeus_push_failures_total",
+    "Number of requests to the push endpoint that failed and are retried.");
+// Counts the bytes of the bodies before compression.
+static metrics_metric_t encoded_total = METRICS_COUNTER_INIT(
+    "zeus_push_encoded_bytes_total",
+    "Number of bytes of the pushed batches before compression.");
+// Counts the bytes of the bodies that were sent.
+static metrics_metric_t sent_total = METRICS_COUNTER_INIT(
+    "zeus_push_sent_bytes_total",
+    "Number of bytes of the pushed batches after compression.");
+// Tracks the samples waiting to be sent.
+static metrics_metric_t queue_gauge = METRICS_GAUGE_INIT(
+    "zeus_push_queue_samples", "Number of samples waiting to be pushed.");
+
+/**
+ * Note that the wall clock was synchronized.
+ *
+ * @param[in] tv The synchronized time.
+ */
+static void push_time_synced(struct timeval* tv) {
+  if (!atomic_exchange(&time_synced, true)) {
+    ESP_LOGI(TAG, "Synchronized wall clock");
+  }
+}
+
+/**
+ * Queue a sample for the sending thread. Must only be called by the
+ * sampling thread.
+ *
+ * @param[in] sample The sample.
+ */
+static void push_queue(const batch_sample_t* sample) {
+  if (ring_push(&queue, sample, 1) == 0) {
+    metrics_add(&dropped_total, 1);
+  }
+}
+
+/**
+ * Take a sample of all registered metrics and of the readings of all outlets.
+ */
+static void push_sample(void) {
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  batch_sample_t sample = {
+      .time_ms = (int64_t)now.tv_sec * 1000 + now.tv_usec / 1000,
+  };
+
+  size_t count = metrics_count();
+  for (size_t i = 0; i < count; ++i) {
+    metrics_metric_t* metric = metrics_get(i);
+    // The sum and the count of a histogram are read together.
+    metrics_snapshot_t snapshot;
+    metrics_snapshot(metric, &snapshot);
+    sample.series = (uint16_t)(2 * i);
+    sample.value = snapshot.value;
+    push_queue(&sample);
+    if (metric->type == METRICS_HISTOGRAM) {
+      sample.series += 1;
+      sample.value = (double)snapshot.count;
+      push_queue(&sample);
+    }
+  }
+
+  size_t outlet_count = meter_outlet_count();
+  for (size_t outlet = 0; outlet < outlet_count; ++outlet) {
+    uint16_t series =
+        (uint16_t)(PUSH_SERIES_OUTLETS + outlet * PUSH_OUTLET_FIELDS);
+    meter_reading_t reading;
+    if (meter_get_reading(outlet, &reading) == ESP_OK) {
+      for (size_t i = 0; i < PUSH_OUTLET_FIELDS - 1; ++i) {
+        sample.series = (uint16_t)(series + i);
+        sample.value =
+            *(const float*)((const char*)&reading + outlet_series[i].offset);
+        push_queue(&sample);
+      }
+    }
+    sample.series = (uint16_t)(series + PUSH_OUTLET_FIELDS - 1);
+    sample.value = (double)energy_get(outlet) / 1000;
+    push_queue(&sample);
+  }
+}
+
+/**
+ * Resolve a series into the name of its metric and its outlet.
+ *
+ * @param[in] ctx Unused.
+ * @param[in] series The series.
+ * @param[out] description Receives the name and the outlet.
+ */
+static void push_describe(void* ctx, uint16_t series,
+                          batch_series_t* description) {
+  if (series < PUSH_SERIES_OUTLETS) {
+    metrics_metric_t* metric = metrics_get(series / 2);
+    const char* suffix = "";
+    if (metric->type == METRICS_HISTOGRAM) {
+      suffix = series % 2 == 0 ? "_sum" : "_count";
+    }
+    snprintf(description->name, sizeof(description->name), "%s%s",
+             metric->name, suffix);
+    description->outlet = -1;
+    return;
+  }
+
+  size_t field = (series - PUSH_SERIES_OUTLETS) % PUSH_OUTLET_FIELDS;
+  snprintf(description->name, sizeof(description->name), "%s",
+           field < PUSH_OUTLET_FIELDS - 1 ? outlet_series[field].name
+                                          : "zeus_outlet_energy_joules_total");
+  description->outlet = (series - PUSH_SERIES_OUTLETS) / PUSH_OUTLET_FIELDS;
+}
+
+/**
+ * Calculate the delay before retrying a failed request. The delay grows
+ * exponentially, starting at PUSH_BACKOFF_MIN_S and capped at
+ * PUSH_BACKOFF_MAX_S. A random jitter keeps devices that lost the endpoint at
+ * the same time from retrying at the same time.
+ *
+ * @param[in] failures Number of consecutive failed requests.
+ *
+ * @return The delay in seconds.
+ */
+static uint32_t push_backoff(uint32_t failures) {
+  uint32_t shift = min(failures - 1, PUSH_BACKOFF_MAX_SHIFT);
+  uint32_t backoff = min(PUSH_BACKOFF_MIN_S << shift, PUSH_BACKOFF_MAX_S);
+
+  // Wait between 50 % and 100 % of the backoff.
+  return backoff / 2 + esp_random() % (backoff / 2 + 1);
+}
+
+/**
+ * Send the oldest samples of a batch. Batches whose body doesn't fit into the
+ * buffers are halved until it does.
+ *
+ * @param[in] client The HTTP client.
+ * @param[in] batch The encoder.
+ * @param[in] samples The samples waiting to be sent.
+ * @param[in,out] count Number of samples waiting to be sent, which receives
+ * the number of samples that are done with, whether they were accepted or
+ * rejected.
+ *
+ * @return ESP_OK if the samples are done with or an error if they have to be
+ * sent again.
+ */
+static esp_err_t push_send(esp_http_client_handle_t client, batch_t* batch,
+                           batch_sample_t* samples, size_t* count) {
+  size_t length = 0;
+  esp_err_t err = batch_encode(batch, samples, *count, &length);
+  while (err == ESP_ERR_NO_MEM && *count > 1) {
+    *count /= 2;
+    err = batch_encode(batch, samples, *count, &length);
+  }
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to encode samples: %s", esp_err_to_name(err));
+    metrics_add(&rejected_total, *count);
+    return ESP_OK;
+  }
+  metrics_add(&encoded_total, batch->encoded_length);
+
+  esp_http_client_set_post_field(client, batch->body, (int)length);
+  metrics_add(&requests_total, 1);
+  err = esp_http_client_perform(client);
+  int status = esp_http_client_get_status_code(client);
+  if (err == ESP_OK && status / 100 == 2) {
+    metrics_add(&samples_total, *count);
+    metrics_add(&sent_total, length);
+    return ESP_OK;
+  }
+
+  // Retrying a request that the endpoint refuses is futile, except for rate
+  // limiting.
+  if (err == ESP_OK && status / 100 == 4 && status != 429) {
+    ESP_LOGW(TAG, "Endpoint rejected %u samples: %d", (unsigned)*count,
+             status);
+    metrics_add(&rejected_total, *count);
+    return ESP_OK;
+  }
+
+  if (err == ESP_OK) {
+    ESP_LOGW(TAG, "Failed to push samples: %d", status);
+    err = ESP_FAIL;
+  } else {
+    ESP_LOGW(TAG, "Failed to push samples: %s", esp_err_to_name(err));
+  }
+  metrics_add(&failures_total, 1);
+  return err;
+}
+
+/**
+ * Periodically sample all metrics once the wall clock is synchronized.
+ *
+ * @param[in] arg Unused.
+ *
+ * @return NULL.
+ */
+static void* push_sampler_thread(void* arg) {
+  int64_t interval_us = CONFIG_ZEUS_PUSH_INTERVAL * 1000000LL;
+  int64_t next_sample_us = esp_timer_get_time();
+  while (1) {
+    // Keep the interval steady, regardless of the time sampling takes.
+    next_sample_us += interval_us;
+    int64_t now_us = esp_timer_get_time();
+    if (next_sample_us > now_us) {
+      usleep(next_sample_us - now_us);
+    } else {
+      next_sample_us = now_us;
+    }
+
+    if (atomic_load(&time_synced)) {
+      push_sample();
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ * Send the queued samples in batches, retrying failed requests with a
+ * backoff while the queue keeps filling.
+ *
+ * @param[in] arg Unused.
+ *
+ * @return NULL.
+ */
+static void* push_sender_thread(void* arg) {
+  char instance[BATCH_INSTANCE_SIZE];
+  uint8_t mac[6] = {0};
+  esp_read_mac(mac, ESP_MAC_ETH);
+  snprintf(instance, sizeof(instance), "%02x%02x%02x%02x%02x%02x", mac[0],
+           mac[1], mac[2], mac[3], mac[4], mac[5]);
+
+  batch_sample_t* samples =
+      malloc(CONFIG_ZEUS_PUSH_BATCH_SIZE * sizeof(batch_sample_t));
+  batch_t* batch = malloc(sizeof(batch_t));
+  char* body = malloc(PUSH_BODY_SIZE);
+  char* scratch = PUSH_FORMAT == BATCH_REMOTE_WRITE
+                      ? malloc(PUSH_SCRATCH_SIZE)
+                      : NULL;
+  if (samples == NULL || batch == NULL || body == NULL ||
+      (PUSH_FORMAT == BATCH_REMOTE_WRITE && scratch == NULL)) {
+    ESP_LOGE(TAG, "Failed to allocate batch");
+    free(samples);
+    free(batch);
+    free(body);
+    free(scratch);
+    return NULL;
+  }
+  batch_init(batch, PUSH_FORMAT, instance, push_describe, NULL, body,
+             PUSH_BODY_SIZE, scratch, PUSH_SCRATCH_SIZE);
+
+  char* user_agent = http_user_agent();
+  esp_http_client_config_t config = {
+      .url = CONFIG_ZEUS_PUSH_URL,
+      .method = HTTP_METHOD_POST,
+      .crt_bundle_attach = esp_crt_bundle_attach,
+      .timeout_ms = PUSH_TIMEOUT_MS,
+      .keep_alive_enable = true,
+      .user_agent = user_agent,
+  };
+  esp_http_client_handle_t client = esp_http_client_init(&config);
+  free(user_agent);
+  if (client == NULL) {
+    ESP_LOGE(TAG, "Failed to configure HTTP client");
+    return NULL;
+  }
+  esp_http_client_set_header(client, "Content-Encoding",
+                             batch_content_encoding(batch));
+  esp_http_client_set_header(client, "Content-Type",
+                             batch_content_type(batch));
+  if (PUSH_FORMAT == BATCH_REMOTE_WRITE) {
+    esp_http_client_set_header(client, "X-Prometheus-Remote-Write-Version",
+                               "0.1.0");
+  }
+
+  // The samples of a failed request are kept at the front of the batch, so
+  // that they are sent again before newer ones.
+  size_t count = 0;
+  uint32_t failures = 0;
+  while (1) {
+    sleep(failures == 0 ? CONFIG_ZEUS_PUSH_INTERVAL : push_backoff(failures));
+
+    esp_err_t err = ESP_OK;
+    while (err == ESP_OK) {
+      count += ring_pop(&queue, &samples[count],
+                        CONFIG_ZEUS_PUSH_BATCH_SIZE - count);
+      metrics_set(&queue_gauge, (int32_t)(count + ring_available(&queue)));
+      if (count == 0) {
+        break;
+      }
+
+      size_t done = count;
+      err = push_send(client, batch, samples, &done);
+      if (err == ESP_OK) {
+        count -= done;
+        memmove(samples, &samples[done], count * sizeof(batch_sample_t));
+      }
+    }
+    failures = err == ESP_OK ? 0 : failures + 1;
+  }
+
+  return NULL;
+}
+
+#endif
+
+esp_err_t push_init(void) {
+#ifdef CONFIG_ZEUS_PUSH
+  metrics_register(&samples_total);
+  metrics_register(&dropped_total);
+  metrics_register(&rejected_total);
+  metrics_register(&requests_total);
+  metrics_register(&failures_total);
+  metrics_register(&encoded_total);
+  metrics_register(&sent_total);
+  metrics_register(&queue_gauge);
+
+  esp_err_t err = ring_init(&queue, CONFIG_ZEUS_PUSH_QUEUE_SIZE,
+                            sizeof(batch_sample_t));
+  if (err != ESP_OK) {
+    return err;
+  }
+
+  // The clock is synchronized in the background once the network is up.
+  esp_sntp_config_t sntp_config =
+      ESP_NETIF_SNTP_DEFAULT_CONFIG(CONFIG_ZEUS_SNTP_SERVER);
+  sntp_config.sync_cb = push_time_synced;
+  err = esp_netif_sntp_init(&sntp_config);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to start SNTP: %s", esp_err_to_name(err));
+    return err;
+  }
+
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setstacksize(&attr, PUSH_SAMPLER_STACK_SIZE);
+  if (pthread_create(&sampler_handle, &attr, push_sampler_thread, NULL) != 0) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  pthread_attr_setstacksize(&attr, PUSH_SENDER_STACK_SIZE);
+  if (pthread_create(&sender_handle, &attr, push_sender_thread, NULL) != 0) {
+    return ESP_ERR_INVALID_STATE;
+  }
+#endif
+
+  return ESP_OK;
+}
@@ -0,0 +1,17 @@
+#ifndef PUSH_H
+#define PUSH_H
+
+#include "esp_err.h"
+
+/**
+ * Start synchronizing the wall clock and the threads that sample the metrics
+ * and push them to the configured endpoint, if pushing is enabled. Samples
+ * are queued in a ring of fixed size and sent in batches, so that an
+ * unreachable endpoint only costs the samples that overflow the queue.
+ *
+ * @return ESP_OK, ESP_ERR_NO_MEM if the queue can't be allocated or
+ * ESP_ERR_INVALID_STATE if the threads can't be started.
+ */
+esp_err_t push_init(void);
+
+#endif
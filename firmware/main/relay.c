@@ -0,0 +1,332 @@
+#include "relay.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "esp_log.h"
+#include "esp_pthread.h"
+#include "esp_timer.h"
+#include "metrics.h"
+#include "ring.h"
+#include "sdkconfig.h"
+
+// Log prefix to be used.
+#define TAG "relay"
+
+// Priority of the thread switching the relays, which is above the network
+// stack and the HTTP server, but below the sampling of the outlets.
+#define RELAY_PRIORITY 19
+
+/**
+ * A queued switching request.
+ *
+ * @param outlets Bit mask of the outlets to be switched.
+ * @param states Bit mask of the requested states.
+ * @param start_us The time at which the request arrived.
+ */
+typedef struct relay_command {
+  uint32_t outlets;
+  uint32_t states;
+  int64_t start_us;
+} relay_command_t;
+
+// The driver of the relays.
+static relay_driver_t driver;
+// Bit mask of the outlets that are on.
+static _Atomic uint32_t switched = 0;
+// Hands the commands to the relay thread without blocking it.
+static ring_t queue;
+// Serializes the threads submitting commands, as the queue has a single
+// producer.
+static pthread_mutex_t submit_mutex = PTHREAD_MUTEX_INITIALIZER;
+// Guards waking up the relay thread.
+static pthread_mutex_t wake_mutex = PTHREAD_MUTEX_INITIALIZER;
+// Signals the relay thread that a command was queued.
+static pthread_cond_t wake;
+// The time at which an outlet was last turned on.
+static int64_t last_on_us = INT64_MIN / 2;
+// Bit mask of the outlets waiting for their turn to be turned on, which is
+// only used by the relay thread.
+static uint32_t pending = 0;
+// The times at which the requests to turn on the pending outlets arrived.
+static int64_t pending_start_us[RELAY_MAX_OUTLETS];
+// Indicates that the relays were started.
+static _Atomic bool started = false;
+// The thread switching the relays.
+static pthread_t thread_handle;
+
+// Upper bounds of the latency from the request to the switching in
+// microseconds.
+static const uint32_t latency_bounds[] = {
+    100,   250,   500,   1000,   2500,   5000,
+    10000, 25000, 50000, 100000, 250000, 1000000,
+};
+// Counts queued commands.
+static metrics_metric_t commands_total = METRICS_COUNTER_INIT(
+    "zeus_relay_commands_total", "Number of queued switching commands.");
+// Counts commands rejected because the queue was full.
+static metrics_metric_t rejected_total = METRICS_COUNTER_INIT(
+    "zeus_relay_rejected_commands_total",
+    "Number of switching commands rejected because the queue was full.");
+// Counts relays that were switched.
+static metrics_metric_t switches_total = METRICS_COUNTER_INIT(
+    "zeus_relay_switches_total", "Number of times a relay was switched.");
+// Counts relays that couldn't be switched.
+static metrics_metric_t failures_total = METRICS_COUNTER_INIT(
+    "zeus_relay_failures_total",
+    "Number of times a relay couldn't be switched.");
+// Measures the time from the request to the switching of a relay.
+static metrics_metric_t latency_seconds = METRICS_HISTOGRAM_INIT(
+    "zeus_relay_actuation_latency_seconds",
+    "Time from a switching request to the switching of the relay, including "
+    "the stagger.",
+    latency_bounds, 1e-6);
+
+/**
+ * Switch the relay of an outlet and record the result.
+ *
+ * @param[in] outlet The index of the outlet.
+ * @param[in] on Indicates that the outlet is turned on.
+ * @param[in] start_us The time at which the request arrived.
+ */
+static void relay_switch(size_t outlet, bool on, int64_t start_us) {
+  esp_err_t err = driver.write(driver.ctx, outlet, on);
+  int64_t now_us = esp_timer_get_time();
+  if (err != ESP_OK) {
+    ESP_LOGW(TAG, "Failed to switch outlet %u: %s", (unsigned)outlet,
+             esp_err_to_name(err));
+    metrics_add(&failures_total, 1);
+    return;
+  }
+
+  if (on) {
+    atomic_fetch_or(&switched, 1UL << outlet);
+    last_on_us = now_us;
+  } else {
+    atomic_fetch_and(&switched, ~(1UL << outlet));
+  }
+  metrics_add(&switches_total, 1);
+  metrics_observe(&latency_seconds, (uint32_t)(now_us - start_us));
+}
+
+/**
+ * Execute a command. Outlets are turned off at once, while outlets that are
+ * turned on wait for their turn, so that the inrush currents of their loads
+ * don't add up.
+ *
+ * @param[in] command The command.
+ */
+static void relay_execute(const relay_command_t* command) {
+  uint32_t current = atomic_load(&switched);
+  uint32_t off = command->outlets & ~command->states;
+  uint32_t on = command->outlets & command->states & ~current & ~pending;
+
+  // An outlet that is turned off before its turn is not turned on anymore.
+  pending &= ~off;
+  for (size_t outlet = 0; outlet < driver.outlet_count; ++outlet) {
+    if (off & current & (1UL << outlet)) {
+      relay_switch(outlet, false, command->start_us);
+    }
+    if (on & (1UL << outlet)) {
+      pending_start_us[outlet] = command->start_us;
+    }
+  }
+  pending |= on;
+}
+
+/**
+ * Turn on the first pending outlet.
+ */
+static void relay_turn_on_next(void) {
+  size_t outlet = 0;
+  while ((pending & (1UL << outlet)) == 0) {
+    ++outlet;
+  }
+  pending &= ~(1UL << outlet);
+  relay_switch(outlet, true, pending_start_us[outlet]);
+}
+
+/**
+ * Wait until a command is queued or, while outlets are pending, at most until
+ * the next one is due.
+ *
+ * @param[in] wait_us The time until the next pending outlet is due.
+ */
+static void relay_wait(int64_t wait_us) {
+  struct timespec deadline = {0};
+  if (pending != 0) {
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += wait_us / 1000000;
+    deadline.tv_nsec += (wait_us % 1000000) * 1000;
+    if (deadline.tv_nsec >= 1000000000) {
+      deadline.tv_sec += 1;
+      deadline.tv_nsec -= 1000000000;
+    }
+  }
+
+  pthread_mutex_lock(&wake_mutex);
+  while (ring_available(&queue) == 0) {
+    if (pending == 0) {
+      pthread_cond_wait(&wake, &wake_mutex);
+    } else if (pthread_cond_timedwait(&wake, &wake_mutex, &deadline) ==
+               ETIMEDOUT) {
+      break;
+    }
+  }
+  pthread_mutex_unlock(&wake_mutex);
+}
+
+/**
+ * Execute the queued commands. The stagger is a deadline rather than a sleep,
+ * so that commands turning outlets off are executed while other outlets wait
+ * for their turn.
+ *
+ * @param[in] arg Unused.
+ *
+ * @return NULL.
+ */
+static void* relay_thread(void* arg) {
+  while (true) {
+    relay_command_t command;
+    while (ring_pop(&queue, &command, 1) == 1) {
+      relay_execute(&command);
+    }
+
+    int64_t wait_us = last_on_us + CONFIG_ZEUS_RELAY_STAGGER_MS * 1000LL -
+                      esp_timer_get_time();
+    if (pending != 0 && wait_us <= 0) {
+      relay_turn_on_next();
+    } else {
+      relay_wait(wait_us);
+    }
+  }
+
+  return NULL;
+}
+
+#ifdef CONFIG_ZEUS_RELAY_STUB
+/**
+ * Remember the states of the relays without switching anything, which stands
+ * in for the driver of the relay board.
+ *
+ * @param[in] ctx Unused.
+ * @param[in] outlet The index of the outlet.
+ * @param[in] on Indicates that the outlet is turned on.
+ *
+ * @return ESP_OK.
+ */
+static esp_err_t relay_stub_write(void* ctx, size_t outlet, bool on) {
+  ESP_LOGD(TAG, "Outlet %u %s", (unsigned)outlet, on ? "on" : "off");
+  return ESP_OK;
+}
+#endif
+
+esp_err_t relay_start(const relay_driver_t* config) {
+  if (config->outlet_count == 0 || config->outlet_count > RELAY_MAX_OUTLETS) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (atomic_load(&started)) {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  driver = *config;
+  esp_err_t err = ring_init(&queue, RELAY_QUEUE_SIZE, sizeof(relay_command_t));
+  if (err != ESP_OK) {
+    return err;
+  }
+
+  metrics_register(&commands_total);
+  metrics_register(&rejected_total);
+  metrics_register(&switches_total);
+  metrics_register(&failures_total);
+  metrics_register(&latency_seconds);
+
+  // Start from a known state, as the relays may have kept their state across
+  // a restart.
+  for (size_t outlet = 0; outlet < driver.outlet_count; ++outlet) {
+    driver.write(driver.ctx, outlet, false);
+  }
+
+  // Measure the stagger with a clock that is not affected by time
+  // adjustments.
+  pthread_condattr_t cond_attr;
+  pthread_condattr_init(&cond_attr);
+  pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&wake, &cond_attr);
+  pthread_condattr_destroy(&cond_attr);
+
+  // Switch the relays with a priority above the network stack.
+  esp_pthread_cfg_t cfg = esp_pthread_get_default_config();
+  cfg.prio = RELAY_PRIORITY;
+  cfg.thread_name = "relay";
+  esp_pthread_set_cfg(&cfg);
+  int ret = pthread_create(&thread_handle, NULL, relay_thread, NULL);
+  cfg = esp_pthread_get_default_config();
+  esp_pthread_set_cfg(&cfg);
+  if (ret != 0) {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  atomic_store(&started, true);
+
+  return ESP_OK;
+}
+
+esp_err_t relay_init(void) {
+#ifdef CONFIG_ZEUS_RELAY_STUB
+  relay_driver_t config = {
+      .write = relay_stub_write,
+      .ctx = NULL,
+      .outlet_count = CONFIG_ZEUS_METER_OUTLETS,
+  };
+  ESP_LOGW(TAG, "Switching stubbed relays");
+  return relay_start(&config);
+#else
+  // The relay board has no driver yet.
+  ESP_LOGW(TAG, "No relay driver configured");
+  return ESP_OK;
+#endif
+}
+
+size_t relay_outlet_count(void) {
+  return atomic_load(&started) ? driver.outlet_count : 0;
+}
+
+esp_err_t relay_submit(uint32_t outlets, uint32_t states, int64_t start_us) {
+  size_t outlet_count = relay_outlet_count();
+  if (outlet_count == 0 || (outlets >> outlet_count) != 0) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  relay_command_t command = {
+      .outlets = outlets,
+      .states = states,
+      .start_us = start_us,
+  };
+  pthread_mutex_lock(&submit_mutex);
+  size_t pushed = ring_push(&queue, &command, 1);
+  pthread_mutex_unlock(&submit_mutex);
+
+  if (pushed == 0) {
+    metrics_add(&rejected_total, 1);
+    return ESP_ERR_NO_MEM;
+  }
+  metrics_add(&commands_total, 1);
+
+  // Waking up under the mutex ensures the thread can't miss the command
+  // between checking the queue and waiting.
+  pthread_mutex_lock(&wake_mutex);
+  pthread_cond_signal(&wake);
+  pthread_mutex_unlock(&wake_mutex);
+
+  return ESP_OK;
+}
+
+bool relay_get(size_t outlet) {
+  return outlet < RELAY_MAX_OUTLETS && (atomic_load(&switched) >> outlet) & 1;
+}
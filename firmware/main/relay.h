@@ -0,0 +1,90 @@
+#ifndef RELAY_H
+#define RELAY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+// Maximum number of outlets that can be switched.
+#define RELAY_MAX_OUTLETS 16
+// Number of commands waiting for the relay thread.
+#define RELAY_QUEUE_SIZE 16
+
+/**
+ * Switch the relay of an outlet.
+ *
+ * @param[in] ctx The context of the driver.
+ * @param[in] outlet The index of the outlet.
+ * @param[in] on Indicates that the outlet is turned on.
+ *
+ * @return ESP_OK if the relay was switched.
+ */
+typedef esp_err_t (*relay_write_t)(void* ctx, size_t outlet, bool on);
+
+/**
+ * Describes how the relays are switched, such as through GPIOs or a stub
+ * that only remembers the states.
+ *
+ * @param write The function switching a relay.
+ * @param ctx The context passed to the function.
+ * @param outlet_count Number of outlets.
+ */
+typedef struct relay_driver {
+  relay_write_t write;
+  void* ctx;
+  size_t outlet_count;
+} relay_driver_t;
+
+/**
+ * Turn all outlets off and start the thread switching the relays.
+ *
+ * @param[in] driver The driver of the relays, which is copied.
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_ARG if the driver has too many outlets,
+ * ESP_ERR_NO_MEM if the queue can't be allocated or ESP_ERR_INVALID_STATE if
+ * the relays were already started or the thread can't be started.
+ */
+esp_err_t relay_start(const relay_driver_t* driver);
+
+/**
+ * Start switching the relays with the driver selected in the configuration.
+ *
+ * @return ESP_OK or the error of `relay_start()`.
+ */
+esp_err_t relay_init(void);
+
+/**
+ * Get the number of outlets that can be switched.
+ *
+ * @return Number of outlets or 0 if the relays were not started.
+ */
+size_t relay_outlet_count(void);
+
+/**
+ * Queue switching several outlets at once. Outlets that are turned on are
+ * staggered to limit the inrush current. This function is thread-safe and
+ * never waits for the relays.
+ *
+ * @param[in] outlets Bit mask of the outlets to be switched.
+ * @param[in] states Bit mask of the states, where a set bit turns the outlet
+ * on.
+ * @param[in] start_us The time at which the request arrived in microseconds,
+ * which is used to measure the latency of the switching.
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_ARG if an outlet doesn't exist or
+ * ESP_ERR_NO_MEM if the queue is full.
+ */
+esp_err_t relay_submit(uint32_t outlets, uint32_t states, int64_t start_us);
+
+/**
+ * Get the state of an outlet. This function is thread-safe.
+ *
+ * @param[in] outlet The index of the outlet.
+ *
+ * @return true if the relay of the outlet is on.
+ */
+bool relay_get(size_t outlet);
+
+#endif
@@ -0,0 +1,90 @@
+#include "ring.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util.h"
+
+/**
+ * Copy elements between a linear buffer and the ring, wrapping around at the
+ * end of the ring.
+ *
+ * @param[in] ring A pointer to the ring.
+ * @param[in] index Position of the first element in the ring.
+ * @param[in] buffer The linear buffer.
+ * @param[in] count Number of elements to be copied.
+ * @param[in] into_ring Indicates that the buffer is copied into the ring.
+ */
+static void ring_copy(ring_t* ring, size_t index, char* buffer, size_t count,
+                      bool into_ring) {
+  size_t offset = index & (ring->capacity - 1);
+  size_t first = min(count, ring->capacity - offset);
+  size_t size = ring->element_size;
+
+  char* slot = &ring->data[offset * size];
+  if (into_ring) {
+    memcpy(slot, buffer, first * size);
+    memcpy(ring->data, &buffer[first * size], (count - first) * size);
+  } else {
+    memcpy(buffer, slot, first * size);
+    memcpy(&buffer[first * size], ring->data, (count - first) * size);
+  }
+}
+
+esp_err_t ring_init(ring_t* ring, size_t capacity, size_t element_size) {
+  if (capacity == 0 || (capacity & (capacity - 1)) != 0) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+
+  ring->data = (char*)malloc(capacity * element_size);
+  if (ring->data == NULL) {
+    return ESP_ERR_NO_MEM;
+  }
+
+  ring->element_size = element_size;
+  ring->capacity = capacity;
+  atomic_init(&ring->head, 0);
+  atomic_init(&ring->tail, 0);
+
+  return ESP_OK;
+}
+
+void ring_deinit(ring_t* ring) {
+  free(ring->data);
+  ring->data = NULL;
+}
+
+size_t ring_push(ring_t* ring, const void* elements, size_t count) {
+  size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+  count = min(count, ring->capacity - (head - tail));
+  ring_copy(ring, head, (char*)elements, count, true);
+
+  // Publish the elements only after they were copied.
+  atomic_store_explicit(&ring->head, head + count, memory_order_release);
+
+  return count;
+}
+
+size_t ring_pop(ring_t* ring, void* elements, size_t count) {
+  size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+  count = min(count, head - tail);
+  ring_copy(ring, tail, (char*)elements, count, false);
+
+  // Release the slots only after they were copied.
+  atomic_store_explicit(&ring->tail, tail + count, memory_order_release);
+
+  return count;
+}
+
+size_t ring_available(ring_t* ring) {
+  size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+  return head - tail;
+}
@@ -0,0 +1,84 @@
+#ifndef RING_H
+#define RING_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+
+#include "esp_err.h"
+
+/**
+ * A bounded ring of equally sized elements that hands data from a single
+ * producer thread to a single consumer thread without locks. Unlike a
+ * pipeline, neither side ever blocks: the producer learns how much fits and the
+ * consumer how much is available, which suits real-time producers such as a
+ * sampling loop that must not wait for a busy consumer.
+ *
+ * @param data Memory backing all elements.
+ * @param element_size Size of an element in bytes.
+ * @param capacity Number of elements, which is a power of two.
+ * @param head Number of elements pushed so far, only written by the producer.
+ * @param tail Number of elements popped so far, only written by the consumer.
+ */
+typedef struct ring {
+  char* data;
+  size_t element_size;
+  size_t capacity;
+  _Atomic size_t head;
+  _Atomic size_t tail;
+} ring_t;
+
+/**
+ * Allocate the elements of a ring.
+ *
+ * @param[out] ring A pointer to the ring.
+ * @param[in] capacity Number of elements, which must be a power of two.
+ * @param[in] element_size Size of an element in bytes.
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_SIZE if the capacity is not a power of two or
+ * ESP_ERR_NO_MEM if the elements can't be allocated.
+ */
+esp_err_t ring_init(ring_t* ring, size_t capacity, size_t element_size);
+
+/**
+ * Release the elements of a ring. Both threads must have stopped using the
+ * ring before calling this.
+ *
+ * @param[in] ring A pointer to the ring.
+ */
+void ring_deinit(ring_t* ring);
+
+/**
+ * Append as many elements as fit into the ring. Must only be called by the
+ * producer.
+ *
+ * @param[in] ring A pointer to the ring.
+ * @param[in] elements The elements to be appended.
+ * @param[in] count Number of elements to be appended.
+ *
+ * @return Number of elements that were appended.
+ */
+size_t ring_push(ring_t* ring, const void* elements, size_t count);
+
+/**
+ * Remove the oldest elements from the ring. Must only be called by the
+ * consumer.
+ *
+ * @param[in] ring A pointer to the ring.
+ * @param[out] elements Buffer receiving the elements.
+ * @param[in] count Maximum number of elements to be removed.
+ *
+ * @return Number of elements that were removed.
+ */
+size_t ring_pop(ring_t* ring, void* elements, size_t count);
+
+/**
+ * Get the number of elements that can be popped. Must only be called by the
+ * consumer.
+ *
+ * @param[in] ring A pointer to the ring.
+ *
+ * @return Number of elements in the ring.
+ */
+size_t ring_available(ring_t* ring);
+
+#endif
@@ -0,0 +1,190 @@
+#include "snappy.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Number of bytes at the end of a block that are never searched for matches,
+// so that four-byte loads near the end stay within the block.
+#define SNAPPY_MARGIN 15
+// Maximum length of a single copy.
+#define SNAPPY_MAX_COPY 64
+
+// Tags of the elements of the compressed data.
+#define SNAPPY_LITERAL 0
+#define SNAPPY_COPY_2 2
+
+/**
+ * Load four bytes in little-endian byte order.
+ *
+ * @param[in] data A pointer to the first byte.
+ *
+ * @return The loaded bytes.
+ */
+static inline uint32_t snappy_load(const uint8_t* data) {
+  return (uint32_t)data[0] | (uint32_t)data[1] << 8 |
+         (uint32_t)data[2] << 16 | (uint32_t)data[3] << 24;
+}
+
+/**
+ * Hash four bytes into an index of the hash table.
+ *
+ * @param[in] bytes The bytes.
+ *
+ * @return The index.
+ */
+static inline uint32_t snappy_hash(uint32_t bytes) {
+  return (bytes * 0x1e35a7bd) >> (32 - SNAPPY_TABLE_BITS);
+}
+
+/**
+ * Write a literal element.
+ *
+ * @param[out] op The position in the output.
+ * @param[in] literal The literal bytes.
+ * @param[in] length Number of literal bytes, at least one.
+ *
+ * @return The position after the element.
+ */
+static uint8_t* snappy_literal(uint8_t* op, const uint8_t* literal,
+                               size_t length) {
+  size_t n = length - 1;
+  if (n < 60) {
+    *op++ = (uint8_t)(SNAPPY_LITERAL | n << 2);
+  } else {
+    // Longer lengths follow the tag in little-endian byte order.
+    uint8_t* tag = op++;
+    size_t count = 0;
+    while (n > 0) {
+      *op++ = (uint8_t)n;
+      n >>= 8;
+      count++;
+    }
+    *tag = (uint8_t)(SNAPPY_LITERAL | (59 + count) << 2);
+  }
+  memcpy(op, literal, length);
+  return op + length;
+}
+
+/**
+ * Write copy elements of up to SNAPPY_MAX_COPY bytes each.
+ *
+ * @param[out] op The position in the output.
+ * @param[in] offset Distance back to the copied bytes.
+ * @param[in] length Number of copied bytes, at least four.
+ *
+ * @return The position after the elements.
+ */
+static uint8_t* snappy_copy(uint8_t* op, size_t offset, size_t length) {
+  while (length > 0) {
+    // Don't leave a remainder below four bytes, which couldn't be matched.
+    size_t chunk = length;
+    if (chunk > SNAPPY_MAX_COPY) {
+      chunk = length - SNAPPY_MAX_COPY < 4 ? SNAPPY_MAX_COPY - 4
+                                           : SNAPPY_MAX_COPY;
+    }
+    *op++ = (uint8_t)(SNAPPY_COPY_2 | (chunk - 1) << 2);
+    *op++ = (uint8_t)offset;
+    *op++ = (uint8_t)(offset >> 8);
+    length -= chunk;
+  }
+  return op;
+}
+
+/**
+ * Compress a block of at most SNAPPY_BLOCK_SIZE bytes.
+ *
+ * @param[in] block The uncompressed block.
+ * @param[in] length Number of bytes of the block.
+ * @param[out] op The position in the output.
+ * @param[in] table The hash table.
+ *
+ * @return The position after the compressed block.
+ */
+static uint8_t* snappy_block(const uint8_t* block, size_t length, uint8_t* op,
+                             uint16_t* table) {
+  size_t next_emit = 0;
+  if (length < SNAPPY_MARGIN) {
+    return length > 0 ? snappy_literal(op, block, length) : op;
+  }
+
+  memset(table, 0, SNAPPY_TABLE_SIZE * sizeof(uint16_t));
+  size_t limit = length - SNAPPY_MARGIN;
+  size_t ip = 1;
+  while (ip <= limit) {
+    // Skip ahead faster the longer no match is found, so that data that
+    // doesn't compress is passed through quickly.
+    uint32_t skip = 32;
+    size_t candidate = 0;
+    while (true) {
+      uint32_t bytes = snappy_load(&block[ip]);
+      uint32_t hash = snappy_hash(bytes);
+      candidate = table[hash];
+      table[hash] = (uint16_t)ip;
+      if (snappy_load(&block[candidate]) == bytes) {
+        break;
+      }
+      ip += skip++ >> 5;
+      if (ip > limit) {
+        goto done;
+      }
+    }
+
+    op = snappy_literal(op, &block[next_emit], ip - next_emit);
+    do {
+      size_t matched = 4;
+      while (ip + matched < length &&
+             block[candidate + matched] == block[ip + matched]) {
+        matched++;
+      }
+      op = snappy_copy(op, ip - candidate, matched);
+      ip += matched;
+      next_emit = ip;
+      if (ip > limit) {
+        goto done;
+      }
+
+      // Continue matching right away, as runs of matches are common.
+      table[snappy_hash(snappy_load(&block[ip - 1]))] = (uint16_t)(ip - 1);
+      uint32_t hash = snappy_hash(snappy_load(&block[ip]));
+      candidate = table[hash];
+      table[hash] = (uint16_t)ip;
+    } while (snappy_load(&block[candidate]) == snappy_load(&block[ip]));
+    ip++;
+  }
+
+done:
+  if (next_emit < length) {
+    op = snappy_literal(op, &block[next_emit], length - next_emit);
+  }
+  return op;
+}
+
+size_t snappy_max_length(size_t length) {
+  return 32 + length + length / 6;
+}
+
+size_t snappy_compress(const void* input, size_t length, void* output,
+                       uint16_t* table) {
+  const uint8_t* ip = (const uint8_t*)input;
+  uint8_t* op = (uint8_t*)output;
+
+  // The data starts with its uncompressed length as a varint.
+  size_t n = length;
+  while (n >= 0x80) {
+    *op++ = (uint8_t)(n | 0x80);
+    n >>= 7;
+  }
+  *op++ = (uint8_t)n;
+
+  for (size_t offset = 0; offset < length; offset += SNAPPY_BLOCK_SIZE) {
+    size_t block = length - offset;
+    if (block > SNAPPY_BLOCK_SIZE) {
+      block = SNAPPY_BLOCK_SIZE;
+    }
+    op = snappy_block(&ip[offset], block, op, table);
+  }
+
+  return (size_t)(op - (uint8_t*)output);
+}
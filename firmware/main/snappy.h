@@ -0,0 +1,43 @@
+#ifndef SNAPPY_H
+#define SNAPPY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Base-two logarithm of the number of entries of the hash table.
+#define SNAPPY_TABLE_BITS 10
+// Number of entries of the hash table, which remembers the most recent
+// position of every hashed four-byte sequence.
+#define SNAPPY_TABLE_SIZE (1 << SNAPPY_TABLE_BITS)
+// Size of the blocks that are compressed independently, which bounds the
+// offsets of copies to 16 bits.
+#define SNAPPY_BLOCK_SIZE 65536
+
+/**
+ * Get the maximum size of the compressed data, which is reached if the data
+ * doesn't compress at all.
+ *
+ * @param[in] length Number of bytes of the uncompressed data.
+ *
+ * @return Number of bytes.
+ */
+size_t snappy_max_length(size_t length);
+
+/**
+ * Compress data into the raw Snappy format, as used by the Prometheus
+ * remote-write protocol. Matches are found greedily through a hash table of
+ * fixed size, which trades some compression for speed and bounded memory.
+ *
+ * @param[in] input The uncompressed data.
+ * @param[in] length Number of bytes of the uncompressed data.
+ * @param[out] output Buffer receiving the compressed data, which must hold
+ * `snappy_max_length(length)` bytes.
+ * @param[in] table Hash table of SNAPPY_TABLE_SIZE entries, which is used as
+ * scratch memory.
+ *
+ * @return Number of bytes of the compressed data.
+ */
+size_t snappy_compress(const void* input, size_t length, void* output,
+                       uint16_t* table);
+
+#endif
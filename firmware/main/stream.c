@@ -0,0 +1,567 @@
+#include "stream.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "esp_log.h"
+#include "metrics.h"
+#include "ring.h"
+#include "sdkconfig.h"
+
+// Log prefix to be used.
+#define TAG "stream"
+
+// Number of readings buffered between the meter and the stream thread.
+#define STREAM_QUEUE_SIZE 128
+// Number of readings taken from the queue at once.
+#define STREAM_BATCH 16
+// Time between two passes of the stream thread in milliseconds.
+#define STREAM_INTERVAL_MS 20
+// Size of a frame, which is limited to a payload of 125 B so that the length
+// fits into the first header byte.
+#define STREAM_FRAME_SIZE (2 + 125)
+// Size of the subscription of a client.
+#define STREAM_QUERY_SIZE 96
+
+/**
+ * A reading queued for the clients.
+ *
+ * @param time_ms The time at the end of the cycle in milliseconds.
+ * @param voltage_rms The RMS voltage in volts.
+ * @param current_rms The RMS current in amperes.
+ * @param real_power The real power in watts.
+ * @param outlet The index of the outlet.
+ */
+typedef struct stream_point {
+  int64_t time_ms;
+  float voltage_rms;
+  float current_rms;
+  float real_power;
+  uint32_t outlet;
+} stream_point_t;
+
+/**
+ * A client of the stream endpoint. Frames are appended to the send buffer of
+ * the client and sent without blocking, so that a slow client only loses its
+ * own frames. As a frame may be sent partially, all frames of the socket go
+ * through the buffer, including the answers to control frames.
+ *
+ * @param fd The socket of the client or -1 if the entry is unused.
+ * @param server The HTTP server owning the socket.
+ * @param outlets Bit mask of the subscribed outlets.
+ * @param decimation Number of cycles per frame of each outlet.
+ * @param skipped Number of cycles skipped since the last frame per outlet.
+ * @param dropped Number of frames dropped because the buffer was full.
+ * @param closing Indicates that a close frame was queued, after which the
+ * socket is closed once the buffer is sent.
+ * @param fill Number of bytes in the buffer.
+ * @param buffer Frames that were not sent yet.
+ */
+typedef struct stream_client {
+  int fd;
+  httpd_handle_t server;
+  uint32_t outlets;
+  uint16_t decimation;
+  uint16_t skipped[METER_MAX_OUTLETS];
+  uint32_t dropped;
+  bool closing;
+  size_t fill;
+  char buffer[STREAM_BUFFER_SIZE];
+} stream_client_t;
+
+// The subscribed clients.
+static stream_client_t clients[CONFIG_ZEUS_STREAM_CLIENTS];
+// Guards the clients, which are shared by the stream and the server thread.
+static pthread_mutex_t clients_mutex = PTHREAD_MUTEX_INITIALIZER;
+// Number of subscribed clients, which allows skipping the queue without them.
+static _Atomic size_t active = 0;
+// Indicates that sending the buffers was queued on the server thread.
+static _Atomic bool flush_queued = false;
+// Hands the readings from the meter to the stream thread.
+static ring_t queue;
+// The thread encoding the frames.
+static pthread_t thread_handle;
+
+// Tracks the subscribed clients.
+static metrics_metric_t clients_gauge = METRICS_GAUGE_INIT(
+    "zeus_stream_clients", "Number of clients streaming readings.");
+// Counts frames queued for clients.
+static metrics_metric_t frames_total = METRICS_COUNTER_INIT(
+    "zeus_stream_frames_total", "Number of frames queued for clients.");
+// Counts frames dropped because a client was too slow.
+static metrics_metric_t dropped_frames_total = METRICS_COUNTER_INIT(
+    "zeus_stream_dropped_frames_total",
+    "Number of frames dropped because a client didn't keep up.");
+// Counts readings lost because the stream thread was too slow.
+static metrics_metric_t dropped_readings_total = METRICS_COUNTER_INIT(
+    "zeus_stream_dropped_readings_total",
+    "Number of readings lost because they couldn't be streamed in time.");
+
+/**
+ * Encode a reading as a final text frame of the WebSocket protocol.
+ *
+ * @param[out] frame Buffer receiving the frame.
+ * @param[in] point The reading.
+ *
+ * @return Length of the frame or 0 if it doesn't fit into the buffer.
+ */
+static size_t stream_encode(char frame[STREAM_FRAME_SIZE],
+                            const stream_point_t* point) {
+  int length = snprintf(&frame[2], STREAM_FRAME_SIZE - 2,
+                        "{\"outlet\":%u,\"time\":%lld,\"voltage\":%.6g,"
+                        "\"current\":%.6g,\"power\":%.6g}",
+                        (unsigned)point->outlet, (long long)point->time_ms,
+                        point->voltage_rms, point->current_rms,
+                        point->real_power);
+  if (length < 0 || length >= STREAM_FRAME_SIZE - 2) {
+    return 0;
+  }
+
+  frame[0] = (char)0x81;
+  frame[1] = (char)length;
+  return 2 + (size_t)length;
+}
+
+/**
+ * Append a reading to the buffers of the subscribed clients. The caller must
+ * hold the mutex of the clients.
+ *
+ * @param[in] point The reading.
+ */
+static void stream_fan_out(const stream_point_t* point) {
+  // The frame is only encoded once, when the first client needs it.
+  char frame[STREAM_FRAME_SIZE];
+  size_t length = 0;
+
+  for (size_t i = 0; i < CONFIG_ZEUS_STREAM_CLIENTS; ++i) {
+    stream_client_t* client = &clients[i];
+    if (client->fd < 0 || client->closing ||
+        (client->outlets & (1UL << point->outlet)) == 0) {
+      continue;
+    }
+
+    uint16_t* skipped = &client->skipped[point->outlet];
+    if (*skipped + 1 < client->decimation) {
+      *skipped += 1;
+      continue;
+    }
+    *skipped = 0;
+
+    if (length == 0) {
+      length = stream_encode(frame, point);
+      if (length == 0) {
+        return;
+      }
+    }
+
+    if (client->fill + length > STREAM_BUFFER_SIZE) {
+      client->dropped += 1;
+      metrics_add(&dropped_frames_total, 1);
+      continue;
+    }
+    memcpy(&client->buffer[client->fill], frame, length);
+    client->fill += length;
+    metrics_add(&frames_total, 1);
+  }
+}
+
+/**
+ * Check whether a socket accepts data without blocking.
+ *
+ * @param[in] fd The socket.
+ *
+ * @return true if at least one byte can be sent.
+ */
+static bool stream_writable(int fd) {
+  fd_set fds;
+  FD_ZERO(&fds);
+  FD_SET(fd, &fds);
+  struct timeval timeout = {0};
+  return select(fd + 1, NULL, &fds, NULL, &timeout) > 0;
+}
+
+/**
+ * Send as much of the buffer of a client as its socket accepts and close the
+ * socket once a queued close frame was sent. The caller must hold the mutex of
+ * the clients and run on the server thread.
+ *
+ * @param[in] server The HTTP server.
+ * @param[in] client The client.
+ */
+static void stream_send(httpd_handle_t server, stream_client_t* client) {
+  if (client->fill > 0 && stream_writable(client->fd)) {
+    int sent = httpd_socket_send(server, client->fd, client->buffer,
+                                 client->fill, MSG_DONTWAIT);
+    if (sent < 0 && sent != HTTPD_SOCK_ERR_TIMEOUT) {
+      ESP_LOGW(TAG, "Failed to send to socket %d", client->fd);
+      client->fill = 0;
+      httpd_sess_trigger_close(server, client->fd);
+      return;
+    }
+    if (sent > 0) {
+      memmove(client->buffer, &client->buffer[sent], client->fill - sent);
+      client->fill -= sent;
+    }
+  }
+
+  if (client->fill == 0 && client->closing) {
+    httpd_sess_trigger_close(server, client->fd);
+  }
+}
+
+/**
+ * Send as much of the buffers of the clients as their sockets accept. This
+ * runs on the server thread, which is the only one writing to the sockets of
+ * the clients, so that nothing is written between the parts of a frame that
+ * was sent partially.
+ *
+ * @param[in] arg The HTTP server.
+ */
+static void stream_flush(void* arg) {
+  httpd_handle_t server = (httpd_handle_t)arg;
+  atomic_store(&flush_queued, false);
+
+  pthread_mutex_lock(&clients_mutex);
+  for (size_t i = 0; i < CONFIG_ZEUS_STREAM_CLIENTS; ++i) {
+    stream_client_t* client = &clients[i];
+    if (client->fd < 0 || client->server != server) {
+      continue;
+    }
+    stream_send(server, client);
+  }
+  pthread_mutex_unlock(&clients_mutex);
+}
+
+/**
+ * Queue sending the buffers on the server thread unless it is queued already
+ * or all buffers are empty.
+ */
+static void stream_schedule_flush(void) {
+  pthread_mutex_lock(&clients_mutex);
+  for (size_t i = 0; i < CONFIG_ZEUS_STREAM_CLIENTS; ++i) {
+    stream_client_t* client = &clients[i];
+    if (client->fd < 0 || client->fill == 0) {
+      continue;
+    }
+
+    if (!atomic_exchange(&flush_queued, true) &&
+        httpd_queue_work(client->server, stream_flush, client->server) !=
+            ESP_OK) {
+      atomic_store(&flush_queued, false);
+    }
+    break;
+  }
+  pthread_mutex_unlock(&clients_mutex);
+}
+
+/**
+ * Pass the queued readings on to the clients.
+ *
+ * @param[in] arg Unused.
+ *
+ * @return NULL.
+ */
+static void* stream_thread(void* arg) {
+  static stream_point_t points[STREAM_BATCH];
+
+  while (true) {
+    size_t count;
+    while ((count = ring_pop(&queue, points, STREAM_BATCH)) > 0) {
+      pthread_mutex_lock(&clients_mutex);
+      for (size_t i = 0; i < count; ++i) {
+        stream_fan_out(&points[i]);
+      }
+      pthread_mutex_unlock(&clients_mutex);
+    }
+
+    // Buffers that a socket didn't accept are retried on every pass.
+    stream_schedule_flush();
+    usleep(STREAM_INTERVAL_MS * 1000);
+  }
+
+  return NULL;
+}
+
+/**
+ * Parse a subscription, such as "outlets=0,2&decimation=5". All outlets are
+ * subscribed unless they are listed and every cycle is streamed unless a
+ * decimation is given.
+ *
+ * @param[in] query The subscription.
+ * @param[out] outlets Receives the bit mask of the outlets.
+ * @param[out] decimation Receives the number of cycles per frame.
+ *
+ * @return ESP_OK or ESP_ERR_INVALID_ARG if the subscription is malformed.
+ */
+static esp_err_t stream_parse_subscription(const char* query, uint32_t* outlets,
+                                           uint16_t* decimation) {
+  size_t outlet_count = meter_outlet_count();
+  char value[64];
+  char* end;
+
+  *outlets = (uint32_t)((1ULL << outlet_count) - 1);
+  if (httpd_query_key_value(query, "outlets", value, sizeof(value)) ==
+      ESP_OK) {
+    *outlets = 0;
+    const char* cursor = value;
+    do {
+      long outlet = strtol(cursor, &end, 10);
+      if (end == cursor || outlet < 0 || outlet >= (long)outlet_count ||
+          (*end != ',' && *end != 0)) {
+        return ESP_ERR_INVALID_ARG;
+      }
+      *outlets |= 1UL << outlet;
+      cursor = end + 1;
+    } while (*end != 0);
+  }
+
+  *decimation = 1;
+  if (httpd_query_key_value(query, "decimation", value, sizeof(value)) ==
+      ESP_OK) {
+    long cycles = strtol(value, &end, 10);
+    if (*end != 0 || cycles < 1 || cycles > STREAM_MAX_DECIMATION) {
+      return ESP_ERR_INVALID_ARG;
+    }
+    *decimation = (uint16_t)cycles;
+  }
+
+  return ESP_OK;
+}
+
+/**
+ * Add a client or change its subscription.
+ *
+ * @param[in] server The HTTP server owning the socket.
+ * @param[in] fd The socket of the client.
+ * @param[in] outlets Bit mask of the subscribed outlets.
+ * @param[in] decimation Number of cycles per frame.
+ *
+ * @return ESP_OK or ESP_ERR_NO_MEM if there are too many clients.
+ */
+static esp_err_t stream_subscribe(httpd_handle_t server, int fd,
+                                  uint32_t outlets, uint16_t decimation) {
+  pthread_mutex_lock(&clients_mutex);
+
+  stream_client_t* client = NULL;
+  for (size_t i = 0; i < CONFIG_ZEUS_STREAM_CLIENTS; ++i) {
+    if (clients[i].fd == fd) {
+      client = &clients[i];
+      break;
+    }
+    if (clients[i].fd < 0 && client == NULL) {
+      client = &clients[i];
+    }
+  }
+
+  if (client == NULL) {
+    pthread_mutex_unlock(&clients_mutex);
+    return ESP_ERR_NO_MEM;
+  }
+
+  if (client->fd != fd) {
+    client->fd = fd;
+    client->server = server;
+    client->dropped = 0;
+    client->closing = false;
+    client->fill = 0;
+    size_t count = atomic_fetch_add(&active, 1) + 1;
+    metrics_set(&clients_gauge, count);
+  }
+  client->outlets = outlets;
+  client->decimation = decimation;
+  memset(client->skipped, 0, sizeof(client->skipped));
+
+  pthread_mutex_unlock(&clients_mutex);
+
+  return ESP_OK;
+}
+
+esp_err_t stream_init(void) {
+  metrics_register(&clients_gauge);
+  metrics_register(&frames_total);
+  metrics_register(&dropped_frames_total);
+  metrics_register(&dropped_readings_total);
+
+  for (size_t i = 0; i < CONFIG_ZEUS_STREAM_CLIENTS; ++i) {
+    clients[i].fd = -1;
+  }
+
+  esp_err_t err =
+      ring_init(&queue, STREAM_QUEUE_SIZE, sizeof(stream_point_t));
+  if (err != ESP_OK) {
+    return err;
+  }
+
+  if (pthread_create(&thread_handle, NULL, stream_thread, NULL) != 0) {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  return ESP_OK;
+}
+
+void stream_publish(size_t outlet, int64_t time_ms,
+                    const meter_reading_t* reading) {
+  if (atomic_load_explicit(&active, memory_order_relaxed) == 0) {
+    return;
+  }
+
+  stream_point_t point = {
+      .time_ms = time_ms,
+      .voltage_rms = reading->voltage_rms,
+      .current_rms = reading->current_rms,
+      .real_power = reading->real_power,
+      .outlet = (uint32_t)outlet,
+  };
+  if (ring_push(&queue, &point, 1) == 0) {
+    metrics_add(&dropped_readings_total, 1);
+  }
+}
+
+/**
+ * Answer a control frame of a client. The server leaves them to the endpoint,
+ * as its own answers could be written into the middle of a frame that was sent
+ * partially. Pings are answered with a pong and a close frame is echoed before
+ * the socket is closed, both through the send buffer of the client.
+ *
+ * @param[in] req The request.
+ * @param[in] frame The header of the control frame, whose payload wasn't
+ * received yet.
+ *
+ * @return ESP_OK or an error that closes the connection.
+ */
+static esp_err_t stream_control(httpd_req_t* req, httpd_ws_frame_t* frame) {
+  int fd = httpd_req_to_sockfd(req);
+  char answer[STREAM_FRAME_SIZE];
+
+  // The payload of control frames is limited to 125 B by the protocol.
+  if (frame->len > STREAM_FRAME_SIZE - 2) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+  frame->payload = (uint8_t*)&answer[2];
+  esp_err_t err = httpd_ws_recv_frame(req, frame, STREAM_FRAME_SIZE - 2);
+  if (err != ESP_OK || frame->type == HTTPD_WS_TYPE_PONG) {
+    return err;
+  }
+
+  bool closing = frame->type == HTTPD_WS_TYPE_CLOSE;
+  answer[0] =
+      (char)(0x80 | (closing ? HTTPD_WS_TYPE_CLOSE : HTTPD_WS_TYPE_PONG));
+  answer[1] = (char)frame->len;
+  size_t length = 2 + frame->len;
+
+  pthread_mutex_lock(&clients_mutex);
+  stream_client_t* client = NULL;
+  for (size_t i = 0; i < CONFIG_ZEUS_STREAM_CLIENTS; ++i) {
+    if (clients[i].fd == fd && clients[i].server == req->handle) {
+      client = &clients[i];
+      break;
+    }
+  }
+
+  if (client == NULL) {
+    // Nothing was queued for the socket, so the answer can be sent directly.
+    pthread_mutex_unlock(&clients_mutex);
+    if (httpd_socket_send(req->handle, fd, answer, length, 0) !=
+        (int)length) {
+      return ESP_FAIL;
+    }
+    return closing ? httpd_sess_trigger_close(req->handle, fd) : ESP_OK;
+  }
+
+  if (client->closing) {
+    // Nothing may follow the close frame that was queued already.
+  } else if (client->fill + length <= STREAM_BUFFER_SIZE) {
+    memcpy(&client->buffer[client->fill], answer, length);
+    client->fill += length;
+    client->closing = closing;
+  } else if (closing) {
+    // The client doesn't wait for the queued frames, so they are discarded.
+    client->fill = 0;
+    client->closing = true;
+  } else {
+    // A client this far behind is not worth answering.
+    client->dropped += 1;
+    metrics_add(&dropped_frames_total, 1);
+  }
+  stream_send(req->handle, client);
+  pthread_mutex_unlock(&clients_mutex);
+
+  return ESP_OK;
+}
+
+esp_err_t stream_endpoint(httpd_req_t* req) {
+  int fd = httpd_req_to_sockfd(req);
+  char query[STREAM_QUERY_SIZE] = {0};
+
+  if (req->method == HTTP_GET) {
+    // The handshake was answered, so the query holds the subscription.
+    httpd_req_get_url_query_str(req, query, sizeof(query));
+  } else {
+    // Every frame must be received completely to keep the socket in sync.
+    httpd_ws_frame_t frame = {0};
+    esp_err_t err = httpd_ws_recv_frame(req, &frame, 0);
+    if (err != ESP_OK) {
+      return err;
+    }
+    if (frame.type == HTTPD_WS_TYPE_PING || frame.type == HTTPD_WS_TYPE_PONG ||
+        frame.type == HTTPD_WS_TYPE_CLOSE) {
+      return stream_control(req, &frame);
+    }
+    if (frame.len >= sizeof(query)) {
+      ESP_LOGW(TAG, "Subscription of socket %d is too long", fd);
+      return ESP_ERR_INVALID_SIZE;
+    }
+    frame.payload = (uint8_t*)query;
+    err = httpd_ws_recv_frame(req, &frame, sizeof(query) - 1);
+    if (err != ESP_OK || frame.type != HTTPD_WS_TYPE_TEXT) {
+      return err;
+    }
+  }
+
+  uint32_t outlets;
+  uint16_t decimation;
+  esp_err_t err = stream_parse_subscription(query, &outlets, &decimation);
+  if (err != ESP_OK) {
+    ESP_LOGW(TAG, "Invalid subscription of socket %d: %s", fd, query);
+    return err;
+  }
+
+  err = stream_subscribe(req->handle, fd, outlets, decimation);
+  if (err != ESP_OK) {
+    ESP_LOGW(TAG, "Too many clients to subscribe socket %d", fd);
+  }
+
+  return err;
+}
+
+void stream_close(httpd_handle_t server, int fd) {
+  pthread_mutex_lock(&clients_mutex);
+  for (size_t i = 0; i < CONFIG_ZEUS_STREAM_CLIENTS; ++i) {
+    stream_client_t* client = &clients[i];
+    if (client->fd != fd || client->server != server) {
+      continue;
+    }
+
+    if (client->dropped > 0) {
+      ESP_LOGI(TAG, "Socket %d dropped %u frames", fd,
+               (unsigned)client->dropped);
+    }
+    client->fd = -1;
+    client->closing = false;
+    client->fill = 0;
+    size_t count = atomic_fetch_sub(&active, 1) - 1;
+    metrics_set(&clients_gauge, count);
+  }
+  pthread_mutex_unlock(&clients_mutex);
+
+  close(fd);
+}
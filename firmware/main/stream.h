@@ -0,0 +1,61 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+#include "meter.h"
+
+// Size of the send buffer of a client, which bounds the frames queued for a
+// slow client before further frames are dropped.
+#define STREAM_BUFFER_SIZE 1024
+// Maximum number of cycles that may be skipped between two frames.
+#define STREAM_MAX_DECIMATION 3000
+
+/**
+ * Start the thread that passes the readings of the outlets on to the clients
+ * of the stream endpoint.
+ *
+ * @return ESP_OK, ESP_ERR_NO_MEM if the queue can't be allocated or
+ * ESP_ERR_INVALID_STATE if the thread can't be started.
+ */
+esp_err_t stream_init(void);
+
+/**
+ * Queue the reading of a completed cycle for the clients that subscribed to
+ * the outlet. This function is lock-free and doesn't allocate memory, but
+ * must only be called from a single thread.
+ *
+ * @param[in] outlet The index of the outlet.
+ * @param[in] time_ms The time at the end of the cycle in milliseconds since
+ * the device was started.
+ * @param[in] reading The reading of the cycle.
+ */
+void stream_publish(size_t outlet, int64_t time_ms,
+                    const meter_reading_t* reading);
+
+/**
+ * Handle the WebSocket of a client. The handshake subscribes the client to
+ * the outlets and the decimation given in the query, such as
+ * "?outlets=0,2&decimation=5". Text frames with the same syntax change the
+ * subscription. Pings are answered by the endpoint, which must be registered
+ * with `is_websocket` and `handle_ws_control_frames` set.
+ *
+ * @param[in] req The request.
+ *
+ * @return ESP_OK or an error that closes the connection.
+ */
+esp_err_t stream_endpoint(httpd_req_t* req);
+
+/**
+ * Unsubscribe the client of a socket and close the socket. This is meant to
+ * be used as the `close_fn` of the HTTP server.
+ *
+ * @param[in] server The HTTP server.
+ * @param[in] fd The socket that is closed.
+ */
+void stream_close(httpd_handle_t server, int fd);
+
+#endif
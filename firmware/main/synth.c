@@ -0,0 +1,94 @@
+#include "synth.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "esp_timer.h"
+
+// Number of entries in the sine table, which is a power of two.
+#define SYNTH_TABLE_BITS 10
+#define SYNTH_TABLE_SIZE (1 << SYNTH_TABLE_BITS)
+// Peak of the voltage samples, which corresponds to 325 V.
+#define SYNTH_VOLTAGE_AMPLITUDE 8000
+// Volts per unit of a voltage sample.
+#define SYNTH_VOLTAGE_SCALE (325.0f / SYNTH_VOLTAGE_AMPLITUDE)
+// Amperes per unit of a current sample.
+#define SYNTH_CURRENT_SCALE 0.002f
+
+// A full turn of a sine wave scaled to the range of a sample.
+static int16_t sine[SYNTH_TABLE_SIZE];
+
+/**
+ * Look up the sine of a phase.
+ *
+ * @param[in] phase The phase, where 2^32 is a full turn.
+ * @param[in] amplitude The peak value.
+ *
+ * @return The scaled sine.
+ */
+static inline int16_t synth_sine(uint32_t phase, int16_t amplitude) {
+  return (int16_t)((sine[phase >> (32 - SYNTH_TABLE_BITS)] * amplitude) >> 15);
+}
+
+void synth_init(synth_t* synth, size_t outlet_count, uint32_t sample_rate,
+                uint32_t frequency, bool realtime) {
+  for (size_t i = 0; i < SYNTH_TABLE_SIZE; ++i) {
+    sine[i] = (int16_t)lrintf(32767 * sinf(2 * (float)M_PI * i /
+                                           SYNTH_TABLE_SIZE));
+  }
+
+  synth->outlet_count = outlet_count;
+  synth->sample_rate = sample_rate;
+  synth->phase = 0;
+  synth->step = (uint32_t)(((uint64_t)frequency << 32) / sample_rate);
+  synth->realtime = realtime;
+  synth->next_us = esp_timer_get_time();
+
+  // Outlet 0 is idle, the others draw a growing current with a growing phase
+  // lag.
+  for (size_t outlet = 0; outlet < outlet_count && outlet < METER_MAX_OUTLETS;
+       ++outlet) {
+    synth->current_amplitude[outlet] =
+        (int16_t)(outlet * 8000 / METER_MAX_OUTLETS);
+    synth->current_shift[outlet] = (uint32_t)(outlet * (UINT32_MAX / 72));
+  }
+}
+
+void synth_source(synth_t* synth, meter_source_t* source) {
+  source->read = synth_read;
+  source->ctx = synth;
+  source->outlet_count = synth->outlet_count;
+  source->sample_rate = synth->sample_rate;
+  source->voltage_scale = SYNTH_VOLTAGE_SCALE;
+  source->current_scale = SYNTH_CURRENT_SCALE;
+}
+
+esp_err_t synth_read(void* ctx, meter_sample_t* samples, size_t frames) {
+  synth_t* synth = (synth_t*)ctx;
+
+  // Deliver the frames no earlier than an ADC would.
+  if (synth->realtime) {
+    synth->next_us += frames * 1000000LL / synth->sample_rate;
+    int64_t wait_us = synth->next_us - esp_timer_get_time();
+    if (wait_us > 0) {
+      usleep((useconds_t)wait_us);
+    }
+  }
+
+  for (size_t frame = 0; frame < frames; ++frame) {
+    int16_t voltage = synth_sine(synth->phase, SYNTH_VOLTAGE_AMPLITUDE);
+    for (size_t outlet = 0; outlet < synth->outlet_count; ++outlet) {
+      meter_sample_t* sample = &samples[frame * synth->outlet_count + outlet];
+      sample->voltage = voltage;
+      sample->current =
+          synth_sine(synth->phase - synth->current_shift[outlet],
+                     synth->current_amplitude[outlet]);
+    }
+    synth->phase += synth->step;
+  }
+
+  return ESP_OK;
+}
@@ -0,0 +1,69 @@
+#ifndef SYNTH_H
+#define SYNTH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "meter.h"
+
+/**
+ * Generates the voltage and current waveforms of mains-powered loads. It
+ * stands in for the analog front end, so that the sampling pipeline can be
+ * run and measured without hardware, including on the host.
+ *
+ * @param outlet_count Number of outlets.
+ * @param sample_rate Number of frames per second.
+ * @param phase The phase of the voltage, where 2^32 is a full turn.
+ * @param step The phase increment per frame.
+ * @param current_amplitude The peak current of every outlet.
+ * @param current_shift The phase lag of the current of every outlet.
+ * @param realtime Indicates that reads are paced to the sample rate.
+ * @param next_us The time at which the next frames are due.
+ */
+typedef struct synth {
+  size_t outlet_count;
+  uint32_t sample_rate;
+  uint32_t phase;
+  uint32_t step;
+  int16_t current_amplitude[METER_MAX_OUTLETS];
+  uint32_t current_shift[METER_MAX_OUTLETS];
+  bool realtime;
+  int64_t next_us;
+} synth_t;
+
+/**
+ * Prepare a generator with a different load on every outlet, ranging from
+ * idle to a large inductive load.
+ *
+ * @param[out] synth A pointer to the generator.
+ * @param[in] outlet_count Number of outlets.
+ * @param[in] sample_rate Number of frames per second.
+ * @param[in] frequency The mains frequency in hertz.
+ * @param[in] realtime Indicates that reads are paced to the sample rate, like
+ * an ADC would be.
+ */
+void synth_init(synth_t* synth, size_t outlet_count, uint32_t sample_rate,
+                uint32_t frequency, bool realtime);
+
+/**
+ * Describe the generator as a source of samples.
+ *
+ * @param[in] synth A pointer to the generator.
+ * @param[out] source Receives the description.
+ */
+void synth_source(synth_t* synth, meter_source_t* source);
+
+/**
+ * Generate the next frames. This is a `meter_read_t`.
+ *
+ * @param[in] ctx A pointer to the generator.
+ * @param[out] samples Buffer receiving the frames.
+ * @param[in] frames Number of frames to be generated.
+ *
+ * @return ESP_OK.
+ */
+esp_err_t synth_read(void* ctx, meter_sample_t* samples, size_t frames);
+
+#endif
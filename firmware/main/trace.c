@@ -0,0 +1,178 @@
+#include "trace.h"
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "esp_cpu.h"
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "json.h"
+#include "util.h"
+
+/**
+ * A recorded event. The slot is written like a seqlock, so that it can be
+ * exported while it is being overwritten: the sequence is cleared before the
+ * fields are written and set to the index of the event plus one afterwards.
+ *
+ * @param sequence The index of the event plus one or 0 while it is written.
+ * @param phase The phase of the event.
+ * @param time The time of the event in microseconds since boot.
+ * @param name The name of the event or NULL.
+ * @param task The task that recorded the event.
+ */
+typedef struct trace_event {
+  _Atomic uint32_t sequence;
+  char phase;
+  int64_t time;
+  const char* name;
+  TaskHandle_t task;
+} trace_event_t;
+
+/**
+ * The events recorded on a core. Writers claim slots by incrementing the head,
+ * so that tasks preempting each other on the same core don't need a lock.
+ *
+ * @param events The slots, of which there are `capacity`.
+ * @param head Number of events claimed so far.
+ */
+typedef struct trace_ring {
+  trace_event_t* events;
+  _Atomic uint32_t head;
+} trace_ring_t;
+
+// The ring of every core or NULL until the rings are allocated, which happens
+// before any task records events.
+static trace_ring_t* rings = NULL;
+// Number of slots per ring minus one, which masks the index of an event.
+static uint32_t capacity_mask = 0;
+
+esp_err_t trace_init(size_t capacity) {
+  if (capacity == 0 || (capacity & (capacity - 1)) != 0) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+  if (rings != NULL) {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  trace_ring_t* allocated =
+      (trace_ring_t*)calloc(portNUM_PROCESSORS, sizeof(trace_ring_t));
+  if (allocated == NULL) {
+    return ESP_ERR_NO_MEM;
+  }
+  for (size_t core = 0; core < portNUM_PROCESSORS; ++core) {
+    allocated[core].events =
+        (trace_event_t*)calloc(capacity, sizeof(trace_event_t));
+    if (allocated[core].events == NULL) {
+      for (size_t i = 0; i < core; ++i) {
+        free(allocated[i].events);
+      }
+      free(allocated);
+      return ESP_ERR_NO_MEM;
+    }
+    atomic_init(&allocated[core].head, 0);
+  }
+
+  capacity_mask = (uint32_t)capacity - 1;
+  rings = allocated;
+
+  return ESP_OK;
+}
+
+void trace_record(const char* name, char phase) {
+  trace_ring_t* ring = rings;
+  if (ring == NULL) {
+    return;
+  }
+
+  int64_t time = esp_timer_get_time();
+  ring = &ring[esp_cpu_get_core_id()];
+  uint32_t index =
+      atomic_fetch_add_explicit(&ring->head, 1, memory_order_relaxed);
+  trace_event_t* event = &ring->events[index & capacity_mask];
+
+  atomic_store_explicit(&event->sequence, 0, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  event->phase = phase;
+  event->time = time;
+  event->name = name;
+  event->task = xTaskGetCurrentTaskHandle();
+  atomic_store_explicit(&event->sequence, index + 1, memory_order_release);
+}
+
+/**
+ * Write an event as a member of the trace events.
+ *
+ * @param[in] json The writer.
+ * @param[in] event A consistent copy of the event.
+ */
+static void trace_write_event(json_t* json, const trace_event_t* event) {
+  char phase[2] = {event->phase, '\0'};
+
+  json_object_begin(json);
+  if (event->name != NULL) {
+    json_key(json, "name");
+    json_string(json, event->name);
+  }
+  json_key(json, "ph");
+  json_string(json, phase);
+  json_key(json, "ts");
+  json_int(json, event->time);
+  json_key(json, "pid");
+  json_int(json, 1);
+  json_key(json, "tid");
+  json_int(json, (int64_t)(uintptr_t)event->task);
+  json_object_end(json);
+}
+
+/**
+ * Write the events of a core that are still in its ring, oldest first.
+ *
+ * @param[in] json The writer.
+ * @param[in] ring The ring of the core.
+ */
+static void trace_write_ring(json_t* json, trace_ring_t* ring) {
+  uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+  uint32_t count = min(head, capacity_mask + 1);
+
+  for (uint32_t index = head - count; index != head; ++index) {
+    trace_event_t* slot = &ring->events[index & capacity_mask];
+    uint32_t sequence =
+        atomic_load_explicit(&slot->sequence, memory_order_acquire);
+    if (sequence != index + 1) {
+      // The event is being written or was already overwritten.
+      continue;
+    }
+
+    trace_event_t event;
+    event.phase = slot->phase;
+    event.time = slot->time;
+    event.name = slot->name;
+    event.task = slot->task;
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&slot->sequence, memory_order_relaxed) !=
+        sequence) {
+      continue;
+    }
+
+    trace_write_event(json, &event);
+  }
+}
+
+void trace_export(json_t* json) {
+  json_object_begin(json);
+  json_key(json, "traceEvents");
+  json_array_begin(json);
+  if (rings != NULL) {
+    for (size_t core = 0; core < portNUM_PROCESSORS; ++core) {
+      trace_write_ring(json, &rings[core]);
+    }
+  }
+  json_array_end(json);
+  json_key(json, "displayTimeUnit");
+  json_string(json, "ms");
+  json_object_end(json);
+}
@@ -0,0 +1,82 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stddef.h>
+
+#include "esp_err.h"
+#include "json.h"
+#include "sdkconfig.h"
+
+// Content type of the exported trace.
+#define TRACE_CONTENT_TYPE JSON_CONTENT_TYPE
+
+// Phase of an event that begins a slice of the current task.
+#define TRACE_PHASE_BEGIN 'B'
+// Phase of an event that ends the innermost slice of the current task.
+#define TRACE_PHASE_END 'E'
+// Phase of an event without duration.
+#define TRACE_PHASE_INSTANT 'i'
+
+#ifdef CONFIG_ZEUS_TRACE
+/**
+ * Begin a slice of the current task.
+ *
+ * @param NAME A string literal naming the slice, such as "http.metrics".
+ */
+#define TRACE_BEGIN(NAME) trace_record((NAME), TRACE_PHASE_BEGIN)
+
+/**
+ * End the innermost slice of the current task.
+ *
+ * @param NAME The name of the slice or NULL, as the slice is identified by the
+ * task.
+ */
+#define TRACE_END(NAME) trace_record((NAME), TRACE_PHASE_END)
+
+/**
+ * Record an event without duration.
+ *
+ * @param NAME A string literal naming the event.
+ */
+#define TRACE_INSTANT(NAME) trace_record((NAME), TRACE_PHASE_INSTANT)
+#else
+#define TRACE_BEGIN(NAME) ((void)0)
+#define TRACE_END(NAME) ((void)0)
+#define TRACE_INSTANT(NAME) ((void)0)
+#endif
+
+/**
+ * Allocate a ring of events per core. Events recorded before are dropped.
+ *
+ * @param[in] capacity Number of the most recent events kept per core, which
+ * must be a power of two.
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_SIZE if the capacity is not a power of two,
+ * ESP_ERR_INVALID_STATE if the rings were already allocated or ESP_ERR_NO_MEM
+ * if they can't be allocated.
+ */
+esp_err_t trace_init(size_t capacity);
+
+/**
+ * Record an event of the current task in the ring of the current core. This
+ * never blocks and is safe to call from any task: concurrent writers claim
+ * distinct slots and the oldest events are overwritten. Use the macros above
+ * rather than calling this directly, so that tracing is compiled out when it
+ * is disabled. The cost of an event is measured by the trace/record benchmark.
+ *
+ * @param[in] name The name of the event, which must have static storage, or
+ * NULL.
+ * @param[in] phase The phase of the event, such as `TRACE_PHASE_BEGIN`.
+ */
+void trace_record(const char* name, char phase);
+
+/**
+ * Write the recorded events as a Chrome trace-event document, which can be
+ * loaded into Perfetto or chrome://tracing. Events are grouped into threads by
+ * their task. Events that are overwritten while they are exported are skipped.
+ *
+ * @param[in] json The writer receiving the document.
+ */
+void trace_export(json_t* json);
+
+#endif
@@ -1,41 +1,121 @@
 #include "update.h"
 
+#include <ctype.h>
 #include <pthread.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
-#include <unistd.h>
+#include <string.h>
+#include <time.h>
 
-#include "esp_crt_bundle.h"
 #include "esp_err.h"
+#include "esp_eth.h"
+#include "esp_event.h"
 #include "esp_http_client.h"
 #include "esp_log.h"
+#include "esp_netif.h"
 #include "esp_ota_ops.h"
 #include "esp_pthread.h"
+#include "esp_random.h"
+#include "esp_timer.h"
 #include "esp_tls.h"
+#include "delta.h"
+#include "download.h"
+#include "fetch.h"
 #include "git.h"
 #include "http.h"
+#include "manifest.h"
+#include "metrics.h"
+#include "nvs.h"
+#include "peer.h"
+#include "sdkconfig.h"
 #include "semver.h"
+#include "trace.h"
 #include "util.h"
+#include "writer.h"
 
 // Log prefix to be used.
 #define TAG "update"
-// Size of the buffer used to write the OTA data to the flash.
+// Size of the buffer used to receive the OTA data.
 #define BUFFER_SIZE 1024
-// Maximum size of the URL.
-#define URL_SIZE 512
-
-// Update channel, which may either be "latest" or an existing Git tag.
-static char* channel = "latest";
+// Delay in seconds before retrying a failed update check.
+#define BACKOFF_MIN_S 30
+// Maximum number of times the retry delay is doubled.
+#define BACKOFF_MAX_SHIFT 16
+
+// The configured update source, which is the URL of a mirror or empty for the
+// GitHub releases.
+static char source_setting[UPDATE_SOURCE_SIZE] = CONFIG_ZEUS_UPDATE_SOURCE;
+// The configured update channel.
+static char channel_setting[UPDATE_CHANNEL_SIZE] = CONFIG_ZEUS_UPDATE_CHANNEL;
+// Protects access to the configured update source and channel.
+static pthread_mutex_t source_mutex = PTHREAD_MUTEX_INITIALIZER;
+// Update source of the running check, which is only used under the lock.
+static char source[UPDATE_SOURCE_SIZE];
+// Update channel of the running check, which may either be "latest" or an
+// existing Git tag and is only used under the lock.
+static char channel[UPDATE_CHANNEL_SIZE];
 // Name of the binary file.
 static const char firmware[] = "zeus-esp32.bin";
-// Gives access to the current firmware update process.
-static esp_ota_handle_t update_handle = 0;
+// Name of the patch from the previous release to the binary file.
+static const char patch[] = "zeus-esp32.delta";
+// Name of the zlib-compressed binary file.
+static const char compressed[] = "zeus-esp32.zlib";
+// Name of the release manifest describing the binary file.
+static const char manifest[] = "zeus-esp32.json";
+// NVS namespace used to persist the state of the update module.
+static const char nvs_namespace[] = "update";
+// Upper bounds of the bytes received from the update source per check.
+static const uint32_t check_bytes_bounds[] = {
+    1024,   4096,    16384,   65536,   262144,
+    524288, 1048576, 2097152, 4194304,
+};
+// Counts update checks.
+static metrics_metric_t checks_total = METRICS_COUNTER_INIT(
+    "zeus_update_checks_total", "Number of checks for a firmware update.");
+// Counts update checks that didn't download any firmware.
+static metrics_metric_t short_circuited_total = METRICS_COUNTER_INIT(
+    "zeus_update_short_circuited_total",
+    "Number of checks that found the running firmware up to date without "
+    "downloading the firmware image.");
+// Counts failed update checks.
+static metrics_metric_t failures_total = METRICS_COUNTER_INIT(
+    "zeus_update_failures_total", "Number of failed firmware updates.");
+// Measures the bytes received from the update source per check.
+static metrics_metric_t check_bytes = METRICS_HISTOGRAM_INIT(
+    "zeus_update_check_bytes",
+    "Number of body bytes received from the update source per check.",
+    check_bytes_bounds, 1);
+// Counts bytes of firmware downloaded from peers.
+static metrics_metric_t peer_bytes_total = METRICS_COUNTER_INIT(
+    "zeus_update_peer_bytes_total",
+    "Number of bytes of firmware downloaded from other devices instead of the "
+    "update source.");
+// Size of the sector-aligned blocks written to the flash.
+static size_t block_size = CONFIG_ZEUS_UPDATE_BLOCK_SIZE;
 // Protects access to shared resources, such as the receive buffer.
 static pthread_mutex_t update_mutex = PTHREAD_MUTEX_INITIALIZER;
 // Gives access to the update thread.
 static pthread_t thread_handle;
+// Protects access to the state of the update scheduler.
+static pthread_mutex_t schedule_mutex = PTHREAD_MUTEX_INITIALIZER;
+// Wakes up the update thread if the state of the update scheduler changes.
+static pthread_cond_t schedule_cond;
+// Indicates that the network is up.
+static bool online = false;
+// Indicates that an update check was requested manually.
+static bool triggered = false;
+// Number of seconds between regular update checks.
+static uint32_t interval_s = 0;
+
+// Locations from which an update may be downloaded.
+typedef enum update_origin {
+  // The configured update source.
+  UPDATE_ORIGIN_SOURCE,
+  // Another device on the local network running the release.
+  UPDATE_ORIGIN_PEER,
+} update_origin_t;
 
 /**
  * Retrieve partitioning information. Check whether the configured boot
@@ -142,249 +222,572 @@ static esp_err_t update_check_update_header(const char buffer[],
 }
 
 /**
- * Process the firmware update. Please note that this function is NOT
- * thread-safe. This function is only intended for internal use.
+ * Check whether a firmware version should be installed on the current update
+ * channel.
  *
- * @param[in] firmware_url URL to the firmware image.
- * @param[in] user_agent Desired content of the HTTP User-Agent header.
+ * @param[in] update_version The version of the new firmware.
+ * @param[in] running_version The version of the running firmware.
  *
- * @return ESP_OK if the operation succeeds.
+ * @return true if the new firmware should be installed.
  */
-static esp_err_t update_execute(const char* firmware_url,
-                                const char* user_agent) {
-  esp_err_t err = update_check_preflight();
-  if (err != ESP_OK) {
-    return err;
+static bool update_is_needed(const char* update_version,
+                             const char* running_version) {
+  bool is_latest = strcmp(channel, "latest") == 0 ? true : false;
+  // Update direction, where 1 is upgrade, -1 is downgrade and 0 is no
+  // change.
+  int8_t dir = semver_compare(update_version, running_version);
+
+  // If the channel is a specific version, we allow users to up- or
+  // downgrade the firmware to a specific version. If the channel is
+  // latest in contrast, we only allow firmware upgrades.
+  return !((is_latest && dir <= 0) || (!is_latest && dir == 0));
+}
+
+/**
+ * Build the URL of a file of the release on the update channel. A mirror keeps
+ * the files of every release in a directory named after the channel, such as
+ * "<source>/latest/zeus-esp32.json". Please note that this function is NOT
+ * thread-safe.
+ *
+ * @param[in] file Name of the file.
+ *
+ * @return The URL, which must be freed.
+ */
+static char* update_file_url(const char* file) {
+  if (source[0] == 0) {
+    return git_release_download_url(channel, file);
   }
 
-  esp_http_client_config_t config = {
-      .url = firmware_url,
-      .crt_bundle_attach = esp_crt_bundle_attach,
-      .timeout_ms = 30 * 1000,
-      .keep_alive_enable = true,
-      .user_agent = user_agent,
-      .buffer_size_tx = BUFFER_SIZE,
-      .buffer_size = BUFFER_SIZE,
-  };
+  char* url;
+  asprintf(&url, "%s/%s/%s", source, channel, file);
+  return url;
+}
 
-  esp_http_client_handle_t client = esp_http_client_init(&config);
-  if (client == NULL) {
-    ESP_LOGE(TAG, "Failed to configure HTTP client");
-    return ESP_FAIL;
+/**
+ * Check whether an update source is a valid HTTPS URL without a trailing
+ * slash. HTTP URLs are only valid if CONFIG_ZEUS_UPDATE_INSECURE_SOURCE is
+ * enabled, as the manifest and the image could be tampered with on the way.
+ *
+ * @param[in] url The URL or an empty string for the GitHub releases.
+ *
+ * @return true if the update source is valid.
+ */
+static bool update_is_valid_source(const char* url) {
+  size_t length = strlen(url);
+  if (length == 0) {
+    return true;
   }
+  if (length >= UPDATE_SOURCE_SIZE || url[length - 1] == '/') {
+    return false;
+  }
+#ifdef CONFIG_ZEUS_UPDATE_INSECURE_SOURCE
+  if (strncmp(url, "http://", 7) != 0 && strncmp(url, "https://", 8) != 0) {
+    return false;
+  }
+#else
+  if (strncmp(url, "https://", 8) != 0) {
+    return false;
+  }
+#endif
 
-  // A buffer to store the response payload.
-  char* buffer = NULL;
-  // Handle for update partition.
-  const esp_partition_t* part = esp_ota_get_next_update_partition(NULL);
-  // Count the image length.
-  int32_t image_length = 0;
-  // Flag whether image header was checked and firmware update was started.
-  bool image_header_checked = false;
-  // Indicates whether we are downloading or still following redirects.
-  bool downloading = 0;
-  // Size of the buffer for the response payload.
-  int32_t buffer_size = 0;
-
-  // Stream data using the native API.
-  while (1) {
-    // Check if the firware is downloading or if we are still following
-    // redirects to locate it.
-    if (!downloading) {
-      char url[URL_SIZE];
-      esp_http_client_get_url(client, url, URL_SIZE);
-      ESP_LOGI(TAG, "Update location: %s", url);
-
-      err = esp_http_client_open(client, 0);
-      if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to open HTTP connection: %s",
-                 esp_err_to_name(err));
-        esp_http_client_cleanup(client);
-        return err;
-      }
-
-      int64_t content_length = esp_http_client_fetch_headers(client);
-      if (content_length < 0) {
-        ESP_LOGE(TAG, "Failed to fetch HTTP headers");
-        esp_http_client_cleanup(client);
-        return err;
-      }
-      buffer_size = min((int32_t)content_length, BUFFER_SIZE);
+  for (size_t index = 0; index < length; ++index) {
+    if (url[index] <= ' ' || url[index] > '~') {
+      return false;
     }
+  }
 
-    // Allocate buffer and stream response payload.
-    if (buffer == NULL) {
-      buffer = (char*)malloc(buffer_size + 1);
-      buffer[buffer_size] = 0;
-      if (!buffer) {
-        ESP_LOGE(TAG, "Failed to allocate memory");
-        esp_http_client_cleanup(client);
-        return ESP_FAIL;
-      }
-    }
+  return true;
+}
 
-    // We always need to receive the payload irrespective if we are being
-    // redirected or if we are downloading.
-    int32_t bytes_read = esp_http_client_read(client, buffer, buffer_size);
-    if (bytes_read < 0) {
-      ESP_LOGE(TAG, "Failed to read HTTP response");
-      esp_http_client_cleanup(client);
-      return ESP_FAIL;
+/**
+ * Check whether an update channel is either "latest" or a plausible Git tag,
+ * which is used as a path segment of the URLs.
+ *
+ * @param[in] name The channel.
+ *
+ * @return true if the update channel is valid.
+ */
+static bool update_is_valid_channel(const char* name) {
+  size_t length = strlen(name);
+  if (length == 0 || length >= UPDATE_CHANNEL_SIZE || name[0] == '.') {
+    return false;
+  }
+
+  for (size_t index = 0; index < length; ++index) {
+    char charcode = name[index];
+    if (!isalnum((unsigned char)charcode) && strchr("+-._", charcode) == NULL) {
+      return false;
     }
+  }
 
-    if (!downloading) {
-      // Follow redirects.
-      int32_t status = esp_http_client_get_status_code(client);
-      if (http_is_redirect(status)) {
-        // We need to handle the redirect manually, because we are using the
-        // native API.
-        esp_http_client_set_redirection(client);
+  return true;
+}
 
-        if (buffer != NULL) {
-          free(buffer);
-          buffer = NULL;
-        }
+/**
+ * Load the configured update source and channel, which override the defaults
+ * of the build configuration. A source that isn't valid in this build, such as
+ * a plain HTTP URL stored before CONFIG_ZEUS_UPDATE_INSECURE_SOURCE was
+ * disabled, is ignored in favor of the GitHub releases.
+ */
+static void update_load_source(void) {
+  pthread_mutex_lock(&source_mutex);
+  if (!update_is_valid_source(source_setting)) {
+    ESP_LOGE(TAG, "Ignoring update source: %s", source_setting);
+    source_setting[0] = 0;
+  }
+  pthread_mutex_unlock(&source_mutex);
 
-        continue;
-      }
+  nvs_handle_t nvs;
+  if (nvs_open(nvs_namespace, NVS_READONLY, &nvs) != ESP_OK) {
+    return;
+  }
+
+  char url[UPDATE_SOURCE_SIZE];
+  char name[UPDATE_CHANNEL_SIZE];
+  size_t url_size = sizeof(url);
+  size_t name_size = sizeof(name);
+  if (nvs_get_str(nvs, "source", url, &url_size) == ESP_OK &&
+      nvs_get_str(nvs, "channel", name, &name_size) == ESP_OK) {
+    if (update_is_valid_source(url) && update_is_valid_channel(name)) {
+      pthread_mutex_lock(&source_mutex);
+      strlcpy(source_setting, url, sizeof(source_setting));
+      strlcpy(channel_setting, name, sizeof(channel_setting));
+      pthread_mutex_unlock(&source_mutex);
+    } else {
+      ESP_LOGE(TAG, "Ignoring configured update source: %s", url);
     }
+  }
 
-    // Indicate that the firmware has been located and is being downloaded.
-    downloading = true;
-
-    // NOTE: I am aware that the arrangement of the `if` statements here adds
-    // runtime overhead. I have deliberately chosen to structure the code like
-    // this to make it more readable as I find nested `if else` statements
-    // hard to comprehend. As for runtime performance optimization, remember
-    // that "premature optimization is the root of all evil"!
-
-    if (bytes_read > 0) {
-      if (image_header_checked == false) {
-        size_t app_info_offset = sizeof(esp_image_header_t) +
-                                 sizeof(esp_image_segment_header_t) +
-                                 sizeof(esp_app_desc_t);
-
-        if (bytes_read <= app_info_offset) {
-          ESP_LOGE(TAG,
-                   "Failed to download firmware: "
-                   "Firmware image incomplete");
-          esp_http_client_cleanup(client);
-          return ESP_FAIL;
-        }
-
-        // Fetch the firmware image header of the currently running firmware.
-        esp_app_desc_t info_running;
-        err = update_check_running_header(&info_running);
-        if (err != ESP_OK) {
-          esp_http_client_cleanup(client);
-          return err;
-        }
-
-        // Check if a previous update for this firmware failed.
-        esp_app_desc_t info_update;
-        err = update_check_update_header(buffer, &info_update);
-        if (err != ESP_OK) {
-          esp_http_client_cleanup(client);
-          return err;
-        }
-        image_header_checked = true;
-
-        bool is_latest = strcmp(channel, "latest") == 0 ? true : false;
-        // Update direction, where 1 is upgrade, -1 is downgrade and 0 is no
-        // change.
-        int8_t dir = semver_compare(info_update.version, info_running.version);
-
-        // If the channel is a specific version, we allow users to up- or
-        // downgrade the firmware to a specific version. If the channel is
-        // latest in contrast, we only allow firmware upgrades.
-        if ((is_latest && dir <= 0) || (!is_latest && dir == 0)) {
-          ESP_LOGI(TAG, "Skipping firmware update");
-          esp_http_client_cleanup(client);
-          // It's okay if the firmware is already up-to-date,
-          // we don't consider this an error.
-          return ESP_OK;
-        }
-
-        err = esp_ota_begin(part, OTA_WITH_SEQUENTIAL_WRITES, &update_handle);
-        if (err != ESP_OK) {
-          ESP_LOGE(TAG, "Failed to start update: %s", esp_err_to_name(err));
-          esp_http_client_cleanup(client);
-          esp_ota_abort(update_handle);
-          return err;
-        }
-        ESP_LOGI(TAG, "Starting firmware update: %s", info_update.version);
-      }
+  nvs_close(nvs);
+}
 
-      err = esp_ota_write(update_handle, (const void*)buffer, bytes_read);
-      if (err != ESP_OK) {
-        esp_http_client_cleanup(client);
-        esp_ota_abort(update_handle);
-        return err;
-      }
+/**
+ * Load the ETag of the last manifest that did not announce an update. The
+ * ETag is only valid as long as the same firmware is running.
+ *
+ * @param[in] running_version The version of the running firmware.
+ * @param[out] etag Buffer receiving the ETag, which is empty if none is known.
+ */
+static void update_load_etag(const char* running_version,
+                             char etag[MANIFEST_ETAG_SIZE]) {
+  etag[0] = 0;
 
-      image_length += bytes_read;
-      ESP_LOGD(TAG, "Written image: %d B", image_length);
-    }
+  nvs_handle_t nvs;
+  if (nvs_open(nvs_namespace, NVS_READONLY, &nvs) != ESP_OK) {
+    return;
+  }
 
-    if (bytes_read == 0) {
-      // As esp_http_client_read never returns a negative error code. We rely on
-      // `errno` to check for underlying transport connectivity closure, if any.
-      if (errno == ECONNRESET || errno == ENOTCONN) {
-        char* err_name = strerror(errno);
+  char version[sizeof(((esp_app_desc_t*)0)->version)];
+  size_t version_size = sizeof(version);
+  size_t etag_size = MANIFEST_ETAG_SIZE;
+  if (nvs_get_str(nvs, "etag_version", version, &version_size) != ESP_OK ||
+      strcmp(version, running_version) != 0 ||
+      nvs_get_str(nvs, "etag", etag, &etag_size) != ESP_OK) {
+    etag[0] = 0;
+  }
 
-        ESP_LOGE(TAG, "Failed to receive update");
-        ESP_LOGE(TAG, "Connection closed prematurely: %s", err_name);
+  nvs_close(nvs);
+}
 
-        free(err_name);
+/**
+ * Persist the ETag of a manifest that did not announce an update.
+ *
+ * @param[in] running_version The version of the running firmware.
+ * @param[in] etag The ETag of the manifest.
+ */
+static void update_store_etag(const char* running_version, const char* etag) {
+  nvs_handle_t nvs;
+  if (nvs_open(nvs_namespace, NVS_READWRITE, &nvs) != ESP_OK) {
+    return;
+  }
 
-        esp_http_client_cleanup(client);
-        esp_ota_abort(update_handle);
+  if (nvs_set_str(nvs, "etag_version", running_version) != ESP_OK ||
+      nvs_set_str(nvs, "etag", etag) != ESP_OK ||
+      nvs_commit(nvs) != ESP_OK) {
+    ESP_LOGW(TAG, "Failed to persist manifest ETag");
+  }
 
-        return ESP_ERR_HTTP_CONNECTION_CLOSED;
-      }
+  nvs_close(nvs);
+}
 
-      if (esp_http_client_is_complete_data_received(client) == true) {
-        esp_http_client_cleanup(client);
-        ESP_LOGI(TAG, "Received new firmware image: %d B", image_length);
-        break;
-      }
-    }
+/**
+ * Check the release manifest to find out cheaply whether an update is
+ * available. Using a conditional request, an unchanged manifest costs a single
+ * small round trip. Please note that this function is NOT thread-safe. This
+ * function is only intended for internal use.
+ *
+ * @param[in] user_agent Desired content of the HTTP User-Agent header.
+ * @param[out] release Receives the manifest of the release, if an update is
+ * available.
+ * @param[out] has_release Set to true if the manifest was received.
+ *
+ * @return true if an update may be available or if the manifest can't be
+ * fetched, in which case the firmware image itself has to be checked.
+ */
+static bool update_probe(const char* user_agent, manifest_t* release,
+                         bool* has_release) {
+  esp_app_desc_t info_running;
+  if (update_check_running_header(&info_running) != ESP_OK) {
+    return true;
   }
 
-  // End update by verifying firmware image.
-  err = esp_ota_end(update_handle);
+  char etag[MANIFEST_ETAG_SIZE];
+  update_load_etag(info_running.version, etag);
+
+  char* manifest_url = update_file_url(manifest);
+  bool modified = true;
+  esp_err_t err =
+      manifest_fetch(manifest_url, user_agent, etag, release, &modified);
+  free(manifest_url);
   if (err != ESP_OK) {
-    if (err == ESP_ERR_OTA_VALIDATE_FAILED) {
-      ESP_LOGE(TAG, "Failed to validate update: Checksum mismatch");
-    } else {
-      ESP_LOGE(TAG, "Failed to finish update: %s", esp_err_to_name(err));
+    // Releases without a manifest are handled by checking the image header.
+    return true;
+  }
+
+  if (!modified) {
+    ESP_LOGI(TAG, "Release manifest not modified");
+    return false;
+  }
+
+  ESP_LOGI(TAG, "Latest firmware: %s", release->version);
+  if (update_is_needed(release->version, info_running.version)) {
+    *has_release = true;
+    return true;
+  }
+
+  // Only remember the manifest if it did not announce an update, so that a
+  // failed update is retried with the next check.
+  if (etag[0] != 0) {
+    update_store_etag(info_running.version, etag);
+  }
+
+  return false;
+}
+
+/**
+ * Read a range of the running firmware, which is the base image of a patch.
+ *
+ * @param[in] ctx The running partition.
+ * @param[in] offset Offset within the running partition.
+ * @param[out] data Buffer receiving the data.
+ * @param[in] length Number of bytes to be read.
+ *
+ * @return ESP_OK if the data was read.
+ */
+static esp_err_t update_base_read(void* ctx, size_t offset, void* data,
+                                  size_t length) {
+  return esp_partition_read((const esp_partition_t*)ctx, offset, data, length);
+}
+
+/**
+ * Validate the header of the new firmware and decide whether it is installed.
+ *
+ * @param[in] ctx Unused.
+ * @param[in] header The beginning of the new firmware image.
+ * @param[out] needed Receives whether the update is needed.
+ *
+ * @return ESP_OK if the header is valid.
+ */
+static esp_err_t update_check(void* ctx, const char* header, bool* needed) {
+  // Fetch the firmware image header of the currently running firmware.
+  esp_app_desc_t info_running;
+  esp_err_t err = update_check_running_header(&info_running);
+  if (err != ESP_OK) {
+    return err;
+  }
+
+  // Check if a previous update for this firmware failed.
+  esp_app_desc_t info_update;
+  err = update_check_update_header(header, &info_update);
+  if (err != ESP_OK) {
+    return err;
+  }
+
+  *needed = update_is_needed(info_update.version, info_running.version);
+
+  return ESP_OK;
+}
+
+/**
+ * Process the firmware update. Please note that this function is NOT
+ * thread-safe. This function is only intended for internal use.
+ *
+ * @param[in] url URL to the firmware image or patch.
+ * @param[in] user_agent Desired content of the HTTP User-Agent header.
+ * @param[in] format Format of the file located at the URL.
+ * @param[in] origin Location of the file.
+ * @param[in] release The manifest of the firmware image or NULL if unknown.
+ *
+ * @return ESP_OK if the operation succeeds or if the update is not needed.
+ */
+static esp_err_t update_execute(const char* url, const char* user_agent,
+                                download_format_t format,
+                                update_origin_t origin,
+                                const manifest_t* release) {
+  esp_err_t err = update_check_preflight();
+  if (err != ESP_OK) {
+    return err;
+  }
+
+  download_config_t config = {
+      .format = format,
+      .release = release,
+      .block_size = block_size,
+      .slot_count = DOWNLOAD_SLOT_COUNT,
+      .check = update_check,
+      .ctx = NULL,
+  };
+
+  // Patches are applied to the running firmware, which is identified by the
+  // digest of its image.
+  const esp_partition_t* running = esp_ota_get_running_partition();
+  uint8_t running_sha256[DELTA_SHA256_LEN];
+  if (format == DOWNLOAD_FORMAT_DELTA) {
+    err = esp_partition_get_sha256(running, running_sha256);
+    if (err != ESP_OK) {
+      ESP_LOGE(TAG, "Failed to hash running firmware: %s",
+               esp_err_to_name(err));
+      return err;
     }
+    config.base_sha256 = running_sha256;
+    config.base_read = update_base_read;
+    config.base_ctx = (void*)running;
+  }
+
+  // The state is too large for the stack of the update thread.
+  download_t* download = (download_t*)malloc(sizeof(download_t));
+  if (download == NULL) {
+    ESP_LOGE(TAG, "Failed to allocate memory");
+    return ESP_ERR_NO_MEM;
+  }
+  err = download_prepare(download, &config);
+  if (err != ESP_OK) {
+    free(download);
+    return err;
+  }
+
+  esp_http_client_handle_t client = NULL;
+  if (origin == UPDATE_ORIGIN_PEER) {
+    // Peers serve their image over plain HTTP, so they get a client of their
+    // own, which leaves the connection to the update source alone.
+    esp_http_client_config_t client_config = {
+        .url = url,
+        .timeout_ms = 30 * 1000,
+        .user_agent = user_agent,
+        .buffer_size_tx = BUFFER_SIZE,
+        .buffer_size = BUFFER_SIZE,
+    };
+    client = esp_http_client_init(&client_config);
+  } else {
+    client = fetch_begin(url, user_agent, 30 * 1000, NULL, NULL);
+  }
+  if (client == NULL) {
+    ESP_LOGE(TAG, "Failed to configure HTTP client");
+    err = ESP_FAIL;
+  }
+
+  if (err == ESP_OK) {
+    err = download_run(download, client);
+  }
+
+  if (client != NULL && origin == UPDATE_ORIGIN_PEER) {
+    metrics_add(&peer_bytes_total, download->download_length);
+    esp_http_client_cleanup(client);
+  } else if (client != NULL) {
+    // The connection isn't reused after a response was read through the
+    // native API, as the client only resets its state in
+    // esp_http_client_perform().
+    fetch_end(client, false);
+  }
+
+  err = download_finish(download, err);
+  bool installed = download->started && !download->skipped;
+  free(download);
+  if (err != ESP_OK || !installed) {
     return err;
   }
 
   // Configure the new boot partition.
+  const esp_partition_t* part = esp_ota_get_next_update_partition(NULL);
   err = esp_ota_set_boot_partition(part);
   if (err != ESP_OK) {
     ESP_LOGE(TAG, "Failed to set boot partition: %s", esp_err_to_name(err));
     return err;
   }
 
+  // The verified image is identified by the manifest, which spares hashing it
+  // before it can be shared with peers after the restart.
+  if (release != NULL) {
+    peer_store_image(part, release);
+  }
+
   ESP_LOGI(TAG, "Restarting system ...");
   esp_restart();
 
   return ESP_OK;
 };
 
-esp_err_t update_lock(void) {
-  pthread_mutex_lock(&update_mutex);
-
-  char* firmware_url = git_release_download_url(channel, firmware);
+/**
+ * Look up the update and install it, preferring a peer on the local network
+ * that runs the release, then a patch for the running firmware and finally
+ * the full firmware image. Please note that this function is NOT thread-safe.
+ * This function is only intended for internal use.
+ *
+ * @return ESP_OK if the operation succeeds or if the update is not needed.
+ */
+static esp_err_t update_run(void) {
   char* user_agent = http_user_agent();
+  esp_err_t err = ESP_FAIL;
+
+  // Changes of the configuration take effect with the next check.
+  pthread_mutex_lock(&source_mutex);
+  strlcpy(source, source_setting, sizeof(source));
+  strlcpy(channel, channel_setting, sizeof(channel));
+  pthread_mutex_unlock(&source_mutex);
+
+  metrics_add(&checks_total, 1);
+  uint64_t received = fetch_received_bytes();
+  // The manifest is too large for the stack and only used under the lock.
+  static manifest_t release;
+  bool has_release = false;
+  TRACE_BEGIN("update.probe");
+  bool available = update_probe(user_agent, &release, &has_release);
+  TRACE_END(NULL);
+  if (!available) {
+    ESP_LOGI(TAG, "Skipping firmware update");
+    metrics_add(&short_circuited_total, 1);
+    metrics_observe(&check_bytes,
+                    (uint32_t)(fetch_received_bytes() - received));
+    free(user_agent);
+    return ESP_OK;
+  }
+  const manifest_t* known = has_release ? &release : NULL;
+
+#ifdef CONFIG_ZEUS_PEER
+  // A peer is only trusted with an image that is verified against the
+  // manifest. If the peer fails, the download is resumed from the update
+  // source after the last verified block.
+  char peer_url[PEER_URL_SIZE];
+  if (known != NULL &&
+      peer_find(known, peer_url, sizeof(peer_url)) == ESP_OK) {
+    err = update_execute(peer_url, user_agent, DOWNLOAD_FORMAT_IMAGE,
+                         UPDATE_ORIGIN_PEER, known);
+    if (err != ESP_OK) {
+      ESP_LOGI(TAG, "Falling back to update source");
+    }
+  }
+#endif
+
+#ifdef CONFIG_ZEUS_UPDATE_DELTA
+  // A patch is only published for the previous release. If it doesn't apply to
+  // the running firmware or fails otherwise, fall back to the full image. An
+  // interrupted download of the full image is resumed instead.
+  if (err != ESP_OK && (known == NULL || download_load_progress(known) == 0)) {
+    char* patch_url = update_file_url(patch);
+    err = update_execute(patch_url, user_agent, DOWNLOAD_FORMAT_DELTA,
+                         UPDATE_ORIGIN_SOURCE, known);
+    free(patch_url);
+    if (err != ESP_OK) {
+      ESP_LOGI(TAG, "Falling back to full firmware image");
+    }
+  }
+#endif
+
+#ifdef CONFIG_ZEUS_UPDATE_COMPRESSED
+  // Compressed images can't be resumed, as the download can't be split at an
+  // offset of the image. Releases published before compressed images were
+  // introduced fall back to the raw image.
+  if (err != ESP_OK && (known == NULL || download_load_progress(known) == 0)) {
+    char* compressed_url = update_file_url(compressed);
+    err = update_execute(compressed_url, user_agent, DOWNLOAD_FORMAT_COMPRESSED,
+                         UPDATE_ORIGIN_SOURCE, known);
+    free(compressed_url);
+    if (err != ESP_OK) {
+      ESP_LOGI(TAG, "Falling back to raw firmware image");
+    }
+  }
+#endif
 
-  esp_err_t err = update_execute(firmware_url, user_agent);
+  if (err != ESP_OK) {
+    char* firmware_url = update_file_url(firmware);
+    err = update_execute(firmware_url, user_agent, DOWNLOAD_FORMAT_IMAGE,
+                         UPDATE_ORIGIN_SOURCE, known);
+    free(firmware_url);
+  }
 
   free(user_agent);
-  free(firmware_url);
+  metrics_observe(&check_bytes, (uint32_t)(fetch_received_bytes() - received));
+  if (err != ESP_OK) {
+    metrics_add(&failures_total, 1);
+  }
+
+  return err;
+}
+
+esp_err_t update_set_block_size(size_t size) {
+  if (size == 0 || size % WRITER_SECTOR_SIZE != 0) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+
+  // Don't change the block size while an update is being written.
+  pthread_mutex_lock(&update_mutex);
+  block_size = size;
+  pthread_mutex_unlock(&update_mutex);
+
+  return ESP_OK;
+}
+
+esp_err_t update_set_source(const char* url, const char* name) {
+  if (!update_is_valid_source(url) || !update_is_valid_channel(name)) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  nvs_handle_t nvs;
+  esp_err_t err = nvs_open(nvs_namespace, NVS_READWRITE, &nvs);
+  if (err != ESP_OK) {
+    return err;
+  }
+
+  // The ETag of the manifest on the previous source is meaningless on the new
+  // one.
+  nvs_erase_key(nvs, "etag");
+  err = nvs_set_str(nvs, "source", url);
+  if (err == ESP_OK) {
+    err = nvs_set_str(nvs, "channel", name);
+  }
+  if (err == ESP_OK) {
+    err = nvs_commit(nvs);
+  }
+  nvs_close(nvs);
+  if (err != ESP_OK) {
+    ESP_LOGW(TAG, "Failed to persist update source: %s", esp_err_to_name(err));
+    return err;
+  }
+
+  pthread_mutex_lock(&source_mutex);
+  strlcpy(source_setting, url, sizeof(source_setting));
+  strlcpy(channel_setting, name, sizeof(channel_setting));
+  pthread_mutex_unlock(&source_mutex);
+
+  ESP_LOGI(TAG, "Update source: %s (%s)", url[0] != 0 ? url : git_url(),
+           name);
+  update_trigger();
+
+  return ESP_OK;
+}
+
+void update_get_source(char url[UPDATE_SOURCE_SIZE],
+                       char name[UPDATE_CHANNEL_SIZE]) {
+  pthread_mutex_lock(&source_mutex);
+  strlcpy(url, source_setting, UPDATE_SOURCE_SIZE);
+  strlcpy(name, channel_setting, UPDATE_CHANNEL_SIZE);
+  pthread_mutex_unlock(&source_mutex);
+}
+
+esp_err_t update_lock(void) {
+  pthread_mutex_lock(&update_mutex);
+
+  esp_err_t err = update_run();
 
   pthread_mutex_unlock(&update_mutex);
 
@@ -396,44 +799,132 @@ esp_err_t update_trylock(void) {
     return ESP_FAIL;
   }
 
-  char* firmware_url = git_release_download_url(channel, firmware);
-  char* user_agent = http_user_agent();
-
-  esp_err_t err = update_execute(firmware_url, user_agent);
-
-  free(user_agent);
-  free(firmware_url);
+  esp_err_t err = update_run();
 
   pthread_mutex_unlock(&update_mutex);
 
   return err;
 }
 
+/**
+ * Calculate the delay until the next update check. After failed checks, the
+ * delay grows exponentially, starting at BACKOFF_MIN_S and capped at the
+ * regular interval. A random jitter spreads the checks of many devices.
+ *
+ * @param[in] failures Number of consecutive failed checks.
+ *
+ * @return The delay in seconds.
+ */
+static uint32_t update_next_delay(uint32_t failures) {
+  if (failures == 0) {
+    // Deviate by up to 10 % from the regular interval.
+    return interval_s - esp_random() % (interval_s / 10 + 1);
+  }
+
+  uint32_t shift = min(failures - 1, BACKOFF_MAX_SHIFT);
+  uint32_t backoff = min(BACKOFF_MIN_S << shift, interval_s);
+
+  // Wait between 50 % and 100 % of the backoff.
+  return backoff / 2 + esp_random() % (backoff / 2 + 1);
+}
+
 static void* update_thread(void* arg) {
-  uint32_t* interval_mins_ptr = (uint32_t*)arg;
-  uint32_t interval_ms = *interval_mins_ptr * 60000;
+  uint32_t failures = 0;
 
   while (1) {
-    update_lock();
-
-    // Suspend thread until the next update check.
-    sleep(interval_ms);
+    // Only check for updates while the network is up.
+    pthread_mutex_lock(&schedule_mutex);
+    while (!online) {
+      pthread_cond_wait(&schedule_cond, &schedule_mutex);
+    }
+    triggered = false;
+    pthread_mutex_unlock(&schedule_mutex);
+
+    TRACE_BEGIN("update.check");
+    esp_err_t err = update_lock();
+    TRACE_END(NULL);
+    failures = err == ESP_OK ? 0 : failures + 1;
+
+    uint32_t delay_s = update_next_delay(failures);
+    ESP_LOGI(TAG, "Next update check in: %u s", delay_s);
+
+    // Suspend thread until the next update check or until a check is
+    // triggered manually.
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += delay_s;
+
+    pthread_mutex_lock(&schedule_mutex);
+    while (!triggered) {
+      if (pthread_cond_timedwait(&schedule_cond, &schedule_mutex, &deadline) ==
+          ETIMEDOUT) {
+        break;
+      }
+    }
+    pthread_mutex_unlock(&schedule_mutex);
   }
 
   return NULL;
 }
 
+// Allow update checks once the network is up.
+static void update_connect_handler(void* arg, esp_event_base_t event_base,
+                                   int32_t event_id, void* event_data) {
+  pthread_mutex_lock(&schedule_mutex);
+  online = true;
+  pthread_cond_broadcast(&schedule_cond);
+  pthread_mutex_unlock(&schedule_mutex);
+}
+
+// Pause update checks while the network is down.
+static void update_disconnect_handler(void* arg, esp_event_base_t event_base,
+                                      int32_t event_id, void* event_data) {
+  pthread_mutex_lock(&schedule_mutex);
+  online = false;
+  pthread_mutex_unlock(&schedule_mutex);
+}
+
+void update_trigger(void) {
+  pthread_mutex_lock(&schedule_mutex);
+  triggered = true;
+  pthread_cond_broadcast(&schedule_cond);
+  pthread_mutex_unlock(&schedule_mutex);
+}
+
 esp_err_t update_init(uint32_t interval_mins) {
-  // TODO: Remove this and use events instead!
-  // Delay start of update thread to allow internet connection to be
-  // established first.
-  sleep(6);
+  interval_s = interval_mins * 60;
+
+  metrics_register(&checks_total);
+  metrics_register(&short_circuited_total);
+  metrics_register(&failures_total);
+  metrics_register(&check_bytes);
+  metrics_register(&peer_bytes_total);
+  fetch_init();
+  download_init();
+
+  update_load_source();
+
+  // Measure timeouts with a clock that is not affected by time adjustments.
+  pthread_condattr_t cond_attr;
+  pthread_condattr_init(&cond_attr);
+  pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&schedule_cond, &cond_attr);
+  pthread_condattr_destroy(&cond_attr);
+
+  // Start and pause update checks based on the network connection status.
+  ESP_ERROR_CHECK(esp_event_handler_register(
+      IP_EVENT, IP_EVENT_ETH_GOT_IP, &update_connect_handler, NULL));
+  ESP_ERROR_CHECK(esp_event_handler_register(ETH_EVENT,
+                                             ETHERNET_EVENT_DISCONNECTED,
+                                             &update_disconnect_handler, NULL));
 
   // Start thread for automatic updates.
   pthread_attr_t attr;
   pthread_attr_init(&attr);
   pthread_attr_setstacksize(&attr, 32 * 1024);
-  pthread_create(&thread_handle, &attr, update_thread, (void*)&interval_mins);
+  if (pthread_create(&thread_handle, &attr, update_thread, NULL) != 0) {
+    return ESP_ERR_INVALID_STATE;
+  }
 
   return ESP_OK;
 }
@@ -1,13 +1,21 @@
 #ifndef UPDATE_H
 #define UPDATE_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 #include "esp_err.h"
 
+// Maximum length of the URL of the update source.
+#define UPDATE_SOURCE_SIZE 256
+// Maximum length of the update channel.
+#define UPDATE_CHANNEL_SIZE 33
+
 /**
  * Create a background thread that will periodically check for a
- * new firmware.
+ * new firmware. Checks only run while the network is up, so this must be
+ * called before the network interface is brought up. Failed checks are
+ * retried with an exponential backoff.
  *
  * @param[in] interval_mins Number of minutes between checks.
  *
@@ -15,6 +23,53 @@
  */
 esp_err_t update_init(uint32_t interval_mins);
 
+/**
+ * Request an update check from the background thread without waiting for the
+ * next regular check. This function is thread-safe and returns immediately.
+ */
+void update_trigger(void);
+
+/**
+ * Configure the size of the blocks in which the firmware is written to the
+ * flash. The default is set via CONFIG_ZEUS_UPDATE_BLOCK_SIZE. This function is
+ * thread-safe and takes effect with the next update.
+ *
+ * @param[in] size Block size in bytes, which must be a multiple of the 4096 B
+ * flash sector size.
+ *
+ * @return ESP_OK or ESP_ERR_INVALID_SIZE if the size is not sector-aligned.
+ */
+esp_err_t update_set_block_size(size_t size);
+
+/**
+ * Configure where firmware updates are downloaded from, such as a mirror on
+ * the local network. A mirror keeps the files of every release in a directory
+ * named after the channel, such as "https://mirror.local/zeus/v1.2.0/". The
+ * defaults are set via CONFIG_ZEUS_UPDATE_SOURCE and
+ * CONFIG_ZEUS_UPDATE_CHANNEL. The configuration is persisted and an update
+ * check is triggered. This function is thread-safe.
+ *
+ * @param[in] url The HTTPS URL of the mirror without a trailing slash or an
+ * empty string for the GitHub releases. HTTP URLs are only accepted if
+ * CONFIG_ZEUS_UPDATE_INSECURE_SOURCE is enabled.
+ * @param[in] name The update channel, which is either "latest" or a Git tag.
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_ARG if the URL or the channel is malformed
+ * or the error of persisting the configuration.
+ */
+esp_err_t update_set_source(const char* url, const char* name);
+
+/**
+ * Get where firmware updates are downloaded from. This function is
+ * thread-safe.
+ *
+ * @param[out] url Buffer receiving the URL of the mirror, which is empty for
+ * the GitHub releases.
+ * @param[out] name Buffer receiving the update channel.
+ */
+void update_get_source(char url[UPDATE_SOURCE_SIZE],
+                       char name[UPDATE_CHANNEL_SIZE]);
+
 /**
  * Perform a firmware update or block thread until a firmware update may be
  * performed. This function is thread-safe and may also be used to manually
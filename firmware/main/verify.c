@@ -0,0 +1,116 @@
+#include "verify.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "util.h"
+
+// Log prefix to be used.
+#define TAG "verify"
+
+/**
+ * Compare the digest of the current block with the manifest and start hashing
+ * the next block.
+ *
+ * @param[in] verify A pointer to the verification state.
+ *
+ * @return ESP_OK or ESP_ERR_INVALID_CRC if the block is corrupt.
+ */
+static esp_err_t verify_block(verify_t* verify) {
+  const manifest_t* manifest = verify->manifest;
+  uint32_t index = (verify->offset - 1) / manifest->block_size;
+
+  uint8_t digest[MANIFEST_SHA256_LEN];
+  mbedtls_sha256_finish(&verify->block, digest);
+  mbedtls_sha256_starts(&verify->block, 0);
+
+  if (memcmp(digest, manifest->block_sha256[index], sizeof(digest)) != 0) {
+    verify->failed_start = index * manifest->block_size;
+    verify->failed_end = verify->offset;
+    ESP_LOGE(TAG, "Corrupt firmware image: Bytes %u to %u",
+             verify->failed_start, verify->failed_end - 1);
+    return ESP_ERR_INVALID_CRC;
+  }
+
+  return ESP_OK;
+}
+
+void verify_init(verify_t* verify, const manifest_t* manifest) {
+  verify->manifest = manifest;
+  verify->offset = 0;
+  verify->failed_start = 0;
+  verify->failed_end = 0;
+  mbedtls_sha256_init(&verify->image);
+  mbedtls_sha256_init(&verify->block);
+  mbedtls_sha256_starts(&verify->image, 0);
+  mbedtls_sha256_starts(&verify->block, 0);
+}
+
+void verify_free(verify_t* verify) {
+  mbedtls_sha256_free(&verify->block);
+  mbedtls_sha256_free(&verify->image);
+}
+
+esp_err_t verify_update(verify_t* verify, const void* data, size_t length) {
+  const manifest_t* manifest = verify->manifest;
+  const uint8_t* cursor = (const uint8_t*)data;
+
+  if (verify->offset + length > manifest->size) {
+    verify->failed_start = manifest->size;
+    verify->failed_end = verify->offset + length;
+    ESP_LOGE(TAG, "Corrupt firmware image: Larger than %u B", manifest->size);
+    return ESP_ERR_INVALID_SIZE;
+  }
+
+  mbedtls_sha256_update(&verify->image, cursor, length);
+  if (manifest->block_size == 0) {
+    verify->offset += length;
+    return ESP_OK;
+  }
+
+  while (length > 0) {
+    // Hash up to the end of the current block.
+    uint32_t block_end =
+        min((verify->offset / manifest->block_size + 1) * manifest->block_size,
+            manifest->size);
+    size_t chunk = min(length, block_end - verify->offset);
+    mbedtls_sha256_update(&verify->block, cursor, chunk);
+    verify->offset += chunk;
+    cursor += chunk;
+    length -= chunk;
+
+    if (verify->offset == block_end) {
+      esp_err_t err = verify_block(verify);
+      if (err != ESP_OK) {
+        return err;
+      }
+    }
+  }
+
+  return ESP_OK;
+}
+
+esp_err_t verify_finish(verify_t* verify) {
+  const manifest_t* manifest = verify->manifest;
+
+  if (verify->offset != manifest->size) {
+    verify->failed_start = verify->offset;
+    verify->failed_end = manifest->size;
+    ESP_LOGE(TAG, "Incomplete firmware image: %u of %u B", verify->offset,
+             manifest->size);
+    return ESP_ERR_INVALID_SIZE;
+  }
+
+  uint8_t digest[MANIFEST_SHA256_LEN];
+  mbedtls_sha256_finish(&verify->image, digest);
+  if (memcmp(digest, manifest->sha256, sizeof(digest)) != 0) {
+    verify->failed_start = 0;
+    verify->failed_end = manifest->size;
+    ESP_LOGE(TAG, "Corrupt firmware image: Digest mismatch");
+    return ESP_ERR_INVALID_CRC;
+  }
+
+  return ESP_OK;
+}
@@ -0,0 +1,72 @@
+#ifndef VERIFY_H
+#define VERIFY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "manifest.h"
+#include "mbedtls/sha256.h"
+
+/**
+ * Verifies a firmware image against the digests of its release manifest while
+ * it is being streamed. If the manifest lists block digests, every block is
+ * verified as soon as it is complete, so that corrupt data is detected long
+ * before the end of the image.
+ *
+ * @param manifest The manifest of the image.
+ * @param image Hashes the whole image.
+ * @param block Hashes the current block.
+ * @param offset Number of bytes verified so far.
+ * @param failed_start Offset of the first byte of the corrupt range.
+ * @param failed_end Offset of the byte after the corrupt range.
+ */
+typedef struct verify {
+  const manifest_t* manifest;
+  mbedtls_sha256_context image;
+  mbedtls_sha256_context block;
+  uint32_t offset;
+  uint32_t failed_start;
+  uint32_t failed_end;
+} verify_t;
+
+/**
+ * Prepare the verification of an image.
+ *
+ * @param[out] verify A pointer to the verification state.
+ * @param[in] manifest The manifest of the image, which must outlive the
+ * verification.
+ */
+void verify_init(verify_t* verify, const manifest_t* manifest);
+
+/**
+ * Release the resources of the verification.
+ *
+ * @param[in] verify A pointer to the verification state.
+ */
+void verify_free(verify_t* verify);
+
+/**
+ * Hash the next range of the image and check each block that is completed.
+ *
+ * @param[in] verify A pointer to the verification state.
+ * @param[in] data The next range of the image.
+ * @param[in] length Number of bytes in the range.
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_CRC if a block doesn't match its digest or
+ * ESP_ERR_INVALID_SIZE if the image is larger than announced. The corrupt range
+ * is recorded in `failed_start` and `failed_end`.
+ */
+esp_err_t verify_update(verify_t* verify, const void* data, size_t length);
+
+/**
+ * Check the size and the digest of the complete image.
+ *
+ * @param[in] verify A pointer to the verification state.
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_SIZE if the image is incomplete or
+ * ESP_ERR_INVALID_CRC if the image doesn't match its digest.
+ */
+esp_err_t verify_finish(verify_t* verify);
+
+#endif
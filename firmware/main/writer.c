@@ -0,0 +1,116 @@
+#include "writer.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_timer.h"
+#include "util.h"
+
+/**
+ * Pass data on to the sink and account for the time spent doing so.
+ *
+ * @param[in] writer A pointer to the writer.
+ * @param[in] data The data to be written.
+ * @param[in] length Number of bytes to be written.
+ *
+ * @return ESP_OK or the error returned by the sink.
+ */
+static esp_err_t writer_sink(writer_t* writer, const void* data,
+                             size_t length) {
+  int64_t start = esp_timer_get_time();
+  esp_err_t err = writer->sink(writer->ctx, data, length);
+  writer->write_time_us += esp_timer_get_time() - start;
+  if (err != ESP_OK) {
+    return err;
+  }
+
+  writer->bytes_written += length;
+  writer->writes += 1;
+
+  return ESP_OK;
+}
+
+esp_err_t writer_init(writer_t* writer, size_t block_size, writer_sink_t sink,
+                      void* ctx) {
+  if (block_size == 0 || block_size % WRITER_SECTOR_SIZE != 0) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+
+  writer->block = (char*)malloc(block_size);
+  if (writer->block == NULL) {
+    return ESP_ERR_NO_MEM;
+  }
+
+  writer->sink = sink;
+  writer->ctx = ctx;
+  writer->block_size = block_size;
+  writer->fill = 0;
+  writer->bytes_written = 0;
+  writer->writes = 0;
+  writer->write_time_us = 0;
+
+  return ESP_OK;
+}
+
+void writer_deinit(writer_t* writer) {
+  free(writer->block);
+  writer->block = NULL;
+}
+
+esp_err_t writer_write(writer_t* writer, const void* data, size_t length) {
+  const char* cursor = (const char*)data;
+
+  while (length > 0) {
+    // Pass complete blocks on directly, if no block is being gathered.
+    if (writer->fill == 0 && length >= writer->block_size) {
+      size_t direct = length - length % writer->block_size;
+      esp_err_t err = writer_sink(writer, cursor, direct);
+      if (err != ESP_OK) {
+        return err;
+      }
+      cursor += direct;
+      length -= direct;
+      continue;
+    }
+
+    size_t chunk = min(length, writer->block_size - writer->fill);
+    memcpy(&writer->block[writer->fill], cursor, chunk);
+    writer->fill += chunk;
+    cursor += chunk;
+    length -= chunk;
+
+    if (writer->fill == writer->block_size) {
+      esp_err_t err = writer_flush(writer);
+      if (err != ESP_OK) {
+        return err;
+      }
+    }
+  }
+
+  return ESP_OK;
+}
+
+esp_err_t writer_flush(writer_t* writer) {
+  if (writer->fill == 0) {
+    return ESP_OK;
+  }
+
+  esp_err_t err = writer_sink(writer, writer->block, writer->fill);
+  if (err != ESP_OK) {
+    return err;
+  }
+  writer->fill = 0;
+
+  return ESP_OK;
+}
+
+uint32_t writer_throughput(const writer_t* writer) {
+  if (writer->write_time_us <= 0) {
+    return 0;
+  }
+
+  return (uint32_t)((int64_t)writer->bytes_written * 1000000 /
+                    writer->write_time_us);
+}
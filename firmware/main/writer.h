@@ -0,0 +1,101 @@
+#ifndef WRITER_H
+#define WRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+// Size of a flash sector, which is the smallest unit that can be erased.
+#define WRITER_SECTOR_SIZE 4096
+
+/**
+ * Write data to the underlying storage, such as an OTA partition.
+ *
+ * @param[in] ctx The context passed to `writer_init()`.
+ * @param[in] data The data to be written.
+ * @param[in] length Number of bytes to be written.
+ *
+ * @return ESP_OK if the data was written.
+ */
+typedef esp_err_t (*writer_sink_t)(void* ctx, const void* data, size_t length);
+
+/**
+ * Coalesces writes of arbitrary size into blocks that are aligned to flash
+ * sectors, before passing them on to a sink. This avoids many small writes,
+ * each of which may have to wait for a sector to be erased.
+ *
+ * @param sink The function receiving the blocks.
+ * @param ctx The context passed to the sink.
+ * @param block Memory holding the block that is currently being gathered.
+ * @param block_size Size of a block, which is a multiple of the sector size.
+ * @param fill Number of bytes in the current block.
+ * @param bytes_written Number of bytes passed on to the sink.
+ * @param writes Number of calls to the sink.
+ * @param write_time_us Time spent in the sink in microseconds.
+ */
+typedef struct writer {
+  writer_sink_t sink;
+  void* ctx;
+  char* block;
+  size_t block_size;
+  size_t fill;
+  size_t bytes_written;
+  uint32_t writes;
+  int64_t write_time_us;
+} writer_t;
+
+/**
+ * Allocate the block buffer of a writer.
+ *
+ * @param[out] writer A pointer to the writer.
+ * @param[in] block_size Size of a block in bytes.
+ * @param[in] sink The function receiving the blocks.
+ * @param[in] ctx The context passed to the sink.
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_SIZE if the block size is not a multiple of
+ * the sector size or ESP_ERR_NO_MEM if the block can't be allocated.
+ */
+esp_err_t writer_init(writer_t* writer, size_t block_size, writer_sink_t sink,
+                      void* ctx);
+
+/**
+ * Release the block buffer of a writer. Data that was not flushed is lost.
+ *
+ * @param[in] writer A pointer to the writer.
+ */
+void writer_deinit(writer_t* writer);
+
+/**
+ * Append data to the current block, passing every completed block on to the
+ * sink. If no block is being gathered, complete blocks are passed on directly
+ * without copying them.
+ *
+ * @param[in] writer A pointer to the writer.
+ * @param[in] data The data to be written.
+ * @param[in] length Number of bytes to be written.
+ *
+ * @return ESP_OK or the error returned by the sink.
+ */
+esp_err_t writer_write(writer_t* writer, const void* data, size_t length);
+
+/**
+ * Pass the remaining, incomplete block on to the sink.
+ *
+ * @param[in] writer A pointer to the writer.
+ *
+ * @return ESP_OK or the error returned by the sink.
+ */
+esp_err_t writer_flush(writer_t* writer);
+
+/**
+ * Calculate the throughput of the sink, only taking the time spent in the sink
+ * into account.
+ *
+ * @param[in] writer A pointer to the writer.
+ *
+ * @return The throughput in bytes per second.
+ */
+uint32_t writer_throughput(const writer_t* writer);
+
+#endif
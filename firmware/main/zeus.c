@@ -1,10 +1,18 @@
+#include "dsp.h"
+#include "energy.h"
 #include "esp_event.h"
 #include "esp_log.h"
 #include "esp_netif.h"
 #include "http.h"
+#include "meter.h"
 #include "net.h"
 #include "nvs.h"
 #include "nvs_flash.h"
+#include "peer.h"
+#include "push.h"
+#include "relay.h"
+#include "stream.h"
+#include "trace.h"
 #include "update.h"
 
 void app_main(void) {
@@ -16,6 +24,13 @@ void app_main(void) {
   esp_log_level_set("HTTP_CLIENT", ESP_LOG_WARN);
   esp_log_level_set("system_api", ESP_LOG_WARN);
 
+#ifdef CONFIG_ZEUS_TRACE
+  // Trace the hot paths from the start, as their logs
+  // are mostly muted. This must be done before any
+  // task records events.
+  ESP_ERROR_CHECK(trace_init(CONFIG_ZEUS_TRACE_EVENTS));
+#endif
+
   // Initialize non-volatile storage.
   esp_err_t err = nvs_flash_init();
   if (err == ESP_ERR_NVS_NO_FREE_PAGES ||
@@ -44,17 +59,51 @@ void app_main(void) {
   // this may be called only once.
   ESP_ERROR_CHECK(esp_netif_init());
 
+  // Restore the energy counters of the outlets before
+  // sampling adds to them.
+  ESP_ERROR_CHECK(energy_init());
+
+  // Prepare streaming the readings before the meter
+  // starts producing them.
+  ESP_ERROR_CHECK(stream_init());
+
+#ifdef CONFIG_ZEUS_DSP_BENCH
+  // Measure the kernels of the meter while nothing
+  // else competes for the CPU yet.
+  dsp_bench_t results[DSP_BENCH_KERNELS];
+  ESP_ERROR_CHECK(dsp_bench(results));
+#endif
+
+  // Start sampling the outlets continuously, so that
+  // readings are available once the network is up.
+  ESP_ERROR_CHECK(meter_init());
+
+  // Turn all outlets off until they are switched
+  // through the HTTP server.
+  ESP_ERROR_CHECK(relay_init());
+
   // Set up an HTTP server to serve information about
   // the application and to expose metrics in a format
   // that can be scraped by Prometheus.
   ESP_ERROR_CHECK(http_server_init());
 
-  // Install the ethernet driver and event handlers
-  // for some informative logging. Do this after the
-  // setup of the HTTP server as it will automatically
-  // come online after the interface is up.
-  ESP_ERROR_CHECK(net_eth_init());
+  // Identify the running firmware in the background and
+  // share it with other devices once the network is up.
+  ESP_ERROR_CHECK(peer_init());
+
+  // Push the metrics to a remote endpoint, if enabled,
+  // once the network is up and the clock is synchronized.
+  ESP_ERROR_CHECK(push_init());
 
   // Start thread to handle firmware updates automatically.
+  // Like the HTTP server, it only becomes active once
+  // the interface is up.
   ESP_ERROR_CHECK(update_init(5));
+
+  // Install the ethernet driver and event handlers
+  // for some informative logging. Do this after the
+  // setup of the HTTP server and the update thread as
+  // they will automatically come online after the
+  // interface is up.
+  ESP_ERROR_CHECK(net_eth_init());
 }
@@ -0,0 +1,95 @@
+#!/usr/bin/env python3
+"""Compare two results of the host benchmarks to find regressions.
+
+The results are the JSON written by `zeus_bench --json`, such as the one of
+the previous release and the one of the current build. Benchmarks whose median
+duration grew by more than the threshold are reported as regressions, in which
+case the exit status is 1.
+
+Some benchmarks are also guarded against a baseline measured in the same run,
+such as the overlapped download against the serial one. These guards are
+checked even if only the current results are given.
+
+Usage:
+    benchcmp.py [--threshold PERCENT] [BASELINE] CURRENT
+"""
+
+import argparse
+import json
+import sys
+
+# Benchmarks whose median duration must not exceed a fraction of the one of
+# another benchmark of the same run.
+RATIOS = [
+    # Receiving the firmware overlaps with writing it to a slow flash.
+    ("update/download_flash", "update/download_serial", 0.9),
+]
+
+
+def load(path):
+    with open(path) as file:
+        results = json.load(file)
+    return {bench["name"]: bench for bench in results["benchmarks"]}
+
+
+def check_ratios(current):
+    failures = 0
+    guarded = [ratio for ratio in RATIOS if ratio[0] in current and ratio[1] in current]
+    if guarded:
+        sys.stdout.write("\n%-32s %-32s %9s\n" % ("benchmark", "against", "ratio"))
+    for name, base, limit in guarded:
+        ratio = current[name]["ns_per_op"] / current[base]["ns_per_op"]
+        failed = ratio > limit
+        failures += failed
+        sys.stdout.write(
+            "%-32s %-32s %9.2f%s\n"
+            % (name, base, ratio, " above %.2f" % limit if failed else "")
+        )
+    return failures
+
+
+def main(argv):
+    parser = argparse.ArgumentParser(
+        description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter
+    )
+    parser.add_argument(
+        "results", nargs="+", metavar="RESULTS", help="[BASELINE] CURRENT"
+    )
+    parser.add_argument(
+        "--threshold",
+        type=float,
+        default=10.0,
+        help="slowdown in percent above which a benchmark regressed",
+    )
+    args = parser.parse_args(argv[1:])
+    if len(args.results) > 2:
+        parser.error("expected at most a baseline and the current results")
+
+    baseline = load(args.results[0]) if len(args.results) == 2 else {}
+    current = load(args.results[-1])
+
+    regressions = 0
+    sys.stdout.write(
+        "%-32s %12s %12s %9s\n" % ("benchmark", "old ns/op", "new ns/op", "delta")
+    )
+    for name, bench in current.items():
+        if name not in baseline:
+            sys.stdout.write(
+                "%-32s %12s %12.1f %9s\n" % (name, "-", bench["ns_per_op"], "new")
+            )
+            continue
+        old = baseline[name]["ns_per_op"]
+        new = bench["ns_per_op"]
+        change = (new - old) / old * 100
+        regressed = change > args.threshold
+        regressions += regressed
+        sys.stdout.write(
+            "%-32s %12.1f %12.1f %+8.1f%%%s\n"
+            % (name, old, new, change, " regressed" if regressed else "")
+        )
+    regressions += check_ratios(current)
+    return 1 if regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -0,0 +1,53 @@
+#!/usr/bin/env python3
+"""Compress a firmware image for updates over slow links.
+
+Devices decompress the image while it is written to the flash, keeping only the
+most recent 8 KiB of the output to resolve matches. The image is therefore
+compressed into a zlib stream with a window of that size, which devices reject
+otherwise. The stream is decompressed again to check that it is intact.
+
+Usage:
+    compress.py IMAGE OUTPUT
+"""
+
+import argparse
+import sys
+import zlib
+
+# Base-two logarithm of the window size, matching INFLATE_WINDOW_BITS.
+WINDOW_BITS = 13
+
+
+def compress(data):
+    compressor = zlib.compressobj(
+        level=9, method=zlib.DEFLATED, wbits=WINDOW_BITS, memLevel=9
+    )
+    return compressor.compress(data) + compressor.flush()
+
+
+def main(argv):
+    parser = argparse.ArgumentParser(
+        description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter
+    )
+    parser.add_argument("image", help="firmware image to be compressed")
+    parser.add_argument("output", help="file receiving the compressed image")
+    args = parser.parse_args(argv[1:])
+
+    with open(args.image, "rb") as file:
+        data = file.read()
+    stream = compress(data)
+    if zlib.decompress(stream, wbits=WINDOW_BITS) != data:
+        sys.stderr.write("%s: round trip failed\n" % args.output)
+        return 1
+
+    with open(args.output, "wb") as file:
+        file.write(stream)
+    sys.stdout.write(
+        "%s: %d B from %d B (%.1f%%)\n"
+        % (args.output, len(stream), len(data), 100.0 * len(stream) / len(data))
+    )
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -0,0 +1,203 @@
+#!/usr/bin/env python3
+"""Create and apply delta patches between two firmware images.
+
+The patch format is decoded on the device by firmware/main/delta.c. A patch
+starts with an 80 byte header, followed by operations that either copy a range
+of the base image or insert literal data:
+
+    magic        4 B   "ZDLT"
+    format       1 B   1
+    reserved     3 B
+    base_size    4 B   little-endian
+    target_size  4 B   little-endian
+    base_sha256  32 B  digest reported by esp_partition_get_sha256()
+    base_version 32 B  NUL-padded version string of the base image
+
+    COPY   0x01 <offset varint> <length varint>
+    INSERT 0x02 <length varint> <data>
+
+Usage:
+    delta.py diff BASE TARGET PATCH
+    delta.py apply BASE PATCH TARGET
+"""
+
+import hashlib
+import struct
+import sys
+
+MAGIC = b"ZDLT"
+FORMAT = 1
+HEADER = struct.Struct("<4sB3xII32s32s")
+OP_COPY = 1
+OP_INSERT = 2
+
+# Number of bytes used to look up candidate matches in the base image.
+KEY_SIZE = 8
+# Matches shorter than this are cheaper to insert literally.
+MIN_MATCH = 24
+
+# Offset of the version in esp_app_desc_t, which follows the image header
+# (24 B) and the first segment header (8 B).
+VERSION_OFFSET = 24 + 8 + 16
+# Offset of the flag indicating an appended SHA-256 digest in the image header.
+HASH_APPENDED_OFFSET = 23
+
+
+def image_sha256(image):
+    """Return the digest that esp_partition_get_sha256() reports for an app."""
+    if image[HASH_APPENDED_OFFSET] == 1:
+        return image[-32:]
+    return hashlib.sha256(image).digest()
+
+
+def image_version(image):
+    """Return the version embedded in the app description of an image."""
+    return image[VERSION_OFFSET:VERSION_OFFSET + 32].split(b"\0", 1)[0]
+
+
+def varint(value):
+    out = bytearray()
+    while True:
+        byte = value & 0x7F
+        value >>= 7
+        if value:
+            out.append(byte | 0x80)
+        else:
+            out.append(byte)
+            return bytes(out)
+
+
+def match_length(base, base_pos, target, target_pos):
+    """Return the number of equal bytes starting at the given positions."""
+    limit = min(len(base) - base_pos, len(target) - target_pos)
+    length = 0
+    # Compare in blocks first, as comparing single bytes is slow in Python.
+    while length + 64 <= limit and (
+        base[base_pos + length:base_pos + length + 64]
+        == target[target_pos + length:target_pos + length + 64]
+    ):
+        length += 64
+    while length < limit and base[base_pos + length] == target[target_pos + length]:
+        length += 1
+    return length
+
+
+def diff(base, target):
+    index = {}
+    for pos in range(len(base) - KEY_SIZE + 1):
+        index.setdefault(base[pos:pos + KEY_SIZE], pos)
+
+    ops = bytearray()
+    literal = bytearray()
+
+    def flush_literal():
+        if literal:
+            ops.extend(bytes([OP_INSERT]) + varint(len(literal)) + literal)
+            literal.clear()
+
+    pos = 0
+    # Code that did not change usually keeps its offset relative to the
+    # previous match, so that candidate is tried first.
+    last_delta = 0
+    while pos < len(target):
+        best_offset, best_length = 0, 0
+
+        candidate = pos + last_delta
+        if 0 <= candidate < len(base):
+            best_offset = candidate
+            best_length = match_length(base, candidate, target, pos)
+
+        if best_length < MIN_MATCH:
+            candidate = index.get(target[pos:pos + KEY_SIZE])
+            if candidate is not None:
+                length = match_length(base, candidate, target, pos)
+                if length > best_length:
+                    best_offset, best_length = candidate, length
+
+        if best_length >= MIN_MATCH:
+            flush_literal()
+            ops.extend(bytes([OP_COPY]) + varint(best_offset) + varint(best_length))
+            last_delta = best_offset - pos
+            pos += best_length
+        else:
+            literal.append(target[pos])
+            pos += 1
+
+    flush_literal()
+
+    header = HEADER.pack(
+        MAGIC,
+        FORMAT,
+        len(base),
+        len(target),
+        image_sha256(base),
+        image_version(base).ljust(32, b"\0"),
+    )
+    return header + bytes(ops)
+
+
+def read_varint(patch, pos):
+    value, shift = 0, 0
+    while True:
+        byte = patch[pos]
+        pos += 1
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if not byte & 0x80:
+            return value, pos
+
+
+def apply(base, patch):
+    magic, fmt, base_size, target_size, base_sha256, _ = HEADER.unpack_from(patch)
+    if magic != MAGIC or fmt != FORMAT:
+        raise ValueError("not a delta patch")
+    if base_size != len(base) or base_sha256 != image_sha256(base):
+        raise ValueError("patch does not apply to this base image")
+
+    out = bytearray()
+    pos = HEADER.size
+    while pos < len(patch):
+        op = patch[pos]
+        pos += 1
+        if op == OP_COPY:
+            offset, pos = read_varint(patch, pos)
+            length, pos = read_varint(patch, pos)
+            out.extend(base[offset:offset + length])
+        elif op == OP_INSERT:
+            length, pos = read_varint(patch, pos)
+            out.extend(patch[pos:pos + length])
+            pos += length
+        else:
+            raise ValueError("unknown operation: %d" % op)
+
+    if len(out) != target_size:
+        raise ValueError("patch is truncated")
+    return bytes(out)
+
+
+def main(argv):
+    if len(argv) != 5 or argv[1] not in ("diff", "apply"):
+        sys.stderr.write(__doc__)
+        return 1
+
+    with open(argv[2], "rb") as f:
+        base = f.read()
+    with open(argv[3], "rb") as f:
+        data = f.read()
+
+    if argv[1] == "diff":
+        out = diff(base, data)
+        sys.stderr.write(
+            "Patch: %d B for %d B image (%.1f %%)\n"
+            % (len(out), len(data), 100.0 * len(out) / max(len(data), 1))
+        )
+    else:
+        out = apply(base, data)
+
+    with open(argv[4], "wb") as f:
+        f.write(out)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
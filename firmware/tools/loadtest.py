@@ -0,0 +1,140 @@
+#!/usr/bin/env python3
+"""Measure the throughput and latency of the HTTP server of a device.
+
+Every client opens a persistent connection and requests the given paths in
+turn for the given duration. The results are printed as a table, or as JSON
+for further processing, and include the throughput and the latency
+percentiles of every path. Use a slow path, such as /metrics, together with a
+fast one, such as /health, to check that slow requests don't hold up the rest.
+
+Usage:
+    loadtest.py [--clients N] [--duration S] [--json] HOST PATH...
+"""
+
+import argparse
+import http.client
+import json
+import sys
+import threading
+import time
+
+
+def percentile(values, fraction):
+    """Return the value below which the given fraction of the values lies."""
+    if not values:
+        return None
+    index = min(len(values) - 1, int(fraction * len(values)))
+    return values[index]
+
+
+def client(host, paths, deadline, results, lock):
+    latencies = {path: [] for path in paths}
+    errors = 0
+    connection = http.client.HTTPConnection(host, timeout=10)
+    turn = 0
+    while time.monotonic() < deadline:
+        path = paths[turn % len(paths)]
+        turn += 1
+        start = time.monotonic()
+        try:
+            connection.request("GET", path)
+            response = connection.getresponse()
+            response.read()
+            if response.status != 200:
+                errors += 1
+                continue
+        except (OSError, http.client.HTTPException):
+            errors += 1
+            connection.close()
+            connection = http.client.HTTPConnection(host, timeout=10)
+            continue
+        latencies[path].append(time.monotonic() - start)
+    connection.close()
+
+    with lock:
+        for path, values in latencies.items():
+            results["latencies"][path].extend(values)
+        results["errors"] += errors
+
+
+def run(host, paths, clients, duration):
+    results = {"latencies": {path: [] for path in paths}, "errors": 0}
+    lock = threading.Lock()
+    deadline = time.monotonic() + duration
+    threads = [
+        threading.Thread(target=client, args=(host, paths, deadline, results, lock))
+        for _ in range(clients)
+    ]
+    start = time.monotonic()
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+    elapsed = time.monotonic() - start
+
+    report = {
+        "host": host,
+        "clients": clients,
+        "duration_s": elapsed,
+        "errors": results["errors"],
+        "paths": {},
+    }
+    for path, values in results["latencies"].items():
+        values.sort()
+        report["paths"][path] = {
+            "requests": len(values),
+            "throughput_rps": len(values) / elapsed,
+            "p50_ms": ms(percentile(values, 0.50)),
+            "p90_ms": ms(percentile(values, 0.90)),
+            "p99_ms": ms(percentile(values, 0.99)),
+            "max_ms": ms(values[-1] if values else None),
+        }
+    return report
+
+
+def ms(seconds):
+    return None if seconds is None else seconds * 1000
+
+
+def print_table(report):
+    sys.stdout.write(
+        "%d clients for %.1f s, %d errors\n"
+        % (report["clients"], report["duration_s"], report["errors"])
+    )
+    sys.stdout.write(
+        "%-20s %9s %9s %9s %9s %9s %9s\n"
+        % ("path", "requests", "req/s", "p50 ms", "p90 ms", "p99 ms", "max ms")
+    )
+    for path, stats in report["paths"].items():
+        cells = [
+            "-" if stats[key] is None else "%.1f" % stats[key]
+            for key in ("p50_ms", "p90_ms", "p99_ms", "max_ms")
+        ]
+        sys.stdout.write(
+            "%-20s %9d %9.1f %9s %9s %9s %9s\n"
+            % (path, stats["requests"], stats["throughput_rps"], *cells)
+        )
+
+
+def main(argv):
+    parser = argparse.ArgumentParser(
+        description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter
+    )
+    parser.add_argument("host", help="address of the device, such as 10.0.0.2:80")
+    parser.add_argument("paths", nargs="+", help="paths to be requested")
+    parser.add_argument("--clients", type=int, default=4)
+    parser.add_argument("--duration", type=float, default=10.0)
+    parser.add_argument("--json", action="store_true", help="print JSON")
+    args = parser.parse_args(argv[1:])
+
+    report = run(args.host, args.paths, args.clients, args.duration)
+    if args.json:
+        json.dump(report, sys.stdout, indent=2)
+        sys.stdout.write("\n")
+    else:
+        print_table(report)
+    return 1 if report["errors"] else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
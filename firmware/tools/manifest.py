@@ -0,0 +1,62 @@
+#!/usr/bin/env python3
+"""Create the release manifest for a firmware image.
+
+The manifest is published alongside the firmware image and parsed on the device
+by firmware/main/manifest.c. It allows devices to find out whether an update is
+available without downloading the firmware image. The digests of the blocks
+of the image allow devices to detect corrupt data while downloading.
+
+Usage:
+    manifest.py IMAGE MANIFEST
+"""
+
+import hashlib
+import json
+import sys
+
+from delta import image_version
+
+# Size of the blocks with a separate digest, which is doubled for large images.
+BLOCK_SIZE = 64 * 1024
+# Maximum number of blocks, see MANIFEST_MAX_BLOCKS.
+MAX_BLOCKS = 64
+
+
+def blocks(image):
+    block_size = BLOCK_SIZE
+    while len(image) > block_size * MAX_BLOCKS:
+        block_size *= 2
+    return {
+        "size": block_size,
+        "sha256": [
+            hashlib.sha256(image[pos:pos + block_size]).hexdigest()
+            for pos in range(0, len(image), block_size)
+        ],
+    }
+
+
+def manifest(image):
+    return {
+        "version": image_version(image).decode(),
+        "size": len(image),
+        "sha256": hashlib.sha256(image).hexdigest(),
+        "blocks": blocks(image),
+    }
+
+
+def main(argv):
+    if len(argv) != 3:
+        sys.stderr.write(__doc__)
+        return 1
+
+    with open(argv[1], "rb") as f:
+        image = f.read()
+
+    with open(argv[2], "w") as f:
+        json.dump(manifest(image), f, indent=2)
+        f.write("\n")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -0,0 +1,82 @@
+#!/usr/bin/env python3
+"""Mirror the firmware releases into a directory served by a local web server.
+
+Devices configured with a mirror as their update source download the files of
+a release from a directory named after the release, and those of the latest
+release from "latest", such as <source>/latest/zeus-esp32.json. Missing files,
+such as the patch of the first release, are skipped. Run this periodically to
+keep the latest release up to date. The web server must serve HTTPS, unless the
+devices were built with CONFIG_ZEUS_UPDATE_INSECURE_SOURCE.
+
+Usage:
+    mirror.py [--repository OWNER/NAME] [--tag TAG]... DIRECTORY
+"""
+
+import argparse
+import json
+import os
+import sys
+import urllib.error
+import urllib.request
+
+# The manifest comes last, so that it never announces files that are missing.
+FILES = (
+    "zeus-esp32.bin",
+    "zeus-esp32.delta",
+    "zeus-esp32.zlib",
+    "zeus-esp32.json",
+)
+
+
+def download_url(repository, tag, name):
+    if tag == "latest":
+        return "https://github.com/%s/releases/latest/download/%s" % (
+            repository,
+            name,
+        )
+    return "https://github.com/%s/releases/download/%s/%s" % (repository, tag, name)
+
+
+def mirror(repository, tag, directory):
+    """Download the files of a release, replacing each file atomically."""
+    target = os.path.join(directory, tag)
+    os.makedirs(target, exist_ok=True)
+    for name in FILES:
+        path = os.path.join(target, name)
+        url = download_url(repository, tag, name)
+        try:
+            with urllib.request.urlopen(url) as response:
+                data = response.read()
+        except urllib.error.HTTPError as error:
+            if error.code != 404:
+                raise
+            sys.stderr.write("%s/%s: not published\n" % (tag, name))
+            continue
+        with open(path + ".tmp", "wb") as file:
+            file.write(data)
+        os.replace(path + ".tmp", path)
+        sys.stdout.write("%s/%s: %d B\n" % (tag, name, len(data)))
+
+
+def main(argv):
+    parser = argparse.ArgumentParser(
+        description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter
+    )
+    parser.add_argument("directory", help="root directory of the mirror")
+    parser.add_argument("--repository", default="nicklasfrahm/zeus")
+    parser.add_argument(
+        "--tag", action="append", default=[], help="release to be mirrored"
+    )
+    args = parser.parse_args(argv[1:])
+
+    mirror(args.repository, "latest", args.directory)
+    # Devices pinned to the latest version find it under its tag as well.
+    with open(os.path.join(args.directory, "latest", FILES[-1])) as file:
+        version = json.load(file)["version"]
+    for tag in sorted(set(args.tag + [version])):
+        mirror(args.repository, tag, args.directory)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
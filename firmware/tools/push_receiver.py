@@ -0,0 +1,194 @@
+#!/usr/bin/env python3
+"""Receive the metrics pushed by devices and print the samples.
+
+Stands in for a Prometheus remote-write receiver or an InfluxDB server while
+testing the push mode locally. Both formats are decoded: snappy-compressed
+remote-write protobuf and gzip-compressed line protocol. Configure the device
+with http://<host>:<port>/api/v1/write as its push endpoint. With --status,
+every request is answered with that status code instead, which exercises the
+retries and the handling of rejected batches.
+
+Usage:
+    push_receiver.py [--port PORT] [--status CODE] [--quiet]
+"""
+
+import argparse
+import gzip
+import http.server
+import struct
+import sys
+
+
+def snappy_decompress(data):
+    """Decompress the raw Snappy format."""
+    position = 0
+    length = 0
+    shift = 0
+    while True:
+        byte = data[position]
+        position += 1
+        length |= (byte & 0x7F) << shift
+        shift += 7
+        if byte < 0x80:
+            break
+
+    output = bytearray()
+    while position < len(data):
+        tag = data[position]
+        position += 1
+        kind = tag & 3
+        if kind == 0:
+            count = tag >> 2
+            if count >= 60:
+                size = count - 59
+                count = int.from_bytes(data[position : position + size], "little")
+                position += size
+            count += 1
+            output += data[position : position + count]
+            position += count
+            continue
+        if kind == 1:
+            count = ((tag >> 2) & 7) + 4
+            offset = (tag >> 5) << 8 | data[position]
+            position += 1
+        else:
+            size = 2 if kind == 2 else 4
+            count = (tag >> 2) + 1
+            offset = int.from_bytes(data[position : position + size], "little")
+            position += size
+        if offset == 0 or offset > len(output):
+            raise ValueError("copy before the start of the data")
+        for _ in range(count):
+            output.append(output[-offset])
+
+    if len(output) != length:
+        raise ValueError("expected %d B, got %d B" % (length, len(output)))
+    return bytes(output)
+
+
+def protobuf_fields(data):
+    """Yield the field numbers and values of a protobuf message."""
+    position = 0
+    while position < len(data):
+        key, position = protobuf_varint(data, position)
+        field, kind = key >> 3, key & 7
+        if kind == 0:
+            value, position = protobuf_varint(data, position)
+        elif kind == 1:
+            value = data[position : position + 8]
+            position += 8
+        elif kind == 2:
+            length, position = protobuf_varint(data, position)
+            value = data[position : position + length]
+            position += length
+        elif kind == 5:
+            value = data[position : position + 4]
+            position += 4
+        else:
+            raise ValueError("unsupported wire type %d" % kind)
+        yield field, value
+
+
+def protobuf_varint(data, position):
+    value = 0
+    shift = 0
+    while True:
+        byte = data[position]
+        position += 1
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if byte < 0x80:
+            return value, position
+
+
+def remote_write_samples(body):
+    """Yield the series and the samples of a WriteRequest."""
+    for field, series in protobuf_fields(snappy_decompress(body)):
+        if field != 1:
+            continue
+        labels = {}
+        samples = []
+        for kind, value in protobuf_fields(series):
+            if kind == 1:
+                label = dict(protobuf_fields(value))
+                labels[label[1].decode()] = label[2].decode()
+            elif kind == 2:
+                sample = dict(protobuf_fields(value))
+                samples.append(
+                    (sample.get(2, 0), struct.unpack("<d", sample.get(1, bytes(8)))[0])
+                )
+        name = labels.pop("__name__", "")
+        pairs = ",".join('%s="%s"' % item for item in sorted(labels.items()))
+        for timestamp_ms, value in samples:
+            yield "%s{%s} %.9g %d" % (name, pairs, value, timestamp_ms)
+
+
+def line_samples(body):
+    """Yield the lines of a line protocol body."""
+    for line in gzip.decompress(body).decode().splitlines():
+        if line:
+            yield line
+
+
+class Handler(http.server.BaseHTTPRequestHandler):
+    status = 204
+    quiet = False
+
+    def do_POST(self):
+        body = self.rfile.read(int(self.headers.get("Content-Length", 0)))
+        encoding = self.headers.get("Content-Encoding", "")
+        try:
+            if encoding == "snappy":
+                samples = list(remote_write_samples(body))
+            elif encoding == "gzip":
+                samples = list(line_samples(body))
+            else:
+                raise ValueError("unsupported encoding %r" % encoding)
+        except (ValueError, IndexError, OSError, struct.error) as error:
+            sys.stderr.write("%s: %s\n" % (self.client_address[0], error))
+            self.send_response(400)
+            self.end_headers()
+            return
+
+        sys.stdout.write(
+            "%s: %d samples in %d B (%s)\n"
+            % (self.client_address[0], len(samples), len(body), encoding)
+        )
+        if not self.quiet:
+            for sample in samples:
+                sys.stdout.write("  %s\n" % sample)
+        sys.stdout.flush()
+        self.send_response(self.status)
+        self.end_headers()
+
+    def log_message(self, format, *args):
+        pass
+
+
+def main(argv):
+    parser = argparse.ArgumentParser(
+        description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter
+    )
+    parser.add_argument("--port", type=int, default=9090)
+    parser.add_argument(
+        "--status", type=int, default=204, help="status code of the responses"
+    )
+    parser.add_argument(
+        "--quiet", action="store_true", help="only print a line per request"
+    )
+    args = parser.parse_args(argv[1:])
+
+    Handler.status = args.status
+    Handler.quiet = args.quiet
+    server = http.server.ThreadingHTTPServer(("", args.port), Handler)
+    sys.stdout.write("Receiving on port %d\n" % args.port)
+    sys.stdout.flush()
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))